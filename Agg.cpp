@@ -0,0 +1,270 @@
+#include "Agg.h"
+
+Agg Agg::instance;
+
+void Agg::aggregate(Tree *t) {
+  xfers.clear();
+  context.clear();
+  for (auto x : t->spec) spec(x);
+  for (auto x : t->prog) cmd(x);
+
+  // Lower matched pairs of contiguous transfers as block copies and
+  // anything else that can be aggregated through a coalescing buffer.
+  for (auto &x : xfers) {
+    bool block = false;
+    if (x.contiguous) {
+      for (auto &y : xfers)
+        if (y.contiguous && matched(x, y))
+          block = true;
+    }
+    x.loop->xfer = block ? RepSeq::BLOCK : RepSeq::COALESCE;
+  }
+}
+
+// Whether two transfers are opposite ends of the same channel in different
+// components of a parallel
+bool Agg::matched(Xfer &a, Xfer &b) {
+  if (a.out == b.out
+      || !sameElem(a.chan, b.chan)
+      || !sameExpr(a.count, b.count))
+    return false;
+  for (auto x : a.context)
+    for (auto y : b.context)
+      if (x.first == y.first && x.second != y.second)
+        return true;
+  return false;
+}
+
+// Whether a subscript selects consecutive components for a range: the index
+// offset by an expression that does not depend on it.
+bool Agg::contiguous(Expr *e, Range *r) {
+  if (r->step != nullptr) {
+    if (r->step->type != Expr::LITERAL
+        || literalValue(static_cast<OperLiteral*>(r->step)->literal) != 1)
+      return false;
+  }
+  while (e->type == Expr::EXPR)
+    e = static_cast<OperExpr*>(e)->expr;
+  const std::string &n = r->name->str;
+  Name index(n);
+  OperElem operand(&index);
+  if (sameExpr(e, &operand))
+    return true;
+  if (e->type != Expr::BINARY)
+    return false;
+  BinaryOp *x = static_cast<BinaryOp*>(e);
+  switch (x->op) {
+  default:
+    return false;
+  case Lex::tADD:
+    return (sameExpr(x->left, &operand) && !usesName(x->right, n))
+        || (sameExpr(x->right, &operand) && !usesName(x->left, n));
+  case Lex::tSUB:
+    return sameExpr(x->left, &operand) && !usesName(x->right, n);
+  }
+}
+
+// Record a replicated sequence that performs a single input or output on
+// the same channel in each iteration.
+void Agg::candidate(RepSeq *r) {
+  if (r->ranges == nullptr)
+    return;
+  Cmd *c = r->cmd;
+  while (c->type == Cmd::SEQ && static_cast<Seq*>(c)->cmds->size() == 1)
+    c = static_cast<Seq*>(c)->cmds->front();
+
+  Elem *chan;
+  Elem *data = nullptr;
+  bool out;
+  switch (c->type) {
+  default:
+    return;
+  case Cmd::OUT: {
+      Out *x = static_cast<Out*>(c);
+      chan = x->lhs;
+      out = true;
+      if (x->rhs->type == Expr::ELEM)
+        data = static_cast<OperElem*>(x->rhs)->elem;
+      break;
+    }
+  case Cmd::IN: {
+      In *x = static_cast<In*>(c);
+      chan = x->lhs;
+      out = false;
+      data = x->rhs;
+      break;
+    }
+  }
+
+  for (auto x : *r->ranges)
+    if (usesName(chan, x->name->str))
+      return;
+
+  bool contig = r->ranges->size() == 1
+      && data != nullptr
+      && data->type == Elem::NAME
+      && data->subscripts != nullptr
+      && data->subscripts->size() == 1
+      && contiguous(data->subscripts->front(), r->ranges->front());
+
+  Expr *count = r->ranges->size() == 1 ? r->ranges->front()->count : nullptr;
+  xfers.push_back(Xfer{r, out, contig, chan, count, context});
+}
+
+void Agg::spec(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+  default:
+    break;
+
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      if (d->defType == Def::PROCESS)
+        process(static_cast<ProcessDef*>(d)->process);
+      else if (d->defType == Def::SERVER)
+        server(static_cast<ServerDef*>(d)->server);
+      break;
+    }
+
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      if (d->tDecl == Decl::SERVER)
+        server(static_cast<ServerDecl*>(d)->server);
+      else if (d->tDecl == Decl::RSERVER)
+        server(static_cast<RepServerDecl*>(d)->server);
+      else if (d->tDecl == Decl::INITIAL)
+        cmd(static_cast<InitialDecl*>(d)->cmd);
+      break;
+    }
+
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      spec(x);
+    break;
+  }
+}
+
+void Agg::process(Process *p) {
+  switch (p->type) {
+  default:
+    break;
+  case Process::CMD:  cmd(static_cast<ProcessCmd*>(p)->cmd);  break;
+  case Process::SPEC: cmd(static_cast<ProcessSpec*>(p)->cmd); break;
+  }
+}
+
+void Agg::server(Server *s) {
+  if (s->type != Server::SPEC)
+    return;
+  ServerSpec *x = static_cast<ServerSpec*>(s);
+  if (x->decls != nullptr)
+    for (auto y : *x->decls)
+      spec(y);
+}
+
+void Agg::cmd(Cmd *c) {
+  if (c == nullptr)
+    return;
+  switch (c->type) {
+  default:
+    break;
+
+  case Cmd::SPEC:
+    spec(static_cast<CmdSpec*>(c)->spec);
+    cmd(static_cast<CmdSpec*>(c)->cmd);
+    break;
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::PAR: {
+      Par *x = static_cast<Par*>(c);
+      int i = 0;
+      for (auto y : *x->cmds) {
+        context.push_back(std::make_pair(x, i++));
+        cmd(y);
+        context.pop_back();
+      }
+      break;
+    }
+
+  case Cmd::RSEQ: {
+      RepSeq *x = static_cast<RepSeq*>(c);
+      candidate(x);
+      cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::RPAR:
+    cmd(static_cast<RepPar*>(c)->cmd);
+    break;
+
+  case Cmd::IFD:
+    cmd(static_cast<IfD*>(c)->cmd);
+    break;
+
+  case Cmd::IFTE:
+    cmd(static_cast<IfTE*>(c)->cmd);
+    cmd(static_cast<IfTE*>(c)->elseCmd);
+    break;
+
+  case Cmd::WHILE: cmd(static_cast<While*>(c)->cmd); break;
+  case Cmd::UNTIL: cmd(static_cast<Until*>(c)->cmd); break;
+  case Cmd::DO:    cmd(static_cast<Do*>(c)->cmd);    break;
+
+  case Cmd::ALT:
+    if (static_cast<Alt*>(c)->altns != nullptr)
+      for (auto x : *static_cast<Alt*>(c)->altns)
+        altn(x);
+    break;
+
+  case Cmd::RALT:
+    altn(static_cast<RepAlt*>(c)->altn);
+    break;
+
+  case Cmd::TEST:
+    if (static_cast<Test*>(c)->choices != nullptr)
+      for (auto x : *static_cast<Test*>(c)->choices)
+        choice(x);
+    break;
+
+  case Cmd::RTEST:
+    choice(static_cast<RepTest*>(c)->choice);
+    break;
+
+  case Cmd::CASE:
+    if (static_cast<Case*>(c)->selects != nullptr)
+      for (auto x : *static_cast<Case*>(c)->selects)
+        cmd(x->cmd);
+    break;
+
+  case Cmd::RCASE:
+    cmd(static_cast<RepCase*>(c)->select->cmd);
+    break;
+  }
+}
+
+void Agg::altn(Altn *a) {
+  switch (a->type) {
+  default:
+    break;
+  case Altn::UNGUARDED: cmd(static_cast<UnguardedAltn*>(a)->cmd); break;
+  case Altn::GUARDED:   cmd(static_cast<GuardedAltn*>(a)->cmd);   break;
+  case Altn::SKIP:      cmd(static_cast<SkipAltn*>(a)->cmd);      break;
+  case Altn::NESTED:    cmd(static_cast<NestedAltn*>(a)->alt);    break;
+  case Altn::SPEC:      altn(static_cast<SpecAltn*>(a)->altn);    break;
+  }
+}
+
+void Agg::choice(Choice *c) {
+  switch (c->type) {
+  default:
+    break;
+  case Choice::GUARDED: cmd(static_cast<GuardedChoice*>(c)->cmd); break;
+  case Choice::NESTED:  cmd(static_cast<NestedChoice*>(c)->test); break;
+  case Choice::SPEC:    choice(static_cast<SpecChoice*>(c)->choice); break;
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef AGG_H
+#define AGG_H
+
+#include "Tree.h"
+
+#include <list>
+#include <utility>
+#include <vector>
+
+#define AGG Agg::get()
+
+// Message aggregation: replicated sequences whose body is a single input or
+// output on a fixed channel are marked to be lowered as one transfer. A loop
+// is a BLOCK transfer when it moves a contiguous array slice and a matching
+// loop on the other end of the channel is found in a parallel component;
+// otherwise it is a COALESCE transfer through a runtime buffer.
+class Agg {
+public:
+  static Agg instance;
+  static Agg &get() { return instance; }
+  Agg() {};
+  ~Agg() {};
+  void aggregate(Tree *);
+
+private:
+  // A candidate transfer loop
+  struct Xfer {
+    RepSeq *loop;
+    bool out;
+    bool contiguous;
+    Elem *chan;
+    Expr *count;
+    std::vector<std::pair<Par*, int>> context;
+  };
+  std::vector<Xfer> xfers;
+  std::vector<std::pair<Par*, int>> context;
+
+  void spec(Spec *);
+  void process(Process *);
+  void server(Server *);
+  void cmd(Cmd *);
+  void altn(Altn *);
+  void choice(Choice *);
+  void candidate(RepSeq *);
+  bool matched(Xfer &, Xfer &);
+  bool contiguous(Expr *, Range *);
+};
+
+#endif
@@ -0,0 +1,863 @@
+#include "Bounds.h"
+
+#include <algorithm>
+
+Bounds Bounds::instance;
+
+// Intervals beyond this are not tracked
+#define MAX_BOUND (1L << 31)
+
+void Bounds::analyse(Tree *t) {
+  scope.clear();
+  depth = 0;
+  guarded = 0;
+  invariant = 0;
+  checked.clear();
+  for (auto x : t->spec) spec(x);
+  for (auto x : t->prog) cmd(x);
+}
+
+// ============================================================================
+// Scope
+// ============================================================================
+
+// Bind a variable or formal with the lengths of its specifier
+void Bounds::bind(const std::string &name, bool fixed, Spef *s) {
+  Var v{name, fixed, false, 0, 0, std::vector<long>()};
+  if (s != nullptr && s->lengths != nullptr) {
+    for (auto x : *s->lengths) {
+      if (x != nullptr && x->type == Expr::LITERAL)
+        v.lengths.push_back(literalValue(static_cast<OperLiteral*>(x)->literal));
+      else
+        v.lengths.push_back(-1);
+    }
+  }
+  scope.push_back(v);
+}
+
+// Bind a value abbreviation to the interval of its expression
+void Bounds::bind(const std::string &name, Expr *e) {
+  long lo, hi;
+  if (interval(e, lo, hi))
+    bind(name, lo, hi);
+  else
+    scope.push_back(Var{name, true, false, 0, 0, std::vector<long>()});
+}
+
+void Bounds::bind(const std::string &name, long lo, long hi) {
+  scope.push_back(Var{name, true, true, lo, hi, std::vector<long>()});
+}
+
+void Bounds::hide(const std::string &name) {
+  scope.push_back(Var{name, false, false, 0, 0, std::vector<long>()});
+}
+
+Bounds::Var *Bounds::lookup(const std::string &name) {
+  for (auto x = scope.rbegin(); x != scope.rend(); ++x)
+    if (x->name == name)
+      return &*x;
+  return nullptr;
+}
+
+// Leave the names bound since the scope had a size, and the checks of
+// elements that may name them
+void Bounds::restore(size_t n) {
+  scope.resize(n);
+  checked.erase(std::remove_if(checked.begin(), checked.end(),
+      [n](const Checked &x) { return x.extent > n; }), checked.end());
+}
+
+// ============================================================================
+// Analysis
+// ============================================================================
+
+// Compute an interval containing every value of an expression
+bool Bounds::interval(Expr *e, long &lo, long &hi) {
+  if (e == nullptr)
+    return false;
+  long l1, h1, l2, h2;
+  switch (e->type) {
+  default:
+    return false;
+
+  case Expr::LITERAL:
+    lo = hi = literalValue(static_cast<OperLiteral*>(e)->literal);
+    return true;
+
+  case Expr::ELEM: {
+      Elem *x = static_cast<OperElem*>(e)->elem;
+      if (x->type != Elem::NAME || x->subscripts != nullptr)
+        return false;
+      Var *v = lookup(static_cast<Name*>(x)->str);
+      if (v == nullptr || !v->known)
+        return false;
+      lo = v->lo;
+      hi = v->hi;
+      return true;
+    }
+
+  case Expr::EXPR:
+    return interval(static_cast<OperExpr*>(e)->expr, lo, hi);
+
+  case Expr::UNARY: {
+      UnaryOp *x = static_cast<UnaryOp*>(e);
+      if (x->op != Lex::tSUB || !interval(x->operand, l1, h1))
+        return false;
+      lo = -h1;
+      hi = -l1;
+      return true;
+    }
+
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(e);
+      if (!interval(x->left, l1, h1) || !interval(x->right, l2, h2))
+        return false;
+      switch (x->op) {
+      default:
+        return false;
+      case Lex::tADD:
+        lo = l1 + l2;
+        hi = h1 + h2;
+        break;
+      case Lex::tSUB:
+        lo = l1 - h2;
+        hi = h1 - l2;
+        break;
+      case Lex::tMUL:
+        lo = std::min(std::min(l1*l2, l1*h2), std::min(h1*l2, h1*h2));
+        hi = std::max(std::max(l1*l2, l1*h2), std::max(h1*l2, h1*h2));
+        break;
+      }
+      return -MAX_BOUND < lo && hi < MAX_BOUND;
+    }
+
+  // Combine the intervals of the operands from the left
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(e);
+      if (x->op != Lex::tADD && x->op != Lex::tMUL)
+        return false;
+      bool first = true;
+      for (auto y : *x->operands) {
+        if (!interval(y, l2, h2))
+          return false;
+        if (first) {
+          l1 = l2;
+          h1 = h2;
+          first = false;
+        }
+        else if (x->op == Lex::tADD) {
+          l1 += l2;
+          h1 += h2;
+        }
+        else {
+          long a = std::min(std::min(l1*l2, l1*h2), std::min(h1*l2, h1*h2));
+          long b = std::max(std::max(l1*l2, l1*h2), std::max(h1*l2, h1*h2));
+          l1 = a;
+          h1 = b;
+        }
+        if (l1 <= -MAX_BOUND || h1 >= MAX_BOUND)
+          return false;
+      }
+      lo = l1;
+      hi = h1;
+      return true;
+    }
+  }
+}
+
+// Whether an expression is linear in names that are fixed in their scope and
+// bound outside the innermost replicator's body, so its extremes over a loop
+// are at the extremes of the indices and can be evaluated before it
+bool Bounds::linear(Expr *e) {
+  switch (e->type) {
+  default:
+    return false;
+
+  case Expr::LITERAL:
+    return true;
+
+  case Expr::ELEM: {
+      Elem *x = static_cast<OperElem*>(e)->elem;
+      if (x->type != Elem::NAME || x->subscripts != nullptr)
+        return false;
+      Var *v = lookup(static_cast<Name*>(x)->str);
+      return v != nullptr && v->fixed && (size_t) (v - &scope[0]) < invariant;
+    }
+
+  case Expr::EXPR:
+    return linear(static_cast<OperExpr*>(e)->expr);
+
+  case Expr::UNARY: {
+      UnaryOp *x = static_cast<UnaryOp*>(e);
+      return x->op == Lex::tSUB && linear(x->operand);
+    }
+
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(e);
+      switch (x->op) {
+      default:
+        return false;
+      case Lex::tADD:
+      case Lex::tSUB:
+        return linear(x->left) && linear(x->right);
+      case Lex::tMUL:
+        return (x->left->type == Expr::LITERAL && linear(x->right))
+            || (x->right->type == Expr::LITERAL && linear(x->left));
+      }
+    }
+
+  // A sum of linear terms, or a product of literals and one linear term
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(e);
+      if (x->op != Lex::tADD && x->op != Lex::tMUL)
+        return false;
+      int terms = 0;
+      for (auto y : *x->operands) {
+        if (!linear(y))
+          return false;
+        if (y->type != Expr::LITERAL)
+          terms++;
+      }
+      return x->op == Lex::tADD || terms <= 1;
+    }
+  }
+}
+
+// Whether two subscripts certainly have the same value: they are the same
+// expression of the same names, which do not change
+bool Bounds::same(Expr *a, Expr *b, size_t extent) {
+  if (a->type != b->type)
+    return false;
+  switch (a->type) {
+  default:
+    return false;
+
+  case Expr::LITERAL:
+    return literalValue(static_cast<OperLiteral*>(a)->literal)
+        == literalValue(static_cast<OperLiteral*>(b)->literal);
+
+  case Expr::ELEM: {
+      Elem *x = static_cast<OperElem*>(a)->elem;
+      Elem *y = static_cast<OperElem*>(b)->elem;
+      if (x->type != Elem::NAME || y->type != Elem::NAME
+          || x->subscripts != nullptr || y->subscripts != nullptr
+          || static_cast<Name*>(x)->str != static_cast<Name*>(y)->str)
+        return false;
+      Var *v = lookup(static_cast<Name*>(x)->str);
+      return v != nullptr && v->fixed && (size_t) (v - &scope[0]) < extent;
+    }
+
+  case Expr::EXPR:
+    return same(static_cast<OperExpr*>(a)->expr,
+        static_cast<OperExpr*>(b)->expr, extent);
+
+  case Expr::UNARY:
+    return static_cast<UnaryOp*>(a)->op == static_cast<UnaryOp*>(b)->op
+        && same(static_cast<UnaryOp*>(a)->operand,
+            static_cast<UnaryOp*>(b)->operand, extent);
+
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(a);
+      BinaryOp *y = static_cast<BinaryOp*>(b);
+      return x->op == y->op && same(x->left, y->left, extent)
+          && same(x->right, y->right, extent);
+    }
+
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(a);
+      NaryOp *y = static_cast<NaryOp*>(b);
+      if (x->op != y->op || x->operands->size() != y->operands->size())
+        return false;
+      auto j = y->operands->begin();
+      for (auto i : *x->operands)
+        if (!same(i, *j++, extent))
+          return false;
+      return true;
+    }
+  }
+}
+
+// Whether an element of an array is checked on every path to it, by an
+// element of the same array with the same subscripts
+bool Bounds::covered(Elem *e) {
+  if (e->type != Elem::NAME)
+    return false;
+  Var *v = lookup(static_cast<Name*>(e)->str);
+  if (v == nullptr)
+    return false;
+  for (auto &x : checked) {
+    if (static_cast<Name*>(x.elem)->str != static_cast<Name*>(e)->str
+        || (size_t) (v - &scope[0]) >= x.extent
+        || x.elem->subscripts->size() != e->subscripts->size())
+      continue;
+    auto j = x.elem->subscripts->begin();
+    bool all = true;
+    for (auto i : *e->subscripts)
+      all = all && same(i, *j++, x.extent);
+    if (all)
+      return true;
+  }
+  return false;
+}
+
+// Decide how the subscripts of an element are checked
+void Bounds::check(Elem *e) {
+  if (e->subscripts == nullptr)
+    return;
+  if (unchecked) {
+    e->check = Elem::UNCHECKED;
+    return;
+  }
+  if (covered(e)) {
+    e->check = Elem::SAFE;
+    return;
+  }
+  Var *v = e->type == Elem::NAME ?
+      lookup(static_cast<Name*>(e)->str) : nullptr;
+  bool safe = true;
+  bool hoist = depth > 0 && guarded == 0 && v != nullptr
+      && (size_t) (v - &scope[0]) < invariant;
+  size_t i = 0;
+  for (auto x : *e->subscripts) {
+    long lo, hi;
+    long length = v != nullptr && i < v->lengths.size() ? v->lengths[i] : -1;
+    i++;
+    if (length >= 0 && interval(x, lo, hi) && 0 <= lo && hi < length)
+      continue;
+    safe = false;
+    if (!linear(x))
+      hoist = false;
+  }
+  e->check = safe ? Elem::SAFE : hoist ? Elem::HOISTED : Elem::CHECKED;
+  if (!safe && e->type == Elem::NAME)
+    checked.push_back(Checked{e, scope.size()});
+}
+
+// ============================================================================
+// Specifications
+// ============================================================================
+
+void Bounds::spec(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      hide(d->name->str);
+      size_t n = scope.size();
+      int saved = depth;
+      int savedGuarded = guarded;
+      std::vector<Checked> savedChecked;
+      savedChecked.swap(checked);
+      depth = 0;
+      guarded = 0;
+      formals(d->args);
+      switch (d->defType) {
+      case Def::PROCESS:
+        process(static_cast<ProcessDef*>(d)->process);
+        break;
+      case Def::SERVER:
+        server(static_cast<ServerDef*>(d)->server);
+        break;
+      case Def::ISERVER:
+        spec(static_cast<InhrtServerDef*>(d)->hidingDecl);
+        break;
+      case Def::FUNCTION:
+        expr(static_cast<FunctionDef*>(d)->expr);
+        break;
+      }
+      depth = saved;
+      guarded = savedGuarded;
+      restore(n);
+      checked.swap(savedChecked);
+      break;
+    }
+
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      switch (d->tDecl) {
+      case Decl::VAR: {
+          VarDecl *x = static_cast<VarDecl*>(d);
+          if (x->spef != nullptr)
+            exprs(x->spef->lengths);
+          if (d->nameList) {
+            for (auto y : *x->names)
+              bind(y->str, false, x->spef);
+          }
+          else
+            bind(d->name->str, false, x->spef);
+          break;
+        }
+      case Decl::CALL:
+        if (d->nameList) {
+          for (auto y : *d->names)
+            hide(y->str);
+        }
+        else
+          hide(d->name->str);
+        break;
+      case Decl::HIDING: {
+          HidingDecl *x = static_cast<HidingDecl*>(d);
+          size_t n = scope.size();
+          if (x->decls != nullptr)
+            for (auto y : *x->decls)
+              spec(y);
+          restore(n);
+          hide(x->name->str);
+          break;
+        }
+      case Decl::SERVER:
+        server(static_cast<ServerDecl*>(d)->server);
+        hide(d->name->str);
+        break;
+      case Decl::RSERVER: {
+          RepServerDecl *x = static_cast<RepServerDecl*>(d);
+          size_t n = scope.size();
+          ranges(x->exprs);
+          server(x->server);
+          restore(n);
+          hide(d->name->str);
+          break;
+        }
+      case Decl::INITIAL:
+        cmd(static_cast<InitialDecl*>(d)->cmd);
+        break;
+      }
+      break;
+    }
+
+  case Spec::ABBR: {
+      Abbr *a = static_cast<Abbr*>(s);
+      if (a->spef != nullptr)
+        exprs(a->spef->lengths);
+      if (a->type == Abbr::VAL) {
+        expr(a->expr);
+        bind(a->name->str, a->expr);
+      }
+      else {
+        elem(a->elem);
+        hide(a->name->str);
+      }
+      break;
+    }
+
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      spec(x);
+    break;
+  }
+}
+
+// Value formals of a basic type are fixed in their scope
+void Bounds::formals(std::list<Fml*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l) {
+    if (x->spef == nullptr) {
+      hide(x->name->str);
+      continue;
+    }
+    exprs(x->spef->lengths);
+    bind(x->name->str, x->spef->val && x->spef->lengths == nullptr, x->spef);
+  }
+}
+
+// Bind each replicator index to the interval it ranges over
+void Bounds::ranges(std::list<Range*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l) {
+    expr(x->base);
+    expr(x->count);
+    expr(x->step);
+    long bl, bh, cl, ch, sl = 1, sh = 1;
+    if (interval(x->base, bl, bh)
+        && interval(x->count, cl, ch)
+        && (x->step == nullptr || interval(x->step, sl, sh))
+        && ch >= 1) {
+      long dl = std::min(0L, std::min(sl * (ch-1), sh * (ch-1)));
+      long dh = std::max(0L, std::max(sl * (ch-1), sh * (ch-1)));
+      bind(x->name->str, bl + dl, bh + dh);
+    }
+    else
+      scope.push_back(Var{x->name->str, true, false, 0, 0,
+          std::vector<long>()});
+  }
+}
+
+void Bounds::process(Process *p) {
+  switch (p->type) {
+  case Process::CMD:
+    cmd(static_cast<ProcessCmd*>(p)->cmd);
+    break;
+  case Process::SPEC:
+    cmd(static_cast<ProcessSpec*>(p)->cmd);
+    break;
+  case Process::INSTANCE:
+    exprs(static_cast<ProcessInstance*>(p)->actuals);
+    break;
+  }
+}
+
+void Bounds::server(Server *s) {
+  switch (s->type) {
+  case Server::SPEC: {
+      ServerSpec *x = static_cast<ServerSpec*>(s);
+      size_t n = scope.size();
+      size_t k = checked.size();
+      if (x->decls != nullptr)
+        for (auto y : *x->decls)
+          spec(y);
+      restore(n);
+      checked.resize(k);
+      break;
+    }
+  case Server::INSTANCE:
+    exprs(static_cast<ServerInstance*>(s)->actuals);
+    break;
+  }
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+void Bounds::cmd(Cmd *c) {
+  if (c == nullptr)
+    return;
+  size_t n = scope.size();
+  size_t k = checked.size();
+  switch (c->type) {
+  case Cmd::SKIP:
+  case Cmd::STOP:
+    break;
+
+  case Cmd::SPEC:
+    spec(static_cast<CmdSpec*>(c)->spec);
+    cmd(static_cast<CmdSpec*>(c)->cmd);
+    break;
+
+  case Cmd::INSTANCE:
+    exprs(static_cast<Instance*>(c)->actuals);
+    break;
+
+  case Cmd::CALL:
+    elem(static_cast<Call*>(c)->name);
+    exprs(static_cast<Call*>(c)->actuals);
+    break;
+
+  // The value is evaluated before the element it is assigned to
+  case Cmd::ASS:
+    expr(static_cast<Ass*>(c)->rhs);
+    elem(static_cast<Ass*>(c)->lhs);
+    break;
+
+  case Cmd::IN:
+    elem(static_cast<In*>(c)->lhs);
+    elem(static_cast<In*>(c)->rhs);
+    break;
+
+  case Cmd::OUT:
+    elem(static_cast<Out*>(c)->lhs);
+    expr(static_cast<Out*>(c)->rhs);
+    break;
+
+  case Cmd::CONNECT:
+    elem(static_cast<Connect*>(c)->local);
+    elem(static_cast<Connect*>(c)->remote);
+    break;
+
+  // Alternatives, choices and the bodies of conditionals and loops may not
+  // run on every iteration of an enclosing replicator, and the checks made
+  // in one do not cover elements after it or in another
+  case Cmd::ALT:
+    guarded++;
+    if (static_cast<Alt*>(c)->altns != nullptr)
+      for (auto x : *static_cast<Alt*>(c)->altns) {
+        altn(x);
+        checked.resize(k);
+      }
+    guarded--;
+    break;
+
+  case Cmd::RALT:
+    guarded++;
+    ranges(static_cast<RepAlt*>(c)->ranges);
+    altn(static_cast<RepAlt*>(c)->altn);
+    checked.resize(k);
+    guarded--;
+    break;
+
+  case Cmd::TEST:
+    guarded++;
+    if (static_cast<Test*>(c)->choices != nullptr)
+      for (auto x : *static_cast<Test*>(c)->choices) {
+        choice(x);
+        checked.resize(k);
+      }
+    guarded--;
+    break;
+
+  case Cmd::RTEST:
+    guarded++;
+    ranges(static_cast<RepTest*>(c)->ranges);
+    choice(static_cast<RepTest*>(c)->choice);
+    checked.resize(k);
+    guarded--;
+    break;
+
+  case Cmd::IFD:
+    expr(static_cast<IfD*>(c)->expr);
+    k = checked.size();
+    guarded++;
+    cmd(static_cast<IfD*>(c)->cmd);
+    checked.resize(k);
+    guarded--;
+    break;
+
+  case Cmd::IFTE:
+    expr(static_cast<IfTE*>(c)->expr);
+    k = checked.size();
+    guarded++;
+    cmd(static_cast<IfTE*>(c)->cmd);
+    checked.resize(k);
+    cmd(static_cast<IfTE*>(c)->elseCmd);
+    checked.resize(k);
+    guarded--;
+    break;
+
+  case Cmd::CASE: {
+      Case *x = static_cast<Case*>(c);
+      expr(x->expr);
+      k = checked.size();
+      guarded++;
+      if (x->selects != nullptr)
+        for (auto y : *x->selects) {
+          select(y);
+          checked.resize(k);
+        }
+      guarded--;
+      break;
+    }
+
+  case Cmd::RCASE: {
+      RepCase *x = static_cast<RepCase*>(c);
+      expr(x->expr);
+      guarded++;
+      ranges(x->ranges);
+      select(x->select);
+      checked.resize(k);
+      guarded--;
+      break;
+    }
+
+  case Cmd::WHILE:
+    expr(static_cast<While*>(c)->expr);
+    k = checked.size();
+    guarded++;
+    cmd(static_cast<While*>(c)->cmd);
+    checked.resize(k);
+    guarded--;
+    break;
+
+  case Cmd::UNTIL:
+    expr(static_cast<Until*>(c)->expr);
+    k = checked.size();
+    guarded++;
+    cmd(static_cast<Until*>(c)->cmd);
+    checked.resize(k);
+    guarded--;
+    break;
+
+  case Cmd::DO:
+    cmd(static_cast<Do*>(c)->cmd);
+    expr(static_cast<Do*>(c)->expr);
+    break;
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds)
+      cmd(x);
+    break;
+
+  // Components of a parallel do not run in order
+  case Cmd::PAR:
+    for (auto x : *static_cast<Par*>(c)->cmds) {
+      cmd(x);
+      checked.resize(k);
+    }
+    break;
+
+  case Cmd::RSEQ: {
+      ranges(static_cast<RepSeq*>(c)->ranges);
+      int saved = guarded;
+      size_t savedInvariant = invariant;
+      guarded = 0;
+      invariant = scope.size();
+      depth++;
+      cmd(static_cast<RepSeq*>(c)->cmd);
+      checked.resize(k);
+      depth--;
+      guarded = saved;
+      invariant = savedInvariant;
+      break;
+    }
+
+  case Cmd::RPAR: {
+      ranges(static_cast<RepPar*>(c)->ranges);
+      int saved = guarded;
+      size_t savedInvariant = invariant;
+      guarded = 0;
+      invariant = scope.size();
+      depth++;
+      cmd(static_cast<RepPar*>(c)->cmd);
+      checked.resize(k);
+      depth--;
+      guarded = saved;
+      invariant = savedInvariant;
+      break;
+    }
+  }
+  restore(n);
+}
+
+void Bounds::altn(Altn *a) {
+  size_t n = scope.size();
+  switch (a->type) {
+  case Altn::UNGUARDED: {
+      UnguardedAltn *x = static_cast<UnguardedAltn*>(a);
+      elem(x->dst);
+      elem(x->src);
+      cmd(x->cmd);
+      break;
+    }
+  case Altn::GUARDED: {
+      GuardedAltn *x = static_cast<GuardedAltn*>(a);
+      expr(x->expr);
+      elem(x->dst);
+      elem(x->src);
+      cmd(x->cmd);
+      break;
+    }
+  case Altn::SKIP:
+    expr(static_cast<SkipAltn*>(a)->expr);
+    cmd(static_cast<SkipAltn*>(a)->cmd);
+    break;
+  case Altn::NESTED:
+    cmd(static_cast<NestedAltn*>(a)->alt);
+    break;
+  case Altn::SPEC:
+    spec(static_cast<SpecAltn*>(a)->spec);
+    altn(static_cast<SpecAltn*>(a)->altn);
+    break;
+  }
+  restore(n);
+}
+
+void Bounds::choice(Choice *c) {
+  size_t n = scope.size();
+  switch (c->type) {
+  case Choice::GUARDED:
+    expr(static_cast<GuardedChoice*>(c)->expr);
+    cmd(static_cast<GuardedChoice*>(c)->cmd);
+    break;
+  case Choice::NESTED:
+    cmd(static_cast<NestedChoice*>(c)->test);
+    break;
+  case Choice::SPEC:
+    spec(static_cast<SpecChoice*>(c)->spec);
+    choice(static_cast<SpecChoice*>(c)->choice);
+    break;
+  }
+  restore(n);
+}
+
+void Bounds::select(Select *s) {
+  if (s->type == Select::GUARDED)
+    expr(static_cast<GuardedSelect*>(s)->expr);
+  cmd(s->cmd);
+}
+
+// ============================================================================
+// Expressions
+// ============================================================================
+
+void Bounds::elem(Elem *e) {
+  if (e == nullptr)
+    return;
+  exprs(e->subscripts);
+  if (e->type == Elem::FIELD)
+    elem(static_cast<Field*>(e)->base);
+  else if (e->type == Elem::CALL)
+    exprs(static_cast<FuncCall*>(e)->actuals);
+  check(e);
+}
+
+void Bounds::exprs(std::list<Expr*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l)
+    expr(x);
+}
+
+void Bounds::expr(Expr *e) {
+  if (e == nullptr)
+    return;
+  switch (e->type) {
+  default:
+    break;
+
+  case Expr::ELEM:
+    elem(static_cast<OperElem*>(e)->elem);
+    break;
+
+  case Expr::VALOF: {
+      Valof *x = static_cast<OperValof*>(e)->valof;
+      size_t n = scope.size();
+      cmd(x->cmd);
+      expr(x->expr);
+      restore(n);
+      break;
+    }
+
+  case Expr::EXPR:
+    expr(static_cast<OperExpr*>(e)->expr);
+    break;
+
+  case Expr::UNARY:
+    expr(static_cast<UnaryOp*>(e)->operand);
+    break;
+
+  // The right operands of a short-circuit operator are conditional
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(e);
+      bool cond = x->op == Lex::tLAND || x->op == Lex::tLOR;
+      expr(x->left);
+      size_t k = checked.size();
+      guarded += cond;
+      expr(x->right);
+      if (cond)
+        checked.resize(k);
+      guarded -= cond;
+      break;
+    }
+
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(e);
+      bool cond = x->op == Lex::tLAND || x->op == Lex::tLOR;
+      bool first = true;
+      size_t k = checked.size();
+      for (auto y : *x->operands) {
+        guarded += cond && !first;
+        expr(y);
+        guarded -= cond && !first;
+        if (first)
+          k = checked.size();
+        first = false;
+      }
+      if (cond)
+        checked.resize(k);
+      break;
+    }
+  }
+}
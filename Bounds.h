@@ -0,0 +1,81 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "Tree.h"
+
+#include <list>
+#include <string>
+#include <vector>
+
+#define BND Bounds::get()
+
+// Bounds check elimination: an interval analysis over replicator ranges and
+// subscript expressions. Subscripts that are proved to be within the lengths
+// of their arrays need no check. Inside replicators, subscripts that are
+// linear in names bound outside the loop that do not change in it only need
+// a single check at the loop's extremes, which is hoisted out of it,
+// provided they are made on every iteration rather than under a condition.
+// Neither does an element whose subscripts are checked on every path to it,
+// with names that do not change. Checking can be disabled entirely for
+// trusted code.
+class Bounds {
+public:
+  static Bounds instance;
+  static Bounds &get() { return instance; }
+  Bounds() : unchecked(false), depth(0), guarded(0), invariant(0) {};
+  ~Bounds() {};
+  void disable() { unchecked = true; }
+  void analyse(Tree *);
+
+private:
+  // A name in scope. Fixed names do not change in their scope and known
+  // names have a value within an interval. Array lengths are -1 if unknown.
+  struct Var {
+    std::string name;
+    bool fixed;
+    bool known;
+    long lo, hi;
+    std::vector<long> lengths;
+  };
+  // An element that is checked on every path to the point the walk has
+  // reached, and the size of the scope at the check, within which the names
+  // of an element must be found to be the same
+  struct Checked {
+    Elem *elem;
+    size_t extent;
+  };
+  bool unchecked;
+  int depth;
+  // The number of conditions entered within the innermost replicator
+  int guarded;
+  // The number of names in scope outside the body of the innermost replicator
+  size_t invariant;
+  std::vector<Var> scope;
+  std::vector<Checked> checked;
+
+  void bind(const std::string &, bool, Spef *);
+  void bind(const std::string &, Expr *);
+  void bind(const std::string &, long, long);
+  void hide(const std::string &);
+  Var *lookup(const std::string &);
+  void restore(size_t);
+  bool same(Expr *, Expr *, size_t);
+  bool covered(Elem *);
+  bool interval(Expr *, long &, long &);
+  bool linear(Expr *);
+  void check(Elem *);
+  void spec(Spec *);
+  void formals(std::list<Fml*> *);
+  void ranges(std::list<Range*> *);
+  void process(Process *);
+  void server(Server *);
+  void cmd(Cmd *);
+  void altn(Altn *);
+  void choice(Choice *);
+  void select(Select *);
+  void elem(Elem *);
+  void exprs(std::list<Expr*> *);
+  void expr(Expr *);
+};
+
+#endif
@@ -0,0 +1,671 @@
+#include "Clone.h"
+
+#include <cassert>
+
+// Substitute an expression for a name
+void Clone::bind(const std::string &n, Expr *e) {
+  subs.push_back(std::make_pair(n, e));
+}
+
+void Clone::hide(const std::string &n) {
+  subs.push_back(std::make_pair(n, (Expr *) nullptr));
+}
+
+// Hide the names introduced by a specification
+void Clone::hide(Spec *s) {
+  if (s == nullptr)
+    return;
+  if (s->type == Spec::SSPEC) {
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      hide(x);
+  }
+  else if (s->nameList) {
+    for (auto x : *s->names)
+      hide(x->str);
+  }
+  else if (s->name != nullptr)
+    hide(s->name->str);
+}
+
+Expr *Clone::lookup(const std::string &n) {
+  for (auto x = subs.rbegin(); x != subs.rend(); ++x)
+    if (x->first == n)
+      return x->second;
+  return nullptr;
+}
+
+// ============================================================================
+// Specifications
+// ============================================================================
+
+Spef *Clone::spef(Spef *s) {
+  if (s == nullptr)
+    return nullptr;
+  Spef *res;
+  switch (s->kind) {
+  default:
+  case Spef::BASIC:
+    return new Spef(s->type, s->val, exprs(s->lengths));
+  case Spef::NAMED:
+    res = new NamedSpef(s->type,
+        name(static_cast<NamedSpef*>(s)->name), exprs(s->lengths));
+    break;
+  case Spef::INTERFACE:
+    res = new IntfSpef(s->type,
+        decls(static_cast<IntfSpef*>(s)->intf), exprs(s->lengths));
+    break;
+  }
+  res->val = s->val;
+  return res;
+}
+
+Fml *Clone::fml(Fml *f) {
+  return new Fml(spef(f->spef), name(f->name));
+}
+
+Decl *Clone::decl(Decl *d) {
+  return static_cast<Decl*>(spec(d));
+}
+
+Spec *Clone::spec(Spec *s) {
+  if (s == nullptr)
+    return nullptr;
+  switch (s->type) {
+  default:
+    assert(0 && "invalid specification");
+    return nullptr;
+
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      size_t n = subs.size();
+      std::list<Fml*> *args = fmls(d->args);
+      if (d->args != nullptr)
+        for (auto x : *d->args)
+          hide(x->name->str);
+      Def *res = nullptr;
+      switch (d->defType) {
+      case Def::PROCESS:
+        res = new ProcessDef(name(d->name), args,
+            process(static_cast<ProcessDef*>(d)->process));
+        break;
+      case Def::SERVER:
+        res = new ServerDef(name(d->name), args,
+            server(static_cast<ServerDef*>(d)->server));
+        break;
+      case Def::ISERVER:
+        res = new InhrtServerDef(name(d->name), args, static_cast<HidingDecl*>(
+            spec(static_cast<InhrtServerDef*>(d)->hidingDecl)));
+        break;
+      case Def::FUNCTION: {
+          FunctionDef *x = static_cast<FunctionDef*>(d);
+          FunctionDef *y = new FunctionDef(name(d->name), args, expr(x->expr));
+          y->memo = x->memo;
+          res = y;
+          break;
+        }
+      }
+      subs.resize(n);
+      return res;
+    }
+
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      switch (d->tDecl) {
+      default:
+        assert(0 && "invalid declaration");
+        return nullptr;
+      case Decl::VAR: {
+          VarDecl *x = static_cast<VarDecl*>(d);
+          if (x->nameList)
+            return new VarDecl(spef(x->spef), names(x->names));
+          return new VarDecl(spef(x->spef), name(x->name));
+        }
+      case Decl::CALL: {
+          CallDecl *x = static_cast<CallDecl*>(d);
+          if (x->nameList) {
+            std::list<std::list<Fml*>*> *argss = nullptr;
+            if (x->argss != nullptr) {
+              argss = new std::list<std::list<Fml*>*>();
+              for (auto y : *x->argss)
+                argss->push_back(fmls(y));
+            }
+            return new CallDecl(spef(x->spef), names(x->names), argss);
+          }
+          return new CallDecl(spef(x->spef), name(x->name), fmls(x->args));
+        }
+      case Decl::HIDING: {
+          HidingDecl *x = static_cast<HidingDecl*>(d);
+          size_t n = subs.size();
+          std::list<Spec*> *l = specs(x->decls);
+          subs.resize(n);
+          return new HidingDecl(name(x->name), l);
+        }
+      case Decl::SERVER: {
+          ServerDecl *x = static_cast<ServerDecl*>(d);
+          return new ServerDecl(name(x->name), server(x->server));
+        }
+      case Decl::RSERVER: {
+          RepServerDecl *x = static_cast<RepServerDecl*>(d);
+          size_t n = subs.size();
+          std::list<Range*> *r = ranges(x->exprs);
+          Server *srv = server(x->server);
+          subs.resize(n);
+          RepServerDecl *res = new RepServerDecl(name(x->name), r, srv);
+          res->alloc = x->alloc;
+          return res;
+        }
+      case Decl::INITIAL:
+        return new InitialDecl(cmd(static_cast<InitialDecl*>(d)->cmd));
+      }
+    }
+
+  case Spec::ABBR: {
+      Abbr *a = static_cast<Abbr*>(s);
+      switch (a->type) {
+      default:
+        assert(0 && "invalid abbreviation");
+        return nullptr;
+      case Abbr::VAL:
+        return new ValAbbr(name(a->name), expr(a->expr));
+      case Abbr::VAR:
+        return new VarAbbr(spef(a->spef), name(a->name), elem(a->elem));
+      case Abbr::CALL:
+        return new CallAbbr(spef(a->spef), name(a->name),
+            fmls(static_cast<CallAbbr*>(a)->args), elem(a->elem));
+      case Abbr::SERVER:
+        return new ServerAbbr(spef(a->spef), name(a->name), elem(a->elem));
+      case Abbr::PROCESS:
+        return new ProcessAbbr(spef(a->spef), name(a->name), elem(a->elem));
+      case Abbr::FUNCTION:
+        return new FunctionAbbr(spef(a->spef), name(a->name), elem(a->elem));
+      }
+    }
+
+  // Simultaneous specifications are in scope of each other
+  case Spec::SSPEC: {
+      SimSpec *x = static_cast<SimSpec*>(s);
+      hide(x);
+      return new SimSpec(specs(x->specs));
+    }
+  }
+}
+
+Server *Clone::server(Server *s) {
+  if (s->type == Server::INSTANCE) {
+    ServerInstance *x = static_cast<ServerInstance*>(s);
+    return new ServerInstance(name(x->name), exprs(x->actuals));
+  }
+  ServerSpec *x = static_cast<ServerSpec*>(s);
+  size_t n = subs.size();
+  std::list<Decl*> *i = decls(x->intfs);
+  std::list<Spec*> *d = specs(x->decls);
+  subs.resize(n);
+  return new ServerSpec(i, d);
+}
+
+Process *Clone::process(Process *p) {
+  switch (p->type) {
+  default:
+  case Process::CMD:
+    return new ProcessCmd(cmd(static_cast<ProcessCmd*>(p)->cmd));
+  case Process::SPEC: {
+      ProcessSpec *x = static_cast<ProcessSpec*>(p);
+      size_t n = subs.size();
+      std::list<Decl*> *i = decls(x->intf);
+      Cmd *c = cmd(x->cmd);
+      subs.resize(n);
+      return new ProcessSpec(i, c);
+    }
+  case Process::INSTANCE: {
+      ProcessInstance *x = static_cast<ProcessInstance*>(p);
+      ProcessInstance *y =
+          new ProcessInstance(name(x->name), exprs(x->actuals));
+      y->dispatch = x->dispatch;
+      y->target = x->target;
+      y->tail = x->tail;
+      return y;
+    }
+  }
+}
+
+Range *Clone::range(Range *r) {
+  Range *res = new Range(name(r->name),
+      expr(r->base), expr(r->count), expr(r->step));
+  hide(r->name->str);
+  return res;
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+Cmd *Clone::cmd(Cmd *c) {
+  if (c == nullptr)
+    return nullptr;
+  count++;
+  size_t n = subs.size();
+  Cmd *res = nullptr;
+  switch (c->type) {
+
+  case Cmd::SPEC: {
+      CmdSpec *x = static_cast<CmdSpec*>(c);
+      Spec *s = spec(x->spec);
+      hide(x->spec);
+      res = new CmdSpec(s, cmd(x->cmd));
+      break;
+    }
+
+  case Cmd::INSTANCE: {
+      Instance *x = static_cast<Instance*>(c);
+      Instance *y = new Instance(name(x->name), exprs(x->actuals));
+      y->dispatch = x->dispatch;
+      y->target = x->target;
+      y->tail = x->tail;
+      res = y;
+      break;
+    }
+
+  case Cmd::CALL: {
+      Call *x = static_cast<Call*>(c);
+      Call *y = new Call(name(x->name), name(x->field), exprs(x->actuals));
+      y->dispatch = x->dispatch;
+      y->target = x->target;
+      res = y;
+      break;
+    }
+
+  case Cmd::SKIP:
+    res = new Skip();
+    break;
+
+  case Cmd::STOP:
+    res = new Stop();
+    break;
+
+  case Cmd::ASS: {
+      Ass *x = static_cast<Ass*>(c);
+      res = new Ass(elem(x->lhs), expr(x->rhs));
+      break;
+    }
+
+  case Cmd::IN: {
+      In *x = static_cast<In*>(c);
+      res = new In(elem(x->lhs), elem(x->rhs));
+      break;
+    }
+
+  case Cmd::OUT: {
+      Out *x = static_cast<Out*>(c);
+      Out *o = new Out(elem(x->lhs), expr(x->rhs));
+      o->mode = x->mode;
+      res = o;
+      break;
+    }
+
+  case Cmd::CONNECT: {
+      Connect *x = static_cast<Connect*>(c);
+      res = new Connect(elem(x->local), elem(x->remote));
+      break;
+    }
+
+  case Cmd::ALT:
+    res = new Alt(altns(static_cast<Alt*>(c)->altns));
+    break;
+
+  case Cmd::RALT: {
+      RepAlt *x = static_cast<RepAlt*>(c);
+      std::list<Range*> *r = ranges(x->ranges);
+      res = new RepAlt(r, altn(x->altn));
+      break;
+    }
+
+  case Cmd::TEST:
+    res = new Test(choices(static_cast<Test*>(c)->choices));
+    break;
+
+  case Cmd::RTEST: {
+      RepTest *x = static_cast<RepTest*>(c);
+      std::list<Range*> *r = ranges(x->ranges);
+      res = new RepTest(r, choice(x->choice));
+      break;
+    }
+
+  case Cmd::IFD: {
+      IfD *x = static_cast<IfD*>(c);
+      res = new IfD(expr(x->expr), cmd(x->cmd));
+      break;
+    }
+
+  case Cmd::IFTE: {
+      IfTE *x = static_cast<IfTE*>(c);
+      res = new IfTE(expr(x->expr), cmd(x->cmd), cmd(x->elseCmd));
+      break;
+    }
+
+  case Cmd::CASE: {
+      Case *x = static_cast<Case*>(c);
+      res = new Case(expr(x->expr), selects(x->selects));
+      break;
+    }
+
+  case Cmd::RCASE: {
+      RepCase *x = static_cast<RepCase*>(c);
+      Expr *e = expr(x->expr);
+      std::list<Range*> *r = ranges(x->ranges);
+      res = new RepCase(e, r, select(x->select));
+      break;
+    }
+
+  case Cmd::WHILE: {
+      While *x = static_cast<While*>(c);
+      res = new While(expr(x->expr), cmd(x->cmd));
+      break;
+    }
+
+  case Cmd::UNTIL: {
+      Until *x = static_cast<Until*>(c);
+      res = new Until(expr(x->expr), cmd(x->cmd));
+      break;
+    }
+
+  case Cmd::DO: {
+      Do *x = static_cast<Do*>(c);
+      Cmd *body = cmd(x->cmd);
+      res = new Do(body, expr(x->expr));
+      break;
+    }
+
+  case Cmd::SEQ:
+    res = new Seq(cmds(static_cast<Seq*>(c)->cmds));
+    break;
+
+  case Cmd::PAR:
+    res = new Par(cmds(static_cast<Par*>(c)->cmds));
+    break;
+
+  case Cmd::RSEQ: {
+      RepSeq *x = static_cast<RepSeq*>(c);
+      std::list<Range*> *r = ranges(x->ranges);
+      RepSeq *y = new RepSeq(r, cmd(x->cmd));
+      y->xfer = x->xfer;
+      res = y;
+      break;
+    }
+
+  case Cmd::RPAR: {
+      RepPar *x = static_cast<RepPar*>(c);
+      std::list<Range*> *r = ranges(x->ranges);
+      res = new RepPar(r, cmd(x->cmd));
+      break;
+    }
+  }
+  subs.resize(n);
+  return res;
+}
+
+Altn *Clone::altn(Altn *a) {
+  size_t n = subs.size();
+  Altn *res = nullptr;
+  switch (a->type) {
+  case Altn::UNGUARDED: {
+      UnguardedAltn *x = static_cast<UnguardedAltn*>(a);
+      res = new UnguardedAltn(elem(x->dst), elem(x->src), cmd(x->cmd));
+      break;
+    }
+  case Altn::GUARDED: {
+      GuardedAltn *x = static_cast<GuardedAltn*>(a);
+      res = new GuardedAltn(expr(x->expr),
+          elem(x->dst), elem(x->src), cmd(x->cmd));
+      break;
+    }
+  case Altn::SKIP: {
+      SkipAltn *x = static_cast<SkipAltn*>(a);
+      res = new SkipAltn(expr(x->expr), cmd(x->cmd));
+      break;
+    }
+  case Altn::NESTED:
+    res = new NestedAltn(
+        static_cast<Alt*>(cmd(static_cast<NestedAltn*>(a)->alt)));
+    break;
+  case Altn::SPEC: {
+      SpecAltn *x = static_cast<SpecAltn*>(a);
+      Spec *s = spec(x->spec);
+      hide(x->spec);
+      res = new SpecAltn(s, altn(x->altn));
+      break;
+    }
+  }
+  subs.resize(n);
+  return res;
+}
+
+Choice *Clone::choice(Choice *c) {
+  size_t n = subs.size();
+  Choice *res = nullptr;
+  switch (c->type) {
+  case Choice::GUARDED: {
+      GuardedChoice *x = static_cast<GuardedChoice*>(c);
+      res = new GuardedChoice(expr(x->expr), cmd(x->cmd));
+      break;
+    }
+  case Choice::NESTED:
+    res = new NestedChoice(
+        static_cast<Test*>(cmd(static_cast<NestedChoice*>(c)->test)));
+    break;
+  case Choice::SPEC: {
+      SpecChoice *x = static_cast<SpecChoice*>(c);
+      Spec *s = spec(x->spec);
+      hide(x->spec);
+      res = new SpecChoice(s, choice(x->choice));
+      break;
+    }
+  }
+  subs.resize(n);
+  return res;
+}
+
+Select *Clone::select(Select *s) {
+  if (s->type == Select::ELSE)
+    return new ElseSelect(cmd(s->cmd));
+  GuardedSelect *x = static_cast<GuardedSelect*>(s);
+  return new GuardedSelect(expr(x->expr), cmd(x->cmd));
+}
+
+// ============================================================================
+// Expressions
+// ============================================================================
+
+Name *Clone::name(Name *n) {
+  if (n == nullptr)
+    return nullptr;
+  Name *res = new Name(n->str, exprs(n->subscripts));
+  res->check = n->check;
+  seen.insert(n->str);
+  return res;
+}
+
+Elem *Clone::elem(Elem *e) {
+  if (e == nullptr)
+    return nullptr;
+  if (e->type == Elem::CALL) {
+    FuncCall *x = static_cast<FuncCall*>(e);
+    FuncCall *res = new FuncCall(name(x->name), exprs(x->actuals));
+    res->dispatch = x->dispatch;
+    res->target = x->target;
+    res->tail = x->tail;
+    return res;
+  }
+  if (e->type == Elem::FIELD) {
+    Field *x = static_cast<Field*>(e);
+    Field *res = new Field(name(x->base), name(x->field), exprs(x->subscripts));
+    res->check = x->check;
+    return res;
+  }
+  return name(static_cast<Name*>(e));
+}
+
+// Copy an operand, keeping substituted expressions as operands
+Operand *Clone::operand(Operand *o) {
+  Expr *e = expr(o);
+  if (e->type == Expr::UNARY || e->type == Expr::BINARY
+      || e->type == Expr::NARY)
+    return new OperExpr(e);
+  return static_cast<Operand*>(e);
+}
+
+Expr *Clone::expr(Expr *e) {
+  if (e == nullptr)
+    return nullptr;
+  count++;
+  switch (e->type) {
+  default:
+    assert(0 && "invalid expression");
+    return nullptr;
+
+  case Expr::UNARY: {
+      UnaryOp *x = static_cast<UnaryOp*>(e);
+      return new UnaryOp(x->op, operand(x->operand));
+    }
+
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(e);
+      return new BinaryOp(x->op, operand(x->left), operand(x->right));
+    }
+
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(e);
+      std::list<Operand*> *l = new std::list<Operand*>();
+      for (auto y : *x->operands)
+        l->push_back(operand(y));
+      return new NaryOp(x->op, l);
+    }
+
+  case Expr::ELEM: {
+      Elem *x = static_cast<OperElem*>(e)->elem;
+      if (x->type == Elem::NAME && x->subscripts == nullptr) {
+        Expr *sub = lookup(static_cast<Name*>(x)->str);
+        if (sub != nullptr) {
+          substituted[static_cast<Name*>(x)->str]++;
+          Clone c;
+          return c.expr(sub);
+        }
+      }
+      return new OperElem(elem(x));
+    }
+
+  // Literals are immutable and shared
+  case Expr::LITERAL:
+    return new OperLiteral(static_cast<OperLiteral*>(e)->literal);
+
+  case Expr::VALOF: {
+      Valof *x = static_cast<OperValof*>(e)->valof;
+      size_t n = subs.size();
+      Cmd *c = cmd(x->cmd);
+      Expr *r = expr(x->expr);
+      subs.resize(n);
+      return new OperValof(new Valof(c, r));
+    }
+
+  case Expr::EXPR:
+    return new OperExpr(expr(static_cast<OperExpr*>(e)->expr));
+  }
+}
+
+// ============================================================================
+// Lists
+// ============================================================================
+
+std::list<Expr*> *Clone::exprs(std::list<Expr*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Expr*> *res = new std::list<Expr*>();
+  for (auto x : *l)
+    res->push_back(expr(x));
+  return res;
+}
+
+std::list<Name*> *Clone::names(std::list<Name*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Name*> *res = new std::list<Name*>();
+  for (auto x : *l)
+    res->push_back(name(x));
+  return res;
+}
+
+std::list<Fml*> *Clone::fmls(std::list<Fml*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Fml*> *res = new std::list<Fml*>();
+  for (auto x : *l)
+    res->push_back(fml(x));
+  return res;
+}
+
+std::list<Decl*> *Clone::decls(std::list<Decl*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Decl*> *res = new std::list<Decl*>();
+  for (auto x : *l) {
+    res->push_back(decl(x));
+    hide(x);
+  }
+  return res;
+}
+
+// Specifications in a list are in scope of the ones that follow
+std::list<Spec*> *Clone::specs(std::list<Spec*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Spec*> *res = new std::list<Spec*>();
+  for (auto x : *l) {
+    res->push_back(spec(x));
+    hide(x);
+  }
+  return res;
+}
+
+std::list<Range*> *Clone::ranges(std::list<Range*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Range*> *res = new std::list<Range*>();
+  for (auto x : *l)
+    res->push_back(range(x));
+  return res;
+}
+
+std::list<Cmd*> *Clone::cmds(std::list<Cmd*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Cmd*> *res = new std::list<Cmd*>();
+  for (auto x : *l)
+    res->push_back(cmd(x));
+  return res;
+}
+
+std::list<Altn*> *Clone::altns(std::list<Altn*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Altn*> *res = new std::list<Altn*>();
+  for (auto x : *l)
+    res->push_back(altn(x));
+  return res;
+}
+
+std::list<Choice*> *Clone::choices(std::list<Choice*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Choice*> *res = new std::list<Choice*>();
+  for (auto x : *l)
+    res->push_back(choice(x));
+  return res;
+}
+
+std::list<Select*> *Clone::selects(std::list<Select*> *l) {
+  if (l == nullptr)
+    return nullptr;
+  std::list<Select*> *res = new std::list<Select*>();
+  for (auto x : *l)
+    res->push_back(select(x));
+  return res;
+}
@@ -0,0 +1,62 @@
+#ifndef CLONE_H
+#define CLONE_H
+
+#include "Tree.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Deep copy of a part of the tree. Names can be bound to expressions that
+// are substituted for their free occurrences as operands in the copy. The
+// names that occur in the copy, the number of times each bound name is
+// substituted and the size of the copy in nodes are recorded.
+class Clone {
+public:
+  Clone() : count(0) {}
+  ~Clone() {}
+  void bind(const std::string &, Expr *);
+  Spec *spec(Spec *);
+  Cmd  *cmd(Cmd *);
+  Expr *expr(Expr *);
+  Elem *elem(Elem *);
+  const std::set<std::string> &occurring() { return seen; }
+  int uses(const std::string &n) { return substituted[n]; }
+  int size() { return count; }
+
+private:
+  std::vector<std::pair<std::string, Expr*>> subs;
+  std::set<std::string> seen;
+  std::map<std::string, int> substituted;
+  int count;
+
+  void hide(const std::string &);
+  void hide(Spec *);
+  Expr *lookup(const std::string &);
+  Spef    *spef(Spef *);
+  Name    *name(Name *);
+  Fml     *fml(Fml *);
+  Decl    *decl(Decl *);
+  Range   *range(Range *);
+  Altn    *altn(Altn *);
+  Choice  *choice(Choice *);
+  Select  *select(Select *);
+  Server  *server(Server *);
+  Process *process(Process *);
+  Operand *operand(Operand *);
+  std::list<Expr*>   *exprs(std::list<Expr*> *);
+  std::list<Name*>   *names(std::list<Name*> *);
+  std::list<Fml*>    *fmls(std::list<Fml*> *);
+  std::list<Decl*>   *decls(std::list<Decl*> *);
+  std::list<Spec*>   *specs(std::list<Spec*> *);
+  std::list<Range*>  *ranges(std::list<Range*> *);
+  std::list<Cmd*>    *cmds(std::list<Cmd*> *);
+  std::list<Altn*>   *altns(std::list<Altn*> *);
+  std::list<Choice*> *choices(std::list<Choice*> *);
+  std::list<Select*> *selects(std::list<Select*> *);
+};
+
+#endif
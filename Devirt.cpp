@@ -0,0 +1,533 @@
+#include "Devirt.h"
+
+Devirt Devirt::instance;
+
+// Whether a formal or abbreviation can refer to a definition
+static bool procedural(Spef *s) {
+  return s != nullptr && (s->type == Spef::SERVER
+      || s->type == Spef::PROCESS || s->type == Spef::FUNCTION);
+}
+
+// Propagate definitions through formals until they no longer change, then
+// annotate the calls with what reaches them
+void Devirt::devirtualise(Tree *t) {
+  previous.clear();
+  annotate = false;
+  bool converged = false;
+  for (int i = 0; i < MAX_DEVIRT_ROUNDS && !converged; i++) {
+    pass(t);
+    converged = bindings == previous;
+    previous = bindings;
+  }
+  if (!converged)
+    for (auto &x : previous)
+      x.second.open = true;
+  annotate = true;
+  pass(t);
+}
+
+void Devirt::pass(Tree *t) {
+  bindings.clear();
+  escaped.clear();
+  anyOpen = false;
+  scope.clear();
+  for (auto x : t->spec) spec(x);
+  for (auto x : t->prog) cmd(x);
+
+  // Definitions passed to unknown callees can reach any procedural formal
+  // of their own, so those are open
+  if (anyOpen) {
+    for (auto d : escaped) {
+      if (d->args == nullptr)
+        continue;
+      for (auto x : *d->args)
+        if (procedural(x->spef))
+          bindings[x].open = true;
+    }
+  }
+}
+
+// ============================================================================
+// Scope
+// ============================================================================
+
+void Devirt::bind(const std::string &name, const Targets &t) {
+  scope.push_back(Var{name, t, nullptr});
+}
+
+void Devirt::hide(const std::string &name) {
+  Targets t;
+  t.open = true;
+  bind(name, t);
+}
+
+Devirt::Targets Devirt::lookup(const std::string &name) {
+  for (auto x = scope.rbegin(); x != scope.rend(); ++x) {
+    if (x->name == name) {
+      if (x->fml != nullptr)
+        return previous[x->fml];
+      return x->targets;
+    }
+  }
+  Targets t;
+  t.open = true;
+  return t;
+}
+
+// Elements of an array of servers all refer to the same definitions
+Devirt::Targets Devirt::lookup(Elem *e) {
+  if (e->type == Elem::NAME)
+    return lookup(static_cast<Name*>(e)->str);
+  Targets t;
+  t.open = true;
+  return t;
+}
+
+// Record the definitions passed as actuals to each possible callee
+void Devirt::actuals(const Targets &callee, std::list<Expr*> *l) {
+  if (l == nullptr)
+    return;
+  exprs(l);
+  std::vector<Targets> args;
+  for (auto x : *l) {
+    Targets t;
+    if (x->type == Expr::ELEM)
+      t = lookup(static_cast<OperElem*>(x)->elem);
+    else
+      t.open = true;
+    if (callee.open) {
+      anyOpen = true;
+      for (auto y : t.defs)
+        escaped.insert(y.first);
+    }
+    args.push_back(t);
+  }
+  for (auto d : callee.defs) {
+    if (d.first->args == nullptr)
+      continue;
+    auto a = args.begin();
+    for (auto x : *d.first->args) {
+      if (a == args.end())
+        break;
+      if (procedural(x->spef)) {
+        Targets &t = bindings[x];
+        t.open = t.open || a->open;
+        for (auto y : a->defs)
+          t.defs[y.first]++;
+      }
+      ++a;
+    }
+  }
+}
+
+// The definition a call refers to, or the one most often bound to its name
+Def *Devirt::resolve(const Targets &t, Instance::Dispatch &d) {
+  d = Instance::DYNAMIC;
+  if (t.open || t.defs.empty())
+    return nullptr;
+  Def *res = nullptr;
+  int count = 0;
+  for (auto x : t.defs) {
+    if (x.second > count) {
+      res = x.first;
+      count = x.second;
+    }
+  }
+  d = t.defs.size() == 1 ? Instance::DIRECT : Instance::CACHED;
+  return res;
+}
+
+// ============================================================================
+// Specifications
+// ============================================================================
+
+void Devirt::spec(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      Targets t;
+      t.defs[d] = 1;
+      bind(d->name->str, t);
+      size_t n = scope.size();
+      formals(d->args);
+      switch (d->defType) {
+      case Def::PROCESS:
+        process(static_cast<ProcessDef*>(d)->process);
+        break;
+      case Def::SERVER:
+        server(static_cast<ServerDef*>(d)->server);
+        break;
+      case Def::ISERVER:
+        spec(static_cast<InhrtServerDef*>(d)->hidingDecl);
+        break;
+      case Def::FUNCTION:
+        expr(static_cast<FunctionDef*>(d)->expr);
+        break;
+      }
+      scope.resize(n);
+      break;
+    }
+
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      switch (d->tDecl) {
+      case Decl::VAR:
+      case Decl::CALL:
+        if (d->nameList) {
+          for (auto y : *d->names)
+            hide(y->str);
+        }
+        else
+          hide(d->name->str);
+        break;
+      case Decl::HIDING: {
+          HidingDecl *x = static_cast<HidingDecl*>(d);
+          size_t n = scope.size();
+          if (x->decls != nullptr)
+            for (auto y : *x->decls)
+              spec(y);
+          scope.resize(n);
+          hide(x->name->str);
+          break;
+        }
+      case Decl::SERVER:
+      case Decl::RSERVER: {
+          Server *srv = d->tDecl == Decl::SERVER ?
+              static_cast<ServerDecl*>(d)->server :
+              static_cast<RepServerDecl*>(d)->server;
+          server(srv);
+          if (srv->type == Server::INSTANCE)
+            bind(d->name->str,
+                lookup(static_cast<ServerInstance*>(srv)->name->str));
+          else
+            hide(d->name->str);
+          break;
+        }
+      case Decl::INITIAL:
+        cmd(static_cast<InitialDecl*>(d)->cmd);
+        break;
+      }
+      break;
+    }
+
+  case Spec::ABBR: {
+      Abbr *a = static_cast<Abbr*>(s);
+      if (a->type == Abbr::VAL)
+        expr(a->expr);
+      if (procedural(a->spef))
+        bind(a->name->str, lookup(a->elem));
+      else
+        hide(a->name->str);
+      break;
+    }
+
+  // Simultaneous definitions are in scope in each other's bodies
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      if (x->type == Spec::DEF) {
+        Targets t;
+        t.defs[static_cast<Def*>(x)] = 1;
+        bind(x->name->str, t);
+      }
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      spec(x);
+    break;
+  }
+}
+
+void Devirt::formals(std::list<Fml*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l) {
+    if (procedural(x->spef))
+      scope.push_back(Var{x->name->str, Targets(), x});
+    else
+      hide(x->name->str);
+  }
+}
+
+void Devirt::process(Process *p) {
+  switch (p->type) {
+  case Process::CMD:
+    cmd(static_cast<ProcessCmd*>(p)->cmd);
+    break;
+  case Process::SPEC:
+    cmd(static_cast<ProcessSpec*>(p)->cmd);
+    break;
+  case Process::INSTANCE: {
+      ProcessInstance *x = static_cast<ProcessInstance*>(p);
+      Targets t = lookup(x->name->str);
+      actuals(t, x->actuals);
+      if (annotate)
+        x->target = resolve(t, x->dispatch);
+      break;
+    }
+  }
+}
+
+void Devirt::server(Server *s) {
+  switch (s->type) {
+  case Server::SPEC: {
+      ServerSpec *x = static_cast<ServerSpec*>(s);
+      size_t n = scope.size();
+      if (x->decls != nullptr)
+        for (auto y : *x->decls)
+          spec(y);
+      scope.resize(n);
+      break;
+    }
+  case Server::INSTANCE: {
+      ServerInstance *x = static_cast<ServerInstance*>(s);
+      actuals(lookup(x->name->str), x->actuals);
+      break;
+    }
+  }
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+void Devirt::cmd(Cmd *c) {
+  if (c == nullptr)
+    return;
+  size_t n = scope.size();
+  switch (c->type) {
+  case Cmd::SKIP:
+  case Cmd::STOP:
+  case Cmd::IN:
+  case Cmd::CONNECT:
+    break;
+
+  case Cmd::SPEC:
+    spec(static_cast<CmdSpec*>(c)->spec);
+    cmd(static_cast<CmdSpec*>(c)->cmd);
+    break;
+
+  case Cmd::INSTANCE: {
+      Instance *x = static_cast<Instance*>(c);
+      Targets t = lookup(x->name->str);
+      actuals(t, x->actuals);
+      if (annotate)
+        x->target = resolve(t, x->dispatch);
+      break;
+    }
+
+  case Cmd::CALL: {
+      Call *x = static_cast<Call*>(c);
+      exprs(x->actuals);
+      if (annotate)
+        x->target = resolve(lookup(x->name), x->dispatch);
+      break;
+    }
+
+  case Cmd::ASS:
+    expr(static_cast<Ass*>(c)->rhs);
+    break;
+
+  case Cmd::OUT:
+    expr(static_cast<Out*>(c)->rhs);
+    break;
+
+  case Cmd::ALT:
+    if (static_cast<Alt*>(c)->altns != nullptr)
+      for (auto x : *static_cast<Alt*>(c)->altns)
+        altn(x);
+    break;
+
+  case Cmd::RALT:
+    for (auto x : *static_cast<RepAlt*>(c)->ranges)
+      hide(x->name->str);
+    altn(static_cast<RepAlt*>(c)->altn);
+    break;
+
+  case Cmd::TEST:
+    if (static_cast<Test*>(c)->choices != nullptr)
+      for (auto x : *static_cast<Test*>(c)->choices)
+        choice(x);
+    break;
+
+  case Cmd::RTEST:
+    for (auto x : *static_cast<RepTest*>(c)->ranges)
+      hide(x->name->str);
+    choice(static_cast<RepTest*>(c)->choice);
+    break;
+
+  case Cmd::IFD:
+    expr(static_cast<IfD*>(c)->expr);
+    cmd(static_cast<IfD*>(c)->cmd);
+    break;
+
+  case Cmd::IFTE:
+    expr(static_cast<IfTE*>(c)->expr);
+    cmd(static_cast<IfTE*>(c)->cmd);
+    cmd(static_cast<IfTE*>(c)->elseCmd);
+    break;
+
+  case Cmd::CASE: {
+      Case *x = static_cast<Case*>(c);
+      expr(x->expr);
+      if (x->selects != nullptr)
+        for (auto y : *x->selects)
+          select(y);
+      break;
+    }
+
+  case Cmd::RCASE: {
+      RepCase *x = static_cast<RepCase*>(c);
+      expr(x->expr);
+      for (auto y : *x->ranges)
+        hide(y->name->str);
+      select(x->select);
+      break;
+    }
+
+  case Cmd::WHILE:
+    expr(static_cast<While*>(c)->expr);
+    cmd(static_cast<While*>(c)->cmd);
+    break;
+
+  case Cmd::UNTIL:
+    expr(static_cast<Until*>(c)->expr);
+    cmd(static_cast<Until*>(c)->cmd);
+    break;
+
+  case Cmd::DO:
+    cmd(static_cast<Do*>(c)->cmd);
+    expr(static_cast<Do*>(c)->expr);
+    break;
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::PAR:
+    for (auto x : *static_cast<Par*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::RSEQ:
+    for (auto x : *static_cast<RepSeq*>(c)->ranges)
+      hide(x->name->str);
+    cmd(static_cast<RepSeq*>(c)->cmd);
+    break;
+
+  case Cmd::RPAR:
+    for (auto x : *static_cast<RepPar*>(c)->ranges)
+      hide(x->name->str);
+    cmd(static_cast<RepPar*>(c)->cmd);
+    break;
+  }
+  scope.resize(n);
+}
+
+void Devirt::altn(Altn *a) {
+  size_t n = scope.size();
+  switch (a->type) {
+  case Altn::UNGUARDED:
+    cmd(static_cast<UnguardedAltn*>(a)->cmd);
+    break;
+  case Altn::GUARDED:
+    expr(static_cast<GuardedAltn*>(a)->expr);
+    cmd(static_cast<GuardedAltn*>(a)->cmd);
+    break;
+  case Altn::SKIP:
+    expr(static_cast<SkipAltn*>(a)->expr);
+    cmd(static_cast<SkipAltn*>(a)->cmd);
+    break;
+  case Altn::NESTED:
+    cmd(static_cast<NestedAltn*>(a)->alt);
+    break;
+  case Altn::SPEC:
+    spec(static_cast<SpecAltn*>(a)->spec);
+    altn(static_cast<SpecAltn*>(a)->altn);
+    break;
+  }
+  scope.resize(n);
+}
+
+void Devirt::choice(Choice *c) {
+  size_t n = scope.size();
+  switch (c->type) {
+  case Choice::GUARDED:
+    expr(static_cast<GuardedChoice*>(c)->expr);
+    cmd(static_cast<GuardedChoice*>(c)->cmd);
+    break;
+  case Choice::NESTED:
+    cmd(static_cast<NestedChoice*>(c)->test);
+    break;
+  case Choice::SPEC:
+    spec(static_cast<SpecChoice*>(c)->spec);
+    choice(static_cast<SpecChoice*>(c)->choice);
+    break;
+  }
+  scope.resize(n);
+}
+
+void Devirt::select(Select *s) {
+  if (s->type == Select::GUARDED)
+    expr(static_cast<GuardedSelect*>(s)->expr);
+  cmd(s->cmd);
+}
+
+// ============================================================================
+// Expressions
+// ============================================================================
+
+void Devirt::exprs(std::list<Expr*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l)
+    expr(x);
+}
+
+// Only valofs and function calls contain calls
+void Devirt::expr(Expr *e) {
+  if (e == nullptr)
+    return;
+  switch (e->type) {
+  default:
+    break;
+
+  case Expr::ELEM:
+    if (static_cast<OperElem*>(e)->elem->type == Elem::CALL) {
+      FuncCall *x = static_cast<FuncCall*>(static_cast<OperElem*>(e)->elem);
+      Targets t = lookup(x->name->str);
+      actuals(t, x->actuals);
+      if (annotate)
+        x->target = resolve(t, x->dispatch);
+    }
+    break;
+
+  case Expr::VALOF: {
+      Valof *x = static_cast<OperValof*>(e)->valof;
+      size_t n = scope.size();
+      cmd(x->cmd);
+      expr(x->expr);
+      scope.resize(n);
+      break;
+    }
+
+  case Expr::EXPR:
+    expr(static_cast<OperExpr*>(e)->expr);
+    break;
+
+  case Expr::UNARY:
+    expr(static_cast<UnaryOp*>(e)->operand);
+    break;
+
+  case Expr::BINARY:
+    expr(static_cast<BinaryOp*>(e)->left);
+    expr(static_cast<BinaryOp*>(e)->right);
+    break;
+
+  case Expr::NARY:
+    for (auto x : *static_cast<NaryOp*>(e)->operands)
+      expr(x);
+    break;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef DEVIRT_H
+#define DEVIRT_H
+
+#include "Tree.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#define DEV Devirt::get()
+
+// The maximum number of rounds to propagate definitions through formals
+#define MAX_DEVIRT_ROUNDS 16
+
+// Devirtualisation: a whole-program analysis of which process and server
+// definitions reach each abbreviation and procedural formal. Calls through
+// a name that can only refer to one definition are made direct, and calls
+// with several possible definitions predict the one passed most often so
+// it can be guarded with an inline cache.
+class Devirt {
+public:
+  static Devirt instance;
+  static Devirt &get() { return instance; }
+  Devirt() {};
+  ~Devirt() {};
+  void devirtualise(Tree *);
+
+private:
+  // The definitions a name can refer to, with the number of places each is
+  // bound to it. An open set can also refer to unknown definitions.
+  struct Targets {
+    std::map<Def*, int> defs;
+    bool open;
+    Targets() : open(false) {}
+    bool operator==(const Targets &t) const {
+      return open == t.open && defs == t.defs;
+    }
+  };
+  struct Var {
+    std::string name;
+    Targets targets;
+    Fml *fml;
+  };
+  bool annotate;
+  bool anyOpen;
+  std::vector<Var> scope;
+  std::map<Fml*, Targets> bindings;
+  std::map<Fml*, Targets> previous;
+  std::set<Def*> escaped;
+
+  void bind(const std::string &, const Targets &);
+  void hide(const std::string &);
+  Targets lookup(const std::string &);
+  Targets lookup(Elem *);
+  void pass(Tree *);
+  void actuals(const Targets &, std::list<Expr*> *);
+  Def *resolve(const Targets &, Instance::Dispatch &);
+  void spec(Spec *);
+  void formals(std::list<Fml*> *);
+  void process(Process *);
+  void server(Server *);
+  void cmd(Cmd *);
+  void altn(Altn *);
+  void choice(Choice *);
+  void select(Select *);
+  void exprs(std::list<Expr*> *);
+  void expr(Expr *);
+};
+
+#endif
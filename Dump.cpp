@@ -0,0 +1,187 @@
+#include "Dump.h"
+
+#include <string.h>
+
+Dump Dump::instance;
+
+Dump::Dump() :
+  format(TEXT), buf(new char[DUMP_BUF_SIZE]), len(0), markers(1, 1) {}
+
+Dump::~Dump() {
+  finish();
+  delete[] buf;
+}
+
+bool Dump::configure(const std::string &s) {
+  if      (s == "text")   format = TEXT;
+  else if (s == "json")   format = JSON;
+  else if (s == "binary") format = BINARY;
+  else
+    return false;
+  return true;
+}
+
+// A node at a depth, from 1 for a top-level item, with a number of children
+// that follow it, a kind and an optional text
+void Dump::node(int depth, int children, const char *kind,
+    const std::string &text) {
+  switch (format) {
+
+  case TEXT:
+    if ((size_t) depth >= markers.size())
+      markers.resize(depth + 1, 0);
+    markers[depth] = children;
+    if (depth > 1)
+      --markers[depth-1];
+    for (int j = 0; j < depth-1; ++j)
+      write(markers[j] > 0 ? "| " : "  ", 2);
+    write("`-", 2);
+    write(kind, strlen(kind));
+    if (!text.empty()) {
+      put(' ');
+      write(text);
+    }
+    put('\n');
+    break;
+
+  case JSON:
+    close(depth);
+    if (!open.empty()) {
+      if (open.back().children)
+        put(',');
+      else {
+        write(",\"children\":[", 13);
+        open.back().children = true;
+      }
+    }
+    write("{\"kind\":", 8);
+    quoted(kind);
+    if (!text.empty()) {
+      write(",\"text\":", 8);
+      quoted(text);
+    }
+    open.push_back({depth, false});
+    break;
+
+  case BINARY:
+    put(0);
+    word(depth);
+    word(children);
+    string(kind, strlen(kind));
+    string(text.data(), text.size());
+    break;
+  }
+}
+
+// A token with its number, kind and the value of a name or literal
+void Dump::token(int t, const char *kind, const std::string &value) {
+  switch (format) {
+
+  case TEXT: {
+      char s[16];
+      int n = snprintf(s, sizeof(s), "token %3d ", t);
+      write(s, n);
+      write(kind, strlen(kind));
+      put(' ');
+      write(value);
+      put('\n');
+      break;
+    }
+
+  case JSON:
+    write("{\"token\":", 9);
+    number(t);
+    write(",\"kind\":", 8);
+    quoted(kind);
+    if (!value.empty()) {
+      write(",\"value\":", 9);
+      quoted(value);
+    }
+    write("}\n", 2);
+    break;
+
+  case BINARY:
+    put(1);
+    word(t);
+    string(kind, strlen(kind));
+    string(value.data(), value.size());
+    break;
+  }
+}
+
+// Close the nodes that are still open and write out the buffer
+void Dump::finish() {
+  close(0);
+  flush();
+}
+
+void Dump::flush() {
+  if (len > 0)
+    fwrite(buf, 1, len, stdout);
+  len = 0;
+  fflush(stdout);
+}
+
+void Dump::write(const char *s, size_t n) {
+  while (n > 0) {
+    if (len == DUMP_BUF_SIZE)
+      flush();
+    size_t m = DUMP_BUF_SIZE - len < n ? DUMP_BUF_SIZE - len : n;
+    memcpy(buf + len, s, m);
+    len += m;
+    s += m;
+    n -= m;
+  }
+}
+
+void Dump::number(int v) {
+  char s[12];
+  char *p = s + sizeof(s);
+  unsigned u = v < 0 ? 0u - (unsigned) v : (unsigned) v;
+  do { *--p = '0' + u % 10; } while (u /= 10);
+  if (v < 0)
+    *--p = '-';
+  write(p, s + sizeof(s) - p);
+}
+
+void Dump::word(uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    put((char) (v >> (i * 8)));
+}
+
+void Dump::string(const char *s, size_t n) {
+  word((uint32_t) n);
+  write(s, n);
+}
+
+void Dump::quoted(const std::string &s) {
+  static const char *hex = "0123456789abcdef";
+  put('"');
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      put('\\');
+      put(c);
+    }
+    else if (c < 0x20) {
+      write("\\u00", 4);
+      put(hex[c >> 4]);
+      put(hex[c & 15]);
+    }
+    else
+      put(c);
+  }
+  put('"');
+}
+
+// Close the JSON nodes at a depth or deeper, ending the line after each
+// top-level item
+void Dump::close(int depth) {
+  while (!open.empty() && open.back().depth >= depth) {
+    if (open.back().children)
+      put(']');
+    put('}');
+    open.pop_back();
+    if (open.empty())
+      put('\n');
+  }
+}
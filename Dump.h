@@ -0,0 +1,72 @@
+#ifndef DUMP_H
+#define DUMP_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#define DUMP Dump::get()
+
+// The size of the output buffer
+#define DUMP_BUF_SIZE (1 << 20)
+
+// Dumps of the parse tree and of tokens. Everything is written through one
+// large buffer, in one of three formats:
+//
+//   text    the indented tree with markers, and a line for each token
+//   json    a compact JSON object for each top-level item or token, one a
+//           line, with nodes as {"kind":..,"text":..,"children":[..]}
+//   binary  a stream of records, each a type byte (0 for a node, 1 for a
+//           token) followed by little-endian fields: for a node, a 32-bit
+//           depth and number of children, then its kind and text; for a
+//           token, its 32-bit number, then its kind and value. Each string
+//           is a 32-bit length followed by its bytes.
+//
+// Nodes are given in preorder, each with its depth, so there is no limit on
+// the depth of a tree.
+class Dump {
+public:
+  typedef enum {
+    TEXT,
+    JSON,
+    BINARY
+  } Format;
+  static Dump instance;
+  static Dump &get() { return instance; }
+  Dump();
+  ~Dump();
+  bool configure(const std::string &);
+  void node(int, int, const char *, const std::string & = std::string());
+  void token(int, const char *, const std::string &);
+  void finish();
+  void flush();
+
+private:
+  // A JSON node that is yet to be closed
+  struct Open {
+    int depth;
+    bool children;
+  };
+  Format format;
+  char *buf;
+  size_t len;
+  std::vector<int> markers;
+  std::vector<Open> open;
+
+  void put(char c) {
+    if (len == DUMP_BUF_SIZE)
+      flush();
+    buf[len++] = c;
+  }
+  void write(const char *, size_t);
+  void write(const std::string &s) { write(s.data(), s.size()); }
+  void number(int);
+  void word(uint32_t);
+  void string(const char *, size_t);
+  void quoted(const std::string &);
+  void close(int);
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include "Flatten.h"
+#include "Clone.h"
+
+Flatten Flatten::instance;
+
+void Flatten::flatten(Tree *t) {
+  defs.clear();
+  for (auto &x : t->spec)
+    x = spec(x);
+}
+
+// Flatten a specification and record the definitions in scope at the outer
+// level, so later compositions can be resolved against flattened ones
+Spec *Flatten::spec(Spec *s) {
+  if (s == nullptr)
+    return s;
+  switch (s->type) {
+  default:
+    break;
+
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      if (d->defType == Def::ISERVER)
+        d = inherit(static_cast<InhrtServerDef*>(d));
+      if (d->defType == Def::SERVER)
+        server(static_cast<ServerDef*>(d)->server);
+      defs[d->name->str] = d;
+      return d;
+    }
+
+  case Spec::SSPEC:
+    for (auto &x : *static_cast<SimSpec*>(s)->specs)
+      x = spec(x);
+    break;
+  }
+  return s;
+}
+
+void Flatten::server(Server *s) {
+  if (s->type == Server::SPEC)
+    decls(static_cast<ServerSpec*>(s)->decls);
+}
+
+// Allocate replicated servers statically when their ranges are constant
+void Flatten::decls(std::list<Spec*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l) {
+    if (x->type != Spec::DECL)
+      continue;
+    Decl *d = static_cast<Decl*>(x);
+    if (d->tDecl == Decl::SERVER)
+      server(static_cast<ServerDecl*>(d)->server);
+    if (d->tDecl != Decl::RSERVER)
+      continue;
+    RepServerDecl *r = static_cast<RepServerDecl*>(d);
+    bool fixed = true;
+    for (auto y : *r->exprs)
+      if (y->count->type != Expr::LITERAL)
+        fixed = false;
+    if (fixed)
+      r->alloc = RepServerDecl::STATIC;
+    server(r->server);
+  }
+}
+
+// Replace an inheriting server definition with a server definition, when
+// its interface is declared as an instance of a known server definition
+// whose free names are not captured by the hidden declarations or by the
+// inheriting server's own formals.
+Def *Flatten::inherit(InhrtServerDef *d) {
+  HidingDecl *h = d->hidingDecl;
+  if (h == nullptr || h->decls == nullptr)
+    return d;
+  decls(h->decls);
+
+  // Find the declaration of the interface
+  ServerDecl *intf = nullptr;
+  std::set<std::string> hidden;
+  for (auto x : *h->decls) {
+    if (x->type == Spec::DECL
+        && static_cast<Decl*>(x)->tDecl == Decl::SERVER
+        && x->name->str == h->name->str)
+      intf = static_cast<ServerDecl*>(x);
+    else if (x->type == Spec::SSPEC || x->nameList)
+      return d;
+    else
+      hidden.insert(x->name->str);
+  }
+  if (d->args != nullptr)
+    for (auto x : *d->args)
+      hidden.insert(x->name->str);
+  if (intf == nullptr || intf->server->type != Server::INSTANCE)
+    return d;
+
+  // Resolve the instance to a server definition
+  ServerInstance *inst = static_cast<ServerInstance*>(intf->server);
+  if (hidden.count(inst->name->str) || inst->name->subscripts != nullptr)
+    return d;
+  auto it = defs.find(inst->name->str);
+  if (it == defs.end() || it->second->defType != Def::SERVER)
+    return d;
+  ServerDef *def = static_cast<ServerDef*>(it->second);
+  if (def->server->type != Server::SPEC)
+    return d;
+  size_t numArgs = def->args != nullptr ? def->args->size() : 0;
+  size_t numActuals = inst->actuals != nullptr ? inst->actuals->size() : 0;
+  if (numArgs != numActuals)
+    return d;
+
+  Clone clone;
+  ServerDef *copy = static_cast<ServerDef*>(clone.spec(def));
+  std::set<std::string> formals;
+  if (copy->args != nullptr)
+    for (auto x : *copy->args)
+      formals.insert(x->name->str);
+  for (auto x : clone.occurring())
+    if (hidden.count(x) && !formals.count(x))
+      return d;
+
+  // The actuals are bound after the formals before them, so must name none
+  if (inst->actuals != nullptr) {
+    for (auto x : *inst->actuals) {
+      Clone actual;
+      actual.expr(x);
+      for (auto y : actual.occurring())
+        if (formals.count(y))
+          return d;
+    }
+  }
+
+  // Hidden declarations, then formal bindings, then the instance's body
+  std::list<Spec*> *l = new std::list<Spec*>();
+  for (auto x : *h->decls)
+    if (x != intf)
+      l->push_back(x);
+  if (copy->args != nullptr) {
+    auto a = inst->actuals->begin();
+    for (auto x : *copy->args) {
+      Spec *s = formal(x, *a++);
+      if (s == nullptr)
+        return d;
+      l->push_back(s);
+    }
+  }
+  ServerSpec *body = static_cast<ServerSpec*>(copy->server);
+  if (body->decls != nullptr)
+    l->insert(l->end(), body->decls->begin(), body->decls->end());
+  return new ServerDef(d->name, d->args, new ServerSpec(body->intfs, l));
+}
+
+// An abbreviation binding a formal to an actual
+Spec *Flatten::formal(Fml *f, Expr *a) {
+  Spef *s = f->spef;
+  if (s->type == Spef::VAL || (s->val && s->lengths == nullptr))
+    return new ValAbbr(f->name, a);
+  if (a->type != Expr::ELEM)
+    return nullptr;
+  Elem *e = static_cast<OperElem*>(a)->elem;
+  switch (s->type) {
+  default:
+    return new VarAbbr(s, f->name, e);
+  case Spef::CALL:
+    return new CallAbbr(s, f->name, nullptr, e);
+  case Spef::SERVER:
+    return new ServerAbbr(s, f->name, e);
+  case Spef::PROCESS:
+    return new ProcessAbbr(s, f->name, e);
+  case Spef::FUNCTION:
+    return new FunctionAbbr(s, f->name, e);
+  }
+}
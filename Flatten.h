@@ -0,0 +1,36 @@
+#ifndef FLATTEN_H
+#define FLATTEN_H
+
+#include "Tree.h"
+
+#include <list>
+#include <map>
+#include <string>
+
+#define FLAT Flatten::get()
+
+// Flattening of server compositions: an inheriting server definition whose
+// interface is provided by an instance of a server definition is replaced
+// with a single server with that interface. Its hidden declarations are
+// followed by abbreviations binding the instance's formals and then by the
+// instance's own declarations, so calls no longer pass through a separate
+// server. Replicated servers with constant ranges are statically allocated.
+class Flatten {
+public:
+  static Flatten instance;
+  static Flatten &get() { return instance; }
+  Flatten() {};
+  ~Flatten() {};
+  void flatten(Tree *);
+
+private:
+  std::map<std::string, Def*> defs;
+
+  Spec *spec(Spec *);
+  void server(Server *);
+  void decls(std::list<Spec*> *);
+  Def *inherit(InhrtServerDef *);
+  Spec *formal(Fml *, Expr *);
+};
+
+#endif
@@ -0,0 +1,613 @@
+#include "Fold.h"
+#include "Inline.h"
+
+#include <set>
+
+Fold Fold::instance;
+
+void Fold::define(const std::string &name, int value) {
+  for (auto &x : defines) {
+    if (x.name == name) {
+      x.value = value;
+      return;
+    }
+  }
+  defines.push_back(Const{name, true, value});
+}
+
+void Fold::fold(Tree *t) {
+  scope = defines;
+  positions.clear();
+  for (auto x : t->spec) spec(x);
+  for (auto x : t->prog) cmd(x);
+}
+
+// ============================================================================
+// Scope
+// ============================================================================
+
+// Bind a name to the value of a folded expression
+void Fold::bind(const std::string &name, Expr *e) {
+  if (e != nullptr && e->type == Expr::LITERAL)
+    scope.push_back(Const{name, true,
+        literalValue(static_cast<OperLiteral*>(e)->literal)});
+  else
+    hide(name);
+}
+
+// Hide any constant with a name
+void Fold::hide(const std::string &name) {
+  scope.push_back(Const{name, false, 0});
+}
+
+bool Fold::lookup(const std::string &name, int &value) {
+  for (auto x = scope.rbegin(); x != scope.rend(); ++x) {
+    if (x->name == name) {
+      value = x->value;
+      return x->known;
+    }
+  }
+  return false;
+}
+
+// ============================================================================
+// Specifications
+// ============================================================================
+
+void Fold::spec(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      hide(d->name->str);
+      positions[d] = scope.size() - 1;
+      size_t n = scope.size();
+      formals(d->args);
+      switch (d->defType) {
+      case Def::PROCESS:
+        process(static_cast<ProcessDef*>(d)->process);
+        break;
+      case Def::SERVER:
+        server(static_cast<ServerDef*>(d)->server);
+        break;
+      case Def::ISERVER:
+        spec(static_cast<InhrtServerDef*>(d)->hidingDecl);
+        break;
+      case Def::FUNCTION: {
+          FunctionDef *x = static_cast<FunctionDef*>(d);
+          x->expr = expr(x->expr);
+          break;
+        }
+      }
+      scope.resize(n);
+      break;
+    }
+
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      switch (d->tDecl) {
+      case Decl::VAR:
+        if (d->nameList) {
+          VarDecl *x = static_cast<VarDecl*>(d);
+          spef(x->spef);
+          for (auto y : *x->names)
+            hide(y->str);
+        }
+        else {
+          spef(static_cast<VarDecl*>(d)->spef);
+          hide(d->name->str);
+        }
+        break;
+      case Decl::CALL:
+        if (d->nameList) {
+          for (auto y : *d->names)
+            hide(y->str);
+        }
+        else
+          hide(d->name->str);
+        break;
+      case Decl::HIDING: {
+          HidingDecl *x = static_cast<HidingDecl*>(d);
+          size_t n = scope.size();
+          if (x->decls != nullptr)
+            for (auto y : *x->decls)
+              spec(y);
+          scope.resize(n);
+          hide(x->name->str);
+          break;
+        }
+      case Decl::SERVER:
+        server(static_cast<ServerDecl*>(d)->server);
+        hide(d->name->str);
+        break;
+      case Decl::RSERVER: {
+          RepServerDecl *x = static_cast<RepServerDecl*>(d);
+          size_t n = scope.size();
+          ranges(x->exprs);
+          server(x->server);
+          scope.resize(n);
+          hide(d->name->str);
+          break;
+        }
+      case Decl::INITIAL:
+        cmd(static_cast<InitialDecl*>(d)->cmd);
+        break;
+      }
+      break;
+    }
+
+  case Spec::ABBR: {
+      Abbr *a = static_cast<Abbr*>(s);
+      spef(a->spef);
+      if (a->type == Abbr::VAL) {
+        a->expr = expr(a->expr);
+        bind(a->name->str, a->expr);
+      }
+      else {
+        elem(a->elem);
+        hide(a->name->str);
+      }
+      break;
+    }
+
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      spec(x);
+    break;
+  }
+}
+
+void Fold::spef(Spef *s) {
+  if (s != nullptr)
+    exprs(s->lengths);
+}
+
+void Fold::formals(std::list<Fml*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l) {
+    spef(x->spef);
+    hide(x->name->str);
+  }
+}
+
+void Fold::ranges(std::list<Range*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l) {
+    x->base = expr(x->base);
+    x->count = expr(x->count);
+    if (x->step != nullptr)
+      x->step = expr(x->step);
+    hide(x->name->str);
+  }
+}
+
+void Fold::process(Process *p) {
+  switch (p->type) {
+  case Process::CMD:
+    cmd(static_cast<ProcessCmd*>(p)->cmd);
+    break;
+  case Process::SPEC:
+    cmd(static_cast<ProcessSpec*>(p)->cmd);
+    break;
+  case Process::INSTANCE:
+    exprs(static_cast<ProcessInstance*>(p)->actuals);
+    break;
+  }
+}
+
+void Fold::server(Server *s) {
+  switch (s->type) {
+  case Server::SPEC: {
+      ServerSpec *x = static_cast<ServerSpec*>(s);
+      size_t n = scope.size();
+      if (x->decls != nullptr)
+        for (auto y : *x->decls)
+          spec(y);
+      scope.resize(n);
+      break;
+    }
+  case Server::INSTANCE:
+    exprs(static_cast<ServerInstance*>(s)->actuals);
+    break;
+  }
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+void Fold::cmd(Cmd *c) {
+  if (c == nullptr)
+    return;
+  size_t n = scope.size();
+  switch (c->type) {
+  case Cmd::SKIP:
+  case Cmd::STOP:
+    break;
+
+  case Cmd::SPEC:
+    spec(static_cast<CmdSpec*>(c)->spec);
+    cmd(static_cast<CmdSpec*>(c)->cmd);
+    break;
+
+  case Cmd::INSTANCE:
+    exprs(static_cast<Instance*>(c)->actuals);
+    break;
+
+  case Cmd::CALL:
+    elem(static_cast<Call*>(c)->name);
+    exprs(static_cast<Call*>(c)->actuals);
+    break;
+
+  case Cmd::ASS: {
+      Ass *x = static_cast<Ass*>(c);
+      elem(x->lhs);
+      x->rhs = expr(x->rhs);
+      break;
+    }
+
+  case Cmd::IN:
+    elem(static_cast<In*>(c)->lhs);
+    elem(static_cast<In*>(c)->rhs);
+    break;
+
+  case Cmd::OUT: {
+      Out *x = static_cast<Out*>(c);
+      elem(x->lhs);
+      x->rhs = expr(x->rhs);
+      break;
+    }
+
+  case Cmd::CONNECT:
+    elem(static_cast<Connect*>(c)->local);
+    elem(static_cast<Connect*>(c)->remote);
+    break;
+
+  case Cmd::ALT:
+    if (static_cast<Alt*>(c)->altns != nullptr)
+      for (auto x : *static_cast<Alt*>(c)->altns)
+        altn(x);
+    break;
+
+  case Cmd::RALT:
+    ranges(static_cast<RepAlt*>(c)->ranges);
+    altn(static_cast<RepAlt*>(c)->altn);
+    break;
+
+  case Cmd::TEST:
+    if (static_cast<Test*>(c)->choices != nullptr)
+      for (auto x : *static_cast<Test*>(c)->choices)
+        choice(x);
+    break;
+
+  case Cmd::RTEST:
+    ranges(static_cast<RepTest*>(c)->ranges);
+    choice(static_cast<RepTest*>(c)->choice);
+    break;
+
+  case Cmd::IFD: {
+      IfD *x = static_cast<IfD*>(c);
+      x->expr = expr(x->expr);
+      cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::IFTE: {
+      IfTE *x = static_cast<IfTE*>(c);
+      x->expr = expr(x->expr);
+      cmd(x->cmd);
+      cmd(x->elseCmd);
+      break;
+    }
+
+  case Cmd::CASE: {
+      Case *x = static_cast<Case*>(c);
+      x->expr = expr(x->expr);
+      if (x->selects != nullptr)
+        for (auto y : *x->selects)
+          select(y);
+      break;
+    }
+
+  case Cmd::RCASE: {
+      RepCase *x = static_cast<RepCase*>(c);
+      x->expr = expr(x->expr);
+      ranges(x->ranges);
+      select(x->select);
+      break;
+    }
+
+  case Cmd::WHILE: {
+      While *x = static_cast<While*>(c);
+      x->expr = expr(x->expr);
+      cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::UNTIL: {
+      Until *x = static_cast<Until*>(c);
+      x->expr = expr(x->expr);
+      cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::DO: {
+      Do *x = static_cast<Do*>(c);
+      cmd(x->cmd);
+      x->expr = expr(x->expr);
+      break;
+    }
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::PAR:
+    for (auto x : *static_cast<Par*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::RSEQ:
+    ranges(static_cast<RepSeq*>(c)->ranges);
+    cmd(static_cast<RepSeq*>(c)->cmd);
+    break;
+
+  case Cmd::RPAR:
+    ranges(static_cast<RepPar*>(c)->ranges);
+    cmd(static_cast<RepPar*>(c)->cmd);
+    break;
+  }
+  scope.resize(n);
+}
+
+void Fold::altn(Altn *a) {
+  size_t n = scope.size();
+  switch (a->type) {
+  case Altn::UNGUARDED: {
+      UnguardedAltn *x = static_cast<UnguardedAltn*>(a);
+      elem(x->dst);
+      elem(x->src);
+      cmd(x->cmd);
+      break;
+    }
+  case Altn::GUARDED: {
+      GuardedAltn *x = static_cast<GuardedAltn*>(a);
+      x->expr = expr(x->expr);
+      elem(x->dst);
+      elem(x->src);
+      cmd(x->cmd);
+      break;
+    }
+  case Altn::SKIP: {
+      SkipAltn *x = static_cast<SkipAltn*>(a);
+      x->expr = expr(x->expr);
+      cmd(x->cmd);
+      break;
+    }
+  case Altn::NESTED:
+    cmd(static_cast<NestedAltn*>(a)->alt);
+    break;
+  case Altn::SPEC:
+    spec(static_cast<SpecAltn*>(a)->spec);
+    altn(static_cast<SpecAltn*>(a)->altn);
+    break;
+  }
+  scope.resize(n);
+}
+
+void Fold::choice(Choice *c) {
+  size_t n = scope.size();
+  switch (c->type) {
+  case Choice::GUARDED: {
+      GuardedChoice *x = static_cast<GuardedChoice*>(c);
+      x->expr = expr(x->expr);
+      cmd(x->cmd);
+      break;
+    }
+  case Choice::NESTED:
+    cmd(static_cast<NestedChoice*>(c)->test);
+    break;
+  case Choice::SPEC:
+    spec(static_cast<SpecChoice*>(c)->spec);
+    choice(static_cast<SpecChoice*>(c)->choice);
+    break;
+  }
+  scope.resize(n);
+}
+
+void Fold::select(Select *s) {
+  if (s->type == Select::GUARDED) {
+    GuardedSelect *x = static_cast<GuardedSelect*>(s);
+    x->expr = expr(x->expr);
+  }
+  cmd(s->cmd);
+}
+
+// ============================================================================
+// Expressions
+// ============================================================================
+
+void Fold::elem(Elem *e) {
+  if (e == nullptr)
+    return;
+  exprs(e->subscripts);
+  if (e->type == Elem::FIELD)
+    elem(static_cast<Field*>(e)->base);
+  else if (e->type == Elem::CALL)
+    exprs(static_cast<FuncCall*>(e)->actuals);
+}
+
+void Fold::exprs(std::list<Expr*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto &x : *l)
+    x = expr(x);
+}
+
+static bool isLiteral(Expr *e, int &v) {
+  if (e->type != Expr::LITERAL)
+    return false;
+  v = literalValue(static_cast<OperLiteral*>(e)->literal);
+  return true;
+}
+
+// Whether a command only abbreviates values
+static bool inert(Cmd *c) {
+  while (c->type == Cmd::SPEC
+      && static_cast<CmdSpec*>(c)->spec->type == Spec::ABBR
+      && static_cast<Abbr*>(static_cast<CmdSpec*>(c)->spec)->type == Abbr::VAL)
+    c = static_cast<CmdSpec*>(c)->cmd;
+  return c->type == Cmd::SKIP;
+}
+
+static Expr *literal(int v, bool b) {
+  if (b)
+    return new OperLiteral(new BoolLiteral(v != 0));
+  return new OperLiteral(new DecIntLiteral(v));
+}
+
+// Fold an expression, returning it or the literal it evaluates to. An
+// operand is always replaced with an operand.
+Expr *Fold::expr(Expr *e) {
+  if (e == nullptr)
+    return e;
+  int l, r, v;
+  switch (e->type) {
+  default:
+    return e;
+
+  case Expr::ELEM: {
+      Elem *x = static_cast<OperElem*>(e)->elem;
+      elem(x);
+      if (x->type == Elem::NAME
+          && x->subscripts == nullptr
+          && lookup(static_cast<Name*>(x)->str, v))
+        return literal(v, false);
+      if (x->type == Elem::CALL)
+        return call(static_cast<FuncCall*>(x), e);
+      return e;
+    }
+
+  // A valof that only abbreviates values is replaced by a literal result
+  case Expr::VALOF: {
+      Valof *x = static_cast<OperValof*>(e)->valof;
+      size_t n = scope.size();
+      cmd(x->cmd);
+      x->expr = expr(x->expr);
+      scope.resize(n);
+      if (x->expr->type == Expr::LITERAL && inert(x->cmd))
+        return x->expr;
+      return e;
+    }
+
+  // An interned expression is shared, so it is copied rather than changed
+  case Expr::EXPR: {
+      OperExpr *x = static_cast<OperExpr*>(e);
+      Expr *y = expr(x->expr);
+      if (y->type == Expr::LITERAL)
+        return y;
+      if (y != x->expr && x->hash != 0)
+        return new OperExpr(y);
+      x->expr = y;
+      return e;
+    }
+
+  case Expr::UNARY: {
+      UnaryOp *x = static_cast<UnaryOp*>(e);
+      Operand *y = static_cast<Operand*>(expr(x->operand));
+      if (!isLiteral(y, l)) {
+        if (y != x->operand && x->hash != 0)
+          return new UnaryOp(x->op, y);
+        x->operand = y;
+        return e;
+      }
+      if (x->op == Lex::tSUB)
+        return literal(negate(l), false);
+      return literal(!l, true);
+    }
+
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(e);
+      Operand *y = static_cast<Operand*>(expr(x->left));
+      Operand *z = static_cast<Operand*>(expr(x->right));
+      bool b;
+      if (isLiteral(y, l)
+          && isLiteral(z, r)
+          && evaluate(x->op, l, r, v, b))
+        return literal(v, b);
+      if ((y != x->left || z != x->right) && x->hash != 0)
+        return new BinaryOp(x->op, y, z);
+      x->left = y;
+      x->right = z;
+      return e;
+    }
+
+  // The literals of a chain are combined into one, since its operator is
+  // associative and, apart from the logical operators, commutative. A chain
+  // of a logical operator is only folded when all of it is literal.
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(e);
+      std::list<Operand*> all, rest;
+      bool found = false;
+      bool b = false;
+      bool fails = false;
+      for (auto y : *x->operands) {
+        all.push_back(static_cast<Operand*>(expr(y)));
+        if (fails)
+          continue;
+        if (!isLiteral(all.back(), r))
+          rest.push_back(all.back());
+        else if (!found) {
+          v = r;
+          found = true;
+        }
+        else if (!evaluate(x->op, v, r, v, b))
+          fails = true;
+      }
+      if (found && rest.empty() && !fails)
+        return literal(v, b);
+      if (found && !fails && x->op != Lex::tLAND && x->op != Lex::tLOR) {
+        rest.push_back(static_cast<Operand*>(literal(v, b)));
+        if (rest.size() == 2)
+          return new BinaryOp(x->op, rest.front(), rest.back());
+        all = rest;
+      }
+      if (all == *x->operands)
+        return e;
+      if (x->hash != 0)
+        return new NaryOp(x->op, new std::list<Operand*>(all));
+      *x->operands = all;
+      return e;
+    }
+  }
+}
+
+// Inline a call of a function whose definition is in scope, unless a name
+// specified since the definition would be captured
+Expr *Fold::call(FuncCall *c, Expr *e) {
+  if (c->target == nullptr)
+    return e;
+  auto it = positions.find(c->target);
+  if (it == positions.end()
+      || it->second >= scope.size()
+      || scope[it->second].name != c->target->name->str)
+    return e;
+  std::set<std::string> shadowed;
+  for (size_t i = it->second + 1; i < scope.size(); i++)
+    shadowed.insert(scope[i].name);
+  // A recursive function is not expanded within its own expansion
+  if (expanding.count(c->target))
+    return e;
+  Expr *res = INL.expand(c, shadowed);
+  if (res == nullptr)
+    return e;
+  expanding.insert(c->target);
+  res = expr(res);
+  expanding.erase(c->target);
+  return res;
+}
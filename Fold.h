@@ -0,0 +1,60 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "Tree.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#define FOLD Fold::get()
+
+// Constant folding: value abbreviations whose expressions can be evaluated
+// at compile time are bound to their values, which are substituted for the
+// names and folded into every expression in their scope, including
+// replicator ranges and specifier lengths. Constants can also be defined
+// outside the program, for example from the command line. Calls of small
+// functions are inlined so their bodies can be folded too.
+class Fold {
+public:
+  static Fold instance;
+  static Fold &get() { return instance; }
+  Fold() {};
+  ~Fold() {};
+  void define(const std::string &, int);
+  void fold(Tree *);
+
+private:
+  // A name in scope and its value, if it is known
+  struct Const {
+    std::string name;
+    bool known;
+    int value;
+  };
+  std::vector<Const> defines;
+  std::vector<Const> scope;
+  std::map<Def*, size_t> positions;
+  std::set<Def*> expanding;
+
+  void bind(const std::string &, Expr *);
+  void hide(const std::string &);
+  bool lookup(const std::string &, int &);
+  void spec(Spec *);
+  void spef(Spef *);
+  void formals(std::list<Fml*> *);
+  void ranges(std::list<Range*> *);
+  void process(Process *);
+  void server(Server *);
+  void cmd(Cmd *);
+  void altn(Altn *);
+  void choice(Choice *);
+  void select(Select *);
+  void elem(Elem *);
+  void exprs(std::list<Expr*> *);
+  Expr *expr(Expr *);
+  Expr *call(FuncCall *, Expr *);
+};
+
+#endif
@@ -0,0 +1,317 @@
+#include "IR.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <set>
+
+// Whether an instruction only computes a value, so it can be removed when
+// unused or moved. Loads are not pure since memory is shared.
+bool Instr::pure() {
+  switch (op) {
+  default:
+    return false;
+  case CONST:
+  case UNDEF:
+  case PARAM:
+  case PHI:
+  case UNARY:
+  case BINARY:
+  case SELECT:
+  case CALL:
+  case SPLAT:
+  case REDUCE:
+  case ADDR:
+    return true;
+  }
+}
+
+bool Instr::terminator() {
+  return op == STOP || op == BR || op == CBR || op == SWITCH || op == RET;
+}
+
+Instr *Block::terminator() {
+  if (instrs.empty() || !instrs.back()->terminator())
+    return nullptr;
+  return instrs.back();
+}
+
+// ============================================================================
+// Control flow
+// ============================================================================
+
+Block *Function::newBlock() {
+  Block *b = new Block(nextBlock++);
+  blocks.push_back(b);
+  return b;
+}
+
+void Function::addEdge(Block *from, Block *to) {
+  from->succs.push_back(to);
+  to->preds.push_back(from);
+}
+
+// Remove an edge along with the operands of the phis it supplies
+void Function::removeEdge(Block *from, Block *to) {
+  auto s = std::find(from->succs.begin(), from->succs.end(), to);
+  if (s != from->succs.end())
+    from->succs.erase(s);
+  auto p = std::find(to->preds.begin(), to->preds.end(), from);
+  if (p == to->preds.end())
+    return;
+  size_t i = p - to->preds.begin();
+  to->preds.erase(p);
+  for (auto x : to->instrs)
+    if (x->op == Instr::PHI && i < x->args.size())
+      x->args.erase(x->args.begin() + i);
+}
+
+// Find the users of each instruction. They must be found again once
+// operands are changed other than by replaceUses.
+void Function::uses() {
+  for (auto b : blocks)
+    for (auto x : b->instrs)
+      x->users.clear();
+  for (auto b : blocks)
+    for (auto x : b->instrs)
+      for (auto y : x->args)
+        y->users.push_back(x);
+}
+
+void Function::replaceUses(Instr *from, Instr *to) {
+  std::vector<Instr*> users;
+  users.swap(from->users);
+  for (auto x : users) {
+    bool used = false;
+    for (auto &y : x->args) {
+      if (y == from) {
+        y = to;
+        used = true;
+      }
+    }
+    if (used)
+      to->users.push_back(x);
+  }
+}
+
+// Remove the blocks that cannot be reached from the entry
+bool Function::removeUnreachable() {
+  std::set<Block*> reached;
+  for (auto b : order())
+    reached.insert(b);
+  if (reached.size() == blocks.size())
+    return false;
+  std::vector<Block*> live;
+  for (auto b : blocks) {
+    if (reached.count(b)) {
+      live.push_back(b);
+      continue;
+    }
+    while (!b->succs.empty())
+      removeEdge(b, b->succs.front());
+  }
+  blocks = live;
+  return true;
+}
+
+// The reachable blocks in reverse postorder
+std::vector<Block*> Function::order() {
+  std::vector<Block*> post;
+  std::set<Block*> visited;
+  std::vector<std::pair<Block*, size_t>> stack;
+  if (blocks.empty())
+    return post;
+  stack.push_back(std::make_pair(blocks.front(), 0));
+  visited.insert(blocks.front());
+  while (!stack.empty()) {
+    Block *b = stack.back().first;
+    size_t i = stack.back().second++;
+    if (i < b->succs.size()) {
+      if (visited.insert(b->succs[i]).second)
+        stack.push_back(std::make_pair(b->succs[i], 0));
+    }
+    else {
+      post.push_back(b);
+      stack.pop_back();
+    }
+  }
+  std::reverse(post.begin(), post.end());
+  return post;
+}
+
+// Compute immediate dominators over the reachable blocks, with the
+// iterative algorithm of Cooper, Harvey and Kennedy
+void Function::dominators() {
+  std::vector<Block*> rpo = order();
+  std::map<Block*, size_t> index;
+  for (size_t i = 0; i < rpo.size(); i++)
+    index[rpo[i]] = i;
+  for (auto b : blocks)
+    b->idom = nullptr;
+  if (rpo.empty())
+    return;
+  rpo[0]->idom = rpo[0];
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 1; i < rpo.size(); i++) {
+      Block *b = rpo[i];
+      Block *dom = nullptr;
+      for (auto p : b->preds) {
+        if (p->idom == nullptr || !index.count(p))
+          continue;
+        if (dom == nullptr) {
+          dom = p;
+          continue;
+        }
+        Block *x = p;
+        while (x != dom) {
+          while (index[x] > index[dom])
+            x = x->idom;
+          while (index[dom] > index[x])
+            dom = dom->idom;
+        }
+      }
+      if (dom != b->idom) {
+        b->idom = dom;
+        changed = true;
+      }
+    }
+  }
+  rpo[0]->idom = nullptr;
+  std::map<Block*, std::vector<Block*>> children;
+  for (size_t i = 1; i < rpo.size(); i++)
+    children[rpo[i]->idom].push_back(rpo[i]);
+  for (auto b : blocks)
+    b->pre = b->post = -1;
+  int n = 0;
+  std::vector<std::pair<Block*, size_t>> stack;
+  stack.push_back(std::make_pair(rpo[0], 0));
+  rpo[0]->pre = n++;
+  while (!stack.empty()) {
+    Block *b = stack.back().first;
+    size_t i = stack.back().second++;
+    std::vector<Block*> &c = children[b];
+    if (i < c.size()) {
+      c[i]->pre = n++;
+      stack.push_back(std::make_pair(c[i], 0));
+    }
+    else {
+      b->post = n++;
+      stack.pop_back();
+    }
+  }
+}
+
+bool Function::dominates(Block *a, Block *b) {
+  if (a->pre < 0 || b->pre < 0)
+    return a == b;
+  return a->pre <= b->pre && b->post <= a->post;
+}
+
+// ============================================================================
+// Printing
+// ============================================================================
+
+static const char *opStr(Instr *x) {
+  switch (x->op) {
+  default:            return "?";
+  case Instr::CONST:   return "const";
+  case Instr::UNDEF:   return "undef";
+  case Instr::PARAM:   return "param";
+  case Instr::PHI:     return "phi";
+  case Instr::UNARY:   return x->opr == Lex::tSUB ? "neg" : "not";
+  case Instr::BINARY:  return LEX.tokStr(x->opr);
+  case Instr::SELECT:  return "select";
+  case Instr::CALL:    return "call";
+  case Instr::SPLAT:   return "splat";
+  case Instr::REDUCE:  return "reduce";
+  case Instr::ALLOC:   return "alloc";
+  case Instr::ADDR:    return "addr";
+  case Instr::LOAD:    return "load";
+  case Instr::STORE:   return "store";
+  case Instr::CHECK:   return "check";
+  case Instr::IN:      return "in";
+  case Instr::OUT:     return "out";
+  case Instr::CONNECT: return "connect";
+  case Instr::ALT:     return "alt";
+  case Instr::INVOKE:  return "invoke";
+  case Instr::SPAWN:   return "spawn";
+  case Instr::JOIN:    return "join";
+  case Instr::STOP:    return "stop";
+  case Instr::BR:      return "br";
+  case Instr::CBR:     return "cbr";
+  case Instr::SWITCH:  return "switch";
+  case Instr::RET:     return "ret";
+  }
+}
+
+static const char *transferStr(int t) {
+  switch (t) {
+  default:               return "";
+  case Instr::COPY:      return " copy";
+  case Instr::MOVE:      return " move";
+  case Instr::BLOCK:     return " block";
+  case Instr::COALESCE:  return " coalesce";
+  }
+}
+
+static bool hasValue(Instr *x) {
+  return x->pure() || x->op == Instr::LOAD || x->op == Instr::ALT
+      || (x->op == Instr::IN && x->value != Instr::BLOCK);
+}
+
+void Function::print() {
+  printf("function %s(%d)\n", name.c_str(), numParams);
+  for (auto b : blocks) {
+    printf("b%d:", b->id);
+    if (!b->preds.empty()) {
+      printf(" ; preds");
+      for (auto p : b->preds)
+        printf(" b%d", p->id);
+    }
+    printf("\n");
+    for (auto x : b->instrs) {
+      printf("  ");
+      if (hasValue(x))
+        printf("%%%d = ", x->id);
+      printf("%s", opStr(x));
+      if (x->width > 1)
+        printf(".%d", x->width);
+      if (x->op == Instr::REDUCE)
+        printf(" %s", x->opr == Lex::tGT ? "max" :
+            x->opr == Lex::tLT ? "min" : LEX.tokStr(x->opr));
+      if (x->op == Instr::CONST || x->op == Instr::PARAM
+          || x->op == Instr::CHECK)
+        printf(" %d", x->value);
+      if ((x->op == Instr::CALL || x->op == Instr::INVOKE) && x->value)
+        printf(" tail");
+      if (x->op == Instr::IN || x->op == Instr::OUT)
+        printf("%s", transferStr(x->value));
+      if (x->op == Instr::ALT && x->value)
+        printf(" rep");
+      if (x->op == Instr::SPAWN && x->value)
+        printf(" disjoint");
+      if (!x->name.empty())
+        printf(" %s", x->name.c_str());
+      for (size_t i = 0; i < x->args.size(); i++) {
+        printf("%s", i > 0 || !x->name.empty() ? ", " : " ");
+        if (x->op == Instr::PHI && i < b->preds.size())
+          printf("[%%%d, b%d]", x->args[i]->id, b->preds[i]->id);
+        else
+          printf("%%%d", x->args[i]->id);
+      }
+      if (x->op == Instr::BR || x->op == Instr::CBR || x->op == Instr::SWITCH)
+        for (auto s : b->succs)
+          printf(" b%d", s->id);
+      printf("\n");
+    }
+  }
+}
+
+void Module::print() {
+  for (auto f : functions) {
+    f->print();
+    printf("\n");
+  }
+}
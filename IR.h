@@ -0,0 +1,151 @@
+#ifndef IR_H
+#define IR_H
+
+#include "Lex.h"
+
+#include <list>
+#include <string>
+#include <vector>
+
+// Mid-level intermediate representation, between the tree and a backend.
+// Each definition is lowered to a function: a control flow graph of basic
+// blocks of instructions in static single assignment form. Scalar variables
+// are values, while arrays, channels and variables shared with other
+// processes are named memory, accessed by instructions with side effects.
+// Memory passed by reference is named by the parameter holding its address,
+// and other memory is allocated by the function that declares it.
+// Vector operations act on a number of lanes: a vector load or store
+// accesses that many consecutive elements from its last subscript.
+// Subscripts that are not proved to be within bounds are checked explicitly
+// before the access, or once before a loop for the extremes of its index.
+
+struct Block;
+
+struct Instr {
+  typedef enum {
+    // Values
+    CONST,
+    UNDEF,
+    PARAM,
+    PHI,
+    UNARY,
+    BINARY,
+    SELECT,
+    CALL,
+    // Vectors
+    SPLAT,
+    REDUCE,
+    // Memory
+    ALLOC,
+    ADDR,
+    LOAD,
+    STORE,
+    CHECK,
+    // Channels, servers and processes
+    IN,
+    OUT,
+    CONNECT,
+    ALT,
+    INVOKE,
+    SPAWN,
+    JOIN,
+    // Control
+    STOP,
+    BR,
+    CBR,
+    SWITCH,
+    RET
+  } Op;
+  // How an input or output transfers its data: a scalar value, a copy of a
+  // whole array or its storage, given by its address, a block of elements,
+  // given by the address of the first and their number, or one element of
+  // a loop whose transfers are coalesced through a buffer
+  typedef enum {
+    VALUE,
+    COPY,
+    MOVE,
+    BLOCK,
+    COALESCE
+  } Transfer;
+  Op op;
+  // The operator of a unary, binary or reduction operation, where a
+  // reduction by '>' or '<' is a maximum or minimum
+  Lex::Token opr;
+  // The value of a constant, the position of a parameter, the dimension a
+  // check is of, whether a call or invocation is a tail call, the transfer
+  // of an input or output, whether an alternative is replicated, or whether
+  // a spawned component is proved disjoint from those it runs in parallel
+  // with
+  int value;
+  // The number of lanes of a vector operation, otherwise 1
+  int width;
+  // The memory, channel or definition named
+  std::string name;
+  // The operands. The operands of a phi correspond to the block's
+  // predecessors, and the subscripts of a memory access or channel come
+  // before any value it stores or outputs. A switch takes the value it
+  // dispatches on then a constant for each target, and an allocation the
+  // length of each dimension. A check faults unless its subscript is at
+  // least zero and below the length that follows it, or when the length is
+  // not known here, below the length of that dimension of the memory named,
+  // which the backend supplies.
+  std::vector<Instr*> args;
+  // The instructions that use this one, built by Function::uses and kept
+  // by Function::replaceUses. They may include some that no longer do.
+  std::vector<Instr*> users;
+  Block *block;
+  int id;
+  Instr(Op o) :
+    op(o), opr(Lex::tERROR), value(0), width(1), block(nullptr), id(-1) {}
+  bool pure();
+  bool terminator();
+};
+
+struct Block {
+  int id;
+  std::list<Instr*> instrs;
+  std::vector<Block*> preds;
+  // The successors of a conditional branch are its true and false targets,
+  // and those of a switch are its default target then the target of each
+  // of its values, which a backend dispatches on with a jump table
+  std::vector<Block*> succs;
+  // The immediate dominator, set by Function::dominators
+  Block *idom;
+  // The interval of the block in a depth-first walk of the dominator tree,
+  // which contains those of the blocks it dominates, or -1 if unreachable
+  int pre, post;
+  Block(int i) :
+    id(i), idom(nullptr), pre(-1), post(-1) {}
+  Instr *terminator();
+};
+
+struct Function {
+  std::string name;
+  int numParams;
+  // The entry block is first
+  std::vector<Block*> blocks;
+  Function(const std::string &n) :
+    name(n), numParams(0), nextId(0), nextBlock(0) {}
+  Block *newBlock();
+  int newId() { return nextId++; }
+  void addEdge(Block *, Block *);
+  void removeEdge(Block *, Block *);
+  void uses();
+  void replaceUses(Instr *, Instr *);
+  bool removeUnreachable();
+  std::vector<Block*> order();
+  void dominators();
+  bool dominates(Block *, Block *);
+  void print();
+
+private:
+  int nextId;
+  int nextBlock;
+};
+
+struct Module {
+  std::vector<Function*> functions;
+  void print();
+};
+
+#endif
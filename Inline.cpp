@@ -0,0 +1,127 @@
+#include "Inline.h"
+#include "Clone.h"
+
+#include <vector>
+
+Inline Inline::instance;
+
+// Mark the functions of scalar values that refer to themselves to be
+// memoised
+void Inline::memoise(Tree *t) {
+  if (!memo)
+    return;
+  for (auto x : t->spec) {
+    if (x->type != Spec::DEF
+        || static_cast<Def*>(x)->defType != Def::FUNCTION)
+      continue;
+    FunctionDef *d = static_cast<FunctionDef*>(x);
+    bool scalar = true;
+    if (d->args != nullptr)
+      for (auto y : *d->args)
+        if (y->spef == nullptr || !y->spef->val
+            || y->spef->type != Spef::VAR || y->spef->lengths != nullptr)
+          scalar = false;
+    if (!scalar)
+      continue;
+    Clone clone;
+    clone.expr(d->expr);
+    if (clone.occurring().count(d->name->str))
+      d->memo = MEMO_SIZE;
+  }
+}
+
+// Whether an actual can be substituted for any number of uses of its formal
+static bool trivial(Expr *e) {
+  if (e->type == Expr::LITERAL)
+    return true;
+  if (e->type != Expr::ELEM)
+    return false;
+  Elem *x = static_cast<OperElem*>(e)->elem;
+  return x->type == Elem::NAME && x->subscripts == nullptr;
+}
+
+// Substitute a call of a function with its definition, unless the function
+// is too large or memoised, or the substitution would capture a name. The
+// shadowed names are those specified between the definition and the call.
+// An actual that is trivial or used once is substituted for its formal, and
+// any other is bound to it by an abbreviation in a valof, so it is evaluated
+// once, and still evaluated if it is not used. The size of the actuals
+// counts towards the size of the expansion.
+Expr *Inline::expand(FuncCall *c, const std::set<std::string> &shadowed) {
+  if (c->dispatch != Instance::DIRECT
+      || c->target->defType != Def::FUNCTION)
+    return nullptr;
+  FunctionDef *d = static_cast<FunctionDef*>(c->target);
+  size_t numArgs = d->args != nullptr ? d->args->size() : 0;
+  size_t numActuals = c->actuals != nullptr ? c->actuals->size() : 0;
+  if (d->memo > 0 || numArgs != numActuals)
+    return nullptr;
+  std::vector<Fml*> formals;
+  std::vector<Expr*> actuals;
+  if (d->args != nullptr) {
+    formals.assign(d->args->begin(), d->args->end());
+    actuals.assign(c->actuals->begin(), c->actuals->end());
+  }
+
+  // Check the names of the body and count the uses of each formal
+  Clone check;
+  std::set<std::string> names;
+  for (size_t i = 0; i < formals.size(); i++) {
+    check.bind(formals[i]->name->str, actuals[i]);
+    names.insert(formals[i]->name->str);
+  }
+  check.expr(d->expr);
+  for (auto x : check.occurring()) {
+    if (shadowed.count(x))
+      return nullptr;
+    if (names.count(x))
+      continue;
+    for (auto y : actuals)
+      if (usesName(y, x))
+        return nullptr;
+  }
+
+  // Decide how each actual is passed and measure the expansion
+  Clone clone;
+  std::vector<size_t> bound;
+  int size = check.size();
+  for (size_t i = 0; i < formals.size(); i++) {
+    Clone measure;
+    measure.expr(actuals[i]);
+    int uses = check.uses(formals[i]->name->str);
+    Spef *s = formals[i]->spef;
+    if (trivial(actuals[i]) || uses == 1) {
+      clone.bind(formals[i]->name->str, actuals[i]);
+      size += uses * (measure.size() - 1);
+    }
+    else if (s->val && s->type == Spef::VAR && s->lengths == nullptr) {
+      bound.push_back(i);
+      size += measure.size() + 1;
+    }
+    else
+      return nullptr;
+  }
+  if (size > INLINE_SIZE)
+    return nullptr;
+
+  // An abbreviation must not capture a name in another actual
+  for (auto i : bound)
+    for (size_t j = 0; j < actuals.size(); j++)
+      if (j != i && usesName(actuals[j], formals[i]->name->str))
+        return nullptr;
+
+  Expr *res = clone.expr(d->expr);
+  if (!bound.empty()) {
+    Cmd *body = new Skip();
+    for (auto i = bound.rbegin(); i != bound.rend(); ++i) {
+      Clone actual;
+      body = new CmdSpec(new ValAbbr(new Name(formals[*i]->name->str),
+          actual.expr(actuals[*i])), body);
+    }
+    return new OperValof(new Valof(body, res));
+  }
+  if (res->type == Expr::UNARY || res->type == Expr::BINARY
+      || res->type == Expr::NARY)
+    return new OperExpr(res);
+  return res;
+}
@@ -0,0 +1,35 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "Tree.h"
+
+#include <set>
+#include <string>
+
+#define INL Inline::get()
+
+// The maximum size in nodes of a function that is inlined
+#define INLINE_SIZE 32
+
+// The number of entries in the table memoising a function, a power of two
+#define MEMO_SIZE 4096
+
+// Function inlining: a call of a small function is replaced with its
+// definition, with each formal substituted by its actual. Optionally,
+// recursive functions of scalar values can instead be memoised in a bounded
+// table, since functions are free of side effects.
+class Inline {
+public:
+  static Inline instance;
+  static Inline &get() { return instance; }
+  Inline() : memo(false) {};
+  ~Inline() {};
+  void enableMemo() { memo = true; }
+  void memoise(Tree *);
+  Expr *expand(FuncCall *, const std::set<std::string> &);
+
+private:
+  bool memo;
+};
+
+#endif
@@ -0,0 +1,336 @@
+#include "Layout.h"
+
+Layout Layout::instance;
+
+void Layout::layout(Tree *t) {
+  for (auto x : t->spec) spec(x);
+  cmds(&t->prog);
+}
+
+// ============================================================================
+// Specifications
+// ============================================================================
+
+void Layout::spec(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      if (d->defType == Def::PROCESS)
+        process(static_cast<ProcessDef*>(d)->process);
+      else if (d->defType == Def::SERVER)
+        server(static_cast<ServerDef*>(d)->server);
+      else if (d->defType == Def::ISERVER)
+        spec(static_cast<InhrtServerDef*>(d)->hidingDecl);
+      break;
+    }
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      if (d->tDecl == Decl::HIDING) {
+        HidingDecl *x = static_cast<HidingDecl*>(d);
+        if (x->decls != nullptr)
+          for (auto y : *x->decls)
+            spec(y);
+      }
+      else if (d->tDecl == Decl::SERVER)
+        server(static_cast<ServerDecl*>(d)->server);
+      else if (d->tDecl == Decl::RSERVER)
+        server(static_cast<RepServerDecl*>(d)->server);
+      else if (d->tDecl == Decl::INITIAL) {
+        InitialDecl *x = static_cast<InitialDecl*>(d);
+        x->cmd = cmd(x->cmd);
+      }
+      break;
+    }
+  case Spec::ABBR:
+    break;
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      spec(x);
+    break;
+  }
+}
+
+void Layout::process(Process *p) {
+  if (p->type == Process::CMD) {
+    ProcessCmd *x = static_cast<ProcessCmd*>(p);
+    x->cmd = cmd(x->cmd);
+  }
+  else if (p->type == Process::SPEC) {
+    ProcessSpec *x = static_cast<ProcessSpec*>(p);
+    x->cmd = cmd(x->cmd);
+  }
+}
+
+void Layout::server(Server *s) {
+  if (s->type == Server::SPEC) {
+    ServerSpec *x = static_cast<ServerSpec*>(s);
+    if (x->decls != nullptr)
+      for (auto y : *x->decls)
+        spec(y);
+  }
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+void Layout::cmds(std::list<Cmd*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto &x : *l)
+    x = cmd(x);
+}
+
+// Return the command, or the allocation of its state if it is a replicated
+// par that has some
+Cmd *Layout::cmd(Cmd *c) {
+  if (c == nullptr)
+    return nullptr;
+  switch (c->type) {
+  default:
+    break;
+
+  case Cmd::SPEC: {
+      CmdSpec *x = static_cast<CmdSpec*>(c);
+      spec(x->spec);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::ALT:
+    if (static_cast<Alt*>(c)->altns != nullptr)
+      for (auto x : *static_cast<Alt*>(c)->altns)
+        altn(x);
+    break;
+
+  case Cmd::RALT:
+    altn(static_cast<RepAlt*>(c)->altn);
+    break;
+
+  case Cmd::TEST:
+    if (static_cast<Test*>(c)->choices != nullptr)
+      for (auto x : *static_cast<Test*>(c)->choices)
+        choice(x);
+    break;
+
+  case Cmd::RTEST:
+    choice(static_cast<RepTest*>(c)->choice);
+    break;
+
+  case Cmd::IFD: {
+      IfD *x = static_cast<IfD*>(c);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::IFTE: {
+      IfTE *x = static_cast<IfTE*>(c);
+      x->cmd = cmd(x->cmd);
+      x->elseCmd = cmd(x->elseCmd);
+      break;
+    }
+
+  case Cmd::CASE: {
+      Case *x = static_cast<Case*>(c);
+      if (x->selects != nullptr)
+        for (auto y : *x->selects)
+          y->cmd = cmd(y->cmd);
+      break;
+    }
+
+  case Cmd::RCASE: {
+      RepCase *x = static_cast<RepCase*>(c);
+      x->select->cmd = cmd(x->select->cmd);
+      break;
+    }
+
+  case Cmd::WHILE: {
+      While *x = static_cast<While*>(c);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::UNTIL: {
+      Until *x = static_cast<Until*>(c);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::DO: {
+      Do *x = static_cast<Do*>(c);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::SEQ:
+    cmds(static_cast<Seq*>(c)->cmds);
+    break;
+
+  case Cmd::PAR:
+    cmds(static_cast<Par*>(c)->cmds);
+    break;
+
+  case Cmd::RSEQ: {
+      RepSeq *x = static_cast<RepSeq*>(c);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::RPAR: {
+      RepPar *x = static_cast<RepPar*>(c);
+      x->cmd = cmd(x->cmd);
+      return family(x);
+    }
+  }
+  return c;
+}
+
+void Layout::altn(Altn *a) {
+  switch (a->type) {
+  case Altn::UNGUARDED:
+    static_cast<UnguardedAltn*>(a)->cmd =
+        cmd(static_cast<UnguardedAltn*>(a)->cmd);
+    break;
+  case Altn::GUARDED:
+    static_cast<GuardedAltn*>(a)->cmd =
+        cmd(static_cast<GuardedAltn*>(a)->cmd);
+    break;
+  case Altn::SKIP:
+    static_cast<SkipAltn*>(a)->cmd = cmd(static_cast<SkipAltn*>(a)->cmd);
+    break;
+  case Altn::NESTED:
+    cmd(static_cast<NestedAltn*>(a)->alt);
+    break;
+  case Altn::SPEC:
+    spec(static_cast<SpecAltn*>(a)->spec);
+    altn(static_cast<SpecAltn*>(a)->altn);
+    break;
+  }
+}
+
+void Layout::choice(Choice *c) {
+  switch (c->type) {
+  case Choice::GUARDED:
+    static_cast<GuardedChoice*>(c)->cmd =
+        cmd(static_cast<GuardedChoice*>(c)->cmd);
+    break;
+  case Choice::NESTED:
+    cmd(static_cast<NestedChoice*>(c)->test);
+    break;
+  case Choice::SPEC:
+    spec(static_cast<SpecChoice*>(c)->spec);
+    choice(static_cast<SpecChoice*>(c)->choice);
+    break;
+  }
+}
+
+// ============================================================================
+// Layout
+// ============================================================================
+
+static bool constant(Expr *e) {
+  return e == nullptr || e->type == Expr::LITERAL;
+}
+
+static int value(Expr *e, int dflt) {
+  if (e == nullptr)
+    return dflt;
+  return literalValue(static_cast<OperLiteral*>(e)->literal);
+}
+
+static Operand *operand(Expr *e) {
+  if (e->type == Expr::BINARY || e->type == Expr::UNARY
+      || e->type == Expr::NARY)
+    return new OperExpr(e);
+  return static_cast<Operand*>(e);
+}
+
+static Expr *literal(int n) {
+  return new OperLiteral(new DecIntLiteral(n));
+}
+
+// The position of an instance among the family, in row-major order of the
+// ranges, counting from zero.
+Expr *Layout::position(std::list<Range*> *ranges) {
+  Expr *pos = nullptr;
+  for (auto x : *ranges) {
+    int base = value(x->base, 0);
+    int step = value(x->step, 1);
+    Expr *e = new OperElem(new Name(x->name->str));
+    if (base != 0)
+      e = new BinaryOp(Lex::tSUB, operand(e), operand(literal(base)));
+    if (step != 1)
+      e = new BinaryOp(Lex::tDIV, operand(e), operand(literal(step)));
+    if (pos != nullptr)
+      e = new BinaryOp(Lex::tADD, operand(new BinaryOp(Lex::tMUL,
+          operand(pos), operand(literal(value(x->count, 0))))), operand(e));
+    pos = e;
+  }
+  return pos;
+}
+
+// Allocate the variables declared at the start of the body of a replicated
+// par for the whole family, when its ranges and the lengths of the
+// variables are constant. The declaration of each is replaced by an
+// abbreviation of its row, which unrolling and lowering then treat like any
+// other abbreviation of shared memory.
+Cmd *Layout::family(RepPar *c) {
+  int total = 1;
+  for (auto x : *c->ranges) {
+    if (!constant(x->base) || !constant(x->count) || !constant(x->step))
+      return c;
+    total *= value(x->count, 0);
+  }
+  if (total <= 1)
+    return c;
+  std::list<VarDecl*> decls;
+  Cmd **body = &c->cmd;
+  while ((*body)->type == Cmd::SPEC) {
+    CmdSpec *x = static_cast<CmdSpec*>(*body);
+    if (x->spec == nullptr || x->spec->type != Spec::DECL
+     || static_cast<Decl*>(x->spec)->tDecl != Decl::VAR)
+      break;
+    VarDecl *d = static_cast<VarDecl*>(x->spec);
+    if (d->spef->type != Spef::VAR || d->spef->kind != Spef::BASIC)
+      break;
+    bool fixed = true;
+    if (d->spef->lengths != nullptr)
+      for (auto y : *d->spef->lengths)
+        fixed = fixed && y->type == Expr::LITERAL;
+    if (!fixed)
+      break;
+    decls.push_back(d);
+    body = &x->cmd;
+  }
+  if (decls.empty())
+    return c;
+
+  // Replace each declaration with abbreviations of the rows of the instance
+  Cmd *res = c;
+  Cmd *rest = *body;
+  for (auto d = decls.rbegin(); d != decls.rend(); ++d) {
+    std::list<Name*> l;
+    if ((*d)->nameList)
+      l = *(*d)->names;
+    else
+      l.push_back((*d)->name);
+    for (auto n = l.rbegin(); n != l.rend(); ++n) {
+      std::string str = (*n)->str + ".soa";
+      std::list<Expr*> *lengths = new std::list<Expr*>();
+      lengths->push_back(literal(total));
+      if ((*d)->spef->lengths != nullptr)
+        for (auto y : *(*d)->spef->lengths)
+          lengths->push_back(y);
+      std::list<Expr*> *subs = new std::list<Expr*>();
+      subs->push_back(position(c->ranges));
+      rest = new CmdSpec(new VarAbbr(new Spef(Spef::VAR), (*n),
+          new Name(str, subs)), rest);
+      res = new CmdSpec(new VarDecl(new Spef(Spef::VAR, lengths),
+          new Name(str)), res);
+    }
+  }
+  c->cmd = rest;
+  return res;
+}
@@ -0,0 +1,36 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "Tree.h"
+
+#include <list>
+
+#define LAY Layout::get()
+
+// Structure-of-arrays layout: the variables declared at the start of the
+// body of a replicated par whose ranges are constant are replaced by a
+// single allocation for the whole family, enclosing the par, with one row
+// for each instance. Each instance abbreviates its own row, so every
+// variable is contiguous across the instances of the family rather than
+// held in a separate frame for each of them.
+class Layout {
+public:
+  static Layout instance;
+  static Layout &get() { return instance; }
+  Layout() {};
+  ~Layout() {};
+  void layout(Tree *);
+
+private:
+  void spec(Spec *);
+  void process(Process *);
+  void server(Server *);
+  Cmd *cmd(Cmd *);
+  void altn(Altn *);
+  void choice(Choice *);
+  void cmds(std::list<Cmd*> *);
+  Cmd *family(RepPar *);
+  Expr *position(std::list<Range*> *);
+};
+
+#endif
@@ -1,8 +1,11 @@
 #include "Lex.h"
 #include "Table.h"
 #include "Error.h"
+#include "Dump.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 Lex Lex::instance;
 
@@ -14,26 +17,23 @@ void Lex::init(FILE *p) {
 
 Lex::Token Lex::readToken() {
   Lex::Token tok;
-  switch(ch) {
-
-  // Newlines (skip)
-  case '\n':
-    lineNum++;
-    readChar();
-    return readToken();
-
-  // Whitespace (skip)
-  case '\r': case '\t': case ' ':
-    do readChar(); while(ch=='\r' || ch=='\t' || ch==' ');
-    return readToken();
 
-  // Comment: #.* (skip)
-  case '#':
-    do readChar(); while (ch!=EOF && ch!='\n');
-    if(ch=='\n')
+  // Skip newlines, whitespace and comments (#.*)
+  while (true) {
+    if (ch=='\n') {
       lineNum++;
-    readChar();
-    return readToken();
+      readChar();
+    }
+    else if (ch=='\r' || ch=='\t' || ch==' ')
+      readChar();
+    else if (ch=='#') {
+      do readChar(); while (ch!=EOF && ch!='\n');
+    }
+    else
+      break;
+  }
+
+  switch(ch) {
 
   // Number literal: [0-9]+
   case '1': case '2': case '3': case '4': case '5':
@@ -45,20 +45,27 @@ Lex::Token Lex::readToken() {
   case '0':
     readChar();
     if (ch=='x') {
+      readChar();
       readHexInt();
-      tok = tHEXINT;
-      break;
+      return tHEXINT;
     }
     if (ch=='o') {
+      readChar();
       readOctInt();
-      tok = tOCTINT;
-      break;
+      return tOCTINT;
     }
     if (ch=='b') {
+      readChar();
       readBinInt();
-      tok = tBININT;
-      break;
+      return tBININT;
     }
+    if ('0'<=ch && ch<='9') {
+      readDecInt();
+      return tDECINT;
+    }
+    s = "0";
+    value = 0;
+    return tDECINT;
 
   // Name: [a-zA-Z][a-zA-Z0-9]*
   case 'a': case 'b': case 'c': case 'd': case 'e':
@@ -125,6 +132,7 @@ Lex::Token Lex::readToken() {
     return tAND;
 
   case '|':
+    readChar();
     if(ch=='|') { tok = tLOR; break; }
     return tOR;
 
@@ -159,20 +167,22 @@ Lex::Token Lex::readToken() {
 }
 
 void Lex::printToken(Token t) {
-  printf("token %3d %s ", (int) t, tokStr(t));
-  if(t == Lex::tNAME)   printf("%s", s.c_str());
-  if(t == Lex::tSTR)    printf("%s", s.c_str());
-  if(t == Lex::tDECINT) printf("%d", value);
-  if(t == Lex::tHEXINT) printf("%x", value);
-  if(t == Lex::tOCTINT) printf("%o", value);
+  char v[BUF_SIZE+1];
+  v[0] = '\0';
+  if(t == Lex::tDECINT) snprintf(v, sizeof(v), "%d", value);
+  if(t == Lex::tHEXINT) snprintf(v, sizeof(v), "%x", value);
+  if(t == Lex::tOCTINT) snprintf(v, sizeof(v), "%o", value);
   if(t == Lex::tBININT) {
     int val = value;
-    char s[BUF_SIZE+1];
-    char *p = s + BUF_SIZE;
+    char *p = v + BUF_SIZE;
+    *p = '\0';
     do { *--p = '0' + (val & 1); } while (val >>= 1);
-    printf("%s", s);
+    memmove(v, p, v + BUF_SIZE + 1 - p);
   }
-  printf("\n");
+  if(t == Lex::tNAME || t == Lex::tSTR)
+    DUMP.token((int) t, tokStr(t), s);
+  else
+    DUMP.token((int) t, tokStr(t), v);
 }
 
 void Lex::readChar() {
@@ -310,6 +320,7 @@ void Lex::declareKeywords() {
 }
 
 void Lex::error(const char *msg) {
+  DUMP.flush();
   printf("Error near line %d: %s\n", lineNum, msg);
   printChBuf();
   ERR.record();
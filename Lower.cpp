@@ -0,0 +1,2247 @@
+#include "Lower.h"
+#include "Visitor.h"
+
+#include <algorithm>
+
+Lower Lower::instance;
+
+// Whether a formal takes a scalar value rather than a reference
+static bool byValue(Fml *f) {
+  return f->spef->val
+      && f->spef->type == Spef::VAR
+      && f->spef->lengths == nullptr;
+}
+
+// Whether evaluating an expression may fault, so it must not be evaluated
+// unless its value is needed
+static bool mayFault(Expr *e) {
+  switch (e->type) {
+  default:
+    return false;
+
+  case Expr::ELEM: {
+      Elem *x = static_cast<OperElem*>(e)->elem;
+      return x->subscripts != nullptr || x->type == Elem::CALL;
+    }
+
+  case Expr::VALOF:
+    return true;
+
+  case Expr::EXPR:
+    return mayFault(static_cast<OperExpr*>(e)->expr);
+
+  case Expr::UNARY:
+    return mayFault(static_cast<UnaryOp*>(e)->operand);
+
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(e);
+      return x->op == Lex::tDIV || x->op == Lex::tREM
+          || mayFault(x->left) || mayFault(x->right);
+    }
+
+  case Expr::NARY:
+    for (auto x : *static_cast<NaryOp*>(e)->operands)
+      if (mayFault(x))
+        return true;
+    return false;
+  }
+}
+
+Module *Lower::lower(Tree *t) {
+  module = new Module();
+  names.clear();
+  suffixes.clear();
+  servers.clear();
+  frame = nullptr;
+  for (auto x : t->spec)
+    reserve(x);
+  Frame f;
+  Frame *outer = open(unique("main"), f, false);
+  for (auto x : t->spec) share(x);
+  for (auto x : t->prog) share(x);
+  for (auto x : t->spec) spec(x);
+  for (auto x : t->prog) cmd(x);
+  close(outer, nullptr);
+  return module;
+}
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+// Start lowering a function. The memory in scope stays visible, and the
+// values that abbreviations of it fix and its lengths are either
+// rematerialised, when they are constant, or captured as parameters.
+Lower::Frame *Lower::open(const std::string &name, Frame &f, bool capture) {
+  f.fn = new Function(name);
+  module->functions.push_back(f.fn);
+  f.cur = f.fn->newBlock();
+  f.sealed.insert(f.cur);
+  f.memo = nullptr;
+  Frame *outer = frame;
+  frame = &f;
+  if (outer == nullptr)
+    return outer;
+  for (auto &x : outer->scope) {
+    if (x.key >= 0)
+      continue;
+    Var v{x.name, -1, x.mem, std::vector<Instr*>(), std::vector<Instr*>()};
+    bool valid = true;
+    for (auto y : x.prefix) {
+      v.prefix.push_back(import(y, capture));
+      if (v.prefix.back() == nullptr)
+        valid = false;
+    }
+    for (auto y : x.lengths)
+      v.lengths.push_back(y != nullptr ? import(y, capture) : nullptr);
+    if (valid)
+      f.scope.push_back(v);
+  }
+  return outer;
+}
+
+// A value of the enclosing function in the function being opened, or null
+// if it can't be captured
+Instr *Lower::import(Instr *x, bool capture) {
+  if (x->op == Instr::CONST)
+    return constant(x->value);
+  if (!capture)
+    return nullptr;
+  Instr *p = emit(Instr::PARAM);
+  p->value = frame->fn->numParams++;
+  frame->captured.push_back(x);
+  return p;
+}
+
+void Lower::close(Frame *outer, Instr *result) {
+  Instr *x = emit(Instr::RET);
+  if (result != nullptr)
+    x->args.push_back(result);
+  frame->fn->removeUnreachable();
+  frame = outer;
+}
+
+std::string Lower::unique(const std::string &name) {
+  std::string s = name;
+  int &i = suffixes[name];
+  while (names.count(s))
+    s = name + "." + std::to_string(++i);
+  names.insert(s);
+  return s;
+}
+
+// Reserve the names of the top-level definitions for their functions
+void Lower::reserve(Spec *s) {
+  if (s->type == Spec::SSPEC) {
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      reserve(x);
+  }
+  else if (s->type == Spec::DEF)
+    names.insert(s->name->str);
+}
+
+// Lower a component of a parallel to a function of its replicator indices
+// and of the values it captures, which are returned in args
+std::string Lower::outline(Cmd *c, std::list<Range*> *ranges,
+    std::vector<Instr*> &args) {
+  Frame f;
+  Frame *outer = open(unique(frame->fn->name + ".par"), f, true);
+  share(c);
+  if (ranges != nullptr) {
+    for (auto x : *ranges) {
+      Instr *p = emit(Instr::PARAM);
+      p->value = frame->fn->numParams++;
+      bind(x->name->str, p);
+    }
+  }
+  cmd(c);
+  std::string name = frame->fn->name;
+  args = frame->captured;
+  close(outer, nullptr);
+  return name;
+}
+
+// Construct the instances of a replicated server at a range of positions,
+// given the address of the array of them. While there are more than a few,
+// the range is halved and each half is constructed in parallel, so every
+// instance is initialised and spawned by a worker close to the one it runs
+// on and touches its state first there, and the time to construct them all
+// scales with the number of workers. The actuals of each instance are
+// evaluated with the replicator indices bound to its position.
+std::string Lower::construct(Server *s, const std::string &server,
+    const std::string &mem, std::list<Range*> *ranges,
+    std::list<Expr*> *actuals) {
+  Frame f;
+  Frame *outer = open(unique(server + ".init"), f, false);
+  std::string name = frame->fn->name;
+  std::vector<Instr*> args;
+  for (size_t i = 0; i < 3; i++) {
+    Instr *p = emit(Instr::PARAM);
+    p->value = frame->fn->numParams++;
+    args.push_back(p);
+  }
+  Instr *base = args[1];
+  Instr *count = args[2];
+  args.resize(1);
+  Block *split = block();
+  Block *leaf = block();
+  Block *done = block();
+  branch(binary(Lex::tGT, count, constant(SPAWN_GRAIN)), split, leaf);
+  seal(split);
+  seal(leaf);
+
+  // Construct the first half in parallel with the second
+  enter(split);
+  Instr *half = binary(Lex::tRSH, count, constant(1));
+  std::vector<Instr*> first(args);
+  first.push_back(base);
+  first.push_back(half);
+  emit(Instr::SPAWN, first)->name = name;
+  std::vector<Instr*> second(args);
+  second.push_back(binary(Lex::tADD, base, half));
+  second.push_back(binary(Lex::tSUB, count, half));
+  emit(Instr::INVOKE, second)->name = name;
+  emit(Instr::JOIN);
+  jump(done);
+
+  // Spawn each instance of a small range
+  enter(leaf);
+  int i = temp();
+  write(i, frame->cur, constant(0));
+  Block *head = block();
+  Block *body = block();
+  jump(head);
+  enter(head);
+  Instr *k = read(i, head);
+  branch(binary(Lex::tLT, k, count), body, done);
+  seal(body);
+  enter(body);
+  Instr *pos = binary(Lex::tADD, base, k);
+  Instr *stride = constant(1);
+  std::vector<Instr*> prefix;
+  for (auto x = ranges->rbegin(); x != ranges->rend(); ++x) {
+    Instr *n = value((*x)->count);
+    Instr *j = binary(Lex::tDIV, pos, stride);
+    if (std::next(x) != ranges->rend())
+      j = binary(Lex::tREM, j, n);
+    prefix.insert(prefix.begin(), j);
+    if ((*x)->step != nullptr)
+      j = binary(Lex::tMUL, j, value((*x)->step));
+    bind((*x)->name->str, binary(Lex::tADD, value((*x)->base), j));
+    stride = binary(Lex::tMUL, stride, n);
+  }
+  std::vector<Instr*> v = values(actuals);
+  initial(s, mem, prefix, actuals, v);
+  std::vector<Instr*> instance(args);
+  instance.insert(instance.end(), v.begin(), v.end());
+  instance.push_back(pos);
+  emit(Instr::SPAWN, instance)->name = server;
+  write(i, frame->cur, binary(Lex::tADD, read(i, frame->cur), constant(1)));
+  jump(head);
+  seal(head);
+  seal(done);
+  enter(done);
+  close(outer, nullptr);
+  return name;
+}
+
+// Run the initial declarations of an instance of a server, before it is
+// spawned. Its state is the memory of its declarations, at the subscripts
+// of its position in an array of instances, and its formals are bound to
+// the actuals it is given as an abbreviation would be. Every name in a
+// definition is shared where it is specified, so the names the initial
+// commands declare are shared again for them alone.
+void Lower::initial(Server *s, const std::string &mem,
+    const std::vector<Instr*> &prefix, std::list<Expr*> *actuals,
+    const std::vector<Instr*> &args) {
+  std::list<Fml*> *fmls = nullptr;
+  if (s->type == Server::INSTANCE) {
+    auto x = servers.find(static_cast<ServerInstance*>(s)->name->str);
+    if (x == servers.end() || x->second->server->type != Server::SPEC)
+      return;
+    fmls = x->second->args;
+    s = x->second->server;
+  }
+  std::list<Spec*> *decls = static_cast<ServerSpec*>(s)->decls;
+  bool any = false;
+  if (decls != nullptr)
+    for (auto x : *decls)
+      if (x->type == Spec::DECL
+          && static_cast<Decl*>(x)->tDecl == Decl::INITIAL)
+        any = true;
+  if (!any)
+    return;
+  size_t n = frame->scope.size();
+  std::set<std::string> shared;
+  shared.swap(frame->shared);
+  if (fmls != nullptr && actuals != nullptr) {
+    auto a = actuals->begin();
+    auto v = args.begin();
+    for (auto x : *fmls) {
+      if (a == actuals->end())
+        break;
+      if (byValue(x) || (*a)->type != Expr::ELEM)
+        bind(x->name->str, *v);
+      else {
+        Elem *e = static_cast<OperElem*>(*a)->elem;
+        std::vector<Instr*> subs;
+        std::string m = location(e, subs);
+        std::vector<Instr*> l;
+        if (e->type == Elem::NAME)
+          l = lookup(static_cast<Name*>(e)->str).lengths;
+        frame->scope.push_back(Var{x->name->str, -1, m, subs, l});
+      }
+      ++a;
+      ++v;
+    }
+  }
+  state(decls, mem, prefix);
+  frame->scope.resize(n);
+  frame->shared.swap(shared);
+}
+
+// Bind the declarations of a server to its state, and run its initial
+// commands in order
+void Lower::state(std::list<Spec*> *l, const std::string &mem,
+    const std::vector<Instr*> &prefix) {
+  for (auto x : *l) {
+    switch (x->type) {
+    default:
+      break;
+
+    case Spec::DECL: {
+        Decl *d = static_cast<Decl*>(x);
+        if (d->tDecl == Decl::INITIAL) {
+          share(static_cast<InitialDecl*>(d)->cmd);
+          cmd(static_cast<InitialDecl*>(d)->cmd);
+          break;
+        }
+        if (d->tDecl != Decl::VAR)
+          break;
+        std::list<Name*> names;
+        if (d->nameList)
+          names = *d->names;
+        else
+          names.push_back(d->name);
+        Spef *spef = static_cast<VarDecl*>(d)->spef;
+        for (auto y : names)
+          frame->scope.push_back(Var{y->str, -1, mem + "." + y->str, prefix,
+              lengths(spef->lengths)});
+        break;
+      }
+
+    case Spec::ABBR:
+      if (static_cast<Abbr*>(x)->type == Abbr::VAL)
+        spec(x);
+      break;
+
+    case Spec::SSPEC:
+      state(static_cast<SimSpec*>(x)->specs, mem, prefix);
+      break;
+    }
+  }
+}
+
+// Servers have no handlers to lower, so only processes and functions
+// become functions. The initial declarations of a server are lowered where
+// each instance of it is constructed.
+void Lower::def(Def *d) {
+  Frame f;
+  switch (d->defType) {
+  default:
+    break;
+
+  case Def::SERVER:
+    servers[d->name->str] = static_cast<ServerDef*>(d);
+    break;
+
+  case Def::PROCESS: {
+      Process *p = static_cast<ProcessDef*>(d)->process;
+      Frame *outer = open(d->name->str, f, false);
+      share(p);
+      formals(d->args);
+      process(p);
+      close(outer, nullptr);
+      break;
+    }
+
+  case Def::FUNCTION: {
+      if (static_cast<FunctionDef*>(d)->memo > 0) {
+        memoised(static_cast<FunctionDef*>(d));
+        break;
+      }
+      Expr *e = static_cast<FunctionDef*>(d)->expr;
+      Frame *outer = open(d->name->str, f, false);
+      share(e);
+      formals(d->args);
+      close(outer, value(e));
+      break;
+    }
+  }
+}
+
+// A memoised function allocates a table, clears it and passes it to a worker
+// with the actuals. Each entry of the table holds whether it is valid, the
+// actuals it was computed for and the result, and is indexed by a hash of
+// the actuals. The worker returns the result from the entry if it matches,
+// otherwise it computes the result, with its recursive calls passed the same
+// table, and replaces the entry.
+void Lower::memoised(FunctionDef *d) {
+  int n = d->args != nullptr ? d->args->size() : 0;
+  std::string worker = unique(d->name->str + ".memo");
+  Frame f;
+  Frame *outer = open(d->name->str, f, false);
+  std::string table = unique("table");
+  std::vector<Instr*> lengths;
+  lengths.push_back(constant(d->memo));
+  lengths.push_back(constant(n + 2));
+  emit(Instr::ALLOC, lengths)->name = table;
+  int i = temp();
+  write(i, frame->cur, constant(0));
+  Block *head = block();
+  Block *body = block();
+  Block *done = block();
+  jump(head);
+  enter(head);
+  Instr *k = read(i, head);
+  branch(binary(Lex::tLT, k, constant(d->memo)), body, done);
+  seal(body);
+  enter(body);
+  std::vector<Instr*> clear;
+  clear.push_back(k);
+  clear.push_back(constant(0));
+  clear.push_back(constant(0));
+  emit(Instr::STORE, clear)->name = table;
+  write(i, frame->cur, binary(Lex::tADD, k, constant(1)));
+  jump(head);
+  seal(head);
+  seal(done);
+  enter(done);
+  Instr *a = emit(Instr::ADDR);
+  a->name = table;
+  std::vector<Instr*> args(1, a);
+  for (int j = 0; j < n; j++) {
+    Instr *p = emit(Instr::PARAM);
+    p->value = frame->fn->numParams++;
+    args.push_back(p);
+  }
+  Instr *call = emit(Instr::CALL, args);
+  call->name = worker;
+  close(outer, call);
+
+  Frame g;
+  outer = open(worker, g, false);
+  Instr *p = emit(Instr::PARAM);
+  p->value = frame->fn->numParams++;
+  p->name = unique("table");
+  frame->memo = d;
+  frame->table = p->name;
+  frame->worker = worker;
+  share(d->expr);
+  formals(d->args);
+  std::vector<Instr*> actuals;
+  Instr *h = constant(0);
+  if (d->args != nullptr) {
+    for (auto x : *d->args) {
+      actuals.push_back(fetch(lookup(x->name->str), std::vector<Instr*>()));
+      h = binary(Lex::tADD, binary(Lex::tMUL, h, constant(31)),
+          actuals.back());
+    }
+  }
+  h = binary(Lex::tAND, h, constant(d->memo - 1));
+  std::vector<Instr*> field(1, h);
+  field.push_back(constant(0));
+  Instr *v = emit(Instr::LOAD, field);
+  v->name = frame->table;
+  Instr *hit = binary(Lex::tNEQ, v, constant(0));
+  for (int j = 0; j < n; j++) {
+    field[1] = constant(j + 1);
+    Instr *key = emit(Instr::LOAD, field);
+    key->name = frame->table;
+    hit = binary(Lex::tAND, hit, binary(Lex::tEQ, key, actuals[j]));
+  }
+  Block *found = block();
+  Block *miss = block();
+  branch(hit, found, miss);
+  seal(found);
+  seal(miss);
+  enter(found);
+  field[1] = constant(n + 1);
+  Instr *r = emit(Instr::LOAD, field);
+  r->name = frame->table;
+  emit(Instr::RET, std::vector<Instr*>(1, r));
+  enter(miss);
+  Instr *result = value(d->expr);
+  std::vector<Instr*> entry(1, h);
+  entry.push_back(constant(0));
+  entry.push_back(constant(1));
+  emit(Instr::STORE, entry)->name = frame->table;
+  for (int j = 0; j <= n; j++) {
+    entry[1] = constant(j + 1);
+    entry[2] = j < n ? actuals[j] : result;
+    emit(Instr::STORE, entry)->name = frame->table;
+  }
+  close(outer, result);
+}
+
+// A scalar value formal is a value; any other formal is the address of the
+// memory it refers to
+void Lower::formals(std::list<Fml*> *l) {
+  if (l == nullptr)
+    return;
+  std::vector<std::pair<size_t, Spef*>> arrays;
+  for (auto x : *l) {
+    Instr *p = emit(Instr::PARAM);
+    p->value = frame->fn->numParams++;
+    if (byValue(x))
+      bind(x->name->str, p);
+    else {
+      p->name = unique(x->name->str);
+      memory(x->name->str, p->name);
+      arrays.push_back(std::make_pair(frame->scope.size() - 1, x->spef));
+    }
+  }
+  // Lengths may refer to any of the formals
+  for (auto &x : arrays)
+    frame->scope[x.first].lengths = lengths(x.second->lengths);
+}
+
+// ============================================================================
+// Names and SSA construction
+// ============================================================================
+
+// A variable with no name, for values computed during lowering
+int Lower::temp() {
+  frame->defs.push_back(std::map<Block*, Instr*>());
+  return frame->defs.size() - 1;
+}
+
+int Lower::declare(const std::string &name) {
+  int key = temp();
+  frame->scope.push_back(Var{name, key, "", std::vector<Instr*>()});
+  return key;
+}
+
+void Lower::memory(const std::string &name, const std::string &mem,
+    const std::vector<Instr*> &lengths) {
+  frame->scope.push_back(Var{name, -1, mem, std::vector<Instr*>(), lengths});
+}
+
+// Bind a name to a value, which is stored if the name is shared
+void Lower::bind(const std::string &name, Instr *v) {
+  if (frame->shared.count(name)) {
+    std::string mem = unique(name);
+    memory(name, mem);
+    emit(Instr::ALLOC)->name = mem;
+    Instr *x = emit(Instr::STORE, std::vector<Instr*>(1, v));
+    x->name = mem;
+  }
+  else
+    write(declare(name), frame->cur, v);
+}
+
+// Names that are not in scope refer to memory of the same name
+Lower::Var Lower::lookup(const std::string &name) {
+  for (auto x = frame->scope.rbegin(); x != frame->scope.rend(); ++x)
+    if (x->name == name)
+      return *x;
+  return Var{name, -1, name, std::vector<Instr*>()};
+}
+
+void Lower::assign(const Var &v, std::vector<Instr*> subs, Instr *x) {
+  if (v.key >= 0 && subs.empty()) {
+    write(v.key, frame->cur, x);
+    return;
+  }
+  std::vector<Instr*> args(v.prefix);
+  args.insert(args.end(), subs.begin(), subs.end());
+  args.push_back(x);
+  Instr *s = emit(Instr::STORE, args);
+  s->name = v.mem.empty() ? v.name : v.mem;
+}
+
+Instr *Lower::fetch(const Var &v, std::vector<Instr*> subs) {
+  if (v.key >= 0 && subs.empty())
+    return read(v.key, frame->cur);
+  std::vector<Instr*> args(v.prefix);
+  args.insert(args.end(), subs.begin(), subs.end());
+  Instr *x = emit(Instr::LOAD, args);
+  x->name = v.mem.empty() ? v.name : v.mem;
+  return x;
+}
+
+void Lower::write(int key, Block *b, Instr *v) {
+  frame->defs[key][b] = v;
+}
+
+// Find the definition of a variable reaching a block, placing phis where
+// definitions join. Operands of phis in blocks whose predecessors are not
+// all known yet are added when the block is sealed.
+Instr *Lower::read(int key, Block *b) {
+  auto d = frame->defs[key].find(b);
+  if (d != frame->defs[key].end())
+    return d->second;
+  Instr *v;
+  if (!frame->sealed.count(b)) {
+    v = phi(b);
+    frame->incomplete[b].push_back(std::make_pair(key, v));
+  }
+  else if (b->preds.size() == 1)
+    v = read(key, b->preds.front());
+  else if (b->preds.empty())
+    v = undef(b);
+  else {
+    v = phi(b);
+    write(key, b, v);
+    v = operands(key, v);
+  }
+  write(key, b, v);
+  return v;
+}
+
+Instr *Lower::phi(Block *b) {
+  Instr *x = new Instr(Instr::PHI);
+  x->id = frame->fn->newId();
+  x->block = b;
+  auto i = b->instrs.begin();
+  while (i != b->instrs.end() && (*i)->op == Instr::PHI)
+    ++i;
+  b->instrs.insert(i, x);
+  return x;
+}
+
+Instr *Lower::undef(Block *b) {
+  Instr *x = phi(b);
+  x->op = Instr::UNDEF;
+  return x;
+}
+
+// Add the operands of a phi and remove it if it only has one distinct
+// operand other than itself, returning the value that replaces it
+Instr *Lower::operands(int key, Instr *x) {
+  for (auto p : x->block->preds)
+    x->args.push_back(read(key, p));
+  Instr *same = nullptr;
+  for (auto y : x->args) {
+    if (y == same || y == x)
+      continue;
+    if (same != nullptr)
+      return x;
+    same = y;
+  }
+  if (same == nullptr)
+    same = undef(x->block);
+  frame->fn->uses();
+  frame->fn->replaceUses(x, same);
+  for (auto &d : frame->defs)
+    for (auto &y : d)
+      if (y.second == x)
+        y.second = same;
+  x->block->instrs.remove(x);
+  return same;
+}
+
+// All the predecessors of a block are known
+void Lower::seal(Block *b) {
+  auto i = frame->incomplete.find(b);
+  if (i != frame->incomplete.end()) {
+    for (auto &x : i->second)
+      operands(x.first, x.second);
+    frame->incomplete.erase(i);
+  }
+  frame->sealed.insert(b);
+}
+
+// ============================================================================
+// Shared names: names used by another function or passed by reference are
+// memory. Within a shareAll, every name used is shared.
+// ============================================================================
+
+void Lower::shareAll(Cmd *c) {
+  all++;
+  share(c);
+  all--;
+}
+
+void Lower::share(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      all++;
+      if (d->defType == Def::PROCESS)
+        share(static_cast<ProcessDef*>(d)->process);
+      else if (d->defType == Def::SERVER)
+        share(static_cast<ServerDef*>(d)->server, false);
+      else if (d->defType == Def::FUNCTION)
+        share(static_cast<FunctionDef*>(d)->expr);
+      all--;
+      break;
+    }
+
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      switch (d->tDecl) {
+      default:
+        break;
+      case Decl::VAR: {
+          Spef *x = static_cast<VarDecl*>(d)->spef;
+          if (x->lengths != nullptr)
+            for (auto y : *x->lengths)
+              if (y != nullptr)
+                share(y);
+          break;
+        }
+      case Decl::HIDING: {
+          HidingDecl *x = static_cast<HidingDecl*>(d);
+          if (x->decls != nullptr)
+            for (auto y : *x->decls)
+              share(y);
+          break;
+        }
+      case Decl::SERVER:
+        share(static_cast<ServerDecl*>(d)->server, false);
+        break;
+      case Decl::RSERVER:
+        share(static_cast<RepServerDecl*>(d)->exprs);
+        share(static_cast<RepServerDecl*>(d)->server, true);
+        break;
+      }
+      break;
+    }
+
+  // An abbreviation of a scalar is the same variable, so it is shared in
+  // case the abbreviation is
+  case Spec::ABBR: {
+      Abbr *a = static_cast<Abbr*>(s);
+      if (a->type == Abbr::VAL)
+        share(a->expr);
+      else {
+        all++;
+        share(a->elem);
+        all--;
+      }
+      break;
+    }
+
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      share(x);
+    break;
+  }
+}
+
+void Lower::share(Process *p) {
+  switch (p->type) {
+  case Process::CMD:
+    share(static_cast<ProcessCmd*>(p)->cmd);
+    break;
+
+  case Process::SPEC:
+    share(static_cast<ProcessSpec*>(p)->cmd);
+    break;
+
+  case Process::INSTANCE: {
+      ProcessInstance *x = static_cast<ProcessInstance*>(p);
+      share(x->actuals, x->dispatch == Instance::DIRECT ? x->target : nullptr);
+      break;
+    }
+  }
+}
+
+// The state of a server is shared with its calls. Its initial declarations
+// run where it is constructed, which is in place unless it is replicated.
+void Lower::share(Server *s, bool replicated) {
+  if (s->type != Server::SPEC) {
+    all++;
+    share(static_cast<ServerInstance*>(s)->actuals, nullptr);
+    all--;
+    return;
+  }
+  ServerSpec *x = static_cast<ServerSpec*>(s);
+  if (x->decls == nullptr)
+    return;
+  for (auto y : *x->decls) {
+    if (y->type != Spec::DECL
+        || static_cast<Decl*>(y)->tDecl != Decl::INITIAL) {
+      all++;
+      share(y);
+      all--;
+    }
+    else if (replicated)
+      shareAll(static_cast<InitialDecl*>(y)->cmd);
+    else
+      share(static_cast<InitialDecl*>(y)->cmd);
+  }
+}
+
+void Lower::share(Cmd *c) {
+  if (c == nullptr)
+    return;
+  switch (c->type) {
+  default:
+    break;
+
+  case Cmd::SPEC:
+    share(static_cast<CmdSpec*>(c)->spec);
+    share(static_cast<CmdSpec*>(c)->cmd);
+    break;
+
+  case Cmd::INSTANCE: {
+      Instance *x = static_cast<Instance*>(c);
+      share(x->actuals, x->dispatch == Instance::DIRECT ? x->target : nullptr);
+      break;
+    }
+
+  case Cmd::CALL:
+    share(static_cast<Call*>(c)->actuals, nullptr);
+    break;
+
+  case Cmd::ASS:
+    share(static_cast<Ass*>(c)->lhs);
+    share(static_cast<Ass*>(c)->rhs);
+    break;
+
+  case Cmd::IN:
+    share(static_cast<In*>(c)->lhs);
+    share(static_cast<In*>(c)->rhs);
+    break;
+
+  case Cmd::OUT:
+    share(static_cast<Out*>(c)->lhs);
+    share(static_cast<Out*>(c)->rhs);
+    break;
+
+  case Cmd::CONNECT:
+    share(static_cast<Connect*>(c)->local);
+    share(static_cast<Connect*>(c)->remote);
+    break;
+
+  case Cmd::ALT:
+    if (static_cast<Alt*>(c)->altns != nullptr)
+      for (auto x : *static_cast<Alt*>(c)->altns)
+        share(x);
+    break;
+
+  case Cmd::RALT:
+    share(static_cast<RepAlt*>(c)->ranges);
+    share(static_cast<RepAlt*>(c)->altn);
+    break;
+
+  case Cmd::TEST:
+    if (static_cast<Test*>(c)->choices != nullptr)
+      for (auto x : *static_cast<Test*>(c)->choices)
+        share(x);
+    break;
+
+  case Cmd::RTEST:
+    share(static_cast<RepTest*>(c)->ranges);
+    share(static_cast<RepTest*>(c)->choice);
+    break;
+
+  case Cmd::IFD:
+    share(static_cast<IfD*>(c)->expr);
+    share(static_cast<IfD*>(c)->cmd);
+    break;
+
+  case Cmd::IFTE:
+    share(static_cast<IfTE*>(c)->expr);
+    share(static_cast<IfTE*>(c)->cmd);
+    share(static_cast<IfTE*>(c)->elseCmd);
+    break;
+
+  case Cmd::CASE:
+    share(static_cast<Case*>(c)->expr);
+    if (static_cast<Case*>(c)->selects != nullptr)
+      for (auto x : *static_cast<Case*>(c)->selects)
+        share(x);
+    break;
+
+  case Cmd::RCASE:
+    share(static_cast<RepCase*>(c)->expr);
+    share(static_cast<RepCase*>(c)->ranges);
+    share(static_cast<RepCase*>(c)->select);
+    break;
+
+  case Cmd::WHILE:
+    share(static_cast<While*>(c)->expr);
+    share(static_cast<While*>(c)->cmd);
+    break;
+
+  case Cmd::UNTIL:
+    share(static_cast<Until*>(c)->expr);
+    share(static_cast<Until*>(c)->cmd);
+    break;
+
+  case Cmd::DO:
+    share(static_cast<Do*>(c)->cmd);
+    share(static_cast<Do*>(c)->expr);
+    break;
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds)
+      share(x);
+    break;
+
+  case Cmd::RSEQ:
+    share(static_cast<RepSeq*>(c)->ranges);
+    share(static_cast<RepSeq*>(c)->cmd);
+    break;
+
+  case Cmd::PAR:
+    for (auto x : *static_cast<Par*>(c)->cmds)
+      shareAll(x);
+    break;
+
+  case Cmd::RPAR:
+    share(static_cast<RepPar*>(c)->ranges);
+    shareAll(static_cast<RepPar*>(c)->cmd);
+    break;
+  }
+}
+
+void Lower::share(Altn *a) {
+  switch (a->type) {
+  case Altn::UNGUARDED: {
+      UnguardedAltn *x = static_cast<UnguardedAltn*>(a);
+      share(x->dst);
+      share(x->src);
+      share(x->cmd);
+      break;
+    }
+
+  case Altn::GUARDED: {
+      GuardedAltn *x = static_cast<GuardedAltn*>(a);
+      share(x->expr);
+      share(x->dst);
+      share(x->src);
+      share(x->cmd);
+      break;
+    }
+
+  case Altn::SKIP:
+    share(static_cast<SkipAltn*>(a)->expr);
+    share(static_cast<SkipAltn*>(a)->cmd);
+    break;
+
+  case Altn::NESTED:
+    share(static_cast<NestedAltn*>(a)->alt);
+    break;
+
+  case Altn::SPEC:
+    share(static_cast<SpecAltn*>(a)->spec);
+    share(static_cast<SpecAltn*>(a)->altn);
+    break;
+  }
+}
+
+void Lower::share(Choice *c) {
+  switch (c->type) {
+  case Choice::GUARDED:
+    share(static_cast<GuardedChoice*>(c)->expr);
+    share(static_cast<GuardedChoice*>(c)->cmd);
+    break;
+
+  case Choice::NESTED:
+    share(static_cast<NestedChoice*>(c)->test);
+    break;
+
+  case Choice::SPEC:
+    share(static_cast<SpecChoice*>(c)->spec);
+    share(static_cast<SpecChoice*>(c)->choice);
+    break;
+  }
+}
+
+void Lower::share(Select *s) {
+  if (s->type == Select::GUARDED)
+    share(static_cast<GuardedSelect*>(s)->expr);
+  share(s->cmd);
+}
+
+void Lower::share(std::list<Range*> *l) {
+  for (auto x : *l) {
+    share(x->base);
+    share(x->count);
+    if (x->step != nullptr)
+      share(x->step);
+  }
+}
+
+// Actuals passed by reference are shared, and every actual is when the
+// formals are not known
+void Lower::share(std::list<Expr*> *l, Def *target) {
+  if (l == nullptr)
+    return;
+  bool known = target != nullptr && target->args != nullptr;
+  std::list<Fml*>::iterator f;
+  if (known)
+    f = target->args->begin();
+  for (auto x : *l) {
+    bool val = known && f != target->args->end() && byValue(*f);
+    if (known && f != target->args->end())
+      ++f;
+    if (!val)
+      all++;
+    share(x);
+    if (!val)
+      all--;
+  }
+}
+
+void Lower::share(Elem *e) {
+  switch (e->type) {
+  default:
+    break;
+
+  case Elem::NAME:
+    if (all > 0)
+      frame->shared.insert(static_cast<Name*>(e)->str);
+    break;
+
+  case Elem::FIELD:
+    if (all > 0)
+      frame->shared.insert(static_cast<Field*>(e)->base->str);
+    if (static_cast<Field*>(e)->base->subscripts != nullptr)
+      for (auto x : *static_cast<Field*>(e)->base->subscripts)
+        share(x);
+    break;
+
+  case Elem::CALL:
+    if (static_cast<FuncCall*>(e)->actuals != nullptr)
+      for (auto x : *static_cast<FuncCall*>(e)->actuals)
+        share(x);
+    break;
+  }
+  if (e->subscripts != nullptr)
+    for (auto x : *e->subscripts)
+      share(x);
+}
+
+void Lower::share(Expr *e) {
+  switch (e->type) {
+  default:
+    break;
+
+  case Expr::ELEM:
+    share(static_cast<OperElem*>(e)->elem);
+    break;
+
+  case Expr::VALOF:
+    share(static_cast<OperValof*>(e)->valof->cmd);
+    share(static_cast<OperValof*>(e)->valof->expr);
+    break;
+
+  case Expr::EXPR:
+    share(static_cast<OperExpr*>(e)->expr);
+    break;
+
+  case Expr::UNARY:
+    share(static_cast<UnaryOp*>(e)->operand);
+    break;
+
+  case Expr::BINARY:
+    share(static_cast<BinaryOp*>(e)->left);
+    share(static_cast<BinaryOp*>(e)->right);
+    break;
+
+  case Expr::NARY:
+    for (auto x : *static_cast<NaryOp*>(e)->operands)
+      share(x);
+    break;
+  }
+}
+
+// ============================================================================
+// Instructions and blocks
+// ============================================================================
+
+Instr *Lower::emit(Instr::Op op) {
+  Instr *x = new Instr(op);
+  x->id = frame->fn->newId();
+  x->block = frame->cur;
+  frame->cur->instrs.push_back(x);
+  return x;
+}
+
+Instr *Lower::emit(Instr::Op op, const std::vector<Instr*> &args) {
+  Instr *x = emit(op);
+  x->args = args;
+  return x;
+}
+
+Instr *Lower::constant(int v) {
+  Instr *x = emit(Instr::CONST);
+  x->value = v;
+  return x;
+}
+
+Instr *Lower::binary(Lex::Token op, Instr *l, Instr *r) {
+  std::vector<Instr*> args;
+  args.push_back(l);
+  args.push_back(r);
+  Instr *x = emit(Instr::BINARY, args);
+  x->opr = op;
+  return x;
+}
+
+Block *Lower::block() {
+  return frame->fn->newBlock();
+}
+
+void Lower::jump(Block *b) {
+  emit(Instr::BR);
+  frame->fn->addEdge(frame->cur, b);
+}
+
+void Lower::branch(Instr *c, Block *t, Block *f) {
+  emit(Instr::CBR, std::vector<Instr*>(1, c));
+  frame->fn->addEdge(frame->cur, t);
+  frame->fn->addEdge(frame->cur, f);
+}
+
+void Lower::enter(Block *b) {
+  frame->cur = b;
+}
+
+// Stop, continuing in an unreachable block
+void Lower::stop() {
+  emit(Instr::STOP);
+  Block *b = block();
+  seal(b);
+  enter(b);
+}
+
+// ============================================================================
+// Specifications
+// ============================================================================
+
+void Lower::spec(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+  case Spec::DEF:
+    def(static_cast<Def*>(s));
+    break;
+
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      switch (d->tDecl) {
+      default:
+        break;
+
+      // Scalar variables start undefined, and memory is allocated with the
+      // length of each dimension
+      case Decl::VAR:
+      case Decl::CALL: {
+          Spef *x = d->tDecl == Decl::VAR ?
+              static_cast<VarDecl*>(d)->spef :
+              static_cast<CallDecl*>(d)->spef;
+          std::list<Name*> l;
+          if (d->nameList)
+            l = *d->names;
+          else
+            l.push_back(d->name);
+          for (auto y : l) {
+            if (x->type == Spef::VAR && x->lengths == nullptr
+                && !frame->shared.count(y->str)) {
+              write(declare(y->str), frame->cur, emit(Instr::UNDEF));
+              continue;
+            }
+            std::string mem = unique(y->str);
+            std::vector<Instr*> v = values(x->lengths);
+            memory(y->str, mem, v);
+            emit(Instr::ALLOC, v)->name = mem;
+          }
+          break;
+        }
+
+      // A server is spawned with the address it is called through, followed
+      // by its actuals, once its initial declarations have run. The instances
+      // of a replicated server are constructed in parallel, each spawned with
+      // its position as well.
+      case Decl::SERVER:
+      case Decl::RSERVER: {
+          Server *x = d->tDecl == Decl::SERVER ?
+              static_cast<ServerDecl*>(d)->server :
+              static_cast<RepServerDecl*>(d)->server;
+          std::string mem = unique(d->name->str);
+          memory(d->name->str, mem);
+          Instr *a = emit(Instr::ADDR);
+          a->name = mem;
+          std::vector<Instr*> args(1, a);
+          std::string name = mem;
+          std::list<Expr*> *actuals = nullptr;
+          if (x->type == Server::INSTANCE) {
+            ServerInstance *y = static_cast<ServerInstance*>(x);
+            name = lookup(y->name->str).mem;
+            actuals = y->actuals;
+          }
+          if (d->tDecl == Decl::SERVER) {
+            std::vector<Instr*> v = values(actuals);
+            initial(x, mem, std::vector<Instr*>(), actuals, v);
+            args.insert(args.end(), v.begin(), v.end());
+            emit(Instr::SPAWN, args)->name = name;
+            break;
+          }
+          std::list<Range*> *ranges = static_cast<RepServerDecl*>(d)->exprs;
+          Instr *total = constant(1);
+          for (auto y : *ranges)
+            total = binary(Lex::tMUL, total, value(y->count));
+          args.push_back(constant(0));
+          args.push_back(total);
+          emit(Instr::INVOKE, args)->name =
+              construct(x, name, mem, ranges, actuals);
+          break;
+        }
+      }
+      break;
+    }
+
+  case Spec::ABBR: {
+      Abbr *a = static_cast<Abbr*>(s);
+      if (a->type == Abbr::VAL) {
+        bind(a->name->str, value(a->expr));
+        break;
+      }
+      if (a->elem->type == Elem::NAME && a->elem->subscripts == nullptr) {
+        Var v = lookup(static_cast<Name*>(a->elem)->str);
+        v.name = a->name->str;
+        frame->scope.push_back(v);
+        break;
+      }
+      std::vector<Instr*> subs;
+      std::string mem = location(a->elem, subs);
+      std::vector<Instr*> l;
+      if (a->elem->type == Elem::NAME)
+        l = lookup(static_cast<Name*>(a->elem)->str).lengths;
+      frame->scope.push_back(Var{a->name->str, -1, mem, subs, l});
+      break;
+    }
+
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      spec(x);
+    break;
+  }
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+void Lower::process(Process *p) {
+  switch (p->type) {
+  case Process::CMD:
+    cmd(static_cast<ProcessCmd*>(p)->cmd);
+    break;
+
+  case Process::SPEC: {
+      ProcessSpec *x = static_cast<ProcessSpec*>(p);
+      if (x->intf != nullptr)
+        for (auto y : *x->intf)
+          spec(y);
+      cmd(x->cmd);
+      break;
+    }
+
+  case Process::INSTANCE: {
+      ProcessInstance *x = static_cast<ProcessInstance*>(p);
+      dispatch(x->name, x->actuals, x->dispatch, x->target, x->tail);
+      break;
+    }
+  }
+}
+
+void Lower::cmd(Cmd *c) {
+  if (c == nullptr)
+    return;
+  switch (c->type) {
+  case Cmd::SPEC: {
+      size_t n = frame->scope.size();
+      spec(static_cast<CmdSpec*>(c)->spec);
+      cmd(static_cast<CmdSpec*>(c)->cmd);
+      frame->scope.resize(n);
+      break;
+    }
+
+  case Cmd::INSTANCE: {
+      Instance *x = static_cast<Instance*>(c);
+      dispatch(x->name, x->actuals, x->dispatch, x->target, x->tail);
+      break;
+    }
+
+  case Cmd::CALL: {
+      Call *x = static_cast<Call*>(c);
+      invoke(lookup(x->name->str).mem + "." + x->field->str,
+          x->actuals, nullptr, false);
+      break;
+    }
+
+  case Cmd::SKIP:
+    break;
+
+  case Cmd::STOP:
+    stop();
+    break;
+
+  case Cmd::ASS:
+    store(static_cast<Ass*>(c)->lhs, value(static_cast<Ass*>(c)->rhs));
+    break;
+
+  case Cmd::IN: {
+      In *x = static_cast<In*>(c);
+      std::vector<Instr*> subs;
+      std::string mem = location(x->lhs, subs);
+      Instr *v = emit(Instr::IN, subs);
+      v->name = mem;
+      if (c == coalesced)
+        v->value = Instr::COALESCE;
+      store(x->rhs, v);
+      break;
+    }
+
+  // An array is output as its address, to be copied or moved
+  case Cmd::OUT: {
+      Out *x = static_cast<Out*>(c);
+      std::vector<Instr*> subs;
+      std::string mem = location(x->lhs, subs);
+      bool array = x->mode != Out::VALUE && x->rhs->type == Expr::ELEM;
+      subs.push_back(array ?
+          address(static_cast<OperElem*>(x->rhs)->elem) : value(x->rhs));
+      Instr *v = emit(Instr::OUT, subs);
+      v->name = mem;
+      if (array)
+        v->value = x->mode == Out::MOVE ? Instr::MOVE : Instr::COPY;
+      else if (c == coalesced)
+        v->value = Instr::COALESCE;
+      break;
+    }
+
+  case Cmd::CONNECT: {
+      Connect *x = static_cast<Connect*>(c);
+      std::vector<Instr*> subs;
+      std::string mem = location(x->local, subs);
+      subs.push_back(address(x->remote));
+      emit(Instr::CONNECT, subs)->name = mem;
+      break;
+    }
+
+  case Cmd::ALT:
+    alt(static_cast<Alt*>(c));
+    break;
+
+  case Cmd::RALT:
+    repAlt(static_cast<RepAlt*>(c));
+    break;
+
+  // Without a true choice, a conditional behaves like skip
+  case Cmd::TEST: {
+      Test *x = static_cast<Test*>(c);
+      Block *done = block();
+      if (x->choices != nullptr)
+        for (auto y : *x->choices)
+          choice(y, done);
+      jump(done);
+      seal(done);
+      enter(done);
+      break;
+    }
+
+  case Cmd::RTEST: {
+      RepTest *x = static_cast<RepTest*>(c);
+      Rep r(Rep::CHOICE);
+      r.choice = x->choice;
+      r.done = block();
+      loop(x->ranges->begin(), x->ranges->end(), r);
+      jump(r.done);
+      seal(r.done);
+      enter(r.done);
+      break;
+    }
+
+  case Cmd::IFD: {
+      IfD *x = static_cast<IfD*>(c);
+      Block *then = block();
+      Block *done = block();
+      branch(value(x->expr), then, done);
+      seal(then);
+      enter(then);
+      cmd(x->cmd);
+      jump(done);
+      seal(done);
+      enter(done);
+      break;
+    }
+
+  case Cmd::IFTE: {
+      IfTE *x = static_cast<IfTE*>(c);
+      Block *then = block();
+      Block *other = block();
+      Block *done = block();
+      branch(value(x->expr), then, other);
+      seal(then);
+      seal(other);
+      enter(then);
+      cmd(x->cmd);
+      jump(done);
+      enter(other);
+      cmd(x->elseCmd);
+      jump(done);
+      seal(done);
+      enter(done);
+      break;
+    }
+
+  // Without a matching selection, a case behaves like stop
+  case Cmd::CASE: {
+      Case *x = static_cast<Case*>(c);
+      Instr *v = value(x->expr);
+      Block *done = block();
+      if (x->selects != nullptr) {
+        for (auto y : *x->selects)
+          select(y, v, done);
+        stop();
+      }
+      jump(done);
+      seal(done);
+      enter(done);
+      break;
+    }
+
+  case Cmd::RCASE: {
+      RepCase *x = static_cast<RepCase*>(c);
+      Rep r(Rep::SELECT);
+      r.value = value(x->expr);
+      r.select = x->select;
+      r.done = block();
+      loop(x->ranges->begin(), x->ranges->end(), r);
+      stop();
+      jump(r.done);
+      seal(r.done);
+      enter(r.done);
+      break;
+    }
+
+  case Cmd::WHILE:
+  case Cmd::UNTIL: {
+      Expr *e = c->type == Cmd::WHILE ?
+          static_cast<While*>(c)->expr : static_cast<Until*>(c)->expr;
+      Block *head = block();
+      Block *body = block();
+      Block *exit = block();
+      jump(head);
+      enter(head);
+      if (c->type == Cmd::WHILE)
+        branch(value(e), body, exit);
+      else
+        branch(value(e), exit, body);
+      seal(body);
+      seal(exit);
+      enter(body);
+      cmd(c->type == Cmd::WHILE ?
+          static_cast<While*>(c)->cmd : static_cast<Until*>(c)->cmd);
+      jump(head);
+      seal(head);
+      enter(exit);
+      break;
+    }
+
+  case Cmd::DO: {
+      Do *x = static_cast<Do*>(c);
+      Block *body = block();
+      Block *exit = block();
+      jump(body);
+      enter(body);
+      cmd(x->cmd);
+      branch(value(x->expr), body, exit);
+      seal(body);
+      seal(exit);
+      enter(exit);
+      break;
+    }
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::RSEQ: {
+      RepSeq *x = static_cast<RepSeq*>(c);
+      if (x->xfer != RepSeq::ELEMENT) {
+        transfer(x);
+        break;
+      }
+      Rep r(Rep::CMD);
+      r.cmd = x->cmd;
+      loop(x->ranges->begin(), x->ranges->end(), r);
+      break;
+    }
+
+  // Each component is spawned as a function and the last waits for them.
+  // Components proved disjoint are marked so they can run with no checks.
+  case Cmd::PAR: {
+      Par *x = static_cast<Par*>(c);
+      std::vector<std::string> fns;
+      std::vector<std::vector<Instr*>> args;
+      for (auto y : *x->cmds) {
+        args.push_back(std::vector<Instr*>());
+        fns.push_back(outline(y, nullptr, args.back()));
+      }
+      for (size_t i = 0; i < fns.size(); i++) {
+        Instr *s = emit(Instr::SPAWN, args[i]);
+        s->name = fns[i];
+        s->value = x->sharing == Par::DISJOINT;
+      }
+      emit(Instr::JOIN);
+      break;
+    }
+
+  case Cmd::RPAR: {
+      RepPar *x = static_cast<RepPar*>(c);
+      Rep r(Rep::SPAWN);
+      r.cmd = x->cmd;
+      r.ranges = x->ranges;
+      r.disjoint = x->sharing == Par::DISJOINT;
+      r.name = outline(x->cmd, x->ranges, r.args);
+      loop(x->ranges->begin(), x->ranges->end(), r);
+      emit(Instr::JOIN);
+      break;
+    }
+  }
+}
+
+// Invoke a process through its name. A cached dispatch compares the address
+// the name holds with that of the definition it predicts, and invokes that
+// directly when they match.
+void Lower::dispatch(Name *n, std::list<Expr*> *l, Instance::Dispatch d,
+    Def *target, bool tail) {
+  if (d == Instance::DIRECT) {
+    invoke(target->name->str, l, target, tail);
+    return;
+  }
+  std::string mem = lookup(n->str).mem;
+  if (d == Instance::CACHED) {
+    Instr *a = emit(Instr::ADDR);
+    a->name = mem;
+    Instr *b = emit(Instr::ADDR);
+    b->name = target->name->str;
+    Block *direct = block();
+    Block *indirect = block();
+    Block *done = block();
+    branch(binary(Lex::tEQ, a, b), direct, indirect);
+    seal(direct);
+    seal(indirect);
+    enter(direct);
+    invoke(target->name->str, l, target, false);
+    jump(done);
+    enter(indirect);
+    invoke(mem, l, nullptr, false);
+    jump(done);
+    seal(done);
+    enter(done);
+    return;
+  }
+  invoke(mem, l, nullptr, false);
+}
+
+// Invoke a process or server call. Actuals are passed by value to scalar
+// value formals and by address otherwise, or when the formals are unknown.
+void Lower::invoke(const std::string &name, std::list<Expr*> *l,
+    Def *target, bool tail) {
+  std::vector<Instr*> args;
+  if (l != nullptr) {
+    bool known = target != nullptr && target->args != nullptr;
+    std::list<Fml*>::iterator f;
+    if (known)
+      f = target->args->begin();
+    for (auto x : *l) {
+      bool val = known && f != target->args->end() && byValue(*f);
+      if (known && f != target->args->end())
+        ++f;
+      if (!val && x->type == Expr::ELEM
+          && static_cast<OperElem*>(x)->elem->type != Elem::CALL)
+        args.push_back(address(static_cast<OperElem*>(x)->elem));
+      else
+        args.push_back(value(x));
+    }
+  }
+  Instr *x = emit(Instr::INVOKE, args);
+  x->name = name;
+  x->value = tail;
+}
+
+// Lower a replicated input or output marked by Agg. A block transfer is a
+// single input or output of the elements the loop would move, which are
+// checked at their extremes. Otherwise the loop is lowered with its input or
+// output marked to be coalesced.
+void Lower::transfer(RepSeq *x) {
+  Cmd *c = x->cmd;
+  while (c->type == Cmd::SEQ && static_cast<Seq*>(c)->cmds->size() == 1)
+    c = static_cast<Seq*>(c)->cmds->front();
+  if (x->xfer == RepSeq::COALESCE) {
+    Cmd *saved = coalesced;
+    coalesced = c;
+    Rep r(Rep::CMD);
+    r.cmd = x->cmd;
+    loop(x->ranges->begin(), x->ranges->end(), r);
+    coalesced = saved;
+    return;
+  }
+  Range *range = x->ranges->front();
+  Elem *chan;
+  Elem *data;
+  if (c->type == Cmd::OUT) {
+    chan = static_cast<Out*>(c)->lhs;
+    data = static_cast<OperElem*>(static_cast<Out*>(c)->rhs)->elem;
+  }
+  else {
+    chan = static_cast<In*>(c)->lhs;
+    data = static_cast<In*>(c)->rhs;
+  }
+  Instr *base = value(range->base);
+  Instr *count = value(range->count);
+  std::vector<const Elem*> elems = hoisted(x->cmd);
+  if (data->check == Elem::CHECKED)
+    elems.push_back(data);
+  hoist(elems, range, base, count, nullptr);
+  std::vector<Instr*> subs;
+  std::string mem = location(chan, subs);
+  size_t n = frame->scope.size();
+  bind(range->name->str, base);
+  Var v = lookup(static_cast<Name*>(data)->str);
+  std::vector<Instr*> first(v.prefix);
+  first.push_back(value(data->subscripts->front()));
+  frame->scope.resize(n);
+  Instr *a = emit(Instr::ADDR, first);
+  a->name = v.mem.empty() ? v.name : v.mem;
+  subs.push_back(a);
+  subs.push_back(count);
+  Instr *t = emit(c->type == Cmd::OUT ? Instr::OUT : Instr::IN, subs);
+  t->name = mem;
+  t->value = Instr::BLOCK;
+}
+
+// Lower replicator ranges as nested counted loops around their body. The
+// base, count and step are evaluated once, before each loop.
+void Lower::loop(std::list<Range*>::iterator begin,
+    std::list<Range*>::iterator end, Rep &r) {
+  if (begin == end) {
+    body(r);
+    return;
+  }
+  Range *x = *begin;
+  Instr *base = value(x->base);
+  Instr *count = value(x->count);
+  Instr *step = x->step != nullptr ? value(x->step) : nullptr;
+  if (std::next(begin) == end
+      && (r.type == Rep::CMD || r.type == Rep::SPAWN))
+    hoist(hoisted(r.cmd), x, base, count, step);
+  int i = temp();
+  write(i, frame->cur, constant(0));
+  Block *head = block();
+  Block *body = block();
+  Block *exit = block();
+  jump(head);
+  enter(head);
+  Instr *n = read(i, head);
+  branch(binary(Lex::tLT, n, count), body, exit);
+  seal(body);
+  seal(exit);
+  enter(body);
+  size_t m = frame->scope.size();
+  if (step != nullptr)
+    n = binary(Lex::tMUL, n, step);
+  bind(x->name->str, binary(Lex::tADD, base, n));
+  loop(++begin, end, r);
+  frame->scope.resize(m);
+  write(i, frame->cur,
+      binary(Lex::tADD, read(i, frame->cur), constant(1)));
+  jump(head);
+  seal(head);
+  enter(exit);
+}
+
+void Lower::body(Rep &r) {
+  switch (r.type) {
+  case Rep::CMD:
+    cmd(r.cmd);
+    break;
+
+  case Rep::CHOICE:
+    choice(r.choice, r.done);
+    break;
+
+  case Rep::SELECT:
+    select(r.select, r.value, r.done);
+    break;
+
+  case Rep::SPAWN: {
+      std::vector<Instr*> args(r.args);
+      for (auto x : *r.ranges)
+        args.push_back(fetch(lookup(x->name->str), std::vector<Instr*>()));
+      Instr *s = emit(Instr::SPAWN, args);
+      s->name = r.name;
+      s->value = r.disjoint;
+      break;
+    }
+
+  // Record the guard and channel of the alternative at the next position
+  case Rep::TABLE: {
+      size_t n = frame->scope.size();
+      Altn *a = r.altn;
+      while (a->type == Altn::SPEC) {
+        spec(static_cast<SpecAltn*>(a)->spec);
+        a = static_cast<SpecAltn*>(a)->altn;
+      }
+      Instr *k = read(r.counter, frame->cur);
+      std::vector<Instr*> args(1, k);
+      args.push_back(guard(a));
+      emit(Instr::STORE, args)->name = r.name + ".guard";
+      args[1] = channel(a);
+      emit(Instr::STORE, args)->name = r.name + ".chan";
+      write(r.counter, frame->cur, binary(Lex::tADD, k, constant(1)));
+      frame->scope.resize(n);
+      break;
+    }
+  }
+}
+
+// Lower a choice of a conditional, continuing in the next choice when its
+// guard is false
+void Lower::choice(Choice *c, Block *done) {
+  switch (c->type) {
+  case Choice::GUARDED: {
+      GuardedChoice *x = static_cast<GuardedChoice*>(c);
+      Block *then = block();
+      Block *next = block();
+      branch(value(x->expr), then, next);
+      seal(then);
+      seal(next);
+      enter(then);
+      cmd(x->cmd);
+      jump(done);
+      enter(next);
+      break;
+    }
+
+  case Choice::NESTED: {
+      Cmd *x = static_cast<NestedChoice*>(c)->test;
+      if (x->type == Cmd::TEST) {
+        if (static_cast<Test*>(x)->choices != nullptr)
+          for (auto y : *static_cast<Test*>(x)->choices)
+            choice(y, done);
+      }
+      else {
+        RepTest *y = static_cast<RepTest*>(x);
+        Rep r(Rep::CHOICE);
+        r.choice = y->choice;
+        r.done = done;
+        loop(y->ranges->begin(), y->ranges->end(), r);
+      }
+      break;
+    }
+
+  case Choice::SPEC: {
+      size_t n = frame->scope.size();
+      spec(static_cast<SpecChoice*>(c)->spec);
+      choice(static_cast<SpecChoice*>(c)->choice, done);
+      frame->scope.resize(n);
+      break;
+    }
+  }
+}
+
+void Lower::select(Select *s, Instr *v, Block *done) {
+  if (s->type == Select::ELSE) {
+    cmd(s->cmd);
+    jump(done);
+    Block *b = block();
+    seal(b);
+    enter(b);
+    return;
+  }
+  Block *then = block();
+  Block *next = block();
+  Instr *e = value(static_cast<GuardedSelect*>(s)->expr);
+  branch(binary(Lex::tEQ, v, e), then, next);
+  seal(then);
+  seal(next);
+  enter(then);
+  cmd(s->cmd);
+  jump(done);
+  enter(next);
+}
+
+// ============================================================================
+// Alternatives: an alt instruction takes the guard and channel address of
+// each alternative and gives the position of the one that is chosen
+// ============================================================================
+
+void Lower::alt(Alt *x) {
+  size_t n = frame->scope.size();
+  std::vector<Altn*> v;
+  if (x->altns != nullptr)
+    for (auto y : *x->altns)
+      altns(y, v);
+  if (v.empty()) {
+    stop();
+    frame->scope.resize(n);
+    return;
+  }
+  std::vector<Instr*> args;
+  for (auto y : v) {
+    args.push_back(guard(y));
+    args.push_back(channel(y));
+  }
+  Instr *a = emit(Instr::ALT, args);
+  Block *done = block();
+  for (size_t i = 0; i < v.size(); i++) {
+    if (i+1 < v.size()) {
+      Block *then = block();
+      Block *next = block();
+      branch(binary(Lex::tEQ, a, constant(i)), then, next);
+      seal(then);
+      seal(next);
+      enter(then);
+      accept(v[i]);
+      jump(done);
+      enter(next);
+    }
+    else {
+      accept(v[i]);
+      jump(done);
+    }
+  }
+  seal(done);
+  enter(done);
+  frame->scope.resize(n);
+}
+
+// A replicated alternative fills tables with the guard and channel of each
+// alternative. The indices of the one chosen are recovered from its
+// position.
+void Lower::repAlt(RepAlt *x) {
+  Rep r(Rep::TABLE);
+  r.altn = x->altn;
+  r.name = unique(frame->fn->name + ".alt");
+  r.counter = temp();
+  write(r.counter, frame->cur, constant(0));
+  loop(x->ranges->begin(), x->ranges->end(), r);
+  std::vector<Instr*> args;
+  args.push_back(emit(Instr::ADDR));
+  args.back()->name = r.name + ".guard";
+  args.push_back(emit(Instr::ADDR));
+  args.back()->name = r.name + ".chan";
+  args.push_back(read(r.counter, frame->cur));
+  Instr *a = emit(Instr::ALT, args);
+  a->value = 1;
+  size_t n = frame->scope.size();
+  std::vector<Range*> ranges(x->ranges->begin(), x->ranges->end());
+  for (size_t i = ranges.size(); i-- > 0; ) {
+    Instr *count = value(ranges[i]->count);
+    Instr *k = binary(Lex::tREM, a, count);
+    a = binary(Lex::tDIV, a, count);
+    if (ranges[i]->step != nullptr)
+      k = binary(Lex::tMUL, k, value(ranges[i]->step));
+    bind(ranges[i]->name->str, binary(Lex::tADD, value(ranges[i]->base), k));
+  }
+  accept(x->altn);
+  frame->scope.resize(n);
+}
+
+// Flatten nested alternations, lowering the specifications on the way. A
+// nested replicated alternation is chosen as a whole, and then waits for one
+// of its own alternatives.
+void Lower::altns(Altn *a, std::vector<Altn*> &v) {
+  switch (a->type) {
+  default:
+    v.push_back(a);
+    break;
+
+  case Altn::NESTED: {
+      Cmd *x = static_cast<NestedAltn*>(a)->alt;
+      if (x->type == Cmd::ALT && static_cast<Alt*>(x)->altns != nullptr) {
+        for (auto y : *static_cast<Alt*>(x)->altns)
+          altns(y, v);
+      }
+      else if (x->type == Cmd::RALT)
+        v.push_back(a);
+      break;
+    }
+
+  case Altn::SPEC:
+    spec(static_cast<SpecAltn*>(a)->spec);
+    altns(static_cast<SpecAltn*>(a)->altn, v);
+    break;
+  }
+}
+
+Instr *Lower::guard(Altn *a) {
+  switch (a->type) {
+  default:
+    return constant(1);
+  case Altn::GUARDED:
+    return value(static_cast<GuardedAltn*>(a)->expr);
+  case Altn::SKIP:
+    return value(static_cast<SkipAltn*>(a)->expr);
+  }
+}
+
+// An alternative's input reads the channel it names first
+Instr *Lower::channel(Altn *a) {
+  switch (a->type) {
+  default:
+    return emit(Instr::UNDEF);
+  case Altn::GUARDED:
+    return address(static_cast<GuardedAltn*>(a)->dst);
+  case Altn::UNGUARDED:
+    return address(static_cast<UnguardedAltn*>(a)->dst);
+  }
+}
+
+// Perform the input and command of the chosen alternative
+void Lower::accept(Altn *a) {
+  Elem *chan = nullptr;
+  Elem *var = nullptr;
+  Cmd *c = nullptr;
+  switch (a->type) {
+  case Altn::UNGUARDED:
+    chan = static_cast<UnguardedAltn*>(a)->dst;
+    var = static_cast<UnguardedAltn*>(a)->src;
+    c = static_cast<UnguardedAltn*>(a)->cmd;
+    break;
+
+  case Altn::GUARDED:
+    chan = static_cast<GuardedAltn*>(a)->dst;
+    var = static_cast<GuardedAltn*>(a)->src;
+    c = static_cast<GuardedAltn*>(a)->cmd;
+    break;
+
+  case Altn::SKIP:
+    c = static_cast<SkipAltn*>(a)->cmd;
+    break;
+
+  case Altn::NESTED:
+    c = static_cast<NestedAltn*>(a)->alt;
+    break;
+
+  case Altn::SPEC:
+    spec(static_cast<SpecAltn*>(a)->spec);
+    accept(static_cast<SpecAltn*>(a)->altn);
+    return;
+  }
+  if (chan != nullptr) {
+    std::vector<Instr*> subs;
+    std::string mem = location(chan, subs);
+    Instr *v = emit(Instr::IN, subs);
+    v->name = mem;
+    store(var, v);
+  }
+  cmd(c);
+}
+
+// ============================================================================
+// Elements and expressions
+// ============================================================================
+
+// Check subscripts of memory, starting at a dimension, against the lengths
+// of the dimensions they select
+void Lower::check(const Var &v, const std::string &mem,
+    const std::vector<Instr*> &subs, size_t dim) {
+  for (size_t i = 0; i < subs.size(); i++, dim++) {
+    std::vector<Instr*> args(1, subs[i]);
+    if (dim < v.lengths.size() && v.lengths[dim] != nullptr)
+      args.push_back(v.lengths[dim]);
+    Instr *x = emit(Instr::CHECK, args);
+    x->name = mem;
+    x->value = dim;
+  }
+}
+
+// Check the subscripts of an element, and those of the server it is a field
+// of, evaluating them again
+void Lower::check(const Elem *e) {
+  if (e->type == Elem::NAME) {
+    Var v = lookup(static_cast<const Name*>(e)->str);
+    check(v, v.mem.empty() ? v.name : v.mem, values(e->subscripts),
+        v.prefix.size());
+  }
+  else if (e->type == Elem::FIELD) {
+    const Field *f = static_cast<const Field*>(e);
+    Var v = lookup(f->base->str);
+    std::string mem = v.mem.empty() ? v.name : v.mem;
+    std::vector<Instr*> x = values(f->base->subscripts);
+    check(v, mem, x, v.prefix.size());
+    Var field{mem, -1, mem, std::vector<Instr*>(), std::vector<Instr*>()};
+    check(field, mem + "." + f->field->str, values(e->subscripts),
+        v.prefix.size() + x.size());
+  }
+}
+
+// The elements of the body of a replicator whose checks are hoisted out of
+// its loop, other than those of nested replicators and definitions
+class Hoisted : public Visitor<true> {
+public:
+  std::vector<const Elem*> elems;
+
+protected:
+  bool pre(const Spec *s) override {
+    return s->type != Spec::DEF;
+  }
+  bool pre(const Cmd *c) override {
+    return c->type != Cmd::RSEQ && c->type != Cmd::RPAR;
+  }
+  bool pre(const Elem *e) override {
+    if (e->check == Elem::HOISTED)
+      elems.push_back(e);
+    return true;
+  }
+};
+
+std::vector<const Elem*> Lower::hoisted(Cmd *c) {
+  Hoisted h;
+  h.walk(c);
+  return h.elems;
+}
+
+// Check elements before a loop, for the first and last values of its index
+// when it runs at all. Their subscripts are linear in the index and in
+// names that do not change in the loop, so these are their extremes.
+void Lower::hoist(const std::vector<const Elem*> &elems, Range *x,
+    Instr *base, Instr *count, Instr *step) {
+  if (elems.empty())
+    return;
+  Block *checks = block();
+  Block *done = block();
+  branch(binary(Lex::tGT, count, constant(0)), checks, done);
+  seal(checks);
+  enter(checks);
+  Instr *last = binary(Lex::tSUB, count, constant(1));
+  if (step != nullptr)
+    last = binary(Lex::tMUL, last, step);
+  last = binary(Lex::tADD, base, last);
+  for (auto i : {base, last}) {
+    size_t n = frame->scope.size();
+    bind(x->name->str, i);
+    for (auto e : elems)
+      check(e);
+    frame->scope.resize(n);
+  }
+  jump(done);
+  seal(done);
+  enter(done);
+}
+
+// The lengths of the dimensions of a specifier, where they are given
+std::vector<Instr*> Lower::lengths(std::list<Expr*> *l) {
+  std::vector<Instr*> v;
+  if (l != nullptr)
+    for (auto x : *l)
+      v.push_back(x != nullptr ? value(x) : nullptr);
+  return v;
+}
+
+// The memory an element refers to and its subscripts, or an empty name for
+// a scalar value. Subscripts that must be checked are checked here.
+std::string Lower::location(Elem *e, std::vector<Instr*> &subs) {
+  switch (e->type) {
+  default:
+    return "";
+
+  case Elem::NAME: {
+      Var v = lookup(static_cast<Name*>(e)->str);
+      subs = v.prefix;
+      std::vector<Instr*> x = values(e->subscripts);
+      if (e->check == Elem::CHECKED)
+        check(v, v.mem, x, v.prefix.size());
+      subs.insert(subs.end(), x.begin(), x.end());
+      return v.key >= 0 ? "" : v.mem;
+    }
+
+  case Elem::FIELD: {
+      Field *f = static_cast<Field*>(e);
+      Var v = lookup(f->base->str);
+      std::string mem = v.mem.empty() ? v.name : v.mem;
+      subs = v.prefix;
+      std::vector<Instr*> x = values(f->base->subscripts);
+      if (f->base->check == Elem::CHECKED)
+        check(v, mem, x, subs.size());
+      subs.insert(subs.end(), x.begin(), x.end());
+      x = values(e->subscripts);
+      if (e->check == Elem::CHECKED) {
+        Var field{mem, -1, mem, std::vector<Instr*>(), std::vector<Instr*>()};
+        check(field, mem + "." + f->field->str, x, subs.size());
+      }
+      subs.insert(subs.end(), x.begin(), x.end());
+      return mem + "." + f->field->str;
+    }
+  }
+}
+
+Instr *Lower::address(Elem *e) {
+  std::vector<Instr*> subs;
+  std::string mem = location(e, subs);
+  if (mem.empty())
+    return e->type == Elem::NAME ?
+        fetch(lookup(static_cast<Name*>(e)->str), std::vector<Instr*>()) :
+        emit(Instr::UNDEF);
+  Instr *x = emit(Instr::ADDR, subs);
+  x->name = mem;
+  return x;
+}
+
+void Lower::store(Elem *e, Instr *v) {
+  if (e->type == Elem::NAME) {
+    Var x = lookup(static_cast<Name*>(e)->str);
+    std::vector<Instr*> subs = values(e->subscripts);
+    if (e->check == Elem::CHECKED)
+      check(x, x.mem.empty() ? x.name : x.mem, subs, x.prefix.size());
+    assign(x, subs, v);
+    return;
+  }
+  std::vector<Instr*> subs;
+  std::string mem = location(e, subs);
+  subs.push_back(v);
+  emit(Instr::STORE, subs)->name = mem;
+}
+
+std::vector<Instr*> Lower::values(std::list<Expr*> *l) {
+  std::vector<Instr*> v;
+  if (l != nullptr)
+    for (auto x : *l)
+      v.push_back(value(x));
+  return v;
+}
+
+Instr *Lower::value(Expr *e) {
+  switch (e->type) {
+  default:
+    return emit(Instr::UNDEF);
+
+  case Expr::LITERAL:
+    return constant(literalValue(static_cast<OperLiteral*>(e)->literal));
+
+  case Expr::ELEM: {
+      Elem *x = static_cast<OperElem*>(e)->elem;
+      switch (x->type) {
+      default:
+        return emit(Instr::UNDEF);
+
+      case Elem::NAME: {
+          Var v = lookup(static_cast<Name*>(x)->str);
+          std::vector<Instr*> subs = values(x->subscripts);
+          if (x->check == Elem::CHECKED)
+            check(v, v.mem.empty() ? v.name : v.mem, subs, v.prefix.size());
+          return fetch(v, subs);
+        }
+
+      case Elem::FIELD: {
+          std::vector<Instr*> subs;
+          std::string mem = location(x, subs);
+          Instr *v = emit(Instr::LOAD, subs);
+          v->name = mem;
+          return v;
+        }
+
+      // A recursive call of a memoised function shares its table, and no
+      // call in it is a tail call, since the result is recorded after it
+      case Elem::CALL: {
+          FuncCall *f = static_cast<FuncCall*>(x);
+          std::vector<Instr*> args = values(f->actuals);
+          if (f->dispatch == Instance::DIRECT && f->target == frame->memo) {
+            Instr *a = emit(Instr::ADDR);
+            a->name = frame->table;
+            args.insert(args.begin(), a);
+          }
+          Instr *v = emit(Instr::CALL, args);
+          v->name = f->dispatch != Instance::DIRECT ?
+              lookup(f->name->str).mem : f->target == frame->memo ?
+              frame->worker : f->target->name->str;
+          v->value = f->tail && frame->memo == nullptr;
+          return v;
+        }
+      }
+    }
+
+  // The specifications of the body of a valof are in scope in its result
+  case Expr::VALOF: {
+      Valof *x = static_cast<OperValof*>(e)->valof;
+      size_t n = frame->scope.size();
+      Cmd *c = x->cmd;
+      for (; c->type == Cmd::SPEC; c = static_cast<CmdSpec*>(c)->cmd)
+        spec(static_cast<CmdSpec*>(c)->spec);
+      cmd(c);
+      Instr *v = value(x->expr);
+      frame->scope.resize(n);
+      return v;
+    }
+
+  case Expr::EXPR:
+    return value(static_cast<OperExpr*>(e)->expr);
+
+  case Expr::UNARY: {
+      UnaryOp *x = static_cast<UnaryOp*>(e);
+      Instr *v = emit(Instr::UNARY,
+          std::vector<Instr*>(1, value(x->operand)));
+      v->opr = x->op;
+      return v;
+    }
+
+  // The right operand of a logical operator is only evaluated when it is
+  // needed if evaluating it may fault
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(e);
+      Instr *l = value(x->left);
+      if ((x->op != Lex::tLAND && x->op != Lex::tLOR)
+          || !mayFault(x->right))
+        return binary(x->op, l, value(x->right));
+      return logical(x->op, l, x->right);
+    }
+
+  // The operands of a chain are evaluated in order, and combined as a
+  // balanced tree so that the operations are independent of one another,
+  // unless an operand of a logical operator must not be evaluated
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(e);
+      if ((x->op == Lex::tLAND || x->op == Lex::tLOR) && mayFault(x)) {
+        Instr *v = nullptr;
+        for (auto y : *x->operands)
+          v = v == nullptr ? value(y) : logical(x->op, v, y);
+        return v;
+      }
+      std::vector<Instr*> v;
+      for (auto y : *x->operands)
+        v.push_back(value(y));
+      while (v.size() > 1) {
+        size_t n = 0;
+        for (size_t i = 0; i + 1 < v.size(); i += 2)
+          v[n++] = binary(x->op, v[i], v[i+1]);
+        if (v.size() % 2 != 0)
+          v[n++] = v.back();
+        v.resize(n);
+      }
+      return v.front();
+    }
+  }
+}
+
+// Evaluate the right operand of a logical operator only when it is needed
+Instr *Lower::logical(Lex::Token op, Instr *l, Expr *right) {
+  int t = temp();
+  Block *rhs = block();
+  Block *done = block();
+  write(t, frame->cur, constant(op == Lex::tLOR ? 1 : 0));
+  if (op == Lex::tLAND)
+    branch(l, rhs, done);
+  else
+    branch(l, done, rhs);
+  seal(rhs);
+  enter(rhs);
+  write(t, frame->cur, binary(Lex::tNEQ, value(right), constant(0)));
+  jump(done);
+  seal(done);
+  enter(done);
+  return read(t, done);
+}
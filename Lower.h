@@ -0,0 +1,196 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "Tree.h"
+#include "IR.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define LOWER Lower::get()
+
+// The number of instances of a replicated server that are constructed one
+// after another, rather than by dividing them between workers
+#define SPAWN_GRAIN 16
+
+// Lowering of the tree to the intermediate representation. The top-level
+// program, each process and function definition and each component of a
+// parallel become a function. Scalar variables that are not shared with
+// another function or passed by reference are values, put in SSA form as
+// they are lowered with the algorithm of Braun et al.; all other variables
+// are memory. Communication, calls and processes are lowered to opaque
+// instructions with side effects. A memoised function allocates a table
+// for each call from outside it, which its recursive calls share.
+class Lower {
+public:
+  static Lower instance;
+  static Lower &get() { return instance; }
+  Lower() : module(nullptr), frame(nullptr), all(0), coalesced(nullptr) {};
+  ~Lower() {};
+  Module *lower(Tree *);
+
+private:
+  // A name in scope: a scalar with a key for its definitions, or memory
+  // with any subscripts an abbreviation of it fixes and the lengths of its
+  // dimensions, which are null where they are not known
+  struct Var {
+    std::string name;
+    int key;
+    std::string mem;
+    std::vector<Instr*> prefix;
+    std::vector<Instr*> lengths;
+  };
+
+  // The body of a replicator: a command, a search for the first choice or
+  // selection that matches, a process spawned for each index, or an entry
+  // in the tables of a replicated alternative
+  struct Rep {
+    typedef enum {
+      CMD,
+      CHOICE,
+      SELECT,
+      SPAWN,
+      TABLE
+    } Type;
+    Type type;
+    Cmd *cmd;
+    Choice *choice;
+    Select *select;
+    Altn *altn;
+    Instr *value;
+    Block *done;
+    std::string name;
+    std::list<Range*> *ranges;
+    std::vector<Instr*> args;
+    int counter;
+    bool disjoint;
+    Rep(Type t) :
+      type(t), cmd(nullptr), choice(nullptr), select(nullptr),
+      altn(nullptr), value(nullptr), done(nullptr), ranges(nullptr),
+      counter(-1), disjoint(false) {}
+  };
+
+  // The function being lowered
+  struct Frame {
+    Function *fn;
+    Block *cur;
+    std::vector<Var> scope;
+    std::set<std::string> shared;
+    std::vector<std::map<Block*, Instr*>> defs;
+    std::map<Block*, std::vector<std::pair<int, Instr*>>> incomplete;
+    std::set<Block*> sealed;
+    std::vector<Instr*> captured;
+    // The memoised function whose table this function is passed, and the
+    // memory and function its recursive calls use
+    FunctionDef *memo;
+    std::string table;
+    std::string worker;
+  };
+  Module *module;
+  Frame *frame;
+  std::set<std::string> names;
+  // The server definitions, whose initial declarations are run by the
+  // constructors of their instances
+  std::map<std::string, ServerDef*> servers;
+  // The last suffix given to each name made unique
+  std::map<std::string, int> suffixes;
+  int all;
+  // The input or output of the loop being lowered that is coalesced
+  Cmd *coalesced;
+
+  // Functions
+  Frame *open(const std::string &, Frame &, bool);
+  Instr *import(Instr *, bool);
+  void close(Frame *, Instr *);
+  std::string unique(const std::string &);
+  void reserve(Spec *);
+  std::string outline(Cmd *, std::list<Range*> *, std::vector<Instr*> &);
+  std::string construct(Server *, const std::string &, const std::string &,
+      std::list<Range*> *, std::list<Expr*> *);
+  void initial(Server *, const std::string &, const std::vector<Instr*> &,
+      std::list<Expr*> *, const std::vector<Instr*> &);
+  void state(std::list<Spec*> *, const std::string &,
+      const std::vector<Instr*> &);
+  void def(Def *);
+  void memoised(FunctionDef *);
+  void formals(std::list<Fml*> *);
+
+  // Names and SSA construction
+  int temp();
+  int declare(const std::string &);
+  void memory(const std::string &, const std::string &,
+      const std::vector<Instr*> & = std::vector<Instr*>());
+  void bind(const std::string &, Instr *);
+  Var lookup(const std::string &);
+  void assign(const Var &, std::vector<Instr*>, Instr *);
+  Instr *fetch(const Var &, std::vector<Instr*>);
+  void write(int, Block *, Instr *);
+  Instr *read(int, Block *);
+  Instr *phi(Block *);
+  Instr *undef(Block *);
+  Instr *operands(int, Instr *);
+  void seal(Block *);
+
+  // Shared names
+  void share(Spec *);
+  void share(Process *);
+  void share(Server *, bool);
+  void share(Cmd *);
+  void share(Altn *);
+  void share(Choice *);
+  void share(Select *);
+  void share(std::list<Range*> *);
+  void share(std::list<Expr*> *, Def *);
+  void share(Elem *);
+  void share(Expr *);
+  void shareAll(Cmd *);
+
+  // Instructions and blocks
+  Instr *emit(Instr::Op);
+  Instr *emit(Instr::Op, const std::vector<Instr*> &);
+  Instr *constant(int);
+  Instr *binary(Lex::Token, Instr *, Instr *);
+  Block *block();
+  void jump(Block *);
+  void branch(Instr *, Block *, Block *);
+  void enter(Block *);
+  void stop();
+
+  // Tree
+  void spec(Spec *);
+  void process(Process *);
+  void cmd(Cmd *);
+  void dispatch(Name *, std::list<Expr*> *, Instance::Dispatch, Def *, bool);
+  void invoke(const std::string &, std::list<Expr*> *, Def *, bool);
+  void transfer(RepSeq *);
+  void loop(std::list<Range*>::iterator, std::list<Range*>::iterator,
+      Rep &);
+  void body(Rep &);
+  void choice(Choice *, Block *);
+  void select(Select *, Instr *, Block *);
+  void alt(Alt *);
+  void repAlt(RepAlt *);
+  void altns(Altn *, std::vector<Altn*> &);
+  Instr *guard(Altn *);
+  Instr *channel(Altn *);
+  void accept(Altn *);
+  void check(const Var &, const std::string &, const std::vector<Instr*> &,
+      size_t);
+  void check(const Elem *);
+  std::vector<const Elem*> hoisted(Cmd *);
+  void hoist(const std::vector<const Elem*> &, Range *, Instr *, Instr *,
+      Instr *);
+  std::vector<Instr*> lengths(std::list<Expr*> *);
+  std::string location(Elem *, std::vector<Instr*> &);
+  Instr *address(Elem *);
+  void store(Elem *, Instr *);
+  std::vector<Instr*> values(std::list<Expr*> *);
+  Instr *value(Expr *);
+  Instr *logical(Lex::Token, Instr *, Expr *);
+};
+
+#endif
@@ -0,0 +1,1253 @@
+#include "Opt.h"
+#include "Tree.h"
+#include "Pool.h"
+
+#include <algorithm>
+#include <map>
+
+Opt Opt::instance;
+
+Opt::Opt() : lanes(DEFAULT_LANES) {
+  configure("const,cse,licm,sr,switch,select,cfg,vec,dce");
+}
+
+// Read a pipeline as a list of pass names, or "none"
+bool Opt::configure(const std::string &desc) {
+  std::vector<Pass> passes;
+  size_t i = 0;
+  while (desc != "none" && i < desc.size()) {
+    size_t j = desc.find(',', i);
+    if (j == std::string::npos)
+      j = desc.size();
+    std::string name = desc.substr(i, j-i);
+    if      (name == "const") passes.push_back(&Opt::constants);
+    else if (name == "cse")   passes.push_back(&Opt::cse);
+    else if (name == "dce")   passes.push_back(&Opt::dce);
+    else if (name == "licm")  passes.push_back(&Opt::licm);
+    else if (name == "sr")    passes.push_back(&Opt::reduce);
+    else if (name == "select") passes.push_back(&Opt::select);
+    else if (name == "cfg")   passes.push_back(&Opt::merge);
+    else if (name == "vec")   passes.push_back(&Opt::vectorise);
+    else if (name == "switch") passes.push_back(&Opt::dispatch);
+    else {
+      msg = "unknown pass: " + name;
+      return false;
+    }
+    i = j+1;
+  }
+  pipeline = passes;
+  return true;
+}
+
+// Functions are optimised independently, on the threads of the pool
+void Opt::optimise(Module *m) {
+  remainders.clear();
+  for (auto f : m->functions)
+    remainders[f];
+  POOL.run(m->functions.size(), [&](size_t n) {
+    Function *f = m->functions[n];
+    for (int i = 0; i < MAX_ROUNDS; i++) {
+      bool changed = false;
+      for (auto p : pipeline)
+        changed |= (this->*p)(f);
+      if (!changed)
+        break;
+    }
+  });
+}
+
+// ============================================================================
+// Utilities
+// ============================================================================
+
+static Instr *binary(Function *f, Lex::Token op, Instr *l, Instr *r) {
+  Instr *x = new Instr(Instr::BINARY);
+  x->opr = op;
+  x->id = f->newId();
+  x->args.push_back(l);
+  x->args.push_back(r);
+  return x;
+}
+
+static Instr *instr(Function *f, Instr::Op op, int width) {
+  Instr *x = new Instr(op);
+  x->id = f->newId();
+  x->width = width;
+  return x;
+}
+
+// Turn an instruction into a constant
+static void fold(Instr *x, int v) {
+  x->op = Instr::CONST;
+  x->opr = Lex::tERROR;
+  x->value = v;
+  x->args.clear();
+}
+
+static bool isConst(Instr *x, int v) {
+  return x->op == Instr::CONST && x->value == v;
+}
+
+// Whether an instruction can be executed when it would not have been: it
+// has no side effects and cannot fault or fail to terminate
+static bool speculable(Instr *x) {
+  switch (x->op) {
+  default:
+    return false;
+  case Instr::CONST:
+  case Instr::UNARY:
+  case Instr::SELECT:
+  case Instr::SPLAT:
+  case Instr::ADDR:
+    return true;
+  case Instr::BINARY:
+    return (x->opr != Lex::tDIV && x->opr != Lex::tREM)
+        || (x->args[1]->op == Instr::CONST
+          && x->args[1]->value != 0 && x->args[1]->value != -1);
+  }
+}
+
+// Replace an instruction with another and remove it
+void Opt::replace(Function *f, Instr *x, Instr *y) {
+  f->replaceUses(x, y);
+  x->block->instrs.remove(x);
+}
+
+// Insert an instruction at the end of a block, before its terminator
+void Opt::insert(Block *b, Instr *x) {
+  auto i = b->instrs.end();
+  if (b->terminator() != nullptr)
+    --i;
+  b->instrs.insert(i, x);
+  x->block = b;
+}
+
+// Find the natural loops, innermost first. A loop only has a preheader when
+// a single block outside it enters it, and only enters it.
+std::vector<Opt::Loop> Opt::loops(Function *f) {
+  f->dominators();
+  std::vector<Loop> res;
+  std::map<Block*, size_t> index;
+  for (auto b : f->order()) {
+    for (auto h : b->succs) {
+      if (!f->dominates(h, b))
+        continue;
+      if (!index.count(h)) {
+        index[h] = res.size();
+        res.push_back(Loop{h, nullptr, std::set<Block*>()});
+        res.back().blocks.insert(h);
+      }
+      Loop &l = res[index[h]];
+      std::vector<Block*> work;
+      if (l.blocks.insert(b).second)
+        work.push_back(b);
+      while (!work.empty()) {
+        Block *x = work.back();
+        work.pop_back();
+        for (auto p : x->preds)
+          if (l.blocks.insert(p).second)
+            work.push_back(p);
+      }
+    }
+  }
+  for (auto &l : res) {
+    for (auto p : l.header->preds) {
+      if (l.blocks.count(p))
+        continue;
+      l.preheader = l.preheader == nullptr && p->succs.size() == 1 ?
+          p : nullptr;
+      if (l.preheader == nullptr)
+        break;
+    }
+  }
+  std::stable_sort(res.begin(), res.end(),
+      [](const Loop &a, const Loop &b) {
+        return a.blocks.size() < b.blocks.size();
+      });
+  return res;
+}
+
+// ============================================================================
+// Constant propagation: fold operations on constants and algebraic
+// identities, remove phis with a single distinct operand, and resolve
+// branches on constants, removing the blocks that become unreachable
+// ============================================================================
+
+bool Opt::constants(Function *f) {
+  f->uses();
+  bool any = false;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    bool edges = false;
+    for (auto b : f->order()) {
+      for (auto i = b->instrs.begin(); i != b->instrs.end(); ) {
+        Instr *x = *i++;
+        Instr *same = nullptr;
+        switch (x->op) {
+        default:
+          break;
+
+        case Instr::PHI:
+          for (auto y : x->args) {
+            if (y == x || y == same)
+              continue;
+            same = same == nullptr ? y : x;
+          }
+          if (same == x)
+            same = nullptr;
+          break;
+
+        case Instr::UNARY:
+          if (x->args[0]->op == Instr::CONST) {
+            int v = x->args[0]->value;
+            fold(x, x->opr == Lex::tSUB ? negate(v) : !v);
+            changed = true;
+          }
+          break;
+
+        case Instr::BINARY: {
+            Instr *l = x->args[0];
+            Instr *r = x->args[1];
+            int v;
+            bool flag;
+            if (l->op == Instr::CONST && r->op == Instr::CONST
+                && evaluate(x->opr, l->value, r->value, v, flag)) {
+              fold(x, v);
+              changed = true;
+              break;
+            }
+            switch (x->opr) {
+            default:
+              break;
+            case Lex::tADD:
+            case Lex::tOR:
+            case Lex::tXOR:
+              same = isConst(l, 0) ? r : isConst(r, 0) ? l : nullptr;
+              break;
+            case Lex::tSUB:
+            case Lex::tLSH:
+            case Lex::tRSH:
+              same = isConst(r, 0) ? l : nullptr;
+              break;
+            case Lex::tMUL:
+              same = isConst(l, 1) ? r : isConst(r, 1) ? l :
+                  isConst(l, 0) ? l : isConst(r, 0) ? r : nullptr;
+              break;
+            case Lex::tDIV:
+              same = isConst(r, 1) ? l : nullptr;
+              break;
+            case Lex::tAND:
+              same = isConst(l, 0) ? l : isConst(r, 0) ? r : nullptr;
+              break;
+            }
+            break;
+          }
+
+        // A check of a constant subscript against a constant length that
+        // it is within is removed
+        case Instr::CHECK:
+          if (x->args.size() == 2 && x->args[0]->op == Instr::CONST
+              && x->args[1]->op == Instr::CONST
+              && x->args[0]->value >= 0
+              && x->args[0]->value < x->args[1]->value) {
+            b->instrs.erase(std::prev(i));
+            changed = true;
+          }
+          break;
+
+        case Instr::SELECT:
+          if (x->args[0]->op == Instr::CONST)
+            same = x->args[0]->value ? x->args[1] : x->args[2];
+          else if (x->args[1] == x->args[2])
+            same = x->args[1];
+          break;
+
+        case Instr::CBR:
+          if (x->args[0]->op == Instr::CONST
+              && b->succs.size() == 2 && b->succs[0] != b->succs[1]) {
+            Block *dead = x->args[0]->value ? b->succs[1] : b->succs[0];
+            f->removeEdge(b, dead);
+            x->op = Instr::BR;
+            x->args.clear();
+            changed = edges = true;
+          }
+          break;
+
+        case Instr::SWITCH:
+          if (x->args[0]->op == Instr::CONST) {
+            Block *target = b->succs[0];
+            for (size_t k = 1; k < x->args.size(); k++)
+              if (x->args[k]->value == x->args[0]->value)
+                target = b->succs[k];
+            for (auto s : std::vector<Block*>(b->succs))
+              if (s != target)
+                f->removeEdge(b, s);
+            x->op = Instr::BR;
+            x->args.clear();
+            changed = edges = true;
+          }
+          break;
+        }
+        if (same != nullptr) {
+          replace(f, x, same);
+          changed = true;
+        }
+      }
+    }
+    if (edges)
+      f->removeUnreachable();
+    any |= changed;
+  }
+  return any;
+}
+
+// ============================================================================
+// Common subexpression elimination: a pure instruction is replaced by an
+// identical one that dominates it. A load is replaced by the value of an
+// earlier load or store of the same element in an extended basic block,
+// when nothing in between has a side effect that could change it.
+// ============================================================================
+
+static bool commutes(Lex::Token op) {
+  switch (op) {
+  default:
+    return false;
+  case Lex::tADD:
+  case Lex::tMUL:
+  case Lex::tAND:
+  case Lex::tOR:
+  case Lex::tXOR:
+  case Lex::tLAND:
+  case Lex::tLOR:
+  case Lex::tEQ:
+  case Lex::tNEQ:
+    return true;
+  }
+}
+
+static std::string key(Instr *x) {
+  std::vector<int> args;
+  for (auto y : x->args)
+    args.push_back(y->id);
+  if (x->op == Instr::BINARY && commutes(x->opr))
+    std::sort(args.begin(), args.end());
+  std::string s = std::to_string(x->op) + " " + std::to_string(x->opr)
+      + " " + std::to_string(x->value) + " " + std::to_string(x->width)
+      + " " + x->name;
+  for (auto y : args)
+    s += " " + std::to_string(y);
+  return s;
+}
+
+// Blocks are visited in a walk of the dominator tree, and an instruction
+// is only available until the walk leaves the blocks that its own block
+// dominates. A check is not pure, but one that a check of the same value
+// against the same length dominates can never fail.
+bool Opt::cse(Function *f) {
+  f->dominators();
+  f->uses();
+  std::vector<Block*> blocks = f->order();
+  std::sort(blocks.begin(), blocks.end(),
+      [](Block *a, Block *b) { return a->pre < b->pre; });
+  std::map<std::string, std::vector<Instr*>> seen;
+  std::vector<std::pair<Block*, std::vector<Instr*>*>> avail;
+  bool changed = false;
+  for (auto b : blocks) {
+    while (!avail.empty() && !f->dominates(avail.back().first, b)) {
+      avail.back().second->pop_back();
+      avail.pop_back();
+    }
+    for (auto i = b->instrs.begin(); i != b->instrs.end(); ) {
+      Instr *x = *i++;
+      if ((!x->pure() && x->op != Instr::CHECK) || x->op == Instr::PHI
+          || x->op == Instr::PARAM || x->op == Instr::UNDEF)
+        continue;
+      std::vector<Instr*> &v = seen[key(x)];
+      if (!v.empty()) {
+        replace(f, x, v.back());
+        changed = true;
+      }
+      else {
+        v.push_back(x);
+        avail.push_back(std::make_pair(b, &v));
+      }
+    }
+  }
+  std::map<Block*, std::map<std::string, std::map<std::string, Instr*>>> out;
+  for (auto b : f->order()) {
+    std::map<std::string, std::map<std::string, Instr*>> avail;
+    if (b->preds.size() == 1 && out.count(b->preds[0]))
+      avail = out[b->preds[0]];
+    for (auto i = b->instrs.begin(); i != b->instrs.end(); ) {
+      Instr *x = *i++;
+      if (x->op != Instr::LOAD && x->op != Instr::STORE) {
+        if (!x->pure() && !x->terminator())
+          avail.clear();
+        continue;
+      }
+      size_t n = x->args.size() - (x->op == Instr::STORE ? 1 : 0);
+      std::string k = std::to_string(x->width);
+      for (size_t j = 0; j < n; j++)
+        k += " " + std::to_string(x->args[j]->id);
+      if (x->op == Instr::STORE) {
+        avail[x->name].clear();
+        avail[x->name][k] = x->args[n];
+      }
+      else if (avail[x->name].count(k)) {
+        replace(f, x, avail[x->name][k]);
+        changed = true;
+      }
+      else
+        avail[x->name][k] = x;
+    }
+    out[b] = avail;
+  }
+  return changed;
+}
+
+// ============================================================================
+// Dead code elimination: pure instructions that no instruction with a side
+// effect depends on are removed
+// ============================================================================
+
+bool Opt::dce(Function *f) {
+  std::set<Instr*> live;
+  std::vector<Instr*> work;
+  for (auto b : f->blocks)
+    for (auto x : b->instrs)
+      if (!x->pure() && live.insert(x).second)
+        work.push_back(x);
+  while (!work.empty()) {
+    Instr *x = work.back();
+    work.pop_back();
+    for (auto y : x->args)
+      if (live.insert(y).second)
+        work.push_back(y);
+  }
+  bool changed = false;
+  for (auto b : f->blocks) {
+    for (auto i = b->instrs.begin(); i != b->instrs.end(); ) {
+      if (live.count(*i))
+        ++i;
+      else {
+        i = b->instrs.erase(i);
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+// ============================================================================
+// Loop-invariant code motion: pure instructions whose operands are all
+// defined outside a loop are moved to its preheader. Calls, which may not
+// terminate, and divisions, which may fault, are left in place.
+// ============================================================================
+
+static bool invariant(Instr *x, const std::set<Block*> &blocks) {
+  if (!speculable(x))
+    return false;
+  for (auto y : x->args)
+    if (blocks.count(y->block))
+      return false;
+  return true;
+}
+
+bool Opt::licm(Function *f) {
+  bool changed = false;
+  for (auto &l : loops(f)) {
+    if (l.preheader == nullptr)
+      continue;
+    bool moved = true;
+    while (moved) {
+      moved = false;
+      for (auto b : f->order()) {
+        if (!l.blocks.count(b))
+          continue;
+        for (auto i = b->instrs.begin(); i != b->instrs.end(); ) {
+          Instr *x = *i++;
+          if (!invariant(x, l.blocks))
+            continue;
+          b->instrs.remove(x);
+          insert(l.preheader, x);
+          moved = changed = true;
+        }
+      }
+    }
+  }
+  return changed;
+}
+
+// ============================================================================
+// Strength reduction: the product of an induction variable and a loop
+// invariant becomes an induction variable of its own, stepped by an
+// addition, and multiplications by powers of two become shifts
+// ============================================================================
+
+bool Opt::reduce(Function *f) {
+  bool changed = false;
+  for (auto &l : loops(f)) {
+    Block *h = l.header;
+    if (l.preheader == nullptr || h->preds.size() != 2)
+      continue;
+    size_t in = h->preds[0] == l.preheader ? 0 : 1;
+    std::vector<Instr*> phis;
+    for (auto x : h->instrs)
+      if (x->op == Instr::PHI)
+        phis.push_back(x);
+    for (auto i : phis) {
+      // A basic induction variable is stepped by an invariant each iteration
+      Instr *next = i->args[1-in];
+      if (next->op != Instr::BINARY || next->opr != Lex::tADD)
+        continue;
+      Instr *step = next->args[0] == i ? next->args[1] :
+          next->args[1] == i ? next->args[0] : nullptr;
+      if (step == nullptr || l.blocks.count(step->block))
+        continue;
+      for (auto b : f->order()) {
+        if (!l.blocks.count(b))
+          continue;
+        for (auto it = b->instrs.begin(); it != b->instrs.end(); ) {
+          Instr *m = *it++;
+          if (m->op != Instr::BINARY || m->opr != Lex::tMUL)
+            continue;
+          Instr *k = m->args[0] == i ? m->args[1] :
+              m->args[1] == i ? m->args[0] : nullptr;
+          if (k == nullptr || l.blocks.count(k->block))
+            continue;
+          Instr *init = binary(f, Lex::tMUL, i->args[in], k);
+          Instr *inc = binary(f, Lex::tMUL, step, k);
+          insert(l.preheader, init);
+          insert(l.preheader, inc);
+          Instr *j = new Instr(Instr::PHI);
+          j->id = f->newId();
+          j->block = h;
+          h->instrs.insert(std::find(h->instrs.begin(), h->instrs.end(), i), j);
+          Instr *jn = binary(f, Lex::tADD, j, inc);
+          jn->block = next->block;
+          auto pos = std::find(next->block->instrs.begin(),
+              next->block->instrs.end(), next);
+          next->block->instrs.insert(++pos, jn);
+          j->args.resize(2);
+          j->args[in] = init;
+          j->args[1-in] = jn;
+          replace(f, m, j);
+          changed = true;
+        }
+      }
+    }
+  }
+  for (auto b : f->blocks) {
+    for (auto i = b->instrs.begin(); i != b->instrs.end(); ++i) {
+      Instr *x = *i;
+      if (x->op != Instr::BINARY || x->opr != Lex::tMUL)
+        continue;
+      if (x->args[0]->op == Instr::CONST)
+        std::swap(x->args[0], x->args[1]);
+      Instr *c = x->args[1];
+      if (c->op != Instr::CONST || c->value <= 1
+          || (c->value & (c->value - 1)) != 0)
+        continue;
+      int n = 0;
+      while ((1 << n) < c->value)
+        n++;
+      Instr *s = new Instr(Instr::CONST);
+      s->id = f->newId();
+      s->value = n;
+      s->block = b;
+      b->instrs.insert(i, s);
+      x->opr = Lex::tLSH;
+      x->args[1] = s;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+// ============================================================================
+// If-conversion: a conditional whose arms only compute values that can be
+// computed whatever the condition becomes a select of the values
+// ============================================================================
+
+// Whether a block is a small arm of a conditional in a block, joining
+// another block
+static bool arm(Block *a, Block *j) {
+  if (a->preds.size() != 1 || a->succs.size() != 1 || a->succs[0] != j
+      || a->instrs.size() > MAX_SPECULATE + 1)
+    return false;
+  for (auto x : a->instrs)
+    if (x != a->terminator() && !speculable(x))
+      return false;
+  return true;
+}
+
+bool Opt::select(Function *f) {
+  bool changed = false;
+  bool found = true;
+  while (found) {
+    found = false;
+    for (auto b : f->order()) {
+      Instr *x = b->terminator();
+      if (x == nullptr || x->op != Instr::CBR || b->succs.size() != 2)
+        continue;
+      Block *t = b->succs[0];
+      Block *e = b->succs[1];
+      Block *j = nullptr;
+      std::vector<Block*> arms;
+      if (t != e && t->succs.size() == 1 && arm(t, t->succs[0])
+          && arm(e, t->succs[0])) {
+        j = t->succs[0];
+        arms.push_back(t);
+        arms.push_back(e);
+      }
+      else if (t != e && arm(t, e)) {
+        j = e;
+        arms.push_back(t);
+      }
+      else if (t != e && arm(e, t)) {
+        j = t;
+        arms.push_back(e);
+      }
+      if (j == nullptr || j == b || j->preds.size() != 2)
+        continue;
+      // Compute the arms unconditionally
+      for (auto a : arms) {
+        for (auto y : a->instrs) {
+          if (y == a->terminator())
+            continue;
+          insert(b, y);
+        }
+      }
+      // Select the value each phi of the join takes
+      for (auto i = j->instrs.begin(); i != j->instrs.end(); ) {
+        Instr *y = *i++;
+        if (y->op != Instr::PHI)
+          continue;
+        Instr *tv = nullptr;
+        Instr *fv = nullptr;
+        for (size_t k = 0; k < j->preds.size(); k++) {
+          Block *p = j->preds[k];
+          if (p == t || (p == b && j == t))
+            tv = y->args[k];
+          else
+            fv = y->args[k];
+        }
+        if (tv == fv) {
+          replace(f, y, tv);
+          continue;
+        }
+        y->op = Instr::SELECT;
+        y->args.clear();
+        y->args.push_back(x->args[0]);
+        y->args.push_back(tv);
+        y->args.push_back(fv);
+      }
+      x->op = Instr::BR;
+      x->args.clear();
+      b->succs.assign(1, j);
+      j->preds.assign(1, b);
+      for (auto a : arms) {
+        a->preds.clear();
+        a->succs.clear();
+        f->blocks.erase(std::find(f->blocks.begin(), f->blocks.end(), a));
+      }
+      found = changed = true;
+      break;
+    }
+  }
+  return changed;
+}
+
+// ============================================================================
+// Control flow simplification: a block that is the only successor of its
+// only predecessor is merged into it
+// ============================================================================
+
+bool Opt::merge(Function *f) {
+  f->uses();
+  bool changed = false;
+  bool found = true;
+  while (found) {
+    found = false;
+    for (auto b : f->blocks) {
+      Instr *x = b->terminator();
+      if (x == nullptr || x->op != Instr::BR || b->succs.size() != 1)
+        continue;
+      Block *s = b->succs[0];
+      if (s == b || s == f->blocks.front() || s->preds.size() != 1)
+        continue;
+      b->instrs.pop_back();
+      std::vector<Instr*> phis;
+      for (auto y : s->instrs) {
+        if (y->op == Instr::PHI) {
+          phis.push_back(y);
+          continue;
+        }
+        y->block = b;
+        b->instrs.push_back(y);
+      }
+      for (auto y : phis)
+        f->replaceUses(y, y->args[0]);
+      b->succs = s->succs;
+      for (auto t : s->succs)
+        std::replace(t->preds.begin(), t->preds.end(), s, b);
+      f->blocks.erase(std::find(f->blocks.begin(), f->blocks.end(), s));
+      found = changed = true;
+      break;
+    }
+  }
+  return changed;
+}
+
+// ============================================================================
+// Vectorisation: an innermost loop counted by an induction variable, whose
+// body is a single block of operations on arrays indexed by the counter, is
+// preceded by a loop that performs a number of its iterations at once with
+// vector operations. The original loop then performs any that remain. Sums,
+// products, bitwise reductions, and maxima or minima chosen by a comparison
+// and a select are accumulated in vectors and reduced when the vector loop
+// finishes. Loads and stores must access consecutive elements as the
+// counter increases, and memory that is stored must only be accessed at the
+// same element in each iteration, since distinct names do not alias.
+// ============================================================================
+
+// How a value of the body varies across iterations: the same in each,
+// stepped by a constant stride, in some other way, or in an unknown way
+typedef enum {
+  UNIFORM,
+  LINEAR,
+  VARYING,
+  UNKNOWN
+} Variance;
+
+// The value of the reduction operator that leaves its operand unchanged
+static int identity(Lex::Token op) {
+  switch (op) {
+  default:        return 0;
+  case Lex::tMUL: return 1;
+  case Lex::tAND: return -1;
+  }
+}
+
+bool Opt::vectorise(Function *f) {
+  if (lanes <= 1)
+    return false;
+  bool changed = false;
+  bool found = true;
+  while (found) {
+    found = false;
+    for (auto &l : loops(f)) {
+      if (vectorise(f, l)) {
+        found = changed = true;
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+bool Opt::vectorise(Function *f, Loop &l) {
+  Block *h = l.header;
+  Block *p = l.preheader;
+  if (p == nullptr || l.blocks.size() != 2 || remainders.at(f).count(h)
+      || h->preds.size() != 2 || h->succs.size() != 2)
+    return false;
+  Block *b = h->succs[0];
+  if (!l.blocks.count(b) || b == h || b->preds.size() != 1
+      || b->succs.size() != 1 || b->succs[0] != h)
+    return false;
+  size_t in = h->preds[0] == p ? 0 : 1;
+
+  // The header holds phis, a test of the counter against a limit and a
+  // branch
+  std::vector<Instr*> phis;
+  Instr *test = nullptr;
+  Instr *br = nullptr;
+  for (auto x : h->instrs) {
+    if (x->op == Instr::PHI && test == nullptr)
+      phis.push_back(x);
+    else if (test == nullptr && x->op == Instr::BINARY
+        && x->opr == Lex::tLT && x->width == 1)
+      test = x;
+    else if (br == nullptr && x->op == Instr::CBR && x->args[0] == test)
+      br = x;
+    else
+      return false;
+  }
+  if (br == nullptr)
+    return false;
+  Instr *counter = test->args[0];
+  Instr *limit = test->args[1];
+  if (counter->block != h || counter->op != Instr::PHI
+      || l.blocks.count(limit->block))
+    return false;
+
+  std::map<Instr*, int> uses;
+  for (auto bl : l.blocks)
+    for (auto x : bl->instrs)
+      for (auto y : x->args)
+        uses[y]++;
+
+  // Classify the phis as induction variables or reductions
+  std::map<Instr*, Variance> var;
+  std::map<Instr*, int> stride;
+  std::map<Instr*, Instr*> step;
+  std::map<Instr*, Lex::Token> reduction;
+  std::set<Instr*> updates;
+  for (auto x : phis) {
+    Instr *next = x->args[1-in];
+    if (next->block != b || next->width != 1)
+      return false;
+    Instr *other = next->args.size() == 2 ?
+        (next->args[0] == x ? next->args[1] :
+         next->args[1] == x ? next->args[0] : nullptr) : nullptr;
+    if (next->op == Instr::BINARY && next->opr == Lex::tADD
+        && other != nullptr && !l.blocks.count(other->block)) {
+      step[x] = other;
+      var[x] = other->op == Instr::CONST ? LINEAR : UNKNOWN;
+      stride[x] = other->value;
+      if (var[x] == UNKNOWN)
+        updates.insert(next);
+      continue;
+    }
+    if (uses[next] != 1)
+      return false;
+    if (next->op == Instr::BINARY && other != nullptr && other != x
+        && uses[x] == 1) {
+      switch (next->opr) {
+      default:
+        return false;
+      case Lex::tADD:
+      case Lex::tMUL:
+      case Lex::tAND:
+      case Lex::tOR:
+      case Lex::tXOR:
+        break;
+      }
+      reduction[x] = next->opr;
+      var[x] = VARYING;
+      continue;
+    }
+    // A select of the greater or lesser of the accumulator and a value
+    if (next->op != Instr::SELECT || uses[x] != 2)
+      return false;
+    Instr *cmp = next->args[0];
+    Instr *a = next->args[1];
+    Instr *c = next->args[2];
+    if (cmp->op != Instr::BINARY || uses[cmp] != 1 || (a != x && c != x)
+        || !((cmp->args[0] == a && cmp->args[1] == c)
+          || (cmp->args[0] == c && cmp->args[1] == a)))
+      return false;
+    bool greater;
+    switch (cmp->opr) {
+    default:
+      return false;
+    case Lex::tGT:
+    case Lex::tGEQ:
+      greater = true;
+      break;
+    case Lex::tLT:
+    case Lex::tLEQ:
+      greater = false;
+      break;
+    }
+    reduction[x] = (cmp->args[0] == a) == greater ? Lex::tGT : Lex::tLT;
+    var[x] = VARYING;
+  }
+  if (!step.count(counter) || var[counter] != LINEAR || stride[counter] != 1)
+    return false;
+
+  // Classify the body
+  auto variance = [&](Instr *y) {
+    if (var.count(y))
+      return var[y];
+    return l.blocks.count(y->block) ? UNKNOWN : UNIFORM;
+  };
+  std::map<std::string, std::vector<Instr*>> accesses;
+  std::set<std::string> stored;
+  for (auto x : b->instrs) {
+    if (x == b->terminator())
+      continue;
+    if (x->width != 1)
+      return false;
+    if (updates.count(x)) {
+      var[x] = UNKNOWN;
+      continue;
+    }
+    std::vector<Variance> v;
+    bool linear = false;
+    bool varying = false;
+    for (auto y : x->args) {
+      v.push_back(variance(y));
+      if (v.back() == UNKNOWN)
+        return false;
+      linear |= v.back() == LINEAR;
+      varying |= v.back() == VARYING;
+    }
+    switch (x->op) {
+    default:
+      return false;
+
+    case Instr::CONST:
+      var[x] = UNIFORM;
+      break;
+
+    // Accesses of consecutive elements
+    case Instr::LOAD:
+    case Instr::STORE: {
+        size_t n = x->args.size() - (x->op == Instr::STORE ? 1 : 0);
+        if (n == 0)
+          return false;
+        for (size_t i = 0; i + 1 < n; i++)
+          if (v[i] != UNIFORM)
+            return false;
+        if (x->op == Instr::STORE && v[n] == LINEAR)
+          return false;
+        if (v[n-1] == UNIFORM && x->op == Instr::LOAD)
+          var[x] = UNIFORM;
+        else if (v[n-1] == LINEAR && stride[x->args[n-1]] == 1)
+          var[x] = VARYING;
+        else
+          return false;
+        accesses[x->name].push_back(x);
+        if (x->op == Instr::STORE)
+          stored.insert(x->name);
+        break;
+      }
+
+    case Instr::UNARY:
+    case Instr::BINARY:
+    case Instr::SELECT:
+      if (!linear) {
+        if (varying && !speculable(x))
+          return false;
+        var[x] = varying ? VARYING : UNIFORM;
+        break;
+      }
+      // Affine functions of induction variables
+      if (varying)
+        return false;
+      var[x] = LINEAR;
+      if (x->op == Instr::UNARY && x->opr == Lex::tSUB)
+        stride[x] = -stride[x->args[0]];
+      else if (x->op == Instr::BINARY && x->opr == Lex::tADD)
+        stride[x] = (v[0] == LINEAR ? stride[x->args[0]] : 0)
+            + (v[1] == LINEAR ? stride[x->args[1]] : 0);
+      else if (x->op == Instr::BINARY && x->opr == Lex::tSUB)
+        stride[x] = (v[0] == LINEAR ? stride[x->args[0]] : 0)
+            - (v[1] == LINEAR ? stride[x->args[1]] : 0);
+      else if (x->op == Instr::BINARY && x->opr == Lex::tMUL
+          && x->args[1]->op == Instr::CONST)
+        stride[x] = stride[x->args[0]] * x->args[1]->value;
+      else if (x->op == Instr::BINARY && x->opr == Lex::tLSH
+          && x->args[1]->op == Instr::CONST
+          && x->args[1]->value >= 0 && x->args[1]->value < 16)
+        stride[x] = stride[x->args[0]] << x->args[1]->value;
+      else
+        return false;
+      break;
+    }
+  }
+
+  // Memory that is stored must be accessed at the same element throughout
+  for (auto &name : stored) {
+    std::vector<Instr*> &a = accesses[name];
+    for (auto x : a) {
+      size_t n = x->args.size() - (x->op == Instr::STORE ? 1 : 0);
+      size_t m = a[0]->args.size() - (a[0]->op == Instr::STORE ? 1 : 0);
+      if (n != m || !std::equal(x->args.begin(), x->args.begin() + n,
+            a[0]->args.begin()))
+        return false;
+    }
+  }
+
+  // Enter a vector loop in place of the original, which it then leaves to
+  Block *vh = f->newBlock();
+  Block *vb = f->newBlock();
+  Block *done = f->newBlock();
+  std::replace(p->succs.begin(), p->succs.end(), h, vh);
+  h->preds[in] = done;
+  vh->preds = {p, vb};
+  vh->succs = {vb, done};
+  vb->preds = {vh};
+  vb->succs = {vh};
+  done->preds = {vh};
+  done->succs = {h};
+  Instr *w = instr(f, Instr::CONST, 1);
+  w->value = lanes;
+  insert(p, w);
+
+  // Induction variables count from the same start and accumulators from the
+  // identity, or the start of a maximum or minimum
+  std::map<Instr*, Instr*> vmap;
+  for (auto x : phis) {
+    Instr *y = instr(f, Instr::PHI, reduction.count(x) ? lanes : 1);
+    y->args.resize(2);
+    if (step.count(x))
+      y->args[0] = x->args[in];
+    else {
+      Instr *init = x->args[in];
+      if (reduction[x] != Lex::tGT && reduction[x] != Lex::tLT) {
+        init = instr(f, Instr::CONST, 1);
+        init->value = identity(reduction[x]);
+        insert(p, init);
+      }
+      Instr *s = instr(f, Instr::SPLAT, lanes);
+      s->args.push_back(init);
+      insert(p, s);
+      y->args[0] = s;
+    }
+    insert(vh, y);
+    vmap[x] = y;
+  }
+  Instr *left = binary(f, Lex::tSUB, limit, vmap[counter]);
+  insert(vh, left);
+  Instr *enough = binary(f, Lex::tGEQ, left, w);
+  insert(vh, enough);
+  Instr *cbr = instr(f, Instr::CBR, 1);
+  cbr->args.push_back(enough);
+  insert(vh, cbr);
+
+  // Uniform and linear values are computed once for the first lane, and
+  // others in every lane
+  std::map<Instr*, Instr*> splats;
+  auto operand = [&](Instr *y, bool vector) {
+    Instr *v = vmap.count(y) ? vmap[y] : y;
+    if (!vector || v->width > 1)
+      return v;
+    if (!splats.count(v)) {
+      Instr *s = instr(f, Instr::SPLAT, lanes);
+      s->args.push_back(v);
+      insert(vb, s);
+      splats[v] = s;
+    }
+    return splats[v];
+  };
+  for (auto x : b->instrs) {
+    if (x == b->terminator())
+      continue;
+    bool vector = x->op == Instr::STORE || var[x] == VARYING;
+    Instr *y = instr(f, x->op, vector ? lanes : 1);
+    y->opr = x->opr;
+    y->value = x->value;
+    y->name = x->name;
+    for (size_t i = 0; i < x->args.size(); i++) {
+      bool subscript = x->op == Instr::LOAD
+          || (x->op == Instr::STORE && i + 1 < x->args.size());
+      y->args.push_back(operand(x->args[i], vector && !subscript));
+    }
+    insert(vb, y);
+    vmap[x] = y;
+  }
+  for (auto x : phis) {
+    Instr *y = vmap[x];
+    if (step.count(x)) {
+      Instr *inc = binary(f, Lex::tMUL, step[x], w);
+      insert(p, inc);
+      Instr *next = binary(f, Lex::tADD, y, inc);
+      insert(vb, next);
+      y->args[1] = next;
+    }
+    else
+      y->args[1] = vmap[x->args[1-in]];
+  }
+  insert(vb, instr(f, Instr::BR, 1));
+
+  // The original loop continues from where the vector loop finished
+  for (auto x : phis) {
+    if (step.count(x)) {
+      x->args[in] = vmap[x];
+      continue;
+    }
+    Instr *r = instr(f, Instr::REDUCE, 1);
+    r->opr = reduction[x];
+    r->args.push_back(vmap[x]);
+    insert(done, r);
+    if (reduction[x] == Lex::tGT || reduction[x] == Lex::tLT)
+      x->args[in] = r;
+    else {
+      Instr *y = binary(f, reduction[x], x->args[in], r);
+      insert(done, y);
+      x->args[in] = y;
+    }
+  }
+  insert(done, instr(f, Instr::BR, 1));
+  remainders.at(f).insert(h);
+  return true;
+}
+
+// ============================================================================
+// Dispatch: a chain of comparisons of the same value with distinct
+// constants, such as a case or a series of if commands testing the same
+// selector lower to, becomes a switch when the constants are dense, which a
+// backend dispatches on with a jump table, or a binary search otherwise
+// ============================================================================
+
+// Whether a block ends by branching on the equality of a value with a
+// constant
+static bool equality(Block *b, Instr *&v, Instr *&k) {
+  Instr *x = b->terminator();
+  if (x == nullptr || x->op != Instr::CBR || b->succs.size() != 2
+      || b->succs[0] == b->succs[1])
+    return false;
+  Instr *c = x->args[0];
+  if (c->op != Instr::BINARY || c->opr != Lex::tEQ || c->width != 1)
+    return false;
+  v = c->args[0];
+  k = c->args[1];
+  if (v->op == Instr::CONST)
+    std::swap(v, k);
+  return k->op == Instr::CONST && v->op != Instr::CONST;
+}
+
+// Whether a block does nothing but test a value against a constant
+static bool onlyTest(Block *b, std::map<Instr*, int> &uses) {
+  Instr *c = b->terminator()->args[0];
+  for (auto x : b->instrs)
+    if (x != b->terminator() && x->op != Instr::CONST
+        && (x != c || uses[c] != 1))
+      return false;
+  return true;
+}
+
+// Move the edge from a predecessor to the front of a block's predecessors,
+// with the phi operands that correspond to it
+static void front(Block *to, Block *from) {
+  size_t i = std::find(to->preds.begin(), to->preds.end(), from)
+      - to->preds.begin();
+  std::swap(to->preds[0], to->preds[i]);
+  for (auto x : to->instrs)
+    if (x->op == Instr::PHI)
+      std::swap(x->args[0], x->args[i]);
+}
+
+// Add an edge to a block, whose phis take the same value from the new
+// predecessor as from its first
+static void link(Block *from, Block *to) {
+  from->succs.push_back(to);
+  to->preds.push_back(from);
+  for (auto x : to->instrs)
+    if (x->op == Instr::PHI)
+      x->args.push_back(x->args[0]);
+}
+
+// Remove the first predecessor of a block, once new edges replace it
+static void unlink(Block *to) {
+  to->preds.erase(to->preds.begin());
+  for (auto x : to->instrs)
+    if (x->op == Instr::PHI)
+      x->args.erase(x->args.begin());
+}
+
+bool Opt::dispatch(Function *f) {
+  bool changed = false;
+  bool found = true;
+  while (found) {
+    found = false;
+    std::map<Instr*, int> uses;
+    for (auto b : f->blocks)
+      for (auto x : b->instrs)
+        for (auto y : x->args)
+          uses[y]++;
+    for (auto b : f->order()) {
+      Instr *v;
+      Instr *k;
+      if (!equality(b, v, k))
+        continue;
+      // Follow the chain while each test only leads to the next
+      std::vector<std::pair<Instr*, Block*>> cases;
+      std::vector<Block*> chain;
+      std::set<int> values;
+      std::set<Block*> targets;
+      Block *cur = b;
+      Block *def = nullptr;
+      while (true) {
+        Block *t = cur->succs[0];
+        if (t->preds.size() != 1 || targets.count(t)
+            || values.count(k->value))
+          break;
+        cases.push_back(std::make_pair(k, t));
+        chain.push_back(cur);
+        values.insert(k->value);
+        targets.insert(t);
+        def = cur->succs[1];
+        Instr *w;
+        if (def->preds.size() != 1 || !equality(def, w, k) || w != v
+            || !onlyTest(def, uses))
+          break;
+        cur = def;
+      }
+      if (cases.size() < MIN_SWITCH || targets.count(def))
+        continue;
+
+      // Take the constants into the head of the chain and disconnect it
+      for (auto c : chain) {
+        if (c == b)
+          continue;
+        for (auto x : c->instrs)
+          if (x->op == Instr::CONST)
+            insert(b, x);
+        f->blocks.erase(std::find(f->blocks.begin(), f->blocks.end(), c));
+      }
+      // The default may be reached from outside the chain too, so only the
+      // chain's edges are replaced
+      front(def, chain.back());
+      b->succs.clear();
+      Instr *x = b->terminator();
+      x->args.clear();
+      std::sort(cases.begin(), cases.end(),
+          [](const std::pair<Instr*, Block*> &l,
+             const std::pair<Instr*, Block*> &r) {
+            return l.first->value < r.first->value;
+          });
+      long range = (long) cases.back().first->value
+          - cases.front().first->value + 1;
+      if (range <= (long) cases.size() * SWITCH_DENSITY) {
+        x->op = Instr::SWITCH;
+        x->args.push_back(v);
+        link(b, def);
+        for (auto &c : cases) {
+          x->args.push_back(c.first);
+          link(b, c.second);
+        }
+      }
+      else {
+        x->op = Instr::BR;
+        link(b, search(f, v, cases, 0, cases.size(), def));
+      }
+      for (auto t : targets)
+        unlink(t);
+      unlink(def);
+      found = changed = true;
+      break;
+    }
+  }
+  return changed;
+}
+
+// Build a binary search of a range of sorted cases, with linear tests of
+// the last few
+Block *Opt::search(Function *f, Instr *v,
+    std::vector<std::pair<Instr*, Block*>> &cases, size_t lo, size_t hi,
+    Block *def) {
+  Block *b = f->newBlock();
+  Instr *br = instr(f, Instr::CBR, 1);
+  if (hi - lo <= 2) {
+    Instr *c = binary(f, Lex::tEQ, v, cases[lo].first);
+    insert(b, c);
+    br->args.push_back(c);
+    insert(b, br);
+    link(b, cases[lo].second);
+    link(b, lo + 1 < hi ? search(f, v, cases, lo + 1, hi, def) : def);
+    return b;
+  }
+  size_t mid = (lo + hi) / 2;
+  Instr *c = binary(f, Lex::tLT, v, cases[mid].first);
+  insert(b, c);
+  br->args.push_back(c);
+  insert(b, br);
+  link(b, search(f, v, cases, lo, mid, def));
+  link(b, search(f, v, cases, mid, hi, def));
+  return b;
+}
@@ -0,0 +1,83 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "IR.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define OPT Opt::get()
+
+// The maximum number of times the pipeline is run over a function
+#define MAX_ROUNDS 8
+
+// The maximum number of instructions in an arm of a conditional that is
+// replaced by a select
+#define MAX_SPECULATE 8
+
+// The least number of comparisons of a value with constants that are
+// replaced by a switch or a binary search
+#define MIN_SWITCH 4
+
+// A switch is used when its values cover at least this fraction (1/n) of
+// the range between the least and greatest of them
+#define SWITCH_DENSITY 2
+
+// The default number of vector lanes, of 32-bit words in 256 bits
+#define DEFAULT_LANES 8
+
+// The pass manager: every function of a module is put through the same
+// pipeline of scalar optimisations, repeated until none of them changes it,
+// so that each backend starts from optimised code. The pipeline can be
+// given as a list of pass names, for example "const,cse,dce".
+class Opt {
+public:
+  static Opt instance;
+  static Opt &get() { return instance; }
+  Opt();
+  ~Opt() {};
+  bool configure(const std::string &);
+  const std::string &error() { return msg; }
+  void setLanes(int n) { lanes = n; }
+  void optimise(Module *);
+
+private:
+  typedef bool (Opt::*Pass)(Function *);
+
+  // A natural loop, with the block that is its only entry from outside
+  struct Loop {
+    Block *header;
+    Block *preheader;
+    std::set<Block*> blocks;
+  };
+  std::vector<Pass> pipeline;
+  std::string msg;
+  int lanes;
+  // The headers of loops left to finish the iterations of a vector loop, of
+  // each function, which are all present before functions are optimised
+  std::map<Function*, std::set<Block*>> remainders;
+
+  // Passes
+  bool constants(Function *);
+  bool cse(Function *);
+  bool dce(Function *);
+  bool licm(Function *);
+  bool reduce(Function *);
+  bool select(Function *);
+  bool merge(Function *);
+  bool vectorise(Function *);
+  bool vectorise(Function *, Loop &);
+  bool dispatch(Function *);
+  Block *search(Function *, Instr *,
+      std::vector<std::pair<Instr*, Block*>> &, size_t, size_t, Block *);
+
+  // Utilities
+  std::vector<Loop> loops(Function *);
+  void replace(Function *, Instr *, Instr *);
+  void insert(Block *, Instr *);
+};
+
+#endif
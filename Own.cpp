@@ -0,0 +1,648 @@
+#include "Own.h"
+
+Own Own::instance;
+
+void Own::transfer(Tree *t) {
+  vars.clear();
+  for (auto x : t->spec) spec(x);
+  for (auto x : t->prog) cmd(x);
+}
+
+// Classify an output: only a whole array can be copied or moved
+void Own::out(Out *o) {
+  Expr *e = o->rhs;
+  while (e->type == Expr::EXPR)
+    e = static_cast<OperExpr*>(e)->expr;
+  if (e->type != Expr::ELEM)
+    return;
+  Elem *elem = static_cast<OperElem*>(e)->elem;
+  if (elem->type != Elem::NAME || elem->subscripts != nullptr)
+    return;
+  const std::string &n = static_cast<Name*>(elem)->str;
+
+  for (auto x = vars.rbegin(); x != vars.rend(); ++x) {
+    if (x->name != n)
+      continue;
+    if (!x->array)
+      return;
+    o->mode = Out::COPY;
+    bool found = false;
+    if (x->decl != nullptr
+        && !liveAfter(x->decl->cmd, o, n, found)
+        && found)
+      o->mode = Out::MOVE;
+    return;
+  }
+}
+
+// Whether the name is used after the target command has been performed in
+// the scope of a command. Found is set when the target has been passed.
+bool Own::liveAfter(Cmd *c, Cmd *t, const std::string &n, bool &found) {
+  if (c == nullptr)
+    return false;
+  if (c == t) {
+    found = true;
+    return false;
+  }
+  switch (c->type) {
+  default:
+    return false;
+
+  case Cmd::SPEC: {
+      CmdSpec *x = static_cast<CmdSpec*>(c);
+      bool live = liveAfter(x->cmd, t, n, found);
+      // An abbreviation of the array may be used in its place
+      return live || (found && uses(x->spec, n));
+    }
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds) {
+      if (found) {
+        if (uses(x, n, nullptr))
+          return true;
+      }
+      else if (liveAfter(x, t, n, found))
+        return true;
+    }
+    return false;
+
+  // The other components could share the array
+  case Cmd::PAR: {
+      Par *x = static_cast<Par*>(c);
+      Cmd *component = nullptr;
+      for (auto y : *x->cmds) {
+        bool f = false;
+        if (liveAfter(y, t, n, f))
+          return true;
+        if (f) {
+          found = true;
+          component = y;
+        }
+      }
+      if (found)
+        for (auto y : *x->cmds)
+          if (y != component && uses(y, n, nullptr))
+            return true;
+      return false;
+    }
+
+  // The array is shared by each replicated instance
+  case Cmd::RPAR:
+    liveAfter(static_cast<RepPar*>(c)->cmd, t, n, found);
+    return found;
+
+  // The target itself uses the array again in the next iteration
+  case Cmd::WHILE:
+    liveAfter(static_cast<While*>(c)->cmd, t, n, found);
+    return found;
+
+  case Cmd::UNTIL:
+    liveAfter(static_cast<Until*>(c)->cmd, t, n, found);
+    return found;
+
+  case Cmd::DO:
+    liveAfter(static_cast<Do*>(c)->cmd, t, n, found);
+    return found;
+
+  case Cmd::RSEQ:
+    liveAfter(static_cast<RepSeq*>(c)->cmd, t, n, found);
+    return found;
+
+  // Only one of the branches is performed
+  case Cmd::IFD:
+    return liveAfter(static_cast<IfD*>(c)->cmd, t, n, found);
+
+  case Cmd::IFTE: {
+      IfTE *x = static_cast<IfTE*>(c);
+      bool live = liveAfter(x->cmd, t, n, found);
+      if (found)
+        return live;
+      return liveAfter(x->elseCmd, t, n, found);
+    }
+
+  case Cmd::CASE:
+    if (static_cast<Case*>(c)->selects != nullptr)
+      for (auto x : *static_cast<Case*>(c)->selects) {
+        bool live = liveAfter(x->cmd, t, n, found);
+        if (found)
+          return live;
+      }
+    return false;
+
+  case Cmd::RCASE:
+    return liveAfter(static_cast<RepCase*>(c)->select->cmd, t, n, found);
+
+  case Cmd::ALT:
+  case Cmd::RALT:
+  case Cmd::TEST:
+  case Cmd::RTEST: {
+      std::list<Cmd*> branches;
+      std::list<Altn*> altns;
+      std::list<Choice*> choices;
+      if (c->type == Cmd::ALT && static_cast<Alt*>(c)->altns != nullptr)
+        altns = *static_cast<Alt*>(c)->altns;
+      if (c->type == Cmd::RALT)
+        altns.push_back(static_cast<RepAlt*>(c)->altn);
+      if (c->type == Cmd::TEST && static_cast<Test*>(c)->choices != nullptr)
+        choices = *static_cast<Test*>(c)->choices;
+      if (c->type == Cmd::RTEST)
+        choices.push_back(static_cast<RepTest*>(c)->choice);
+      for (auto x : altns) {
+        while (x->type == Altn::SPEC)
+          x = static_cast<SpecAltn*>(x)->altn;
+        switch (x->type) {
+        default: break;
+        case Altn::UNGUARDED:
+          branches.push_back(static_cast<UnguardedAltn*>(x)->cmd); break;
+        case Altn::GUARDED:
+          branches.push_back(static_cast<GuardedAltn*>(x)->cmd); break;
+        case Altn::SKIP:
+          branches.push_back(static_cast<SkipAltn*>(x)->cmd); break;
+        case Altn::NESTED:
+          branches.push_back(static_cast<NestedAltn*>(x)->alt); break;
+        }
+      }
+      for (auto x : choices) {
+        while (x->type == Choice::SPEC)
+          x = static_cast<SpecChoice*>(x)->choice;
+        if (x->type == Choice::GUARDED)
+          branches.push_back(static_cast<GuardedChoice*>(x)->cmd);
+        else
+          branches.push_back(static_cast<NestedChoice*>(x)->test);
+      }
+      for (auto x : branches) {
+        bool live = liveAfter(x, t, n, found);
+        if (found)
+          return live;
+      }
+      return false;
+    }
+  }
+}
+
+// ============================================================================
+// Uses of a name
+// ============================================================================
+
+static bool usesActuals(std::list<Expr*> *l, const std::string &n) {
+  if (l != nullptr)
+    for (auto x : *l)
+      if (usesName(x, n))
+        return true;
+  return false;
+}
+
+bool Own::uses(std::list<Range*> *l, const std::string &n) {
+  if (l != nullptr)
+    for (auto x : *l)
+      if (usesName(x->base, n)
+          || usesName(x->count, n)
+          || usesName(x->step, n))
+        return true;
+  return false;
+}
+
+bool Own::uses(Spec *s, const std::string &n) {
+  if (s == nullptr)
+    return false;
+  switch (s->type) {
+  default:
+    return false;
+
+  case Spec::ABBR: {
+      Abbr *x = static_cast<Abbr*>(s);
+      if (x->type == Abbr::VAL)
+        return usesName(x->expr, n);
+      return usesName(x->elem, n);
+    }
+
+  case Spec::DECL: {
+      Decl *x = static_cast<Decl*>(s);
+      if (x->tDecl != Decl::VAR)
+        return false;
+      return usesActuals(static_cast<VarDecl*>(x)->spef->lengths, n);
+    }
+
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      if (uses(x, n))
+        return true;
+    return false;
+  }
+}
+
+bool Own::uses(Altn *a, const std::string &n, Cmd *except) {
+  switch (a->type) {
+  default:
+    return false;
+  case Altn::UNGUARDED: {
+      UnguardedAltn *x = static_cast<UnguardedAltn*>(a);
+      return usesName(x->dst, n) || usesName(x->src, n)
+          || uses(x->cmd, n, except);
+    }
+  case Altn::GUARDED: {
+      GuardedAltn *x = static_cast<GuardedAltn*>(a);
+      return usesName(x->expr, n)
+          || usesName(x->dst, n) || usesName(x->src, n)
+          || uses(x->cmd, n, except);
+    }
+  case Altn::SKIP: {
+      SkipAltn *x = static_cast<SkipAltn*>(a);
+      return usesName(x->expr, n) || uses(x->cmd, n, except);
+    }
+  case Altn::NESTED:
+    return uses(static_cast<NestedAltn*>(a)->alt, n, except);
+  case Altn::SPEC: {
+      SpecAltn *x = static_cast<SpecAltn*>(a);
+      return uses(x->spec, n) || uses(x->altn, n, except);
+    }
+  }
+}
+
+bool Own::uses(Choice *c, const std::string &n, Cmd *except) {
+  switch (c->type) {
+  default:
+    return false;
+  case Choice::GUARDED: {
+      GuardedChoice *x = static_cast<GuardedChoice*>(c);
+      return usesName(x->expr, n) || uses(x->cmd, n, except);
+    }
+  case Choice::NESTED:
+    return uses(static_cast<NestedChoice*>(c)->test, n, except);
+  case Choice::SPEC: {
+      SpecChoice *x = static_cast<SpecChoice*>(c);
+      return uses(x->spec, n) || uses(x->choice, n, except);
+    }
+  }
+}
+
+// Whether a command refers to a name, other than in an excepted command
+bool Own::uses(Cmd *c, const std::string &n, Cmd *except) {
+  if (c == nullptr || c == except)
+    return false;
+  switch (c->type) {
+  default:
+    return false;
+
+  case Cmd::SPEC: {
+      CmdSpec *x = static_cast<CmdSpec*>(c);
+      return uses(x->spec, n) || uses(x->cmd, n, except);
+    }
+
+  case Cmd::INSTANCE:
+    return usesActuals(static_cast<Instance*>(c)->actuals, n);
+
+  case Cmd::CALL: {
+      Call *x = static_cast<Call*>(c);
+      return usesName(x->name, n) || usesActuals(x->actuals, n);
+    }
+
+  case Cmd::ASS: {
+      Ass *x = static_cast<Ass*>(c);
+      return usesName(x->lhs, n) || usesName(x->rhs, n);
+    }
+
+  case Cmd::IN: {
+      In *x = static_cast<In*>(c);
+      return usesName(x->lhs, n) || usesName(x->rhs, n);
+    }
+
+  case Cmd::OUT: {
+      Out *x = static_cast<Out*>(c);
+      return usesName(x->lhs, n) || usesName(x->rhs, n);
+    }
+
+  case Cmd::CONNECT: {
+      Connect *x = static_cast<Connect*>(c);
+      return usesName(x->local, n) || usesName(x->remote, n);
+    }
+
+  case Cmd::ALT:
+    if (static_cast<Alt*>(c)->altns != nullptr)
+      for (auto x : *static_cast<Alt*>(c)->altns)
+        if (uses(x, n, except))
+          return true;
+    return false;
+
+  case Cmd::RALT: {
+      RepAlt *x = static_cast<RepAlt*>(c);
+      return uses(x->ranges, n) || uses(x->altn, n, except);
+    }
+
+  case Cmd::TEST:
+    if (static_cast<Test*>(c)->choices != nullptr)
+      for (auto x : *static_cast<Test*>(c)->choices)
+        if (uses(x, n, except))
+          return true;
+    return false;
+
+  case Cmd::RTEST: {
+      RepTest *x = static_cast<RepTest*>(c);
+      return uses(x->ranges, n) || uses(x->choice, n, except);
+    }
+
+  case Cmd::IFD: {
+      IfD *x = static_cast<IfD*>(c);
+      return usesName(x->expr, n) || uses(x->cmd, n, except);
+    }
+
+  case Cmd::IFTE: {
+      IfTE *x = static_cast<IfTE*>(c);
+      return usesName(x->expr, n)
+          || uses(x->cmd, n, except)
+          || uses(x->elseCmd, n, except);
+    }
+
+  case Cmd::CASE: {
+      Case *x = static_cast<Case*>(c);
+      if (usesName(x->expr, n))
+        return true;
+      if (x->selects != nullptr)
+        for (auto y : *x->selects) {
+          if (y->type == Select::GUARDED
+              && usesName(static_cast<GuardedSelect*>(y)->expr, n))
+            return true;
+          if (uses(y->cmd, n, except))
+            return true;
+        }
+      return false;
+    }
+
+  case Cmd::RCASE: {
+      RepCase *x = static_cast<RepCase*>(c);
+      if (usesName(x->expr, n) || uses(x->ranges, n))
+        return true;
+      if (x->select->type == Select::GUARDED
+          && usesName(static_cast<GuardedSelect*>(x->select)->expr, n))
+        return true;
+      return uses(x->select->cmd, n, except);
+    }
+
+  case Cmd::WHILE: {
+      While *x = static_cast<While*>(c);
+      return usesName(x->expr, n) || uses(x->cmd, n, except);
+    }
+
+  case Cmd::UNTIL: {
+      Until *x = static_cast<Until*>(c);
+      return usesName(x->expr, n) || uses(x->cmd, n, except);
+    }
+
+  case Cmd::DO: {
+      Do *x = static_cast<Do*>(c);
+      return usesName(x->expr, n) || uses(x->cmd, n, except);
+    }
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds)
+      if (uses(x, n, except))
+        return true;
+    return false;
+
+  case Cmd::PAR:
+    for (auto x : *static_cast<Par*>(c)->cmds)
+      if (uses(x, n, except))
+        return true;
+    return false;
+
+  case Cmd::RSEQ: {
+      RepSeq *x = static_cast<RepSeq*>(c);
+      return uses(x->ranges, n) || uses(x->cmd, n, except);
+    }
+
+  case Cmd::RPAR: {
+      RepPar *x = static_cast<RepPar*>(c);
+      return uses(x->ranges, n) || uses(x->cmd, n, except);
+    }
+  }
+}
+
+// ============================================================================
+// Traversal
+// ============================================================================
+
+// Record the names introduced by a specification
+void Own::declare(Spec *s, CmdSpec *c) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+  default:
+    break;
+
+  case Spec::DECL:
+    if (static_cast<Decl*>(s)->tDecl == Decl::VAR) {
+      VarDecl *x = static_cast<VarDecl*>(s);
+      bool array = x->spef->type == Spef::VAR && x->spef->lengths != nullptr;
+      if (x->nameList) {
+        for (auto y : *x->names)
+          vars.push_back(Var{y->str, array, array ? c : nullptr});
+      }
+      else
+        vars.push_back(Var{x->name->str, array, array ? c : nullptr});
+    }
+    break;
+
+  // Abbreviated arrays are not owned
+  case Spec::ABBR: {
+      Abbr *x = static_cast<Abbr*>(s);
+      bool array = x->spef != nullptr && x->spef->lengths != nullptr;
+      vars.push_back(Var{x->name->str, array, nullptr});
+      break;
+    }
+
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      declare(x, c);
+    break;
+  }
+}
+
+void Own::formals(std::list<Fml*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l)
+    vars.push_back(Var{x->name->str, x->spef->lengths != nullptr, nullptr});
+}
+
+void Own::ranges(std::list<Range*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l)
+    vars.push_back(Var{x->name->str, false, nullptr});
+}
+
+void Own::spec(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+  default:
+    break;
+
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      size_t n = vars.size();
+      formals(d->args);
+      if (d->defType == Def::PROCESS)
+        process(static_cast<ProcessDef*>(d)->process);
+      else if (d->defType == Def::SERVER)
+        server(static_cast<ServerDef*>(d)->server);
+      vars.resize(n);
+      break;
+    }
+
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      if (d->tDecl == Decl::SERVER)
+        server(static_cast<ServerDecl*>(d)->server);
+      else if (d->tDecl == Decl::RSERVER)
+        server(static_cast<RepServerDecl*>(d)->server);
+      else if (d->tDecl == Decl::INITIAL)
+        cmd(static_cast<InitialDecl*>(d)->cmd);
+      break;
+    }
+
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      spec(x);
+    break;
+  }
+}
+
+void Own::process(Process *p) {
+  switch (p->type) {
+  default:
+    break;
+  case Process::CMD:  cmd(static_cast<ProcessCmd*>(p)->cmd);  break;
+  case Process::SPEC: cmd(static_cast<ProcessSpec*>(p)->cmd); break;
+  }
+}
+
+void Own::server(Server *s) {
+  if (s->type != Server::SPEC)
+    return;
+  ServerSpec *x = static_cast<ServerSpec*>(s);
+  if (x->decls != nullptr)
+    for (auto y : *x->decls)
+      spec(y);
+}
+
+void Own::cmd(Cmd *c) {
+  if (c == nullptr)
+    return;
+  size_t n = vars.size();
+  switch (c->type) {
+  default:
+    break;
+
+  case Cmd::SPEC: {
+      CmdSpec *x = static_cast<CmdSpec*>(c);
+      spec(x->spec);
+      declare(x->spec, x);
+      cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::OUT:
+    out(static_cast<Out*>(c));
+    break;
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::PAR:
+    for (auto x : *static_cast<Par*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::RSEQ:
+    ranges(static_cast<RepSeq*>(c)->ranges);
+    cmd(static_cast<RepSeq*>(c)->cmd);
+    break;
+
+  case Cmd::RPAR:
+    ranges(static_cast<RepPar*>(c)->ranges);
+    cmd(static_cast<RepPar*>(c)->cmd);
+    break;
+
+  case Cmd::IFD:
+    cmd(static_cast<IfD*>(c)->cmd);
+    break;
+
+  case Cmd::IFTE:
+    cmd(static_cast<IfTE*>(c)->cmd);
+    cmd(static_cast<IfTE*>(c)->elseCmd);
+    break;
+
+  case Cmd::WHILE: cmd(static_cast<While*>(c)->cmd); break;
+  case Cmd::UNTIL: cmd(static_cast<Until*>(c)->cmd); break;
+  case Cmd::DO:    cmd(static_cast<Do*>(c)->cmd);    break;
+
+  case Cmd::ALT:
+    if (static_cast<Alt*>(c)->altns != nullptr)
+      for (auto x : *static_cast<Alt*>(c)->altns)
+        altn(x);
+    break;
+
+  case Cmd::RALT:
+    ranges(static_cast<RepAlt*>(c)->ranges);
+    altn(static_cast<RepAlt*>(c)->altn);
+    break;
+
+  case Cmd::TEST:
+    if (static_cast<Test*>(c)->choices != nullptr)
+      for (auto x : *static_cast<Test*>(c)->choices)
+        choice(x);
+    break;
+
+  case Cmd::RTEST:
+    ranges(static_cast<RepTest*>(c)->ranges);
+    choice(static_cast<RepTest*>(c)->choice);
+    break;
+
+  case Cmd::CASE:
+    if (static_cast<Case*>(c)->selects != nullptr)
+      for (auto x : *static_cast<Case*>(c)->selects)
+        cmd(x->cmd);
+    break;
+
+  case Cmd::RCASE:
+    ranges(static_cast<RepCase*>(c)->ranges);
+    cmd(static_cast<RepCase*>(c)->select->cmd);
+    break;
+  }
+  vars.resize(n);
+}
+
+void Own::altn(Altn *a) {
+  size_t n = vars.size();
+  switch (a->type) {
+  default:
+    break;
+  case Altn::UNGUARDED: cmd(static_cast<UnguardedAltn*>(a)->cmd); break;
+  case Altn::GUARDED:   cmd(static_cast<GuardedAltn*>(a)->cmd);   break;
+  case Altn::SKIP:      cmd(static_cast<SkipAltn*>(a)->cmd);      break;
+  case Altn::NESTED:    cmd(static_cast<NestedAltn*>(a)->alt);    break;
+  case Altn::SPEC:
+    declare(static_cast<SpecAltn*>(a)->spec, nullptr);
+    altn(static_cast<SpecAltn*>(a)->altn);
+    break;
+  }
+  vars.resize(n);
+}
+
+void Own::choice(Choice *c) {
+  size_t n = vars.size();
+  switch (c->type) {
+  default:
+    break;
+  case Choice::GUARDED: cmd(static_cast<GuardedChoice*>(c)->cmd); break;
+  case Choice::NESTED:  cmd(static_cast<NestedChoice*>(c)->test); break;
+  case Choice::SPEC:
+    declare(static_cast<SpecChoice*>(c)->spec, nullptr);
+    choice(static_cast<SpecChoice*>(c)->choice);
+    break;
+  }
+  vars.resize(n);
+}
@@ -0,0 +1,51 @@
+#ifndef OWN_H
+#define OWN_H
+
+#include "Tree.h"
+
+#include <string>
+#include <vector>
+
+#define OWN Own::get()
+
+// Ownership transfer: an output of a whole array is marked as a MOVE when
+// the array is declared locally and the sender never uses it again after the
+// output, so the receiver can take the backing storage. Other array outputs
+// are marked as a COPY of the whole block.
+class Own {
+public:
+  static Own instance;
+  static Own &get() { return instance; }
+  Own() {};
+  ~Own() {};
+  void transfer(Tree *);
+
+private:
+  // A variable in scope, with the command specification that declares it
+  // when it is a local array
+  struct Var {
+    std::string name;
+    bool array;
+    CmdSpec *decl;
+  };
+  std::vector<Var> vars;
+
+  void spec(Spec *);
+  void process(Process *);
+  void server(Server *);
+  void formals(std::list<Fml*> *);
+  void declare(Spec *, CmdSpec *);
+  void ranges(std::list<Range*> *);
+  void cmd(Cmd *);
+  void altn(Altn *);
+  void choice(Choice *);
+  void out(Out *);
+  bool liveAfter(Cmd *, Cmd *, const std::string &, bool &);
+  bool uses(Cmd *, const std::string &, Cmd *);
+  bool uses(Spec *, const std::string &);
+  bool uses(Altn *, const std::string &, Cmd *);
+  bool uses(Choice *, const std::string &, Cmd *);
+  bool uses(std::list<Range*> *, const std::string &);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "Pool.h"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+Pool Pool::instance;
+
+// As many threads as the machine has cores, by default
+Pool::Pool() : threads(std::thread::hardware_concurrency()) {
+  if (threads < 1)
+    threads = 1;
+}
+
+// Run f(0) to f(n-1), with the calling thread taking part. Iterations are
+// taken in order by whichever thread is free, so uneven ones balance out.
+// The first exception thrown by an iteration is thrown again by run.
+void Pool::run(size_t n, const std::function<void(size_t)> &f) {
+  if (threads <= 1 || n <= 1) {
+    for (size_t i = 0; i < n; i++)
+      f(i);
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  std::mutex lock;
+  auto work = [&]() {
+    size_t i;
+    while ((i = next++) < n) {
+      try {
+        f(i);
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!error)
+          error = std::current_exception();
+        next = n;
+      }
+    }
+  };
+  size_t count = (size_t) threads < n ? threads : n;
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < count; i++)
+    workers.push_back(std::thread(work));
+  work();
+  for (auto &x : workers)
+    x.join();
+  if (error)
+    std::rethrow_exception(error);
+}
@@ -0,0 +1,27 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#include <functional>
+
+#define POOL Pool::get()
+
+// A pool of threads that share out the iterations of a loop, for passes
+// over parts of a program that are independent of one another. Each loop
+// starts its threads and waits for them, as a loop covers a whole program.
+class Pool {
+public:
+  static Pool instance;
+  static Pool &get() { return instance; }
+  Pool();
+  ~Pool() {};
+  void setThreads(int n) { threads = n; }
+  int size() { return threads; }
+  void run(size_t, const std::function<void(size_t)> &);
+
+private:
+  int threads;
+};
+
+#endif
@@ -0,0 +1,415 @@
+#include "Resolve.h"
+#include "Clone.h"
+
+#include <functional>
+#include <iterator>
+
+Resolve Resolve::instance;
+
+Resolve::~Resolve() {
+  for (auto x : arena)
+    delete[] x;
+}
+
+void Resolve::resolve(Tree *t) {
+  table.assign(RESOLVE_TABLE, Entry{nullptr, 0, nullptr});
+  used = 0;
+  bound.clear();
+  frames.clear();
+  scopes.clear();
+  skipped.clear();
+  signatures = 0;
+  resolved = nullptr;
+  open();
+  walk(t);
+  t->slots = close();
+  variants.clear();
+}
+
+// ============================================================================
+// Scope
+// ============================================================================
+
+// The entry of a name with its hash, or the empty entry where it would go
+size_t Resolve::find(const std::string &name, size_t hash) {
+  size_t mask = table.size() - 1;
+  size_t i = hash & mask;
+  while (table[i].name != nullptr
+      && (table[i].hash != hash || *table[i].name != name))
+    i = (i + 1) & mask;
+  return i;
+}
+
+// Double the size of the table, keeping each entry's bindings in place
+void Resolve::grow() {
+  std::vector<Entry> old;
+  old.swap(table);
+  table.assign(old.size() * 2, Entry{nullptr, 0, nullptr});
+  std::vector<size_t> moved(old.size());
+  for (size_t i = 0; i < old.size(); i++)
+    if (old[i].name != nullptr) {
+      moved[i] = find(*old[i].name, old[i].hash);
+      table[moved[i]] = old[i];
+    }
+  for (auto &x : bound)
+    x = moved[x];
+}
+
+// Bind a name in the current frame, where it takes the next free slot
+void Resolve::bind(Name *n) {
+  if ((used + 1) * 2 > table.size())
+    grow();
+  size_t hash = std::hash<std::string>()(n->str);
+  size_t i = find(n->str, hash);
+  if (table[i].name == nullptr) {
+    table[i] = Entry{&n->str, hash, nullptr};
+    used++;
+  }
+  size_t block = bound.size() / RESOLVE_BLOCK;
+  if (block == arena.size())
+    arena.push_back(new Binding[RESOLVE_BLOCK]);
+  Binding *b = &arena[block][bound.size() % RESOLVE_BLOCK];
+  Frame &f = frames.back();
+  *b = Binding{n, (int) frames.size() - 1, f.next++, table[i].binding};
+  if (f.next > f.size)
+    f.size = f.next;
+  table[i].binding = b;
+  bound.push_back(i);
+  n->decl = n;
+  n->frame = b->frame;
+  n->slot = b->slot;
+}
+
+void Resolve::bind(std::list<Name*> *l) {
+  for (auto x : *l)
+    bind(x);
+}
+
+Resolve::Binding *Resolve::lookup(const std::string &name) {
+  return table[find(name, std::hash<std::string>()(name))].binding;
+}
+
+// A name the walk reaches that its declaration's hooks bind
+void Resolve::declare(Name *n) {
+  skipped.insert(n);
+}
+
+void Resolve::declare(std::list<Name*> *l) {
+  for (auto x : *l)
+    declare(x);
+}
+
+void Resolve::enter(bool par) {
+  scopes.push_back(Scope{bound.size(), frames.back().next, par,
+      frames.back().size});
+}
+
+// Restore the bindings that those of a scope shadowed, unwinding the arena,
+// and free their slots
+void Resolve::leave() {
+  Scope s = scopes.back();
+  scopes.pop_back();
+  while (bound.size() > s.bound) {
+    size_t block = (bound.size() - 1) / RESOLVE_BLOCK;
+    Binding *b = &arena[block][(bound.size() - 1) % RESOLVE_BLOCK];
+    table[bound.back()].binding = b->shadowed;
+    bound.pop_back();
+  }
+  frames.back().next = s.next;
+}
+
+void Resolve::open() {
+  frames.push_back(Frame{0, 0});
+}
+
+// Leave a frame, giving its size
+int Resolve::close() {
+  int size = frames.back().size;
+  frames.pop_back();
+  return size;
+}
+
+// ============================================================================
+// Specifications
+// ============================================================================
+
+// Definitions can refer to themselves, so each is bound before its body.
+// Other names are bound after their specifiers and values.
+bool Resolve::pre(Spec *s) {
+  if (signatures > 0)
+    return false;
+  if (s->nameList)
+    declare(s->names);
+  else if (s->name != nullptr)
+    declare(s->name);
+  switch (s->type) {
+  default:
+    break;
+
+  case Spec::DEF:
+    bind(s->name);
+    enter();
+    open();
+    break;
+
+  case Spec::DECL:
+    switch (static_cast<Decl*>(s)->tDecl) {
+    default:
+      break;
+    case Decl::CALL:
+      signatures++;
+      break;
+    case Decl::HIDING:
+    case Decl::RSERVER:
+      enter();
+      break;
+    }
+    break;
+
+  case Spec::ABBR:
+    if (static_cast<Abbr*>(s)->type == Abbr::CALL)
+      signatures++;
+    break;
+  }
+  return true;
+}
+
+void Resolve::post(Spec *s) {
+  switch (s->type) {
+  default:
+    return;
+
+  case Spec::DEF:
+    static_cast<Def*>(s)->slots = close();
+    leave();
+    return;
+
+  case Spec::DECL:
+    switch (static_cast<Decl*>(s)->tDecl) {
+    default:
+      break;
+    case Decl::CALL:
+      signatures--;
+      break;
+    case Decl::HIDING:
+    case Decl::RSERVER:
+      leave();
+      break;
+    case Decl::INITIAL:
+      return;
+    }
+    break;
+
+  case Spec::ABBR:
+    if (static_cast<Abbr*>(s)->type == Abbr::CALL)
+      signatures--;
+    break;
+  }
+  if (s->nameList)
+    bind(s->names);
+  else
+    bind(s->name);
+}
+
+// The calls of an interface type are only its signature, so they are not
+// bound
+bool Resolve::pre(Spef *s) {
+  if (s->kind == Spef::INTERFACE)
+    signatures++;
+  return true;
+}
+
+void Resolve::post(Spef *s) {
+  if (s->kind == Spef::INTERFACE)
+    signatures--;
+}
+
+// The formals of a call are only its signature, so they are not bound
+bool Resolve::pre(Fml *f) {
+  if (signatures > 0)
+    return false;
+  declare(f->name);
+  return true;
+}
+
+void Resolve::post(Fml *f) {
+  bind(f->name);
+}
+
+// The calls of an interface are bound for the body it belongs to
+bool Resolve::pre(Process *p) {
+  if (p->type == Process::SPEC)
+    enter();
+  return true;
+}
+
+void Resolve::post(Process *p) {
+  if (p->type == Process::SPEC)
+    leave();
+}
+
+// The state of a server persists between its calls, so it has a frame
+bool Resolve::pre(Server *s) {
+  if (s->type == Server::SPEC) {
+    enter();
+    open();
+  }
+  return true;
+}
+
+void Resolve::post(Server *s) {
+  if (s->type == Server::SPEC) {
+    static_cast<ServerSpec*>(s)->slots = close();
+    leave();
+  }
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+// The components of a parallel are live at the same time, so each starts
+// at the highest slot the ones before it use. Each replica of a replicated
+// parallel has its own copy of the slots of the body.
+bool Resolve::pre(Cmd *c) {
+  if (!scopes.empty() && scopes.back().par)
+    frames.back().size = frames.back().next;
+  if (c->type == Cmd::CALL && static_cast<Call*>(c)->field != nullptr)
+    skipped.insert(static_cast<Call*>(c)->field);
+  enter(c->type == Cmd::PAR);
+  return true;
+}
+
+void Resolve::post(Cmd *c) {
+  if (c->type == Cmd::PAR && scopes.back().size > frames.back().size)
+    frames.back().size = scopes.back().size;
+  leave();
+  if (!scopes.empty() && scopes.back().par)
+    frames.back().next = frames.back().size;
+}
+
+bool Resolve::pre(Altn *) {
+  enter();
+  return true;
+}
+
+void Resolve::post(Altn *) {
+  leave();
+}
+
+bool Resolve::pre(Choice *) {
+  enter();
+  return true;
+}
+
+void Resolve::post(Choice *) {
+  leave();
+}
+
+bool Resolve::pre(Range *r) {
+  declare(r->name);
+  return true;
+}
+
+void Resolve::post(Range *r) {
+  bind(r->name);
+}
+
+// ============================================================================
+// Expressions
+// ============================================================================
+
+// Bind a use of a name to its innermost declaration, if there is one
+void Resolve::name(Name *n) {
+  Binding *b = lookup(n->str);
+  n->decl = b != nullptr ? b->decl : nullptr;
+  n->frame = b != nullptr ? b->frame : -1;
+  n->slot = b != nullptr ? b->slot : -1;
+}
+
+// The field of an element is a name in the interface of its base
+bool Resolve::pre(Elem *e) {
+  if (e->type == Elem::NAME && skipped.erase(static_cast<Name*>(e)))
+    return false;
+  if (e->type == Elem::FIELD)
+    skipped.insert(static_cast<Field*>(e)->field);
+  return true;
+}
+
+void Resolve::post(Elem *e) {
+  if (e->type == Elem::NAME)
+    name(static_cast<Name*>(e));
+}
+
+bool Resolve::pre(Expr *e) {
+  if (e == resolved) {
+    resolved = nullptr;
+    return false;
+  }
+  if (e->type == Expr::VALOF)
+    enter();
+  return true;
+}
+
+void Resolve::post(Expr *e) {
+  if (e->type == Expr::VALOF)
+    leave();
+}
+
+// An interned expression is resolved where it is first reached. Where its
+// names are bound differently, it is replaced by a copy that is bound as
+// they are, which is shared in turn by the places they are bound the same.
+Expr *Resolve::replace(Expr *e) {
+  if (e == nullptr || e->hash == 0)
+    return e;
+  std::pair<Expr*, std::vector<Name*>> key(e, std::vector<Name*>());
+  bindings(e, key.second);
+  if (key.second.empty()) {
+    resolved = e;
+    return e;
+  }
+  auto it = variants.lower_bound(key);
+  if (it != variants.end() && it->first == key) {
+    resolved = it->second;
+    return it->second;
+  }
+  if ((it == variants.end() || it->first.first != e)
+      && (it == variants.begin() || std::prev(it)->first.first != e))
+    variants.insert(it, std::make_pair(key, e));
+  else {
+    Clone clone;
+    Expr *copy = clone.expr(e);
+    copy->hash = e->hash;
+    variants.insert(it, std::make_pair(key, copy));
+    e = copy;
+  }
+  return e;
+}
+
+// The declarations the names of an interned expression are bound to here
+void Resolve::bindings(Expr *e, std::vector<Name*> &decls) {
+  switch (e->type) {
+  default:
+    break;
+  case Expr::ELEM: {
+      Binding *b = lookup(static_cast<Name*>(
+          static_cast<OperElem*>(e)->elem)->str);
+      decls.push_back(b != nullptr ? b->decl : nullptr);
+      break;
+    }
+  case Expr::EXPR:
+    bindings(static_cast<OperExpr*>(e)->expr, decls);
+    break;
+  case Expr::UNARY:
+    bindings(static_cast<UnaryOp*>(e)->operand, decls);
+    break;
+  case Expr::BINARY:
+    bindings(static_cast<BinaryOp*>(e)->left, decls);
+    bindings(static_cast<BinaryOp*>(e)->right, decls);
+    break;
+  case Expr::NARY:
+    for (auto x : *static_cast<NaryOp*>(e)->operands)
+      bindings(x, decls);
+    break;
+  }
+}
@@ -0,0 +1,131 @@
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+#include "Tree.h"
+#include "Visitor.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define RES Resolve::get()
+
+// The number of bindings in each block of the arena
+#define RESOLVE_BLOCK 1024
+
+// The initial number of entries in the table of names, a power of two
+#define RESOLVE_TABLE 256
+
+// Name resolution: each name is bound to the name that declares it and to
+// a slot in the frame of the definition, server or program it is declared
+// in, so later stages can access a variable by its slot rather than by its
+// name. Scopes are opened by definitions, servers, command specifications,
+// replicators, formals and hidden declarations, which are entered and left
+// in the hooks of a walk of the tree. Slots are reused by scopes that are
+// never live at the same time, which excludes the components of a parallel.
+//
+// The innermost binding of each name is found in a single open-addressing
+// table, and each binding records the one it shadows, which is restored when
+// its scope is left. Bindings are allocated from an arena of fixed blocks,
+// which is unwound with the scopes.
+class Resolve : public Visitor<false> {
+public:
+  static Resolve instance;
+  static Resolve &get() { return instance; }
+  Resolve() : signatures(0), resolved(nullptr), used(0) {}
+  ~Resolve();
+  void resolve(Tree *);
+
+protected:
+  bool pre(Spec *) override;
+  bool pre(Spef *) override;
+  bool pre(Fml *) override;
+  bool pre(Process *) override;
+  bool pre(Server *) override;
+  bool pre(Cmd *) override;
+  bool pre(Altn *) override;
+  bool pre(Choice *) override;
+  bool pre(Range *) override;
+  bool pre(Expr *) override;
+  bool pre(Elem *) override;
+  void post(Spec *) override;
+  void post(Spef *) override;
+  void post(Fml *) override;
+  void post(Process *) override;
+  void post(Server *) override;
+  void post(Cmd *) override;
+  void post(Altn *) override;
+  void post(Choice *) override;
+  void post(Range *) override;
+  void post(Expr *) override;
+  void post(Elem *) override;
+  Expr *replace(Expr *) override;
+
+private:
+  struct Binding {
+    Name *decl;
+    int frame;
+    int slot;
+    Binding *shadowed;
+  };
+  // An entry of the table, which keeps its name once it is used
+  struct Entry {
+    const std::string *name;
+    size_t hash;
+    Binding *binding;
+  };
+  // A frame, with the next free slot and the number of slots it needs
+  struct Frame {
+    int next;
+    int size;
+  };
+  // The extent of a scope, to be restored when it is left. The scope of a
+  // parallel keeps the size of its frame before it, as its components
+  // each start at the highest slot the ones before them use.
+  struct Scope {
+    size_t bound;
+    int next;
+    bool par;
+    int size;
+  };
+  std::vector<Binding*> arena;
+  std::vector<Entry> table;
+  std::vector<size_t> bound;
+  std::vector<Frame> frames;
+  std::vector<Scope> scopes;
+  // The names the walk reaches that are not uses: declarations, which are
+  // bound by the hooks of the nodes declaring them, and the fields of calls
+  // and elements, which name calls in the interface of their server
+  std::set<Name*> skipped;
+  // The depth of the signatures of calls being walked, whose formals and
+  // calls are not bound
+  int signatures;
+  // The copies of each interned expression, by the expression and the
+  // declarations its names are bound to
+  std::map<std::pair<Expr*, std::vector<Name*>>, Expr*> variants;
+  // An interned expression that is already resolved where it is reached
+  Expr *resolved;
+  size_t used;
+
+  // Scope
+  size_t find(const std::string &, size_t);
+  void grow();
+  void bind(Name *);
+  void bind(std::list<Name*> *);
+  void declare(Name *);
+  void declare(std::list<Name*> *);
+  Binding *lookup(const std::string &);
+  void enter(bool = false);
+  void leave();
+  void open();
+  int close();
+
+  // Resolution
+  void name(Name *);
+  void bindings(Expr *, std::vector<Name*> &);
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "Specialise.h"
+#include "Clone.h"
+#include "Unroll.h"
+
+#include <algorithm>
+
+Specialise Specialise::instance;
+
+void Specialise::specialise(Tree *t) {
+  copies.clear();
+  added.clear();
+  budget = SPECIALISE_BUDGET;
+  top = &t->spec;
+  for (auto x : t->spec) {
+    current = x->type == Spec::DEF ? static_cast<Def*>(x) : nullptr;
+    spec(x);
+  }
+  current = nullptr;
+  for (auto x : t->prog)
+    cmd(x);
+
+  // Place each copy after its original
+  for (auto x : added) {
+    auto it = std::find(t->spec.begin(), t->spec.end(), x.first);
+    t->spec.insert(std::next(it), x.second.begin(), x.second.end());
+  }
+}
+
+// Whether a formal is a value of a basic type
+static bool constFormal(Fml *f) {
+  return f->spef != nullptr && f->spef->lengths == nullptr
+      && (f->spef->type == Spef::VAL
+       || (f->spef->type == Spef::VAR && f->spef->val));
+}
+
+// Redirect an instance with constant value actuals to a specialised copy
+void Specialise::redirect(Instance *c) {
+  if (c->dispatch != Instance::DIRECT
+      || c->target == current
+      || c->target->defType != Def::PROCESS
+      || c->target->args == nullptr
+      || c->actuals == nullptr
+      || c->actuals->size() != c->target->args->size()
+      || std::find(top->begin(), top->end(), c->target) == top->end())
+    return;
+  Consts consts;
+  int i = 0;
+  auto a = c->actuals->begin();
+  for (auto x : *c->target->args) {
+    if (constFormal(x) && (*a)->type == Expr::LITERAL)
+      consts.push_back(std::make_pair(i,
+          literalValue(static_cast<OperLiteral*>(*a)->literal)));
+    ++a;
+    i++;
+  }
+  if (consts.empty())
+    return;
+  Def *d = copy(static_cast<ProcessDef*>(c->target), consts);
+  if (d == nullptr)
+    return;
+
+  // Remove the constant actuals
+  std::list<Expr*> *actuals = new std::list<Expr*>();
+  auto k = consts.begin();
+  i = 0;
+  for (auto x : *c->actuals) {
+    if (k != consts.end() && k->first == i)
+      ++k;
+    else
+      actuals->push_back(x);
+    i++;
+  }
+  c->name = new Name(d->name->str);
+  c->actuals = actuals;
+  c->target = d;
+}
+
+// Find or make the copy of a definition for a set of constants
+Def *Specialise::copy(ProcessDef *d, const Consts &consts) {
+  auto key = std::make_pair(static_cast<Def*>(d), consts);
+  auto it = copies.find(key);
+  if (it != copies.end())
+    return it->second;
+  Clone clone;
+  std::string name = d->name->str;
+  std::list<Fml*> *args = new std::list<Fml*>();
+  auto k = consts.begin();
+  int i = 0;
+  for (auto x : *d->args) {
+    if (k != consts.end() && k->first == i) {
+      clone.bind(x->name->str, new OperLiteral(new DecIntLiteral(k->second)));
+      name += "#" + std::to_string(k->second);
+      ++k;
+    }
+    else
+      args->push_back(x);
+    i++;
+  }
+  ProcessDef *res = static_cast<ProcessDef*>(
+      clone.spec(new ProcessDef(new Name(name), args, d->process)));
+  if (clone.size() > budget)
+    return nullptr;
+  budget -= clone.size();
+  copies[key] = res;
+  added[d].push_back(res);
+  UNR.unrollSeqs(res);
+  return res;
+}
+
+// ============================================================================
+// Traversal
+// ============================================================================
+
+void Specialise::spec(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+  default:
+    break;
+
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      if (d->defType == Def::PROCESS)
+        process(static_cast<ProcessDef*>(d)->process);
+      else if (d->defType == Def::SERVER)
+        server(static_cast<ServerDef*>(d)->server);
+      break;
+    }
+
+  case Spec::DECL:
+    if (static_cast<Decl*>(s)->tDecl == Decl::SERVER)
+      server(static_cast<ServerDecl*>(s)->server);
+    else if (static_cast<Decl*>(s)->tDecl == Decl::RSERVER)
+      server(static_cast<RepServerDecl*>(s)->server);
+    else if (static_cast<Decl*>(s)->tDecl == Decl::INITIAL)
+      cmd(static_cast<InitialDecl*>(s)->cmd);
+    break;
+
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      spec(x);
+    break;
+  }
+}
+
+void Specialise::process(Process *p) {
+  if (p->type == Process::CMD)
+    cmd(static_cast<ProcessCmd*>(p)->cmd);
+  else if (p->type == Process::SPEC)
+    cmd(static_cast<ProcessSpec*>(p)->cmd);
+}
+
+void Specialise::server(Server *s) {
+  if (s->type == Server::SPEC) {
+    ServerSpec *x = static_cast<ServerSpec*>(s);
+    if (x->decls != nullptr)
+      for (auto y : *x->decls)
+        spec(y);
+  }
+}
+
+void Specialise::cmd(Cmd *c) {
+  if (c == nullptr)
+    return;
+  switch (c->type) {
+  default:
+    break;
+
+  case Cmd::SPEC:
+    spec(static_cast<CmdSpec*>(c)->spec);
+    cmd(static_cast<CmdSpec*>(c)->cmd);
+    break;
+
+  case Cmd::INSTANCE:
+    redirect(static_cast<Instance*>(c));
+    break;
+
+  case Cmd::IFD:
+    cmd(static_cast<IfD*>(c)->cmd);
+    break;
+
+  case Cmd::IFTE:
+    cmd(static_cast<IfTE*>(c)->cmd);
+    cmd(static_cast<IfTE*>(c)->elseCmd);
+    break;
+
+  case Cmd::CASE:
+    if (static_cast<Case*>(c)->selects != nullptr)
+      for (auto x : *static_cast<Case*>(c)->selects)
+        cmd(x->cmd);
+    break;
+
+  case Cmd::WHILE:
+    cmd(static_cast<While*>(c)->cmd);
+    break;
+
+  case Cmd::UNTIL:
+    cmd(static_cast<Until*>(c)->cmd);
+    break;
+
+  case Cmd::DO:
+    cmd(static_cast<Do*>(c)->cmd);
+    break;
+
+  case Cmd::SEQ:
+    for (auto x : *static_cast<Seq*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::PAR:
+    for (auto x : *static_cast<Par*>(c)->cmds)
+      cmd(x);
+    break;
+
+  case Cmd::RSEQ:
+    cmd(static_cast<RepSeq*>(c)->cmd);
+    break;
+
+  case Cmd::RPAR:
+    cmd(static_cast<RepPar*>(c)->cmd);
+    break;
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef SPECIALISE_H
+#define SPECIALISE_H
+
+#include "Tree.h"
+
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+
+#define SPC Specialise::get()
+
+// The total number of nodes that specialised definitions can add
+#define SPECIALISE_BUDGET 4096
+
+// Partial evaluation: a process definition instantiated with literal
+// actuals for its value formals is copied with those formals replaced by
+// their values, and the instance is redirected to the copy. A copy is made
+// for each distinct set of constant actuals, within a budget on the size of
+// the copies. Copies are placed after their original and their fixed-trip
+// loops are unrolled once the constants have been folded.
+class Specialise {
+public:
+  static Specialise instance;
+  static Specialise &get() { return instance; }
+  Specialise() {};
+  ~Specialise() {};
+  void specialise(Tree *);
+
+private:
+  typedef std::vector<std::pair<int, int>> Consts;
+  std::map<std::pair<Def*, Consts>, Def*> copies;
+  std::map<Def*, std::list<Def*>> added;
+  std::list<Spec*> *top;
+  Def *current;
+  int budget;
+
+  void spec(Spec *);
+  void process(Process *);
+  void server(Server *);
+  void cmd(Cmd *);
+  void redirect(Instance *);
+  Def *copy(ProcessDef *, const Consts &);
+};
+
+#endif
@@ -6,9 +6,12 @@
 
 Syn Syn::instance;
 
+// Build with TRACE_TOKENS defined to print each token as it is read
 void Syn::getNextToken() {
   curTok = LEX.readToken();
+#ifdef TRACE_TOKENS
   LEX.printToken(curTok);
+#endif
 }
 
 void Syn::checkFor(Lex::Token t) {
@@ -25,18 +28,26 @@ void Syn::error(const char *msg) {
 }
 
 Tree *Syn::formTree() {
-  Tree *t = readProg();
+  Tree *t = new Tree();
+  readProg([t](Spec *s) { t->spec.push_back(s); },
+           [t](Cmd *c) { t->prog.push_back(c); });
   return t;
 }
 
+// Hand each top-level item to a sink as soon as it is read, then free it,
+// so that the memory used stays that of the largest item
+void Syn::streamTree(const SpecSink &spec, const CmdSink &cmd) {
+  readProg([this, &spec](Spec *s) { spec(s); release(s); interned.clear(); },
+           [this, &cmd](Cmd *c) { cmd(c); release(c); interned.clear(); });
+}
+
 // prog    = <spec> ":" <prog>
 //         | <seq>;
 // spec    = <decl>
 //         | <abbr>
 //         | <def>
 //         | {0 "&" <spec> }
-Tree *Syn::readProg() {
-  Tree *tree = new Tree();
+void Syn::readProg(const SpecSink &spec, const CmdSink &cmd) {
   getNextToken();
 
   // Read specifications
@@ -49,19 +60,17 @@ Tree *Syn::readProg() {
       || curTok == Lex::tFUNCTION) {
 
     // ... <spec> ":"
-    tree->spec.push_back(readSpec());
+    spec(readSpec());
   }
 
   // ... {1 ";" <cmd> }
   while (curTok != Lex::tEOF) {
-    tree->prog.push_back(readCmd());
+    cmd(readCmd());
     if (curTok == Lex::tSEMI)
       getNextToken();
     else
       break;
   }
-
-  return tree;
 }
 
 // ============================================================================
@@ -108,11 +117,15 @@ Spef *Syn::readSpef(bool val) {
       error("expecting name or 'interface'");
       return nullptr;
 
-    case Lex::tNAME:
-      return new NamedSpef(Spef::PROCESS, readName(), readDims());
+    case Lex::tNAME: {
+        Name *name = readName();
+        return new NamedSpef(Spef::PROCESS, name, readDims());
+      }
 
-    case Lex::tINTF:
-      return new IntfSpef(Spef::PROCESS, readIntfs(), readDims());
+    case Lex::tINTF: {
+        std::list<Decl*> *intfs = readIntfs();
+        return new IntfSpef(Spef::PROCESS, intfs, readDims());
+      }
     }
 
   // "server" <name> {0 "[" <expr> "]" }
@@ -123,11 +136,15 @@ Spef *Syn::readSpef(bool val) {
       error("expecting name or 'interface'");
       return nullptr;
 
-    case Lex::tNAME:
-      return new NamedSpef(Spef::SERVER, readName(), readDims());
+    case Lex::tNAME: {
+        Name *name = readName();
+        return new NamedSpef(Spef::SERVER, name, readDims());
+      }
 
-    case Lex::tINTF:
-      return new IntfSpef(Spef::SERVER, readIntfs(), readDims());
+    case Lex::tINTF: {
+        std::list<Decl*> *intfs = readIntfs();
+        return new IntfSpef(Spef::SERVER, intfs, readDims());
+      }
     }
   }
 }
@@ -194,11 +211,16 @@ Spec *Syn::readSpec() {
       case Lex::tCOMMA:
         if (val)
           error("invalid use of 'val' specifier");
-        res = new VarDecl(spef, readNames());
+        {
+          std::list<Name*> *names = readNames();
+          names->push_front(name);
+          res = new VarDecl(spef, names);
+        }
         break;
 
       // ... "is" <elem> ...
       case Lex::tIS:
+        getNextToken();
         res = new VarAbbr(spef, name, readElem());
         break;
       }
@@ -250,15 +272,16 @@ Spec *Syn::readSpecEnd(Spec *spec) {
     return spec;
 
   // ... "&" {1 "&" <spec> }
+  // The rest of the specifications, up to the ":", are read recursively
   case Lex::tAND: {
       std::list<Spec*> *specs = new std::list<Spec*>();
       specs->push_back(spec);
-      do {
-        getNextToken();
-        specs->push_back(readSpec());
-      } while (curTok == Lex::tAND);
-      checkFor(Lex::tCOLON);
       getNextToken();
+      Spec *rest = readSpec();
+      if (rest->type == Spec::SSPEC)
+        specs->splice(specs->end(), *static_cast<SimSpec*>(rest)->specs);
+      else
+        specs->push_back(rest);
       return new SimSpec(specs);
     }
   }
@@ -301,6 +324,7 @@ Spec *Syn::readServerSpec() {
 
           // ... "is" <server>
           case Lex::tIS:
+            getNextToken();
             return new ServerDef(name, args, readServer());
 
           // ... "inherits" <hiding-decl>
@@ -335,8 +359,10 @@ Spec *Syn::readServerSpec() {
 
         // Replicated declaration
         // ... <rep> <server>
-        case Lex::tLSQ:
-          return new RepServerDecl(name, readRep(), readServer());
+        case Lex::tLSQ: {
+            std::list<Range*> *ranges = readRep();
+            return new RepServerDecl(name, ranges, readServer());
+          }
 
         // Declaration or abbreviation
         // ... <name> "(" {0 "," <expr>? } ")"
@@ -622,7 +648,6 @@ Decl *Syn::readIntf() {
         return new VarDecl(spef, name);
       // Multiple names
       else {
-        getNextToken();
         std::list<Name*> *names = readNames();
         names->insert(names->begin(), name);
         return new VarDecl(spef, names);
@@ -659,8 +684,10 @@ Server *Syn::readServer() {
 
   // Instance
   // <name> "(" {0 "," <actual> } ")"
-  if (curTok == Lex::tNAME)
-    return new ServerInstance(readName(), readActuals());
+  if (curTok == Lex::tNAME) {
+    Name *name = readName();
+    return new ServerInstance(name, readActuals());
+  }
 
   // Specification
   // "interface" "(" {0 "," <decl> } ")" "to" ...
@@ -685,8 +712,10 @@ Process *Syn::readProcess() {
 
   // Instance
   // <name> "(" {0 "," <actual> } ")"
-  if (curTok == Lex::tNAME)
-    return new ProcessInstance(readName(), readActuals());
+  if (curTok == Lex::tNAME) {
+    Name *name = readName();
+    return new ProcessInstance(name, readActuals());
+  }
 
   // Speficiation
   // "interface" "(" {0 "," <decl> } ")" "to" <cmd>
@@ -709,7 +738,8 @@ Process *Syn::readProcess() {
 //            | <struct-cmd>
 //            | <instance>
 //            | <call>
-//            | "seq" <rep> ":" <cmd>
+//            | "seq" <rep> <cmd>
+//            | "par" <rep> <cmd>
 //            | <spec> ":" <cmd>
 // prim-cmd   = <ass>
 //            | <connect>
@@ -723,15 +753,132 @@ Process *Syn::readProcess() {
 //            | <case>
 //            | <cond>
 //            | <loop>
+// Commands are read without recursion where they nest in one another.
+// A command that ends with another is pushed on the stack with the place
+// that command goes, as are blocks and the 'then' and 'do' parts of
+// conditionals and loops, and each is completed when the command it is
+// waiting for has been read.
 Cmd *Syn::readCmd() {
+  size_t base = cmdStack.size();
+  enter();
+  while (true) {
+    size_t n = cmdStack.size();
+    Cmd *cmd = readCmdHead();
+    if (cmd == nullptr && cmdStack.size() > n)
+      continue;
+    bool more = false;
+    while (!more && cmdStack.size() > base) {
+      CmdFrame &f = cmdStack.back();
+      switch (f.kind) {
+
+      // ... <cmd>
+      case CmdFrame::TAIL:
+        *f.hole = cmd;
+        cmd = f.cmd;
+        popCmd();
+        break;
+
+      // "{" {0 ";" <cmd> } "}"
+      // "{" {0 "&" <cmd> } "}"
+      case CmdFrame::BLOCK:
+        f.cmds->push_back(cmd);
+        if (f.sep == Lex::tEOF)
+          f.sep = curTok == Lex::tAND ? Lex::tAND : Lex::tSEMI;
+        if (curTok == f.sep) {
+          getNextToken();
+          more = true;
+          break;
+        }
+        checkFor(Lex::tRCURLY);
+        if (f.sep == Lex::tAND)
+          cmd = new Par(f.cmds);
+        else
+          cmd = new Seq(f.cmds);
+        popCmd();
+        break;
+
+      // "if" <expr> "then" <cmd> "else" <cmd>
+      case CmdFrame::THEN: {
+          IfTE *x = static_cast<IfTE*>(f.cmd);
+          x->cmd = cmd;
+          checkFor(Lex::tELSE);
+          f.kind = CmdFrame::TAIL;
+          f.hole = &x->elseCmd;
+          more = true;
+          break;
+        }
+
+      // "do" <cmd> "while" <expr>
+      case CmdFrame::DO: {
+          Do *x = static_cast<Do*>(f.cmd);
+          x->cmd = cmd;
+          checkFor(Lex::tWHILE);
+          x->expr = readExpr();
+          cmd = x;
+          popCmd();
+          break;
+        }
+      }
+    }
+    if (!more) {
+      leave();
+      return cmd;
+    }
+  }
+}
+
+// Push a command waiting for the command that goes in its hole
+void Syn::pushCmd(CmdFrame::Kind kind, Cmd *cmd, Cmd **hole) {
+  enter();
+  CmdFrame f;
+  f.kind = kind;
+  f.cmd = cmd;
+  f.hole = hole;
+  f.cmds = nullptr;
+  f.sep = Lex::tEOF;
+  cmdStack.push_back(f);
+}
+
+void Syn::popCmd() {
+  cmdStack.pop_back();
+  leave();
+}
+
+// Read a command, or the start of one that contains another, in which case
+// it is pushed on the stack and the result is null
+Cmd *Syn::readCmdHead() {
   switch(curTok) {
   default:
     error("invalid command");
     return nullptr;
 
-  // "{" {0 , <cmd> "}"
+  // "{" {0 ";" <cmd> } "}"
+  // "{" {0 "&" <cmd> } "}"
   case Lex::tLCURLY:
-    return new Seq(readSeq());
+    getNextToken();
+    if (curTok == Lex::tRCURLY) {
+      getNextToken();
+      return new Seq(new std::list<Cmd*>());
+    }
+    pushCmd(CmdFrame::BLOCK, nullptr, nullptr);
+    cmdStack.back().cmds = new std::list<Cmd*>();
+    return nullptr;
+
+  // "seq" <rep> <cmd>
+  case Lex::tSEQ: {
+    getNextToken();
+    RepSeq *x = new RepSeq(readRep(), nullptr);
+    pushCmd(CmdFrame::TAIL, x, &x->cmd);
+    return nullptr;
+  }
+
+  // "par" <rep> <cmd>
+  case Lex::tPAR: {
+    getNextToken();
+    RepPar *x = new RepPar(readRep(), nullptr);
+    pushCmd(CmdFrame::TAIL, x, &x->cmd);
+    return nullptr;
+  }
 
   // "skip"
   case Lex::tSKIP:
@@ -752,14 +899,13 @@ Cmd *Syn::readCmd() {
     return new Connect(source, target);
   }
 
-  // ass      = <name> ":=" <expr>
+  // ass      = <elem> ":=" <expr>
   // in       = <elem> "?" <elem>
-  // out      = <elem> "!" <elem>
+  // out      = <elem> "!" <expr>
   // instance = <name> "(" {0 "," <expr> } ")"
   // call     = <name> "." <name> "(" {0 "," <expr> } ")"
   case Lex::tNAME: {
-    Name *name = readName();
-    getNextToken();
+    Elem *elem = readElem();
     switch (curTok) {
     default:
       error("expecting assignment, input, output, instance or call");
@@ -768,35 +914,26 @@ Cmd *Syn::readCmd() {
     // ":=" <expr>
     case Lex::tASS:
       getNextToken();
-      return new Ass(name, readExpr());
+      return new Ass(elem, readExpr());
 
     // "?" <elem>
     case Lex::tIN:
       getNextToken();
-      return new In(name, readElem());
+      return new In(elem, readElem());
 
     // "!" <expr>
     case Lex::tOUT:
       getNextToken();
-      return new Out(name, readExpr());
+      return new Out(elem, readExpr());
 
     // ... "(" {0 "," <expr> } ")"
-    case Lex::tLPAREN: {
-      getNextToken();
-      std::list<Expr*> *actuals = readActuals();
-      checkFor(Lex::tRPAREN);
-      return new Instance(name, actuals);
-    }
-
     // ... "." <name> "(" {0 "," <expr> } ")"
-    case Lex::tDOT: {
-        getNextToken();
-        Name *field = readName();
-        checkFor(Lex::tLPAREN);
-        std::list<Expr*> *actuals = readActuals();
-        checkFor(Lex::tRPAREN);
-        return new Call(name, field, actuals);
+    case Lex::tLPAREN:
+      if (elem->type == Elem::FIELD) {
+        Field *field = static_cast<Field*>(elem);
+        return new Call(field->base, field->field, readActuals());
       }
+      return new Instance(static_cast<Name*>(elem), readActuals());
     }
   }
 
@@ -810,15 +947,17 @@ Cmd *Syn::readCmd() {
           error("expecting 'do' or 'then'");
           return nullptr;
 
-        case Lex::tDO:
-          return new IfD(expr, readCmd());
+        case Lex::tDO: {
+          getNextToken();
+          IfD *x = new IfD(expr, nullptr);
+          pushCmd(CmdFrame::TAIL, x, &x->cmd);
+          return nullptr;
+        }
 
-        case Lex::tTHEN: {
-          Cmd *thenCmd = readCmd();
-          checkFor(Lex::tELSE);
-          return new IfTE(expr, thenCmd, readCmd());
-      }
-      return nullptr;
+        case Lex::tTHEN:
+          getNextToken();
+          pushCmd(CmdFrame::THEN, new IfTE(expr, nullptr, nullptr), nullptr);
+          return nullptr;
     }
   }
 
@@ -834,8 +973,10 @@ Cmd *Syn::readCmd() {
     case Lex::tLPAREN:
       return new Test(readChoices());
 
-    case Lex::tLSQ:
-      return new RepTest(readRep(), readChoice());
+    case Lex::tLSQ: {
+        std::list<Range*> *ranges = readRep();
+        return new RepTest(ranges, readChoice());
+      }
     }
 
   // alt = "alt" "{" {0 "|" <altn> } "}"
@@ -850,8 +991,10 @@ Cmd *Syn::readCmd() {
     case Lex::tLPAREN:
       return new Alt(readAltns());
 
-    case Lex::tLSQ:
-      return new RepAlt(readRep(), readAltn());
+    case Lex::tLSQ: {
+        std::list<Range*> *ranges = readRep();
+        return new RepAlt(ranges, readAltn());
+      }
     }
 
   // case = "case" <expr> "{" {0 "|" <selection> } "}"
@@ -867,8 +1010,10 @@ Cmd *Syn::readCmd() {
     case Lex::tLCURLY:
       return new Case(expr, readSelects());
 
-    case Lex::tLSQ:
-      return new RepCase(expr, readRep(), readSelect());
+    case Lex::tLSQ: {
+        std::list<Range*> *ranges = readRep();
+        return new RepCase(expr, ranges, readSelect());
+      }
     }
   }
 
@@ -877,15 +1022,16 @@ Cmd *Syn::readCmd() {
     getNextToken();
     Expr *expr = readExpr();
     checkFor(Lex::tDO);
-    return new While(expr, readCmd());
+    While *x = new While(expr, nullptr);
+    pushCmd(CmdFrame::TAIL, x, &x->cmd);
+    return nullptr;
   }
 
   // loop = "do" <cmd> "while" <expr>
   case Lex::tDO: {
     getNextToken();
-    Cmd *cmd = readCmd();
-    checkFor(Lex::tWHILE);
-    return new Do(cmd, readExpr());
+    pushCmd(CmdFrame::DO, new Do(nullptr, nullptr), nullptr);
+    return nullptr;
   }
 
   // loop = "until" <expr> "do" <cmd>
@@ -893,7 +1039,9 @@ Cmd *Syn::readCmd() {
     getNextToken();
     Expr *expr = readExpr();
     checkFor(Lex::tDO);
-    return new Until(expr, readCmd());
+    Until *x = new Until(expr, nullptr);
+    pushCmd(CmdFrame::TAIL, x, &x->cmd);
+    return nullptr;
   }
 
   // <spec> ":" <cmd>
@@ -901,8 +1049,9 @@ Cmd *Syn::readCmd() {
   case Lex::tVAR:
   case Lex::tCHAN:
   case Lex::tCALL: {
-    Spec *spec = readSpec();
-    return new CmdSpec(spec, readCmd());
+    CmdSpec *x = new CmdSpec(readSpec(), nullptr);
+    pushCmd(CmdFrame::TAIL, x, &x->cmd);
+    return nullptr;
   }
 
   // Disallowed
@@ -911,7 +1060,9 @@ Cmd *Syn::readCmd() {
   case Lex::tFUNCTION:
     error("definition in specification of command");
     readSpec();
-    return new CmdSpec(nullptr, readCmd());
+    CmdSpec *x = new CmdSpec(nullptr, nullptr);
+    pushCmd(CmdFrame::TAIL, x, &x->cmd);
+    return nullptr;
   }
 }
 
@@ -1047,16 +1198,19 @@ Range *Syn::readRange() {
 // Lists
 // ============================================================================
 
-// {1 "[" <expr> "]" }
+// {1 "[" <expr>? "]" }
 std::list<Expr*> *Syn::readDims() {
   if (curTok != Lex::tLSQ)
     return nullptr;
   else {
     std::list<Expr*> *lengths = new std::list<Expr*>();
     while (curTok == Lex::tLSQ) {
-      lengths->push_back(readExpr());
-      checkFor(Lex::tRSQ);
       getNextToken();
+      // An unspecified length is recorded as a null expression
+      enclosed++;
+      lengths->push_back(curTok == Lex::tRSQ ? nullptr : readExpr());
+      enclosed--;
+      checkFor(Lex::tRSQ);
     }
     return lengths;
   }
@@ -1065,13 +1219,13 @@ std::list<Expr*> *Syn::readDims() {
 // {0 "," <name> }
 std::list<Name*> *Syn::readNames() {
   std::list<Name*> *names = new std::list<Name*>();
-  do {
+  while (curTok == Lex::tCOMMA) {
     getNextToken();
     // In formal lists, don't read next specifier
     if (curTok != Lex::tNAME)
       break;
     names->push_back(readName());
-  } while (curTok != Lex::tCOMMA);
+  }
   return names;
 }
 
@@ -1087,22 +1241,36 @@ inline std::list<Decl*> *Syn::readIntfs() {
       Lex::tLPAREN, Lex::tRPAREN, Lex::tCOMMA, &Syn::readIntf);
 }
 
-// "(" {0 "," <decl> } ")"
-inline std::list<Spec*> *Syn::readSpecs() {
-  return readList<Spec>(
-      Lex::tLPAREN, Lex::tRPAREN, Lex::tCOMMA, &Syn::readSpec);
+// "{" {0 <decl> ":" } "}"
+// The declarations of a server may also be initial commands
+// decl = "initial" <cmd>
+std::list<Spec*> *Syn::readSpecs() {
+  checkFor(Lex::tLCURLY);
+  std::list<Spec*> *l = new std::list<Spec*>();
+  while (curTok != Lex::tRCURLY && curTok != Lex::tEOF) {
+    if (curTok == Lex::tINIT) {
+      getNextToken();
+      l->push_back(readSpecEnd(new InitialDecl(readCmd())));
+    }
+    else
+      l->push_back(readSpec());
+  }
+  checkFor(Lex::tRCURLY);
+  return l;
 }
 
-// "[" {1 ":" <decl> } "]"
+// "[" {1 <decl> ":" } "]"
 inline std::list<Spec*> *Syn::readHiddens() {
-  return readList<Spec>(
-      Lex::tLSQ, Lex::tRSQ, Lex::tCOLON, &Syn::readSpec);
+  return readSpecList(Lex::tLSQ, Lex::tRSQ);
 }
 
 // "(" {0 "," <expr> } ")"
-inline std::list<Expr*> *Syn::readActuals() {
-  return readList<Expr>(
+std::list<Expr*> *Syn::readActuals() {
+  enclosed++;
+  std::list<Expr*> *actuals = readList<Expr>(
       Lex::tLPAREN, Lex::tRPAREN, Lex::tCOMMA, &Syn::readExpr);
+  enclosed--;
+  return actuals;
 }
 
 // "[" {1 "," <range> } "]"
@@ -1158,6 +1326,16 @@ std::list<T*> *Syn::readList(
   return l;
 }
 
+// Specifications are each terminated by a ':', which readSpec consumes
+std::list<Spec*> *Syn::readSpecList(Lex::Token left, Lex::Token right) {
+  checkFor(left);
+  std::list<Spec*> *l = new std::list<Spec*>();
+  while (curTok != right && curTok != Lex::tEOF)
+    l->push_back(readSpec());
+  checkFor(right);
+  return l;
+}
+
 // ============================================================================
 // Elements
 // ============================================================================
@@ -1168,6 +1346,8 @@ std::list<T*> *Syn::readList(
 // field = <elem> "." <name>
 Elem *Syn::readElem() {
   Name *name = readName();
+  if (curTok == Lex::tLSQ)
+    name->subscripts = readDims();
 
   // Field
   if (curTok == Lex::tDOT) {
@@ -1179,8 +1359,6 @@ Elem *Syn::readElem() {
   }
 
   // Name
-  if (curTok == Lex::tLSQ)
-    name->subscripts = readDims();
   return name;
 }
 
@@ -1197,33 +1375,256 @@ Name *Syn::readName() {
 
 // expr    = <op> <operand>
 //         | <operand> <op> <operand>
+//         | <operand> <aop> <operand> {1 <aop> <operand> }
 //         | <operand>
+// aop     = "+" | "*" | "&" | "|" | "^" | "&&" | "||"
+//
+// Outside parentheses, subscripts and actuals, "&" separates the components
+// of a parallel, simultaneous specifications and the guard of an
+// alternative, and "|" separates the choices, alternatives and selections
+// of a test, alt or case, so they end an expression there.
+//
+// A chain of the same associative operator needs no parentheses, and is
+// read as a single n-ary operator. Parenthesised expressions are read
+// without recursion: each operator and parenthesis that is waiting for its
+// operand or expression is pushed on the stack, and is completed when that
+// has been read.
 Expr *Syn::readExpr() {
-  switch (curTok) {
+  size_t base = exprStack.size();
+  bool start = true;
+  enter();
+  while (true) {
 
-  // Unary not
-  case Lex::tNOT:
-    getNextToken();
-    return new UnaryOp(Lex::tNOT, readOperand());
+    // Unary not or minus
+    if (start && (curTok == Lex::tNOT || curTok == Lex::tSUB)) {
+      pushExpr(ExprFrame::UNARY, curTok, nullptr);
+      getNextToken();
+    }
 
-  // Unary minus
-  case Lex::tSUB:
-    getNextToken();
-    return new UnaryOp(Lex::tSUB, readOperand());
+    // "(" <expr> ")"
+    if (curTok == Lex::tLPAREN) {
+      getNextToken();
+      pushExpr(ExprFrame::PAREN, Lex::tERROR, nullptr);
+      enclosed++;
+      start = true;
+      continue;
+    }
+    start = false;
+    Expr *expr = intern(readOperand());
+
+    // Complete the operators and parentheses that are waiting for it
+    bool more = false;
+    while (!more) {
+      ExprFrame *f = exprStack.size() > base ? &exprStack.back() : nullptr;
+      if (expr->type != Expr::UNARY && expr->type != Expr::BINARY
+          && expr->type != Expr::NARY) {
+        Operand *operand = static_cast<Operand*>(expr);
+        if (f != nullptr && f->kind == ExprFrame::UNARY) {
+          expr = intern(new UnaryOp(f->op, operand));
+          popExpr();
+          continue;
+        }
+        if (f != nullptr && f->kind == ExprFrame::BINARY) {
+          f->operands->push_back(operand);
+          if (curTok == f->op && associative(f->op)) {
+            getNextToken();
+            more = true;
+            continue;
+          }
+          if (f->operands->size() == 2) {
+            expr = intern(new BinaryOp(f->op, f->operands->front(),
+                f->operands->back()));
+            delete f->operands;
+          }
+          else
+            expr = intern(new NaryOp(f->op, f->operands));
+          popExpr();
+          continue;
+        }
+        if (isOp(curTok) && ((curTok != Lex::tAND && curTok != Lex::tOR)
+            || enclosed > 0)) {
+          pushExpr(ExprFrame::BINARY, curTok, operand);
+          getNextToken();
+          more = true;
+          continue;
+        }
+      }
+      if (f == nullptr) {
+        leave();
+        return expr;
+      }
+      checkFor(Lex::tRPAREN);
+      expr = intern(new OperExpr(expr));
+      popExpr();
+      enclosed--;
+    }
+  }
+}
+
+// Combine a value into a hash
+static size_t mix(size_t h, size_t v) {
+  return h ^ (v + 0x9e3779b9 + (h << 6) + (h >> 2));
+}
 
-  // <operand> | <operand> <op> <operand>
+// Whether two expressions, whose parts are interned, are identical
+static bool identical(Expr *a, Expr *b) {
+  if (a->type != b->type)
+    return false;
+  switch (a->type) {
   default:
-    Operand *operand = readOperand();
-    if (isOp(curTok)) {
-      Lex::Token op = curTok;
-      getNextToken();
-      return new BinaryOp(op, operand, readOperand());
+    return false;
+  case Expr::LITERAL: {
+      Literal *x = static_cast<OperLiteral*>(a)->literal;
+      Literal *y = static_cast<OperLiteral*>(b)->literal;
+      return x->type == y->type && literalValue(x) == literalValue(y);
     }
-    else
-      return operand;
+  case Expr::ELEM:
+    return static_cast<Name*>(static_cast<OperElem*>(a)->elem)->str
+        == static_cast<Name*>(static_cast<OperElem*>(b)->elem)->str;
+  case Expr::EXPR:
+    return static_cast<OperExpr*>(a)->expr == static_cast<OperExpr*>(b)->expr;
+  case Expr::UNARY:
+    return static_cast<UnaryOp*>(a)->op == static_cast<UnaryOp*>(b)->op
+        && static_cast<UnaryOp*>(a)->operand
+            == static_cast<UnaryOp*>(b)->operand;
+  case Expr::BINARY:
+    return static_cast<BinaryOp*>(a)->op == static_cast<BinaryOp*>(b)->op
+        && static_cast<BinaryOp*>(a)->left == static_cast<BinaryOp*>(b)->left
+        && static_cast<BinaryOp*>(a)->right
+            == static_cast<BinaryOp*>(b)->right;
+  case Expr::NARY:
+    return static_cast<NaryOp*>(a)->op == static_cast<NaryOp*>(b)->op
+        && *static_cast<NaryOp*>(a)->operands
+            == *static_cast<NaryOp*>(b)->operands;
   }
 }
 
+// Free a new expression that is identical to an interned one, but not its
+// parts, which are interned
+static void discard(Expr *e) {
+  switch (e->type) {
+  default:
+    break;
+  case Expr::LITERAL:
+  case Expr::ELEM:
+    release(e);
+    break;
+  case Expr::EXPR:
+    delete static_cast<OperExpr*>(e);
+    break;
+  case Expr::UNARY:
+    delete static_cast<UnaryOp*>(e);
+    break;
+  case Expr::BINARY:
+    delete static_cast<BinaryOp*>(e);
+    break;
+  case Expr::NARY:
+    delete static_cast<NaryOp*>(e)->operands;
+    delete static_cast<NaryOp*>(e);
+    break;
+  }
+}
+
+// With interning, an expression that is identical to one read before is
+// replaced by it, so they share one node. Only literals, names without
+// subscripts and operators over interned operands are interned, since
+// subscripts and calls carry state of their own for each use. The hash of
+// an expression is the same as that of its parenthesised form, and of an
+// equal literal of another base, as sameExpr equates them.
+Expr *Syn::intern(Expr *e) {
+  if (!interning)
+    return e;
+  size_t h = mix(0, e->type);
+  switch (e->type) {
+  default:
+    return e;
+
+  case Expr::LITERAL:
+    h = mix(h, literalValue(static_cast<OperLiteral*>(e)->literal));
+    break;
+
+  case Expr::ELEM: {
+      Elem *x = static_cast<OperElem*>(e)->elem;
+      if (x->type != Elem::NAME || x->subscripts != nullptr)
+        return e;
+      h = mix(h, std::hash<std::string>()(static_cast<Name*>(x)->str));
+      break;
+    }
+
+  case Expr::EXPR:
+    h = static_cast<OperExpr*>(e)->expr->hash;
+    if (h == 0)
+      return e;
+    break;
+
+  case Expr::UNARY: {
+      UnaryOp *x = static_cast<UnaryOp*>(e);
+      if (x->operand->hash == 0)
+        return e;
+      h = mix(mix(h, x->op), x->operand->hash);
+      break;
+    }
+
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(e);
+      if (x->left->hash == 0 || x->right->hash == 0)
+        return e;
+      h = mix(mix(mix(h, x->op), x->left->hash), x->right->hash);
+      break;
+    }
+
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(e);
+      h = mix(h, x->op);
+      for (auto y : *x->operands) {
+        if (y->hash == 0)
+          return e;
+        h = mix(h, y->hash);
+      }
+      break;
+    }
+  }
+  if (h == 0)
+    h = 1;
+  auto range = interned.equal_range(h);
+  for (auto i = range.first; i != range.second; ++i)
+    if (identical(i->second, e)) {
+      discard(e);
+      return i->second;
+    }
+  e->hash = h;
+  interned.insert(std::make_pair(h, e));
+  return e;
+}
+
+// Push an operator or parenthesis waiting for its operand or expression
+void Syn::pushExpr(ExprFrame::Kind kind, Lex::Token op, Operand *left) {
+  enter();
+  ExprFrame f;
+  f.kind = kind;
+  f.op = op;
+  f.operands = nullptr;
+  if (left != nullptr)
+    f.operands = new std::list<Operand*>(1, left);
+  exprStack.push_back(f);
+}
+
+void Syn::popExpr() {
+  exprStack.pop_back();
+  leave();
+}
+
+// Count the depth of nesting of commands and expressions, which is limited
+// so that the passes over the tree do not exhaust the native stack
+void Syn::enter() {
+  if (++depth > maxDepth)
+    error("nesting is too deep");
+}
+
+void Syn::leave() {
+  depth--;
+}
+
 bool Syn::isOp(Lex::Token) {
   switch (curTok) {
   default:
@@ -1252,14 +1653,22 @@ bool Syn::isOp(Lex::Token) {
 //         | "false"
 // byte    = "'" <char> "'"
 Operand *Syn::readOperand() {
+  int value = LEX.value;
   switch (curTok) {
   default:
     error("expecing name, 'valof' or literal");
     return nullptr;
 
   // <elem>
-  case Lex::tNAME:
-    return new OperElem(readElem());
+  // <name> "(" {0 "," <actual> } ")"
+  case Lex::tNAME: {
+      Elem *elem = readElem();
+      if (elem->type == Elem::NAME && curTok == Lex::tLPAREN) {
+        std::list<Expr*> *actuals = readActuals();
+        return new OperElem(new FuncCall(static_cast<Name*>(elem), actuals));
+      }
+      return new OperElem(elem);
+    }
 
   // <valof>
   case Lex::tVALOF:
@@ -1275,38 +1684,49 @@ Operand *Syn::readOperand() {
 
   // Literal <decint>
   case Lex::tDECINT:
-    return new OperLiteral(new DecIntLiteral(LEX.value));
+    getNextToken();
+    return new OperLiteral(new DecIntLiteral(value));
 
   // Literal <hexint>
   case Lex::tHEXINT:
-    return new OperLiteral(new HexIntLiteral(LEX.value));
+    getNextToken();
+    return new OperLiteral(new HexIntLiteral(value));
 
   // Literal <octint>
   case Lex::tOCTINT:
-    return new OperLiteral(new OctIntLiteral(LEX.value));
+    getNextToken();
+    return new OperLiteral(new OctIntLiteral(value));
 
   // Literal <binint>
   case Lex::tBININT:
-    return new OperLiteral(new BinIntLiteral(LEX.value));
+    getNextToken();
+    return new OperLiteral(new BinIntLiteral(value));
 
   // Literal <char>
   case Lex::tCHAR:
-    return new OperLiteral(new CharLiteral(LEX.value));
+    getNextToken();
+    return new OperLiteral(new CharLiteral(value));
 
   // Literal "true"
   case Lex::tTRUE:
+    getNextToken();
     return new OperLiteral(new BoolLiteral(true));
 
   // Literal "false"
   case Lex::tFALSE:
+    getNextToken();
     return new OperLiteral(new BoolLiteral(false));
   }
 }
 
 // valof = "valof" <cmd> "result" <expr>
+// The commands of a valof are not enclosed by the expression it is in.
 Valof *Syn::readValof() {
   checkFor(Lex::tVALOF);
+  int outer = enclosed;
+  enclosed = 0;
   Cmd *cmd = readCmd();
+  enclosed = outer;
   checkFor(Lex::tRESULT);
   return new Valof(cmd, readExpr());
 }
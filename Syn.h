@@ -4,26 +4,90 @@
 #include "Lex.h"
 #include "Tree.h"
 
+#include <functional>
 #include <list>
+#include <unordered_map>
+#include <vector>
 
 #define SYN Syn::get()
 
+// The default greatest depth of nesting of commands and expressions
+#define MAX_NESTING 1000
+
+// The greatest depth of nesting that can be set, which the recursive passes
+// over the tree survive on a default native stack
+#define MAX_SAFE_NESTING 4000
+
 class Syn {
 public:
   static Syn instance;
   static Syn &get() { return instance; }
-  Syn() {};
+  Syn() : maxDepth(MAX_NESTING), depth(0), enclosed(0), interning(false) {};
   ~Syn() {};
   void init() {};
+  void setMaxNesting(int n) {
+    maxDepth = n < MAX_SAFE_NESTING ? n : MAX_SAFE_NESTING;
+  }
+  void enableInterning() { interning = true; }
+  // Receivers of each top-level specification and command as it is read
+  typedef std::function<void(Spec*)> SpecSink;
+  typedef std::function<void(Cmd*)> CmdSink;
   Tree *formTree();
+  void streamTree(const SpecSink &, const CmdSink &);
 
 private:
+  // A command waiting for a command it contains to be read, which goes in
+  // its hole, or in the list of a block
+  struct CmdFrame {
+    typedef enum {
+      TAIL,
+      BLOCK,
+      THEN,
+      DO
+    } Kind;
+    Kind kind;
+    Cmd *cmd;
+    Cmd **hole;
+    std::list<Cmd*> *cmds;
+    Lex::Token sep;
+  };
+
+  // An operator waiting for its next operand, after those it has, or a
+  // parenthesis for its expression
+  struct ExprFrame {
+    typedef enum {
+      UNARY,
+      BINARY,
+      PAREN
+    } Kind;
+    Kind kind;
+    Lex::Token op;
+    std::list<Operand*> *operands;
+  };
+
   Lex::Token curTok;
+  std::vector<CmdFrame> cmdStack;
+  std::vector<ExprFrame> exprStack;
+  int maxDepth;
+  int depth;
+  // The number of parentheses, subscripts and actuals being read, within
+  // which "&" and "|" are operators rather than separators
+  int enclosed;
+  // The interned expressions, by their hash
+  bool interning;
+  std::unordered_multimap<size_t, Expr*> interned;
   void getNextToken();
   void checkFor(Lex::Token);
   void error(const char *);
+  void enter();
+  void leave();
+  void pushCmd(CmdFrame::Kind, Cmd *, Cmd **);
+  void popCmd();
+  void pushExpr(ExprFrame::Kind, Lex::Token, Operand *);
+  void popExpr();
+  Expr *intern(Expr *);
   
-  Tree       *readProg();
+  void        readProg(const SpecSink &, const CmdSink &);
   Spec       *readSpec();
   Spec       *readSpecEnd(Spec*);
   Spec       *readServerSpec();
@@ -40,6 +104,7 @@ private:
   Server     *readServer();
   Process    *readProcess();
   Cmd        *readCmd();
+  Cmd        *readCmdHead();
   Choice     *readChoice();
   Altn       *readAltn();
   Select     *readSelect();
@@ -57,6 +122,7 @@ private:
   std::list<Decl*>   *readIntfs();
   std::list<Spec*>   *readSpecs();
   std::list<Spec*>   *readHiddens();
+  std::list<Spec*>   *readSpecList(Lex::Token, Lex::Token);
   std::list<Expr*>   *readActuals();
   std::list<Range*>  *readRep();
   std::list<Choice*> *readChoices();
@@ -0,0 +1,198 @@
+#include "Tail.h"
+#include "Visitor.h"
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+Tail Tail::instance;
+
+// Finds the definitions of a top-level item and marks the tail calls of
+// each, so each item is marked by a visitor of its own
+class TailCalls : public Visitor<false> {
+protected:
+  bool pre(Spec *) override;
+
+private:
+  // The names declared locally on the path to a tail position
+  std::vector<std::string> locals;
+
+  void declare(Spec *);
+  void tail(Cmd *);
+  void tail(Expr *);
+  bool local(std::list<Expr*> *, Def *);
+};
+
+void Tail::mark(Tree *t) {
+  Visitor<false>::parallel(t, [](size_t) {
+    return std::unique_ptr<Visitor<false>>(new TailCalls());
+  });
+}
+
+// Whether a local is passed by reference to a definition. Only scalar value
+// formals are passed by value; value arrays are passed by address.
+bool TailCalls::local(std::list<Expr*> *actuals, Def *d) {
+  if (actuals == nullptr || d->args == nullptr)
+    return false;
+  auto f = d->args->begin();
+  for (auto x : *actuals) {
+    if (f == d->args->end())
+      break;
+    Spef *s = (*f++)->spef;
+    if (s->val && s->type == Spef::VAR && s->lengths == nullptr)
+      continue;
+    for (auto &y : locals)
+      if (usesName(x, y))
+        return true;
+  }
+  return false;
+}
+
+void TailCalls::declare(Spec *s) {
+  if (s->type == Spec::SSPEC) {
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      declare(x);
+  }
+  else if (s->nameList) {
+    for (auto x : *s->names)
+      locals.push_back(x->str);
+  }
+  else if (s->name != nullptr)
+    locals.push_back(s->name->str);
+}
+
+// ============================================================================
+// Tail positions
+// ============================================================================
+
+// Only the last command of a sequence, and the commands of a choice of which
+// exactly one is performed, are in tail position
+void TailCalls::tail(Cmd *c) {
+  if (c == nullptr)
+    return;
+  size_t n = locals.size();
+  switch (c->type) {
+  default:
+    break;
+
+  case Cmd::INSTANCE: {
+      Instance *x = static_cast<Instance*>(c);
+      if (x->dispatch == Instance::DIRECT
+          && x->target->defType == Def::PROCESS
+          && !local(x->actuals, x->target))
+        x->tail = true;
+      break;
+    }
+
+  case Cmd::SPEC:
+    declare(static_cast<CmdSpec*>(c)->spec);
+    tail(static_cast<CmdSpec*>(c)->cmd);
+    break;
+
+  case Cmd::SEQ:
+    if (!static_cast<Seq*>(c)->cmds->empty())
+      tail(static_cast<Seq*>(c)->cmds->back());
+    break;
+
+  case Cmd::IFD:
+    tail(static_cast<IfD*>(c)->cmd);
+    break;
+
+  case Cmd::IFTE:
+    tail(static_cast<IfTE*>(c)->cmd);
+    tail(static_cast<IfTE*>(c)->elseCmd);
+    break;
+
+  case Cmd::CASE:
+    if (static_cast<Case*>(c)->selects != nullptr)
+      for (auto x : *static_cast<Case*>(c)->selects)
+        tail(x->cmd);
+    break;
+
+  case Cmd::RCASE:
+    for (auto x : *static_cast<RepCase*>(c)->ranges)
+      locals.push_back(x->name->str);
+    tail(static_cast<RepCase*>(c)->select->cmd);
+    break;
+  }
+  locals.resize(n);
+}
+
+// A function call is a tail call unless a local of a valof around it is
+// passed by address
+void TailCalls::tail(Expr *e) {
+  switch (e->type) {
+  default:
+    break;
+
+  case Expr::ELEM:
+    if (static_cast<OperElem*>(e)->elem->type == Elem::CALL) {
+      FuncCall *x = static_cast<FuncCall*>(static_cast<OperElem*>(e)->elem);
+      if (x->dispatch == Instance::DIRECT
+          && x->target->defType == Def::FUNCTION
+          && !local(x->actuals, x->target))
+        x->tail = true;
+    }
+    break;
+
+  case Expr::VALOF: {
+      Valof *x = static_cast<OperValof*>(e)->valof;
+      size_t n = locals.size();
+      for (Cmd *c = x->cmd; c->type == Cmd::SPEC;
+           c = static_cast<CmdSpec*>(c)->cmd)
+        declare(static_cast<CmdSpec*>(c)->spec);
+      tail(x->expr);
+      locals.resize(n);
+      break;
+    }
+
+  case Expr::EXPR:
+    tail(static_cast<OperExpr*>(e)->expr);
+    break;
+  }
+}
+
+// ============================================================================
+// Definitions
+// ============================================================================
+
+// The visitor walks on into nested definitions. A body that is an instance
+// is a tail call.
+bool TailCalls::pre(Spec *s) {
+  if (s->type != Spec::DEF)
+    return true;
+  Def *d = static_cast<Def*>(s);
+  locals.clear();
+  switch (d->defType) {
+  default:
+    break;
+
+  case Def::PROCESS: {
+      Process *p = static_cast<ProcessDef*>(d)->process;
+      if (p->type == Process::CMD)
+        tail(static_cast<ProcessCmd*>(p)->cmd);
+      else if (p->type == Process::SPEC) {
+        ProcessSpec *x = static_cast<ProcessSpec*>(p);
+        if (x->intf != nullptr)
+          for (auto y : *x->intf)
+            declare(y);
+        tail(x->cmd);
+      }
+      else {
+        ProcessInstance *x = static_cast<ProcessInstance*>(p);
+        if (x->dispatch == Instance::DIRECT
+            && x->target->defType == Def::PROCESS
+            && !local(x->actuals, x->target))
+          x->tail = true;
+      }
+      break;
+    }
+
+  case Def::FUNCTION:
+    tail(static_cast<FunctionDef*>(d)->expr);
+    break;
+  }
+  locals.clear();
+  return true;
+}
@@ -0,0 +1,23 @@
+#ifndef TAIL_H
+#define TAIL_H
+
+#include "Tree.h"
+
+#define TAIL Tail::get()
+
+// Tail calls: a direct call of a process or function that is the last
+// action of a definition is marked so it can be performed as a jump that
+// reuses the caller's frame, for self and mutual recursion alike. A process
+// call is only a tail call when no local of the caller is passed to it by
+// reference, since the frame holding it is overwritten. The definitions of
+// each top-level item are marked in parallel.
+class Tail {
+public:
+  static Tail instance;
+  static Tail &get() { return instance; }
+  Tail() {};
+  ~Tail() {};
+  void mark(Tree *);
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "Target.h"
+#include "Fold.h"
+
+#include <stdlib.h>
+
+Target Target::instance;
+
+static int isqrt(int n) {
+  int r = 0;
+  while ((long long) (r+1) * (r+1) <= n)
+    r++;
+  return r;
+}
+
+static int ilog2(int n) {
+  int r = 0;
+  while ((1LL << (r+1)) <= n)
+    r++;
+  return r;
+}
+
+// Read a target description, replacing any given before, and check it is
+// consistent
+bool Target::configure(const std::string &desc) {
+  cores = 0;
+  topology = NONE;
+  size_t i = 0;
+  while (i < desc.size()) {
+    size_t j = desc.find(',', i);
+    if (j == std::string::npos)
+      j = desc.size();
+    std::string item = desc.substr(i, j-i);
+    size_t eq = item.find('=');
+    if (eq == std::string::npos) {
+      msg = "expected key=value in target description: " + item;
+      return false;
+    }
+    if (!set(item.substr(0, eq), item.substr(eq+1)))
+      return false;
+    i = j+1;
+  }
+  if (cores <= 0) {
+    msg = "target description must give a core count";
+    return false;
+  }
+  if (topology == MESH && isqrt(cores) * isqrt(cores) != cores) {
+    msg = "mesh topology requires a square core count";
+    return false;
+  }
+  if (topology == HYPERCUBE && (cores & (cores-1)) != 0) {
+    msg = "hypercube topology requires a power of two core count";
+    return false;
+  }
+  return true;
+}
+
+bool Target::set(const std::string &key, const std::string &value) {
+  if (key == "cores") {
+    char *end;
+    cores = (int) strtol(value.c_str(), &end, 0);
+    if (value.empty() || *end != '\0' || cores <= 0) {
+      msg = "invalid core count: " + value;
+      return false;
+    }
+  }
+  else if (key == "topology") {
+    if      (value == "none")      topology = NONE;
+    else if (value == "ring")      topology = RING;
+    else if (value == "mesh")      topology = MESH;
+    else if (value == "hypercube") topology = HYPERCUBE;
+    else {
+      msg = "unknown topology: " + value;
+      return false;
+    }
+  }
+  else {
+    msg = "unknown target property: " + key;
+    return false;
+  }
+  return true;
+}
+
+// Define the constants describing the target. The square root and logarithm
+// of the core count are only defined when they are exact.
+void Target::define() {
+  if (cores <= 0)
+    return;
+  FOLD.define("NUM_CORES", cores);
+  if (isqrt(cores) * isqrt(cores) == cores)
+    FOLD.define("NUM_CORES_SQRT", isqrt(cores));
+  if ((cores & (cores-1)) == 0)
+    FOLD.define("NUM_CORES_LOG", ilog2(cores));
+}
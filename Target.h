@@ -0,0 +1,35 @@
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <string>
+
+#define TGT Target::get()
+
+// The target machine description, given as a list of key=value pairs, for
+// example "cores=64,topology=mesh". Its properties are defined as constants
+// that programs can refer to and that are folded at compile time.
+class Target {
+public:
+  typedef enum {
+    NONE,
+    RING,
+    MESH,
+    HYPERCUBE
+  } Topology;
+  static Target instance;
+  static Target &get() { return instance; }
+  Target() : cores(0), topology(NONE) {};
+  ~Target() {};
+  bool configure(const std::string &);
+  void define();
+  const std::string &error() { return msg; }
+
+private:
+  int cores;
+  Topology topology;
+  std::string msg;
+
+  bool set(const std::string &, const std::string &);
+};
+
+#endif
@@ -1,16 +1,70 @@
 #include "Tree.h"
+#include "Dump.h"
+#include "Visitor.h"
 #include <stdio.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <limits.h>
 
-// Indenting with tree markers
-static int markers[100] = {1};
-static void indent(int i, int numChildren) {
-  markers[i] = numChildren;
-  if(i > 1) --markers[i-1];
-  for (int j=0; j<i-1; ++j)
-    printf("%s", markers[j] > 0 ? "| " : "  ");
-  printf("`-");
+#include <set>
+
+// Add a word to the text of a node
+static void append(std::string &s, const std::string &w) {
+  if (w.empty())
+    return;
+  if (!s.empty())
+    s += ' ';
+  s += w;
+}
+
+static const char *xferStr(RepSeq::Xfer x) {
+  switch (x) {
+  default:                return "";
+  case RepSeq::BLOCK:     return "(block)";
+  case RepSeq::COALESCE:  return "(coalesce)";
+  }
+}
+
+static const char *modeStr(Out::Mode m) {
+  switch (m) {
+  default:          return "";
+  case Out::COPY:   return "(copy)";
+  case Out::MOVE:   return "(move)";
+  }
+}
+
+static const char *checkStr(Elem *e) {
+  if (e->subscripts == nullptr)
+    return "";
+  switch (e->check) {
+  default:               return "";
+  case Elem::SAFE:       return "(safe)";
+  case Elem::HOISTED:    return "(hoisted)";
+  case Elem::UNCHECKED:  return "(unchecked)";
+  }
+}
+
+static std::string slotStr(Name *n) {
+  if (n->decl == nullptr)
+    return "";
+  return "(frame " + std::to_string(n->frame) + " slot " +
+      std::to_string(n->slot) + ")";
+}
+
+static const char *sharingStr(Par::Sharing s) {
+  switch (s) {
+  default:              return "";
+  case Par::DISJOINT:   return "(disjoint)";
+  case Par::CONFLICT:   return "(conflict)";
+  }
+}
+
+static std::string dispatchStr(Instance::Dispatch d, Def *target) {
+  switch (d) {
+  default:               return "";
+  case Instance::DIRECT: return "(direct " + target->name->str + ")";
+  case Instance::CACHED: return "(cached " + target->name->str + ")";
+  }
 }
 
 void Tree::print() {
@@ -18,6 +72,15 @@ void Tree::print() {
   for (auto x : prog) printCmd(1, x);
 }
 
+// Print a single top-level item, as it would be printed in a whole tree
+void Tree::print(Spec *s) {
+  printSpec(1, s);
+}
+
+void Tree::print(Cmd *c) {
+  printCmd(1, c);
+}
+
 void Tree::printSpec(int i, Spec *s) {
   switch(s->type) {
 
@@ -27,8 +90,7 @@ void Tree::printSpec(int i, Spec *s) {
 
   case Spec::SSPEC: {
       SimSpec *x = static_cast<SimSpec*>(s);
-      indent(i, x->specs->size());
-      printf("SimultaenousSpecification");
+      DUMP.node(i, x->specs->size(), "SimultaneousSpecification");
       for (auto y : *x->specs)
         printSpec(i+1, y);
       break;
@@ -37,12 +99,11 @@ void Tree::printSpec(int i, Spec *s) {
 }
 
 void Tree::printDef(int i, Def *d) {
-  switch(d->type) {
+  switch(d->defType) {
 
   case Def::PROCESS: {
-      indent(i, 3);
       ProcessDef *x = static_cast<ProcessDef*>(d);
-      printf("ProcessDef\n");
+      DUMP.node(i, 3, "ProcessDef");
       printName(i+1, x->name);
       printFmls(i+1, x->args);
       printProcess(i+1, x->process);
@@ -50,9 +111,8 @@ void Tree::printDef(int i, Def *d) {
     }
 
   case Def::SERVER: {
-      indent(i, 3);
       ServerDef *x = static_cast<ServerDef*>(d);
-      printf("ServerDef\n");
+      DUMP.node(i, 3, "ServerDef");
       printName(i+1, x->name);
       printFmls(i+1, x->args);
       printServer(i+1, x->server);
@@ -60,9 +120,8 @@ void Tree::printDef(int i, Def *d) {
     }
 
   case Def::ISERVER: {
-      indent(i, 3);
       InhrtServerDef *x = static_cast<InhrtServerDef*>(d);
-      printf("InheritingServerDef\n");
+      DUMP.node(i, 3, "InheritingServerDef");
       printName(i+1, x->name);
       printFmls(i+1, x->args);
       printHidingDecl(i+1, x->hidingDecl);
@@ -70,9 +129,9 @@ void Tree::printDef(int i, Def *d) {
     }
 
   case Def::FUNCTION: {
-      indent(i, 3);
       FunctionDef *x = static_cast<FunctionDef*>(d);
-      printf("FunctionDef\n");
+      DUMP.node(i, 3, "FunctionDef", x->memo > 0 ?
+          "(memo " + std::to_string(x->memo) + ")" : "");
       printName(i+1, x->name);
       printFmls(i+1, x->args);
       printExpr(i+1, x->expr);
@@ -85,32 +144,41 @@ void Tree::printDecl(int i, Decl *d) {
   switch(d->tDecl) {
 
   case Decl::VAR: {
-      indent(i, 0);
       VarDecl *x = static_cast<VarDecl*>(d);
-      printf("VarDecl\n");
+      DUMP.node(i, 0, "VarDecl");
       break;
     }
 
-  case Decl::HIDING: {
-      indent(i, 0);
-      HidingDecl *x = static_cast<HidingDecl*>(d);
-      printf("HidingDecl\n");
+  case Decl::CALL: {
+      DUMP.node(i, 0, "CallDecl");
       break;
     }
 
+  case Decl::HIDING:
+    printHidingDecl(i, static_cast<HidingDecl*>(d));
+    break;
+
   case Decl::SERVER: {
-      indent(i, 0);
-      VarDecl *x = static_cast<VarDecl*>(d);
-      printf("ServerDecl\n");
+      ServerDecl *x = static_cast<ServerDecl*>(d);
+      DUMP.node(i, 2, "ServerDecl");
+      printName(i+1, x->name);
+      printServer(i+1, x->server);
       break;
     }
 
   case Decl::RSERVER: {
-      indent(i, 0);
       RepServerDecl *x = static_cast<RepServerDecl*>(d);
-      printf("RepServerDecl\n");
+      DUMP.node(i, 2, "RepServerDecl",
+          x->alloc == RepServerDecl::STATIC ? "(static)" : "");
+      printName(i+1, x->name);
+      printServer(i+1, x->server);
       break;
     }
+
+  case Decl::INITIAL:
+    DUMP.node(i, 1, "InitialDecl");
+    printCmd(i+1, static_cast<InitialDecl*>(d)->cmd);
+    break;
   }
 }
 
@@ -118,52 +186,48 @@ void Tree::printAbbr(int i, Abbr *a) {
   switch(a->type) {
 
   case Abbr::VAL: {
-      indent(i, 0);
       ValAbbr *x = static_cast<ValAbbr*>(a);
-      printf("ValAbbr\n");
+      DUMP.node(i, 2, "ValAbbr");
+      printName(i+1, x->name);
+      printExpr(i+1, x->expr);
       break;
     }
 
   case Abbr::VAR: {
-      indent(i, 0);
       VarAbbr *x = static_cast<VarAbbr*>(a);
-      printf("VarAbbr\n");
+      DUMP.node(i, 0, "VarAbbr");
       break;
     }
 
   case Abbr::CALL: {
-      indent(i, 0);
       CallAbbr *x = static_cast<CallAbbr*>(a);
-      printf("CallAbbr\n");
+      DUMP.node(i, 0, "CallAbbr");
       break;
     }
 
   case Abbr::SERVER: {
-      indent(i, 0);
       ServerAbbr *x = static_cast<ServerAbbr*>(a);
-      printf("ServerAbbr\n");
+      DUMP.node(i, 1, "ServerAbbr");
+      printName(i+1, x->name);
       break;
     }
 
   case Abbr::PROCESS: {
-      indent(i, 0);
       ProcessAbbr *x = static_cast<ProcessAbbr*>(a);
-      printf("ProcessAbbr\n");
+      DUMP.node(i, 0, "ProcessAbbr");
       break;
     }
 
   case Abbr::FUNCTION: {
-      indent(i, 0);
       FunctionAbbr *x = static_cast<FunctionAbbr*>(a);
-      printf("FunctionAbbr\n");
+      DUMP.node(i, 0, "FunctionAbbr");
       break;
     }
   }
 }
 
 void Tree::printFmls(int i, std::list<Fml*> *f) {
-  indent(i, f->size());
-  printf("Formals\n");
+  DUMP.node(i, f != nullptr ? f->size() : 0, "Formals");
   if (f != nullptr) {
     for (auto y : *f)
       printFml(i+1, y);
@@ -171,8 +235,7 @@ void Tree::printFmls(int i, std::list<Fml*> *f) {
 }
 
 void Tree::printFml(int i, Fml *f) {
-  indent(i, 1);
-  printf("Formal\n");
+  DUMP.node(i, 1, "Formal");
   printName(i+1, f->name);
 }
 
@@ -180,219 +243,808 @@ void Tree::printProcess(int i, Process *p) {
   switch (p->type) {
 
   case Process::CMD: {
-      indent(i, 1);
       ProcessCmd *x = static_cast<ProcessCmd*>(p);
-      printf("ProcessCmd\n");
+      DUMP.node(i, 1, "ProcessCmd");
       printCmd(i+1, x->cmd);
       break;
     }
 
   case Process::SPEC: {
-      indent(i, 2);
       ProcessSpec *x = static_cast<ProcessSpec*>(p);
-      printf("ProcessSpec\n");
+      DUMP.node(i, 2, "ProcessSpec");
       printIntf(i+1, x->intf);
       printCmd(i+1, x->cmd);
       break;
     }
 
   case Process::INSTANCE: {
-      indent(i, 0);
       ProcessInstance *x = static_cast<ProcessInstance*>(p);
-      printf("ProcessInstance\n");
+      std::string t = dispatchStr(x->dispatch, x->target);
+      if (x->tail)
+        append(t, "(tail)");
+      DUMP.node(i, 1, "ProcessInstance", t);
+      printName(i+1, x->name);
       break;
     }
   }
 }
 
 void Tree::printServer(int i, Server *s) {
-  indent(i, 0);
-  printf("Server\n");
+  if (s->type == Server::INSTANCE) {
+    DUMP.node(i, 1, "ServerInstance");
+    printName(i+1, static_cast<ServerInstance*>(s)->name);
+    return;
+  }
+  ServerSpec *x = static_cast<ServerSpec*>(s);
+  DUMP.node(i, x->decls != nullptr ? x->decls->size() + 1 : 1, "ServerSpec");
+  printIntf(i+1, x->intfs);
+  if (x->decls != nullptr)
+    for (auto y : *x->decls)
+      printSpec(i+1, y);
 }
 
 void Tree::printIntf(int i, std::list<Decl*> *f) {
-  indent(i, 0);
-  printf("Interface\n");
+  DUMP.node(i, 0, "Interface");
 }
 
 void Tree::printHidingDecl(int i, HidingDecl *h) {
-  indent(i, 0);
-  printf("HidingDecl\n");
+  DUMP.node(i, h->decls != nullptr ? h->decls->size() + 1 : 1, "HidingDecl");
+  printName(i+1, h->name);
+  if (h->decls != nullptr)
+    for (auto y : *h->decls)
+      printSpec(i+1, y);
 }
 
 void Tree::printCmd(int i, Cmd *c) {
   switch(c->type) {
 
   case Cmd::SPEC: {
-      indent(i, 2);
-      printf("CmdSpec\n");
+      DUMP.node(i, 2, "CmdSpec");
       CmdSpec *x = static_cast<CmdSpec*>(c);
-      printSpec(i, x->spec);
+      printSpec(i+1, x->spec);
       printCmd(i+1, x->cmd);
       break;
     }
 
   case Cmd::SKIP:
-    indent(i, 0);
-    printf("Skip\n");
+    DUMP.node(i, 0, "Skip");
     break;
 
   case Cmd::STOP:
-    indent(i, 0);
-    printf("Stop\n");
+    DUMP.node(i, 0, "Stop");
     break;
 
   case Cmd::SEQ: {
       Seq *x = static_cast<Seq*>(c);
-      indent(i, x->cmds->size());
-      printf("Seq\n");
+      DUMP.node(i, x->cmds->size(), "Seq");
       for (auto y : *x->cmds)
         printCmd(i+1, y);
       break;
     }
 
   case Cmd::ASS: {
-      indent(i, 0);
-      printf("Ass\n");
+      DUMP.node(i, 2, "Ass");
       Ass *x = static_cast<Ass*>(c);
+      printElem(i+1, x->lhs);
+      printExpr(i+1, x->rhs);
       break;
     }
 
   case Cmd::IN: {
-      indent(i, 0);
-      printf("In\n");
+      DUMP.node(i, 2, "In");
       In *x = static_cast<In*>(c);
+      printElem(i+1, x->lhs);
+      printElem(i+1, x->rhs);
       break;
     }
 
   case Cmd::OUT: {
-      indent(i, 0);
-      printf("Out\n");
       Out *x = static_cast<Out*>(c);
+      DUMP.node(i, 2, "Out", modeStr(x->mode));
+      printElem(i+1, x->lhs);
+      printExpr(i+1, x->rhs);
       break;
     }
 
   case Cmd::CONNECT: {
-      indent(i, 0);
-      printf("Connect\n");
+      DUMP.node(i, 0, "Connect");
       Connect *x = static_cast<Connect*>(c);
       break;
     }
 
   case Cmd::ALT: {
-      indent(i, 0);
-      printf("Alt\n");
+      DUMP.node(i, 0, "Alt");
       Alt *x = static_cast<Alt*>(c);
       break;
     }
 
   case Cmd::TEST: {
-      indent(i, 0);
-      printf("Test\n");
+      DUMP.node(i, 0, "Test");
       Test *x = static_cast<Test*>(c);
       break;
     }
 
   case Cmd::IFD: {
-      indent(i, 0);
-      printf("IfD\n");
+      DUMP.node(i, 2, "IfD");
       IfD *x = static_cast<IfD*>(c);
+      printExpr(i+1, x->expr);
+      printCmd(i+1, x->cmd);
       break;
     }
 
   case Cmd::IFTE: {
-      indent(i, 0);
-      printf("IfTE\n");
+      DUMP.node(i, 3, "IfTE");
       IfTE *x = static_cast<IfTE*>(c);
+      printExpr(i+1, x->expr);
+      printCmd(i+1, x->cmd);
+      printCmd(i+1, x->elseCmd);
       break;
     }
 
   case Cmd::CASE: {
-      indent(i, 0);
-      printf("Case\n");
+      DUMP.node(i, 0, "Case");
       Case *x = static_cast<Case*>(c);
       break;
     }
 
   case Cmd::WHILE: {
-      indent(i, 0);
-      printf("While\n");
+      DUMP.node(i, 0, "While");
       While *x = static_cast<While*>(c);
       break;
     }
 
   case Cmd::UNTIL: {
-      indent(i, 0);
-      printf("Until\n");
+      DUMP.node(i, 0, "Until");
       Until *x = static_cast<Until*>(c);
       break;
     }
 
   case Cmd::DO: {
-      indent(i, 0);
-      printf("Do\n");
+      DUMP.node(i, 0, "Do");
       Do *x = static_cast<Do*>(c);
       break;
     }
 
   case Cmd::PAR: {
-      indent(i, 0);
-      printf("Par\n");
       Par *x = static_cast<Par*>(c);
+      DUMP.node(i, x->cmds->size(), "Par", sharingStr(x->sharing));
+      for (auto y : *x->cmds)
+        printCmd(i+1, y);
       break;
     }
 
   case Cmd::INSTANCE: {
-      indent(i, 0);
-      printf("Instance\n");
       Instance *x = static_cast<Instance*>(c);
+      std::string t = dispatchStr(x->dispatch, x->target);
+      if (x->tail)
+        append(t, "(tail)");
+      DUMP.node(i, 1, "Instance", t);
+      printName(i+1, x->name);
       break;
     }
 
   case Cmd::CALL: {
-      indent(i, 0);
-      printf("Call\n");
       Call *x = static_cast<Call*>(c);
+      DUMP.node(i, 2, "Call", dispatchStr(x->dispatch, x->target));
+      printName(i+1, x->name);
+      printName(i+1, x->field);
       break;
     }
 
   case Cmd::RALT: {
-      indent(i, 0);
-      printf("RepAlt\n");
+      DUMP.node(i, 0, "RepAlt");
       RepAlt *x = static_cast<RepAlt*>(c);
       break;
     }
 
   case Cmd::RTEST: {
-      indent(i, 0);
-      printf("RepTest\n");
+      DUMP.node(i, 0, "RepTest");
       RepTest *x = static_cast<RepTest*>(c);
       break;
     }
 
   case Cmd::RCASE: {
-      indent(i, 0);
-      printf("RepCase\n");
+      DUMP.node(i, 0, "RepCase");
       RepCase *x = static_cast<RepCase*>(c);
       break;
     }
 
   case Cmd::RSEQ: {
-      indent(i, 0);
-      printf("RepSeq\n");
       RepSeq *x = static_cast<RepSeq*>(c);
+      DUMP.node(i, 1, "RepSeq", xferStr(x->xfer));
+      printCmd(i+1, x->cmd);
+      break;
+    }
+
+  case Cmd::RPAR: {
+      RepPar *x = static_cast<RepPar*>(c);
+      DUMP.node(i, 1, "RepPar", sharingStr(x->sharing));
+      printCmd(i+1, x->cmd);
       break;
     }
   }
 }
 
 void Tree::printExpr(int i, Expr *e) {
-  indent(i, 0);
-  printf("Expr\n");
+  if (e->type == Expr::VALOF) {
+    DUMP.node(i, 2, "Valof");
+    printCmd(i+1, static_cast<OperValof*>(e)->valof->cmd);
+    printExpr(i+1, static_cast<OperValof*>(e)->valof->expr);
+    return;
+  }
+  if (e->type == Expr::LITERAL)
+    DUMP.node(i, 0, "Literal",
+        std::to_string(literalValue(static_cast<OperLiteral*>(e)->literal)));
+  else if (e->type == Expr::ELEM) {
+    Elem *x = static_cast<OperElem*>(e)->elem;
+    if (x->type == Elem::CALL) {
+      FuncCall *y = static_cast<FuncCall*>(x);
+      std::string t = y->name->str;
+      append(t, dispatchStr(y->dispatch, y->target));
+      if (y->tail)
+        append(t, "(tail)");
+      DUMP.node(i, 0, "FuncCall", t);
+    }
+    else {
+      std::string t = x->type == Elem::FIELD ?
+          static_cast<Field*>(x)->field->str : static_cast<Name*>(x)->str;
+      if (x->type == Elem::NAME)
+        append(t, slotStr(static_cast<Name*>(x)));
+      append(t, checkStr(x));
+      DUMP.node(i, 0, "Elem", t);
+    }
+  }
+  else
+    DUMP.node(i, 0, "Expr");
+}
+
+void Tree::printElem(int i, Elem *e) {
+  std::string t;
+  if (e->type == Elem::FIELD) {
+    t = static_cast<Field*>(e)->base->str + "." +
+        static_cast<Field*>(e)->field->str;
+    append(t, checkStr(e));
+    DUMP.node(i, 0, "Field", t);
+  }
+  else {
+    t = static_cast<Name*>(e)->str;
+    append(t, slotStr(static_cast<Name*>(e)));
+    append(t, checkStr(e));
+    DUMP.node(i, 0, "Name", t);
+  }
 }
 
 void Tree::printName(int i, Name *name) {
-  indent(i, 0);
-  printf("Name %s\n", name->str.c_str());
+  std::string t = name->str;
+  append(t, slotStr(name));
+  DUMP.node(i, 0, "Name", t);
+}
+
+// ============================================================================
+// Releasing
+// ============================================================================
+
+// Frees the nodes of a parse tree, each after its children. The parser can
+// put the same node in more than one place, so each is freed only the first
+// time it is reached, along with the lists it holds.
+class Release : public Visitor<false> {
+protected:
+  bool pre(Spec *s)    override { return first(s); }
+  bool pre(Spef *s)    override { return first(s); }
+  bool pre(Fml *f)     override { return first(f); }
+  bool pre(Process *p) override { return first(p); }
+  bool pre(Server *s)  override { return first(s); }
+  bool pre(Cmd *c)     override { return first(c); }
+  bool pre(Altn *a)    override { return first(a); }
+  bool pre(Choice *c)  override { return first(c); }
+  bool pre(Select *s)  override { return first(s); }
+  bool pre(Range *r)   override { return first(r); }
+  bool pre(Expr *e)    override { return first(e); }
+  bool pre(Literal *l) override { return first(l); }
+  bool pre(Elem *e)    override { return first(e); }
+  void post(Spec *)    override;
+  void post(Spef *)    override;
+  void post(Fml *f)    override { delete f; }
+  void post(Process *) override;
+  void post(Server *)  override;
+  void post(Cmd *)     override;
+  void post(Altn *)    override;
+  void post(Choice *)  override;
+  void post(Select *)  override;
+  void post(Range *r)  override { delete r; }
+  void post(Expr *)    override;
+  void post(Literal *) override;
+  void post(Elem *)    override;
+
+private:
+  std::set<void*> freed;
+
+  bool first(void *p) { return freed.insert(p).second; }
+  template<typename T> void drop(std::list<T*> *l) {
+    if (l != nullptr && first(l))
+      delete l;
+  }
+};
+
+void Release::post(Spec *s) {
+  if (s->nameList)
+    drop(s->names);
+  switch (s->type) {
+
+  case Spec::DEF:
+    drop(static_cast<Def*>(s)->args);
+    switch (static_cast<Def*>(s)->defType) {
+    case Def::PROCESS:  delete static_cast<ProcessDef*>(s);  break;
+    case Def::SERVER:   delete static_cast<ServerDef*>(s);   break;
+    case Def::FUNCTION: delete static_cast<FunctionDef*>(s); break;
+    case Def::ISERVER:
+      drop(static_cast<InhrtServerDef*>(s)->intf);
+      delete static_cast<InhrtServerDef*>(s);
+      break;
+    }
+    break;
+
+  case Spec::DECL:
+    switch (static_cast<Decl*>(s)->tDecl) {
+    case Decl::VAR:    delete static_cast<VarDecl*>(s);    break;
+    case Decl::SERVER: delete static_cast<ServerDecl*>(s); break;
+    case Decl::CALL: {
+        CallDecl *x = static_cast<CallDecl*>(s);
+        if (!x->nameList)
+          drop(x->args);
+        else if (x->argss != nullptr && first(x->argss)) {
+          for (auto y : *x->argss)
+            drop(y);
+          delete x->argss;
+        }
+        delete x;
+        break;
+      }
+    case Decl::HIDING:
+      drop(static_cast<HidingDecl*>(s)->decls);
+      delete static_cast<HidingDecl*>(s);
+      break;
+    case Decl::RSERVER:
+      drop(static_cast<RepServerDecl*>(s)->exprs);
+      delete static_cast<RepServerDecl*>(s);
+      break;
+    case Decl::INITIAL:
+      delete static_cast<InitialDecl*>(s);
+      break;
+    }
+    break;
+
+  case Spec::ABBR:
+    switch (static_cast<Abbr*>(s)->type) {
+    case Abbr::VAL:      delete static_cast<ValAbbr*>(s);      break;
+    case Abbr::VAR:      delete static_cast<VarAbbr*>(s);      break;
+    case Abbr::SERVER:   delete static_cast<ServerAbbr*>(s);   break;
+    case Abbr::PROCESS:  delete static_cast<ProcessAbbr*>(s);  break;
+    case Abbr::FUNCTION: delete static_cast<FunctionAbbr*>(s); break;
+    case Abbr::CALL:
+      drop(static_cast<CallAbbr*>(s)->args);
+      delete static_cast<CallAbbr*>(s);
+      break;
+    }
+    break;
+
+  case Spec::SSPEC:
+    drop(static_cast<SimSpec*>(s)->specs);
+    delete static_cast<SimSpec*>(s);
+    break;
+  }
+}
+
+void Release::post(Spef *s) {
+  drop(s->lengths);
+  switch (s->kind) {
+  case Spef::BASIC: delete s;                          break;
+  case Spef::NAMED: delete static_cast<NamedSpef*>(s); break;
+  case Spef::INTERFACE:
+    drop(static_cast<IntfSpef*>(s)->intf);
+    delete static_cast<IntfSpef*>(s);
+    break;
+  }
+}
+
+void Release::post(Process *p) {
+  switch (p->type) {
+  case Process::CMD:
+    delete static_cast<ProcessCmd*>(p);
+    break;
+  case Process::SPEC:
+    drop(static_cast<ProcessSpec*>(p)->intf);
+    delete static_cast<ProcessSpec*>(p);
+    break;
+  case Process::INSTANCE:
+    drop(static_cast<ProcessInstance*>(p)->actuals);
+    delete static_cast<ProcessInstance*>(p);
+    break;
+  }
+}
+
+void Release::post(Server *s) {
+  switch (s->type) {
+  case Server::SPEC:
+    drop(static_cast<ServerSpec*>(s)->intfs);
+    drop(static_cast<ServerSpec*>(s)->decls);
+    delete static_cast<ServerSpec*>(s);
+    break;
+  case Server::INSTANCE:
+    drop(static_cast<ServerInstance*>(s)->actuals);
+    delete static_cast<ServerInstance*>(s);
+    break;
+  }
+}
+
+void Release::post(Cmd *c) {
+  switch (c->type) {
+  case Cmd::SPEC:    delete static_cast<CmdSpec*>(c); break;
+  case Cmd::SKIP:    delete static_cast<Skip*>(c);    break;
+  case Cmd::STOP:    delete static_cast<Stop*>(c);    break;
+  case Cmd::ASS:     delete static_cast<Ass*>(c);     break;
+  case Cmd::IN:      delete static_cast<In*>(c);      break;
+  case Cmd::OUT:     delete static_cast<Out*>(c);     break;
+  case Cmd::CONNECT: delete static_cast<Connect*>(c); break;
+  case Cmd::IFD:     delete static_cast<IfD*>(c);     break;
+  case Cmd::IFTE:    delete static_cast<IfTE*>(c);    break;
+  case Cmd::WHILE:   delete static_cast<While*>(c);   break;
+  case Cmd::UNTIL:   delete static_cast<Until*>(c);   break;
+  case Cmd::DO:      delete static_cast<Do*>(c);      break;
+
+  case Cmd::INSTANCE:
+    drop(static_cast<Instance*>(c)->actuals);
+    delete static_cast<Instance*>(c);
+    break;
+
+  case Cmd::CALL:
+    drop(static_cast<Call*>(c)->actuals);
+    delete static_cast<Call*>(c);
+    break;
+
+  case Cmd::ALT:
+    drop(static_cast<Alt*>(c)->altns);
+    delete static_cast<Alt*>(c);
+    break;
+
+  case Cmd::RALT:
+    drop(static_cast<RepAlt*>(c)->ranges);
+    delete static_cast<RepAlt*>(c);
+    break;
+
+  case Cmd::TEST:
+    drop(static_cast<Test*>(c)->choices);
+    delete static_cast<Test*>(c);
+    break;
+
+  case Cmd::RTEST:
+    drop(static_cast<RepTest*>(c)->ranges);
+    delete static_cast<RepTest*>(c);
+    break;
+
+  case Cmd::CASE:
+    drop(static_cast<Case*>(c)->selects);
+    delete static_cast<Case*>(c);
+    break;
+
+  case Cmd::RCASE:
+    drop(static_cast<RepCase*>(c)->ranges);
+    delete static_cast<RepCase*>(c);
+    break;
+
+  case Cmd::SEQ:
+    drop(static_cast<Seq*>(c)->cmds);
+    delete static_cast<Seq*>(c);
+    break;
+
+  case Cmd::PAR:
+    drop(static_cast<Par*>(c)->cmds);
+    delete static_cast<Par*>(c);
+    break;
+
+  case Cmd::RSEQ:
+    drop(static_cast<RepSeq*>(c)->ranges);
+    delete static_cast<RepSeq*>(c);
+    break;
+
+  case Cmd::RPAR:
+    drop(static_cast<RepPar*>(c)->ranges);
+    delete static_cast<RepPar*>(c);
+    break;
+  }
+}
+
+void Release::post(Altn *a) {
+  switch (a->type) {
+  case Altn::UNGUARDED: delete static_cast<UnguardedAltn*>(a); break;
+  case Altn::GUARDED:   delete static_cast<GuardedAltn*>(a);   break;
+  case Altn::SKIP:      delete static_cast<SkipAltn*>(a);      break;
+  case Altn::NESTED:    delete static_cast<NestedAltn*>(a);    break;
+  case Altn::SPEC:      delete static_cast<SpecAltn*>(a);      break;
+  }
+}
+
+void Release::post(Choice *c) {
+  switch (c->type) {
+  case Choice::GUARDED: delete static_cast<GuardedChoice*>(c); break;
+  case Choice::NESTED:  delete static_cast<NestedChoice*>(c);  break;
+  case Choice::SPEC:    delete static_cast<SpecChoice*>(c);    break;
+  }
+}
+
+void Release::post(Select *s) {
+  if (s->type == Select::GUARDED)
+    delete static_cast<GuardedSelect*>(s);
+  else
+    delete static_cast<ElseSelect*>(s);
+}
+
+void Release::post(Expr *e) {
+  switch (e->type) {
+  case Expr::UNARY:   delete static_cast<UnaryOp*>(e);     break;
+  case Expr::BINARY:  delete static_cast<BinaryOp*>(e);    break;
+  case Expr::ELEM:    delete static_cast<OperElem*>(e);    break;
+  case Expr::LITERAL: delete static_cast<OperLiteral*>(e); break;
+  case Expr::EXPR:    delete static_cast<OperExpr*>(e);    break;
+
+  case Expr::NARY:
+    drop(static_cast<NaryOp*>(e)->operands);
+    delete static_cast<NaryOp*>(e);
+    break;
+
+  case Expr::VALOF:
+    if (first(static_cast<OperValof*>(e)->valof))
+      delete static_cast<OperValof*>(e)->valof;
+    delete static_cast<OperValof*>(e);
+    break;
+  }
+}
+
+void Release::post(Literal *l) {
+  switch (l->type) {
+  case Literal::DECINT: delete static_cast<DecIntLiteral*>(l); break;
+  case Literal::HEXINT: delete static_cast<HexIntLiteral*>(l); break;
+  case Literal::OCTINT: delete static_cast<OctIntLiteral*>(l); break;
+  case Literal::BININT: delete static_cast<BinIntLiteral*>(l); break;
+  case Literal::CHAR:   delete static_cast<CharLiteral*>(l);   break;
+  case Literal::BOOL:   delete static_cast<BoolLiteral*>(l);   break;
+  }
+}
+
+void Release::post(Elem *e) {
+  drop(e->subscripts);
+  switch (e->type) {
+  default: assert(0 && "invalid element");
+  case Elem::NAME:
+    delete static_cast<Name*>(e);
+    break;
+  case Elem::FIELD:
+    delete static_cast<Field*>(e);
+    break;
+  case Elem::CALL:
+    drop(static_cast<FuncCall*>(e)->actuals);
+    delete static_cast<FuncCall*>(e);
+    break;
+  }
+}
+
+// Free a top-level specification or command and everything it holds, once
+// nothing refers to it any more
+void release(Spec *s) {
+  Release().walk(s);
+}
+
+void release(Cmd *c) {
+  Release().walk(c);
+}
+
+void release(Expr *e) {
+  Release().walk(e);
+}
+
+// ============================================================================
+// Utilities
+// ============================================================================
+
+int literalValue(Literal *l) {
+  switch (l->type) {
+  default: assert(0 && "invalid literal");
+  case Literal::DECINT: return static_cast<DecIntLiteral*>(l)->value;
+  case Literal::HEXINT: return static_cast<HexIntLiteral*>(l)->value;
+  case Literal::OCTINT: return static_cast<OctIntLiteral*>(l)->value;
+  case Literal::BININT: return static_cast<BinIntLiteral*>(l)->value;
+  case Literal::CHAR:   return static_cast<CharLiteral*>(l)->value;
+  case Literal::BOOL:   return static_cast<BoolLiteral*>(l)->value;
+  }
+}
+
+static bool sameExprs(std::list<Expr*> *a, std::list<Expr*> *b) {
+  if (a == nullptr || b == nullptr)
+    return a == b;
+  if (a->size() != b->size())
+    return false;
+  auto j = b->begin();
+  for (auto x : *a)
+    if (!sameExpr(x, *j++))
+      return false;
+  return true;
+}
+
+// Structural equality of elements
+bool sameElem(Elem *a, Elem *b) {
+  if (a->type != b->type || !sameExprs(a->subscripts, b->subscripts))
+    return false;
+  switch (a->type) {
+  default:
+    return false;
+  case Elem::NAME:
+    return static_cast<Name*>(a)->str == static_cast<Name*>(b)->str;
+  case Elem::FIELD: {
+      Field *x = static_cast<Field*>(a);
+      Field *y = static_cast<Field*>(b);
+      return sameElem(x->base, y->base) && sameElem(x->field, y->field);
+    }
+  }
 }
 
+// Structural equality of expressions, ignoring parentheses. Valofs are
+// never considered equal.
+bool sameExpr(Expr *a, Expr *b) {
+  if (a == nullptr || b == nullptr)
+    return a == b;
+  while (a->type == Expr::EXPR) a = static_cast<OperExpr*>(a)->expr;
+  while (b->type == Expr::EXPR) b = static_cast<OperExpr*>(b)->expr;
+  if (a == b)
+    return true;
+  if (a->type != b->type)
+    return false;
+  if (a->hash != 0 && b->hash != 0 && a->hash != b->hash)
+    return false;
+  switch (a->type) {
+  default:
+    return false;
+  case Expr::UNARY: {
+      UnaryOp *x = static_cast<UnaryOp*>(a);
+      UnaryOp *y = static_cast<UnaryOp*>(b);
+      return x->op == y->op && sameExpr(x->operand, y->operand);
+    }
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(a);
+      BinaryOp *y = static_cast<BinaryOp*>(b);
+      return x->op == y->op
+          && sameExpr(x->left, y->left)
+          && sameExpr(x->right, y->right);
+    }
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(a);
+      NaryOp *y = static_cast<NaryOp*>(b);
+      if (x->op != y->op || x->operands->size() != y->operands->size())
+        return false;
+      auto i = y->operands->begin();
+      for (auto z : *x->operands)
+        if (!sameExpr(z, *i++))
+          return false;
+      return true;
+    }
+  case Expr::ELEM:
+    return sameElem(static_cast<OperElem*>(a)->elem,
+                    static_cast<OperElem*>(b)->elem);
+  case Expr::LITERAL:
+    return literalValue(static_cast<OperLiteral*>(a)->literal)
+        == literalValue(static_cast<OperLiteral*>(b)->literal);
+  }
+}
+
+// Whether an element refers to a name, including in its subscripts
+bool usesName(Elem *e, const std::string &n) {
+  if (e->subscripts != nullptr)
+    for (auto x : *e->subscripts)
+      if (usesName(x, n))
+        return true;
+  switch (e->type) {
+  default:
+    return false;
+  case Elem::NAME:
+    return static_cast<Name*>(e)->str == n;
+  case Elem::FIELD:
+    return usesName(static_cast<Field*>(e)->base, n);
+  case Elem::CALL: {
+      FuncCall *x = static_cast<FuncCall*>(e);
+      if (x->name->str == n)
+        return true;
+      if (x->actuals != nullptr)
+        for (auto y : *x->actuals)
+          if (usesName(y, n))
+            return true;
+      return false;
+    }
+  }
+}
+
+// Whether an expression refers to a name. Valofs are assumed to.
+bool usesName(Expr *e, const std::string &n) {
+  if (e == nullptr)
+    return false;
+  switch (e->type) {
+  default:
+    return true;
+  case Expr::UNARY:
+    return usesName(static_cast<UnaryOp*>(e)->operand, n);
+  case Expr::BINARY:
+    return usesName(static_cast<BinaryOp*>(e)->left, n)
+        || usesName(static_cast<BinaryOp*>(e)->right, n);
+  case Expr::NARY:
+    for (auto x : *static_cast<NaryOp*>(e)->operands)
+      if (usesName(x, n))
+        return true;
+    return false;
+  case Expr::ELEM:
+    return usesName(static_cast<OperElem*>(e)->elem, n);
+  case Expr::LITERAL:
+    return false;
+  case Expr::EXPR:
+    return usesName(static_cast<OperExpr*>(e)->expr, n);
+  }
+}
+
+// Evaluate a binary operator, unless it would fault. Arithmetic wraps, as
+// it does on the target, so it is done unsigned.
+bool evaluate(Lex::Token op, int l, int r, int &v, bool &b) {
+  b = false;
+  switch (op) {
+  default:
+    return false;
+  case Lex::tADD:  v = (int) ((unsigned) l + (unsigned) r);  break;
+  case Lex::tSUB:  v = (int) ((unsigned) l - (unsigned) r);  break;
+  case Lex::tMUL:  v = (int) ((unsigned) l * (unsigned) r);  break;
+  case Lex::tDIV:
+    if (r == 0 || (r == -1 && l == INT_MIN)) return false;
+    v = l / r;
+    break;
+  case Lex::tREM:
+    if (r == 0 || (r == -1 && l == INT_MIN)) return false;
+    v = l % r;
+    break;
+  case Lex::tXOR:  v = l ^ r;  break;
+  case Lex::tAND:  v = l & r;  break;
+  case Lex::tOR:   v = l | r;  break;
+  case Lex::tLSH:
+    if (r < 0 || r > 31) return false;
+    v = (int) ((unsigned) l << r);
+    break;
+  case Lex::tRSH:
+    if (r < 0 || r > 31) return false;
+    v = l >> r;
+    break;
+  case Lex::tLAND: v = l && r; b = true; break;
+  case Lex::tLOR:  v = l || r; b = true; break;
+  case Lex::tEQ:   v = l == r; b = true; break;
+  case Lex::tNEQ:  v = l != r; b = true; break;
+  case Lex::tLT:   v = l < r;  b = true; break;
+  case Lex::tLEQ:  v = l <= r; b = true; break;
+  case Lex::tGT:   v = l > r;  b = true; break;
+  case Lex::tGEQ:  v = l >= r; b = true; break;
+  }
+  return true;
+}
+
+// Negate a value, wrapping as the target does
+int negate(int v) {
+  return (int) (0u - (unsigned) v);
+}
+
+// Whether an operator is associative, so chains of it need no parentheses
+bool associative(Lex::Token op) {
+  switch (op) {
+  default:
+    return false;
+  case Lex::tADD:
+  case Lex::tMUL:
+  case Lex::tAND:
+  case Lex::tOR:
+  case Lex::tXOR:
+  case Lex::tLAND:
+  case Lex::tLOR:
+    return true;
+  }
+}
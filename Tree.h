@@ -34,7 +34,12 @@ struct Tree {
 public:
   std::list<Spec*> spec;
   std::list<Cmd*> prog;
+  // The number of slots in the frame of the program, set by Resolve
+  int slots;
+  Tree() : slots(0) {}
   void print();
+  void print(Spec*);
+  void print(Cmd*);
 
 private:
   void printSpec(int x, Spec*);
@@ -49,6 +54,7 @@ private:
   void printHidingDecl(int x, HidingDecl*);
   void printCmd(int x, Cmd*);
   void printExpr(int x, Expr*);
+  void printElem(int x, Elem*);
   void printName(int x, Name*);
 };
 
@@ -70,35 +76,41 @@ struct Spef : public Node {
     PROCESS,
     FUNCTION
   } Type;
+  typedef enum {
+    BASIC,
+    NAMED,
+    INTERFACE
+  } Kind;
   Type type;
+  Kind kind;
   bool val;
   std::list<Expr*> *lengths;
   Spef(Type t) : 
-    type(t), val(false), lengths(nullptr) {}
+    type(t), kind(BASIC), val(false), lengths(nullptr) {}
   Spef(Type t, std::list<Expr*> *l) : 
-    type(t), val(false), lengths(l) {}
+    type(t), kind(BASIC), val(false), lengths(l) {}
   Spef(Type t, bool v) : 
-    type(t), val(v), lengths(nullptr) {}
+    type(t), kind(BASIC), val(v), lengths(nullptr) {}
   Spef(Type t, bool v, std::list<Expr*> *l) : 
-    type(t), val(v), lengths(l) {}
+    type(t), kind(BASIC), val(v), lengths(l) {}
 };
 
 // Interface specifier
 struct IntfSpef : public Spef {
   std::list<Decl*> *intf;
   IntfSpef(Type t, std::list<Decl*> *i) :
-    Spef(t, false), intf(i) {}
+    Spef(t, false), intf(i) { kind = INTERFACE; }
   IntfSpef(Type t, std::list<Decl*> *i, std::list<Expr*> *l) :
-    Spef(t, false, l), intf(i) {}
+    Spef(t, false, l), intf(i) { kind = INTERFACE; }
 };
 
 // Named specifier
 struct NamedSpef : public Spef {
   Name *name;
   NamedSpef(Type t, Name *n) :
-    Spef(t, false), name(n) {}
+    Spef(t, false), name(n) { kind = NAMED; }
   NamedSpef(Type t, Name *n, std::list<Expr*> *l) :
-    Spef(t, false, l), name(n) {}
+    Spef(t, false, l), name(n) { kind = NAMED; }
 };
 
 // ============================================================================
@@ -121,25 +133,39 @@ struct Elem : public Node {
     NAME,
     FIELD,
     LITERAL,
-    SUBSCRIPT
+    SUBSCRIPT,
+    CALL
   } Type;
+  // How the subscripts are bounds checked
+  typedef enum {
+    CHECKED,
+    SAFE,
+    HOISTED,
+    UNCHECKED
+  } Check;
   Type type;
+  Check check;
   std::list<Expr*> *subscripts;
 
 protected:
   Elem(Type t) :
-    type(t), subscripts(nullptr) {}
+    type(t), check(CHECKED), subscripts(nullptr) {}
   Elem(Type t, std::list<Expr*> *s) :
-    type(t), subscripts(s) {}
+    type(t), check(CHECKED), subscripts(s) {}
 };
 
-// Name
+// Name. Resolve binds each to the name that declares it, which is itself
+// at a declaration, and to a slot in a frame, given by its depth of nesting
+// from 0 for the frame of the program. An unresolved name has no declaration.
 struct Name : public Elem {
   std::string str;
+  Name *decl;
+  int frame;
+  int slot;
   Name(std::string n) :
-    Elem(NAME), str(n) {}
+    Elem(NAME), str(n), decl(nullptr), frame(-1), slot(-1) {}
   Name(std::string n, std::list<Expr*> *s) :
-    Elem(NAME, s), str(n) {}
+    Elem(NAME, s), str(n), decl(nullptr), frame(-1), slot(-1) {}
 };
 
 // Field
@@ -187,10 +213,12 @@ struct Def : public Spec {
   } DefType;
   DefType defType;
   std::list<Fml*> *args;
+  // The number of slots in its frame, set by Resolve
+  int slots;
 
 protected:
   Def(DefType t, Name *n, std::list<Fml*> *a) :
-    Spec(DEF, n), defType(t), args(a) {}
+    Spec(DEF, n), defType(t), args(a), slots(0) {}
 };
 
 // Process definition
@@ -212,14 +240,16 @@ struct InhrtServerDef : public Def {
   std::list<Decl*> *intf;
   HidingDecl *hidingDecl; 
   InhrtServerDef(Name *n, std::list<Fml*> *a, HidingDecl *h) :
-    Def(ISERVER, n, a), hidingDecl(h) {}
+    Def(ISERVER, n, a), intf(nullptr), hidingDecl(h) {}
 };
 
 // Function definition
 struct FunctionDef : public Def {
   Expr *expr;
+  // The number of entries in the table memoising it, or 0
+  int memo;
   FunctionDef(Name *n, std::list<Fml*> *a, Expr *e) :
-    Def(FUNCTION, n, a), expr(e) {}
+    Def(FUNCTION, n, a), expr(e), memo(0) {}
 };
 
 // Simultaneous specification
@@ -233,17 +263,19 @@ struct SimSpec : public Spec {
 struct Decl : public Spec {
   typedef enum {
     VAR,
+    CALL,
     HIDING,
     SERVER,
-    RSERVER
+    RSERVER,
+    INITIAL
   } DeclType;
   DeclType tDecl;
 
 protected:
   Decl(DeclType t, Name *n) :
-    Spec(DECL, n), tDecl(VAR) {}
+    Spec(DECL, n), tDecl(t) {}
   Decl(DeclType t, std::list<Name*> *n) :
-    Spec(DECL, n), tDecl(VAR) {}
+    Spec(DECL, n), tDecl(t) {}
 };
 
 // Variable declaration
@@ -263,9 +295,9 @@ struct CallDecl : public Decl {
     std::list<std::list<Fml*>*> *argss;
   };
   CallDecl(Spef *s, Name *n, std::list<Fml*> *a) :
-    Decl(VAR, n), spef(s), args(a) {}
+    Decl(CALL, n), spef(s), args(a) {}
   CallDecl(Spef *s, std::list<Name*> *n, std::list<std::list<Fml*>*> *a) :
-    Decl(VAR, n), spef(s), argss(a) {}
+    Decl(CALL, n), spef(s), argss(a) {}
 };
 
 // Hiding declaration
@@ -284,10 +316,23 @@ struct ServerDecl : public Decl {
 
 // Replicated server declaration
 struct RepServerDecl : public Decl {
+  // How the replicated servers are allocated
+  typedef enum {
+    DYNAMIC,
+    STATIC
+  } Alloc;
   Server *server;
   std::list<Range*> *exprs;
+  Alloc alloc;
   RepServerDecl(Name *n, std::list<Range*> *e, Server *s) :
-    Decl(RSERVER, n), server(s), exprs(e) {}
+    Decl(RSERVER, n), server(s), exprs(e), alloc(DYNAMIC) {}
+};
+
+// Initial declaration of a server, run when each instance is constructed
+struct InitialDecl : public Decl {
+  Cmd *cmd;
+  InitialDecl(Cmd *c) :
+    Decl(INITIAL, (Name *) nullptr), cmd(c) {}
 };
 
 // Abbreviation
@@ -383,7 +428,8 @@ struct Cmd : public Node {
     RALT,
     RTEST,
     RCASE,
-    RSEQ
+    RSEQ,
+    RPAR
   } Type;
   Type type;
 
@@ -402,10 +448,20 @@ struct CmdSpec : public Cmd {
 
 // Instance
 struct Instance : public Cmd {
+  // How the definition that is called is found
+  typedef enum {
+    DYNAMIC,
+    DIRECT,
+    CACHED
+  } Dispatch;
   Name *name;
   std::list<Expr*> *actuals;
+  Dispatch dispatch;
+  Def *target;
+  bool tail;
   Instance(Name *n, std::list<Expr*> *a) :
-    Cmd(INSTANCE), name(n), actuals(a) {}
+    Cmd(INSTANCE), name(n), actuals(a), dispatch(DYNAMIC), target(nullptr),
+    tail(false) {}
 };
 
 // Call
@@ -413,8 +469,11 @@ struct Call : public Cmd {
   Name *name;
   Name *field;
   std::list<Expr*> *actuals;
+  Instance::Dispatch dispatch;
+  Def *target;
   Call(Name *n, Name *f, std::list<Expr*> *a) : 
-    Cmd(CALL), name(n), field(f), actuals(a) {}
+    Cmd(CALL), name(n), field(f), actuals(a),
+    dispatch(Instance::DYNAMIC), target(nullptr) {}
 };
 
 // Skip
@@ -446,10 +505,17 @@ struct In : public Cmd {
 
 // Output
 struct Out : public Cmd {
+  // Transfer of an array value, set by Own
+  typedef enum {
+    VALUE,
+    COPY,
+    MOVE
+  } Mode;
   Elem *lhs;
   Expr *rhs;
+  Mode mode;
   Out(Elem *lhs, Expr *rhs) : 
-    Cmd(OUT), lhs(lhs), rhs(rhs) {}
+    Cmd(OUT), lhs(lhs), rhs(rhs), mode(VALUE) {}
 };
 
 // Connect
@@ -659,15 +725,41 @@ struct Seq : public Cmd {
 
 // Replicated sequence
 struct RepSeq : public Cmd {
+  // Lowering of a replicated input or output, set by Agg
+  typedef enum {
+    ELEMENT,
+    BLOCK,
+    COALESCE
+  } Xfer;
   std::list<Range*> *ranges;
-  RepSeq(std::list<Range*> *r) :
-    Cmd(RSEQ), ranges(r) {}
+  Cmd *cmd;
+  Xfer xfer;
+  RepSeq(std::list<Range*> *r, Cmd *c) :
+    Cmd(RSEQ), ranges(r), cmd(c), xfer(ELEMENT) {}
 };
 
 // Parallel
 struct Par : public Cmd {
-  Par() : 
-    Cmd(PAR) {}
+  // What is proved of the variables and channel ends that the components
+  // use, set by Usage
+  typedef enum {
+    UNPROVED,
+    DISJOINT,
+    CONFLICT
+  } Sharing;
+  std::list<Cmd*> *cmds;
+  Sharing sharing;
+  Par(std::list<Cmd*> *c) : 
+    Cmd(PAR), cmds(c), sharing(UNPROVED) {}
+};
+
+// Replicated parallel
+struct RepPar : public Cmd {
+  std::list<Range*> *ranges;
+  Cmd *cmd;
+  Par::Sharing sharing;
+  RepPar(std::list<Range*> *r, Cmd *c) :
+    Cmd(RPAR), ranges(r), cmd(c), sharing(Par::UNPROVED) {}
 };
 
 // Index range
@@ -694,8 +786,10 @@ struct Server {
 struct ServerSpec : public Server {
   std::list<Decl*> *intfs;
   std::list<Spec*> *decls;
+  // The number of slots in the frame of its state, set by Resolve
+  int slots;
   ServerSpec(std::list<Decl*> *i, std::list<Spec*> *d) :
-    Server(SPEC), intfs(i), decls(d) {}
+    Server(SPEC), intfs(i), decls(d), slots(0) {}
 };
 
 struct ServerInstance : public Server {
@@ -733,8 +827,12 @@ struct ProcessSpec : public Process {
 struct ProcessInstance : public Process {
   Name *name;
   std::list<Expr*> *actuals;
+  Instance::Dispatch dispatch;
+  Def *target;
+  bool tail;
   ProcessInstance(Name *n, std::list<Expr*> *a) :
-    Process(INSTANCE), name(n), actuals(a) {}
+    Process(INSTANCE), name(n), actuals(a),
+    dispatch(Instance::DYNAMIC), target(nullptr), tail(false) {}
 };
 
 // ============================================================================
@@ -745,15 +843,19 @@ struct Expr : public Node {
   typedef enum {
     UNARY,
     BINARY,
+    NARY,
     ELEM,
     LITERAL,
     VALOF,
     EXPR
   } Type;
   Type type;
+  // The structural hash of an interned expression, which is shared and never
+  // changed in place, or 0
+  size_t hash;
 
 protected:
-  Expr(Type t) : type(t) {}
+  Expr(Type t) : type(t), hash(0) {}
 };
 
 struct Operand : public Expr {
@@ -766,6 +868,18 @@ struct OperElem : public Operand {
     Operand(ELEM), elem(e) {};
 };
 
+// Function call element
+struct FuncCall : public Elem {
+  Name *name;
+  std::list<Expr*> *actuals;
+  Instance::Dispatch dispatch;
+  Def *target;
+  bool tail;
+  FuncCall(Name *n, std::list<Expr*> *a) :
+    Elem(CALL), name(n), actuals(a),
+    dispatch(Instance::DYNAMIC), target(nullptr), tail(false) {}
+};
+
 struct OperLiteral : public Operand {
   Literal *literal;
   OperLiteral(Literal *l) : 
@@ -798,6 +912,14 @@ struct BinaryOp : public Expr {
   BinaryOp(Lex::Token t, Operand *l, Operand *r) :
     Expr(BINARY), op(t), left(l), right(r) {}
 };
+
+// A chain of more than two operands of the same associative operator
+struct NaryOp : public Expr {
+  Lex::Token op;
+  std::list<Operand*> *operands;
+  NaryOp(Lex::Token t, std::list<Operand*> *o) :
+    Expr(NARY), op(t), operands(o) {}
+};
     
 struct Literal {
   typedef enum {
@@ -855,5 +977,21 @@ struct Valof : public Expr {
     Expr(VALOF), cmd(c), expr(e) {}
 };
 
+// ============================================================================
+// Utilities
+// ============================================================================
+
+int literalValue(Literal*);
+bool sameElem(Elem*, Elem*);
+bool sameExpr(Expr*, Expr*);
+bool usesName(Elem*, const std::string&);
+bool usesName(Expr*, const std::string&);
+bool evaluate(Lex::Token, int, int, int&, bool&);
+int negate(int);
+bool associative(Lex::Token);
+void release(Spec*);
+void release(Cmd*);
+void release(Expr*);
+
 #endif
 
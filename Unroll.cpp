@@ -0,0 +1,320 @@
+#include "Unroll.h"
+#include "Clone.h"
+#include "Visitor.h"
+
+Unroll Unroll::instance;
+
+void Unroll::unroll(Tree *t) {
+  for (auto x : t->spec) spec(x);
+  cmds(&t->prog);
+  sizes.clear();
+}
+
+// ============================================================================
+// Specifications
+// ============================================================================
+
+void Unroll::spec(Spec *s) {
+  if (s == nullptr)
+    return;
+  switch (s->type) {
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      bool saved = seqs;
+      seqs = seqDefs.count(d) > 0;
+      if (d->defType == Def::PROCESS)
+        process(static_cast<ProcessDef*>(d)->process);
+      else if (d->defType == Def::SERVER)
+        server(static_cast<ServerDef*>(d)->server);
+      else if (d->defType == Def::ISERVER)
+        spec(static_cast<InhrtServerDef*>(d)->hidingDecl);
+      seqs = saved;
+      break;
+    }
+  case Spec::DECL: {
+      Decl *d = static_cast<Decl*>(s);
+      if (d->tDecl == Decl::HIDING) {
+        HidingDecl *x = static_cast<HidingDecl*>(d);
+        if (x->decls != nullptr)
+          for (auto y : *x->decls)
+            spec(y);
+      }
+      else if (d->tDecl == Decl::SERVER)
+        server(static_cast<ServerDecl*>(d)->server);
+      else if (d->tDecl == Decl::RSERVER)
+        server(static_cast<RepServerDecl*>(d)->server);
+      else if (d->tDecl == Decl::INITIAL) {
+        InitialDecl *x = static_cast<InitialDecl*>(d);
+        x->cmd = cmd(x->cmd);
+      }
+      break;
+    }
+  case Spec::ABBR:
+    break;
+  case Spec::SSPEC:
+    for (auto x : *static_cast<SimSpec*>(s)->specs)
+      spec(x);
+    break;
+  }
+}
+
+void Unroll::process(Process *p) {
+  if (p->type == Process::CMD) {
+    ProcessCmd *x = static_cast<ProcessCmd*>(p);
+    x->cmd = cmd(x->cmd);
+  }
+  else if (p->type == Process::SPEC) {
+    ProcessSpec *x = static_cast<ProcessSpec*>(p);
+    x->cmd = cmd(x->cmd);
+  }
+}
+
+void Unroll::server(Server *s) {
+  if (s->type == Server::SPEC) {
+    ServerSpec *x = static_cast<ServerSpec*>(s);
+    if (x->decls != nullptr)
+      for (auto y : *x->decls)
+        spec(y);
+  }
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+void Unroll::cmds(std::list<Cmd*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto &x : *l)
+    x = cmd(x);
+}
+
+// Return the command, or its expansion if it is an unrollable replicated par
+Cmd *Unroll::cmd(Cmd *c) {
+  if (c == nullptr)
+    return nullptr;
+  switch (c->type) {
+  default:
+    break;
+
+  case Cmd::SPEC: {
+      CmdSpec *x = static_cast<CmdSpec*>(c);
+      spec(x->spec);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::ALT:
+    if (static_cast<Alt*>(c)->altns != nullptr)
+      for (auto x : *static_cast<Alt*>(c)->altns)
+        altn(x);
+    break;
+
+  case Cmd::RALT:
+    altn(static_cast<RepAlt*>(c)->altn);
+    break;
+
+  case Cmd::TEST:
+    if (static_cast<Test*>(c)->choices != nullptr)
+      for (auto x : *static_cast<Test*>(c)->choices)
+        choice(x);
+    break;
+
+  case Cmd::RTEST:
+    choice(static_cast<RepTest*>(c)->choice);
+    break;
+
+  case Cmd::IFD: {
+      IfD *x = static_cast<IfD*>(c);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::IFTE: {
+      IfTE *x = static_cast<IfTE*>(c);
+      x->cmd = cmd(x->cmd);
+      x->elseCmd = cmd(x->elseCmd);
+      break;
+    }
+
+  case Cmd::CASE: {
+      Case *x = static_cast<Case*>(c);
+      if (x->selects != nullptr)
+        for (auto y : *x->selects)
+          y->cmd = cmd(y->cmd);
+      break;
+    }
+
+  case Cmd::RCASE: {
+      RepCase *x = static_cast<RepCase*>(c);
+      x->select->cmd = cmd(x->select->cmd);
+      break;
+    }
+
+  case Cmd::WHILE: {
+      While *x = static_cast<While*>(c);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::UNTIL: {
+      Until *x = static_cast<Until*>(c);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::DO: {
+      Do *x = static_cast<Do*>(c);
+      x->cmd = cmd(x->cmd);
+      break;
+    }
+
+  case Cmd::SEQ:
+    cmds(static_cast<Seq*>(c)->cmds);
+    break;
+
+  case Cmd::PAR:
+    cmds(static_cast<Par*>(c)->cmds);
+    break;
+
+  case Cmd::RSEQ: {
+      RepSeq *x = static_cast<RepSeq*>(c);
+      x->cmd = cmd(x->cmd);
+      if (seqs)
+        return expand(x, x->ranges, x->cmd, MAX_UNROLL_SEQ);
+      break;
+    }
+
+  case Cmd::RPAR: {
+      RepPar *x = static_cast<RepPar*>(c);
+      x->cmd = cmd(x->cmd);
+      return expand(x, x->ranges, x->cmd, MAX_UNROLL);
+    }
+  }
+  return c;
+}
+
+void Unroll::altn(Altn *a) {
+  switch (a->type) {
+  case Altn::UNGUARDED:
+    static_cast<UnguardedAltn*>(a)->cmd =
+        cmd(static_cast<UnguardedAltn*>(a)->cmd);
+    break;
+  case Altn::GUARDED:
+    static_cast<GuardedAltn*>(a)->cmd =
+        cmd(static_cast<GuardedAltn*>(a)->cmd);
+    break;
+  case Altn::SKIP:
+    static_cast<SkipAltn*>(a)->cmd = cmd(static_cast<SkipAltn*>(a)->cmd);
+    break;
+  case Altn::NESTED:
+    cmd(static_cast<NestedAltn*>(a)->alt);
+    break;
+  case Altn::SPEC:
+    spec(static_cast<SpecAltn*>(a)->spec);
+    altn(static_cast<SpecAltn*>(a)->altn);
+    break;
+  }
+}
+
+void Unroll::choice(Choice *c) {
+  switch (c->type) {
+  case Choice::GUARDED:
+    static_cast<GuardedChoice*>(c)->cmd =
+        cmd(static_cast<GuardedChoice*>(c)->cmd);
+    break;
+  case Choice::NESTED:
+    cmd(static_cast<NestedChoice*>(c)->test);
+    break;
+  case Choice::SPEC:
+    spec(static_cast<SpecChoice*>(c)->spec);
+    choice(static_cast<SpecChoice*>(c)->choice);
+    break;
+  }
+}
+
+// ============================================================================
+// Expansion
+// ============================================================================
+
+// Count the nodes of a command, taking the sizes of the replicators
+// already unrolled from the table rather than walking them again
+class Nodes : public Visitor<true> {
+public:
+  long count;
+  Nodes(const std::map<const Cmd*, long> &s) : count(0), sizes(s) {}
+
+protected:
+  bool pre(const Cmd *c) override {
+    auto i = sizes.find(c);
+    count += i == sizes.end() ? 1 : i->second;
+    return i == sizes.end();
+  }
+  bool pre(const Expr *) override {
+    count++;
+    return true;
+  }
+
+private:
+  const std::map<const Cmd*, long> &sizes;
+};
+
+// Expand a replicated par or seq into a par or seq with one component for
+// each value of its indices, when all of its ranges are constant and the
+// total number of components and the size of their copies are within
+// limits.
+Cmd *Unroll::expand(Cmd *c, std::list<Range*> *ranges, Cmd *body,
+    long limit) {
+  long total = 1;
+  for (auto x : *ranges) {
+    if (x->base->type != Expr::LITERAL
+     || x->count->type != Expr::LITERAL
+     || (x->step != nullptr && x->step->type != Expr::LITERAL)) {
+      total = -1;
+      break;
+    }
+    total *= literalValue(static_cast<OperLiteral*>(x->count)->literal);
+    if (total < 0 || total > limit)
+      break;
+  }
+  Nodes n(sizes);
+  n.walk(body);
+  if (total < 0 || total > limit || total * n.count > MAX_UNROLL_NODES) {
+    sizes[c] = n.count + 1;
+    return c;
+  }
+  std::list<Cmd*> *l = new std::list<Cmd*>();
+  std::vector<int> values;
+  instances(ranges->begin(), ranges->end(), values, ranges, body, l);
+  if (l->empty())
+    return new Skip();
+  Cmd *x = c->type == Cmd::RSEQ ? static_cast<Cmd*>(new Seq(l)) :
+      static_cast<Cmd*>(new Par(l));
+  sizes[x] = total * n.count + 1;
+  return x;
+}
+
+void Unroll::instances(std::list<Range*>::iterator r,
+    std::list<Range*>::iterator end, std::vector<int> &values,
+    std::list<Range*> *ranges, Cmd *body, std::list<Cmd*> *l) {
+  // Clone the body with every index bound to its value
+  if (r == end) {
+    Clone clone;
+    size_t i = 0;
+    for (auto x : *ranges)
+      clone.bind(x->name->str,
+          new OperLiteral(new DecIntLiteral(values[i++])));
+    l->push_back(clone.cmd(body));
+    return;
+  }
+  Range *x = *r;
+  int base = literalValue(static_cast<OperLiteral*>(x->base)->literal);
+  int count = literalValue(static_cast<OperLiteral*>(x->count)->literal);
+  int step = x->step == nullptr ? 1 :
+      literalValue(static_cast<OperLiteral*>(x->step)->literal);
+  for (int i = 0; i < count; i++) {
+    values.push_back(base + i * step);
+    instances(std::next(r), end, values, ranges, body, l);
+    values.pop_back();
+  }
+}
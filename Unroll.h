@@ -0,0 +1,57 @@
+#ifndef UNROLL_H
+#define UNROLL_H
+
+#include "Tree.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+
+#define UNR Unroll::get()
+
+// The maximum number of processes a replicated par is unrolled into
+#define MAX_UNROLL 1024
+
+// The maximum number of iterations a replicated seq is unrolled into
+#define MAX_UNROLL_SEQ 16
+
+// The maximum size in nodes of an expansion, including the expansions of
+// any replicators nested in it
+#define MAX_UNROLL_NODES 65536
+
+// Unrolling: replicated pars whose ranges have been folded to constants are
+// expanded into a statically sized par of copies of their body, with each
+// replicator index replaced by its value. Replicated seqs with few
+// iterations are expanded in the same way in definitions that are marked
+// for it. Nests are expanded from the innermost, and a replicator stays
+// when its expansion would exceed the size limit, as do those around it.
+class Unroll {
+public:
+  static Unroll instance;
+  static Unroll &get() { return instance; }
+  Unroll() : seqs(false) {};
+  ~Unroll() {};
+  void unroll(Tree *);
+  void unrollSeqs(Def *d) { seqDefs.insert(d); }
+
+private:
+  std::set<Def*> seqDefs;
+  bool seqs;
+  // The sizes of the replicators in the nest being unrolled, as expanded
+  // or left
+  std::map<const Cmd*, long> sizes;
+
+  void spec(Spec *);
+  void process(Process *);
+  void server(Server *);
+  Cmd *cmd(Cmd *);
+  void altn(Altn *);
+  void choice(Choice *);
+  void cmds(std::list<Cmd*> *);
+  Cmd *expand(Cmd *, std::list<Range*> *, Cmd *, long);
+  void instances(std::list<Range*>::iterator, std::list<Range*>::iterator,
+      std::vector<int> &, std::list<Range*> *, Cmd *, std::list<Cmd*> *);
+};
+
+#endif
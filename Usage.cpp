@@ -0,0 +1,740 @@
+#include "Usage.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+Usage Usage::instance;
+
+// Coefficients and constants beyond this are not tracked
+#define MAX_TERM (1L << 31)
+
+void Usage::check(Tree *t) {
+  defs.clear();
+  aliases.clear();
+  references.clear();
+  indices.clear();
+  depth = 0;
+  depths.clear();
+  summaries.clear();
+  summarising.clear();
+  walk(t);
+}
+
+// The combination of the verdicts of two pairs of uses
+static Par::Sharing worse(Par::Sharing a, Par::Sharing b) {
+  if (a == Par::CONFLICT || b == Par::CONFLICT)
+    return Par::CONFLICT;
+  if (a == Par::UNPROVED || b == Par::UNPROVED)
+    return Par::UNPROVED;
+  return Par::DISJOINT;
+}
+
+// ============================================================================
+// Declarations
+// ============================================================================
+
+// Record what the uses of a declaration need: the body of a definition, the
+// element a variable abbreviation stands for, and the formals that are
+// passed by reference
+void Usage::declare(Spec *s) {
+  switch (s->type) {
+  case Spec::DEF: {
+      Def *d = static_cast<Def*>(s);
+      defs[d->name] = d;
+      if (d->args != nullptr)
+        for (auto x : *d->args)
+          if (x->spef == nullptr || !x->spef->val || x->spef->lengths != nullptr)
+            references.insert(x->name);
+      break;
+    }
+  case Spec::DECL:
+    if (static_cast<Decl*>(s)->tDecl == Decl::RSERVER)
+      declare(static_cast<RepServerDecl*>(s)->exprs);
+    break;
+  case Spec::ABBR:
+    if (static_cast<Abbr*>(s)->type == Abbr::VAR)
+      aliases[s->name] = static_cast<Abbr*>(s)->elem;
+    break;
+  default:
+    break;
+  }
+}
+
+void Usage::declare(std::list<Range*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l)
+    indices[x->name] = x;
+}
+
+// ============================================================================
+// The parallels
+// ============================================================================
+
+// The formals of a definition are declared in it, and the names of other
+// specifications around it
+bool Usage::pre(Spec *s) {
+  declare(s);
+  if (s->type == Spec::DEF) {
+    Def *d = static_cast<Def*>(s);
+    depths[d->name] = depth++;
+    if (d->args != nullptr)
+      for (auto x : *d->args)
+        depths[x->name] = depth;
+  }
+  else if (s->type != Spec::SSPEC && s->nameList)
+    for (auto x : *s->names)
+      depths[x] = depth;
+  else if (s->type != Spec::SSPEC && s->name != nullptr)
+    depths[s->name] = depth;
+  return true;
+}
+
+void Usage::post(Spec *s) {
+  if (s->type == Spec::DEF)
+    depth--;
+}
+
+bool Usage::pre(Range *r) {
+  indices[r->name] = r;
+  depths[r->name] = depth;
+  return true;
+}
+
+// The indices of a replicated parallel are declared before its body is
+// compared with itself
+bool Usage::pre(Cmd *c) {
+  if (c->type == Cmd::PAR)
+    par(static_cast<Par*>(c));
+  else if (c->type == Cmd::RPAR) {
+    declare(static_cast<RepPar*>(c)->ranges);
+    for (auto x : *static_cast<RepPar*>(c)->ranges)
+      depths[x->name] = depth;
+    repPar(static_cast<RepPar*>(c));
+  }
+  return true;
+}
+
+// Whether a formal passed by reference may name the same variable as
+// another name: a formal passed by reference, or a name declared outside
+// the definition of the first, or one not yet seen
+bool Usage::aliasable(Name *a, Name *b) {
+  if (a == b)
+    return false;
+  if (references.count(b))
+    return true;
+  auto x = depths.find(a);
+  auto y = depths.find(b);
+  return x == depths.end() || y == depths.end() || y->second < x->second;
+}
+
+// Compare the uses of each pair of components of the same declaration, and
+// those of formals passed by reference with all of the other components
+void Usage::par(Par *p) {
+  std::vector<Component> parts(p->cmds->size());
+  size_t i = 0;
+  for (auto x : *p->cmds)
+    Collect(*this, parts[i++]).walk(x);
+  std::map<Name*, std::vector<std::pair<size_t, const Access*>>> uses;
+  std::vector<std::pair<size_t, const Access*>> shared;
+  bool exact = true;
+  for (i = 0; i < parts.size(); i++) {
+    exact = exact && parts[i].exact;
+    for (auto &x : parts[i].accesses) {
+      uses[x.decl].push_back(std::make_pair(i, &x));
+      if (references.count(x.decl))
+        shared.push_back(std::make_pair(i, &x));
+    }
+  }
+  Par::Sharing result = Par::DISJOINT;
+  for (auto x = uses.begin(); x != uses.end() && result != Par::CONFLICT; ++x)
+    for (auto a = x->second.begin(); a != x->second.end()
+        && result != Par::CONFLICT; ++a)
+      for (auto b = a + 1; b != x->second.end(); ++b)
+        if (a->first != b->first)
+          result = worse(result, compare(*a->second, *b->second, nullptr,
+              parts[a->first], parts[b->first]));
+  for (auto a = shared.begin(); a != shared.end()
+      && result != Par::CONFLICT; ++a)
+    for (auto &x : uses)
+      if (aliasable(a->second->decl, x.first))
+        for (auto &b : x.second)
+          if (a->first != b.first)
+            result = worse(result, compare(*a->second, *b.second, nullptr,
+                parts[a->first], parts[b.first]));
+  if (!exact && result == Par::DISJOINT)
+    result = Par::UNPROVED;
+  p->sharing = result;
+}
+
+// Compare the uses of the body with themselves in another replica. A
+// certain overlap is only a conflict when there is more than one replica.
+void Usage::repPar(RepPar *r) {
+  long replicas = 1;
+  for (auto x : *r->ranges)
+    if (replicas >= 0 && x->count != nullptr
+        && x->count->type == Expr::LITERAL)
+      replicas *= literalValue(static_cast<OperLiteral*>(x->count)->literal);
+    else
+      replicas = -1;
+  if (replicas == 0 || replicas == 1) {
+    r->sharing = Par::DISJOINT;
+    return;
+  }
+  Component body;
+  Collect(*this, body).walk(r->cmd);
+  std::map<Name*, std::vector<const Access*>> uses;
+  for (auto &x : body.accesses)
+    uses[x.decl].push_back(&x);
+  Par::Sharing result = Par::DISJOINT;
+  for (auto x = uses.begin(); x != uses.end() && result != Par::CONFLICT; ++x)
+    for (auto a = x->second.begin(); a != x->second.end()
+        && result != Par::CONFLICT; ++a)
+      for (auto b = a; b != x->second.end(); ++b)
+        result = worse(result, compare(**a, **b, r->ranges, body, body));
+  for (auto a = body.accesses.begin(); a != body.accesses.end()
+      && result != Par::CONFLICT; ++a)
+    if (references.count(a->decl))
+      for (auto &x : uses)
+        if (aliasable(a->decl, x.first))
+          for (auto b : x.second)
+            result = worse(result, compare(*a, *b, r->ranges, body, body));
+  if (result == Par::CONFLICT && replicas < 0)
+    result = Par::UNPROVED;
+  if (!body.exact && result == Par::DISJOINT)
+    result = Par::UNPROVED;
+  r->sharing = result;
+}
+
+// ============================================================================
+// The uses of a component
+// ============================================================================
+
+// How a definition uses its formals and what is declared outside it, which
+// is inexact for a definition that is reached again while it is summarised.
+// The subscripts of an outside use are cut before the first that depends on
+// a name declared in the definition, which has another value at each use.
+const Usage::Summary &Usage::summary(Def *d) {
+  auto it = summaries.find(d);
+  if (it != summaries.end())
+    return it->second;
+  if (summarising.count(d))
+    return unknown;
+  summarising.insert(d);
+  Component c;
+  Collect(*this, c, d).walk(d);
+  std::map<Name*, size_t> position;
+  if (d->args != nullptr)
+    for (auto x : *d->args)
+      position.insert(std::make_pair(x->name, position.size()));
+  Summary s;
+  s.modes.assign(position.size(), 0);
+  s.exact = c.exact;
+  for (auto &x : c.accesses) {
+    auto p = position.find(x.decl);
+    if (p != position.end()) {
+      s.modes[p->second] |= x.mode;
+      continue;
+    }
+    Access a = x;
+    for (size_t i = 0; i < a.subscripts.size(); i++) {
+      Linear l;
+      bool local = !linear(a.subscripts[i], l);
+      for (auto &y : l.terms)
+        local = local || c.declared.count(y.first) != 0;
+      if (local) {
+        a.subscripts.resize(i);
+        break;
+      }
+    }
+    s.free.push_back(a);
+  }
+  summarising.erase(d);
+  return summaries[d] = s;
+}
+
+// Record a use of an element, through the variable abbreviations it names,
+// unless it is declared in the component. The uses in its subscripts are
+// found by the walk.
+void Usage::access(Elem *e, Mode m, bool certain, Component &c) {
+  if (e == nullptr || (e->type != Elem::NAME && e->type != Elem::FIELD))
+    return;
+  Access a{nullptr, "", std::vector<Expr*>(), m, certain};
+  Name *n;
+  if (e->type == Elem::FIELD) {
+    n = static_cast<Field*>(e)->base;
+    a.field = static_cast<Field*>(e)->field->str;
+    if (n->subscripts != nullptr)
+      a.subscripts.assign(n->subscripts->begin(), n->subscripts->end());
+  }
+  else
+    n = static_cast<Name*>(e);
+  if (e->subscripts != nullptr)
+    a.subscripts.insert(a.subscripts.end(),
+        e->subscripts->begin(), e->subscripts->end());
+  Name *decl = n->decl;
+  for (auto it = aliases.find(decl); decl != nullptr && it != aliases.end();
+      it = aliases.find(decl)) {
+    Elem *x = it->second;
+    if (x->type != Elem::NAME || !a.field.empty()) {
+      decl = nullptr;
+      break;
+    }
+    if (x->subscripts != nullptr)
+      a.subscripts.insert(a.subscripts.begin(),
+          x->subscripts->begin(), x->subscripts->end());
+    decl = static_cast<Name*>(x)->decl;
+  }
+  if (decl == nullptr) {
+    c.exact = false;
+    return;
+  }
+  if (c.declared.count(decl))
+    return;
+  a.decl = decl;
+  c.accesses.push_back(a);
+}
+
+// The actuals of an instance are used as the definition uses its formals.
+// Those of an unknown definition may be used in any way.
+void Usage::Collect::actuals(Name *n, std::list<Expr*> *l) {
+  const Summary *s = &usage.unknown;
+  if (n != nullptr && n->decl != nullptr) {
+    auto it = usage.defs.find(n->decl);
+    if (it != usage.defs.end())
+      s = &usage.summary(it->second);
+  }
+  if (!s->exact)
+    component.exact = false;
+  if (l != nullptr) {
+    size_t i = 0;
+    for (auto x : *l) {
+      Elem *e = x->type == Expr::ELEM ? static_cast<OperElem*>(x)->elem : nullptr;
+      if (e == nullptr || e->type == Elem::CALL || e->type == Elem::LITERAL) {
+        walk(x);
+        i++;
+        continue;
+      }
+      int modes = i < s->modes.size() ? s->modes[i] : READ|WRITE|IN|OUT;
+      walk(e);
+      for (int m = READ; m <= CONNECT; m <<= 1)
+        if (modes & m)
+          usage.access(e, (Mode) m, s->exact, component);
+      i++;
+    }
+  }
+  for (auto &x : s->free)
+    if (!component.declared.count(x.decl)) {
+      component.accesses.push_back(x);
+      component.accesses.back().certain = x.certain && s->exact;
+    }
+}
+
+// The names a specification declares in a component. Only the definition
+// being summarised has its body walked, and the calls of an interface are
+// only declared.
+bool Usage::Collect::pre(Spec *s) {
+  if (s == def)
+    return def->defType != Def::FUNCTION;
+  usage.declare(s);
+  switch (s->type) {
+  default:
+    break;
+
+  case Spec::DEF:
+    component.declared.insert(s->name);
+    return false;
+
+  case Spec::DECL:
+    if (s->nameList)
+      component.declared.insert(s->names->begin(), s->names->end());
+    else
+      component.declared.insert(s->name);
+    return static_cast<Decl*>(s)->tDecl != Decl::CALL;
+
+  case Spec::ABBR:
+    component.declared.insert(s->name);
+    break;
+  }
+  return true;
+}
+
+// The formals of a definition are told apart by its summary
+bool Usage::Collect::pre(Fml *) {
+  return false;
+}
+
+bool Usage::Collect::pre(Process *p) {
+  if (p->type != Process::INSTANCE)
+    return true;
+  actuals(static_cast<ProcessInstance*>(p)->name,
+      static_cast<ProcessInstance*>(p)->actuals);
+  return false;
+}
+
+bool Usage::Collect::pre(Server *s) {
+  if (s->type != Server::INSTANCE)
+    return true;
+  actuals(static_cast<ServerInstance*>(s)->name,
+      static_cast<ServerInstance*>(s)->actuals);
+  return false;
+}
+
+bool Usage::Collect::pre(Cmd *c) {
+  switch (c->type) {
+  default:
+    break;
+
+  case Cmd::INSTANCE:
+    actuals(static_cast<Instance*>(c)->name,
+        static_cast<Instance*>(c)->actuals);
+    return false;
+
+  // The formals of a call are only known from the interface of its server
+  case Cmd::CALL:
+    actuals(nullptr, static_cast<Call*>(c)->actuals);
+    return false;
+
+  case Cmd::ASS:
+    usage.access(static_cast<Ass*>(c)->lhs, WRITE, true, component);
+    break;
+
+  case Cmd::IN:
+    usage.access(static_cast<In*>(c)->lhs, IN, true, component);
+    usage.access(static_cast<In*>(c)->rhs, WRITE, true, component);
+    break;
+
+  case Cmd::OUT:
+    usage.access(static_cast<Out*>(c)->lhs, OUT, true, component);
+    break;
+
+  case Cmd::CONNECT:
+    usage.access(static_cast<Connect*>(c)->local, CONNECT, true, component);
+    usage.access(static_cast<Connect*>(c)->remote, CONNECT, true, component);
+    break;
+  }
+  return true;
+}
+
+bool Usage::Collect::pre(Altn *a) {
+  if (a->type == Altn::UNGUARDED) {
+    UnguardedAltn *x = static_cast<UnguardedAltn*>(a);
+    usage.access(x->dst, IN, true, component);
+    usage.access(x->src, WRITE, true, component);
+  }
+  else if (a->type == Altn::GUARDED) {
+    GuardedAltn *x = static_cast<GuardedAltn*>(a);
+    usage.access(x->dst, IN, true, component);
+    usage.access(x->src, WRITE, true, component);
+  }
+  return true;
+}
+
+// The expressions of a replicator are used once, outside its scope
+bool Usage::Collect::pre(Range *r) {
+  usage.indices[r->name] = r;
+  return true;
+}
+
+void Usage::Collect::post(Range *r) {
+  component.declared.insert(r->name);
+}
+
+// Functions have no side effects, so their actuals are only read
+bool Usage::Collect::pre(Expr *e) {
+  if (e->type == Expr::ELEM)
+    usage.access(static_cast<OperElem*>(e)->elem, READ, true, component);
+  return true;
+}
+
+// ============================================================================
+// Disjointness
+// ============================================================================
+
+static bool scale(std::map<Name*, long> &terms, long &constant, long k) {
+  if (std::labs(k) >= MAX_TERM)
+    return false;
+  for (auto &x : terms) {
+    x.second *= k;
+    if (std::labs(x.second) >= MAX_TERM)
+      return false;
+  }
+  constant *= k;
+  return std::labs(constant) < MAX_TERM;
+}
+
+static bool add(std::map<Name*, long> &terms, long &constant,
+    const std::map<Name*, long> &t, long c, long k) {
+  for (auto &x : t) {
+    long &y = terms[x.first];
+    y += k * x.second;
+    if (std::labs(y) >= MAX_TERM)
+      return false;
+  }
+  constant += k * c;
+  return std::labs(constant) < MAX_TERM;
+}
+
+// Express a subscript as a linear combination of resolved names
+bool Usage::linear(Expr *e, Linear &l) {
+  if (e == nullptr)
+    return false;
+  switch (e->type) {
+  default:
+    return false;
+
+  case Expr::LITERAL:
+    l.constant = literalValue(static_cast<OperLiteral*>(e)->literal);
+    return std::labs(l.constant) < MAX_TERM;
+
+  case Expr::ELEM: {
+      Elem *x = static_cast<OperElem*>(e)->elem;
+      if (x->type != Elem::NAME || x->subscripts != nullptr
+          || static_cast<Name*>(x)->decl == nullptr)
+        return false;
+      l.terms[static_cast<Name*>(x)->decl] = 1;
+      return true;
+    }
+
+  case Expr::EXPR:
+    return linear(static_cast<OperExpr*>(e)->expr, l);
+
+  case Expr::UNARY: {
+      UnaryOp *x = static_cast<UnaryOp*>(e);
+      return x->op == Lex::tSUB && linear(x->operand, l)
+          && scale(l.terms, l.constant, -1);
+    }
+
+  case Expr::BINARY: {
+      BinaryOp *x = static_cast<BinaryOp*>(e);
+      Linear r;
+      if (!linear(x->left, l) || !linear(x->right, r))
+        return false;
+      switch (x->op) {
+      default:
+        return false;
+      case Lex::tADD:
+        return add(l.terms, l.constant, r.terms, r.constant, 1);
+      case Lex::tSUB:
+        return add(l.terms, l.constant, r.terms, r.constant, -1);
+      case Lex::tMUL:
+        if (r.terms.empty())
+          return scale(l.terms, l.constant, r.constant);
+        if (!l.terms.empty())
+          return false;
+        std::swap(l, r);
+        return scale(l.terms, l.constant, r.constant);
+      }
+    }
+
+  // At most one operand of a product may have names
+  case Expr::NARY: {
+      NaryOp *x = static_cast<NaryOp*>(e);
+      if (x->op != Lex::tADD && x->op != Lex::tMUL)
+        return false;
+      long k = 1;
+      bool first = true;
+      for (auto y : *x->operands) {
+        Linear r;
+        if (!linear(y, r))
+          return false;
+        if (x->op == Lex::tADD) {
+          if (!add(l.terms, l.constant, r.terms, r.constant, 1))
+            return false;
+        }
+        else if (r.terms.empty()) {
+          k *= r.constant;
+          if (std::labs(k) >= MAX_TERM)
+            return false;
+        }
+        else if (first) {
+          l = r;
+          first = false;
+        }
+        else
+          return false;
+      }
+      if (x->op == Lex::tMUL) {
+        if (first)
+          l.constant = 1;
+        return scale(l.terms, l.constant, k);
+      }
+      return true;
+    }
+  }
+}
+
+// The values of a replicator index whose range is known
+bool Usage::interval(Name *n, long &lo, long &hi) {
+  auto it = indices.find(n);
+  if (it == indices.end())
+    return false;
+  Range *r = it->second;
+  if (r->base == nullptr || r->base->type != Expr::LITERAL
+      || r->count == nullptr || r->count->type != Expr::LITERAL
+      || (r->step != nullptr && r->step->type != Expr::LITERAL))
+    return false;
+  long base = literalValue(static_cast<OperLiteral*>(r->base)->literal);
+  long count = literalValue(static_cast<OperLiteral*>(r->count)->literal);
+  long step = r->step != nullptr ?
+      literalValue(static_cast<OperLiteral*>(r->step)->literal) : 1;
+  if (count < 1)
+    return false;
+  lo = std::min(base, base + (count - 1) * step);
+  hi = std::max(base, base + (count - 1) * step);
+  return true;
+}
+
+// Prove that a subscript of two uses never has the same value. In a
+// parallel, the names of one component are distinct from those of another,
+// so the difference must have an interval that excludes 0. In a replicated
+// parallel, the two uses are in distinct replicas: the names of the body
+// vary independently and those outside it are the same in both. Either the
+// difference excludes 0 when the replicated indices vary independently
+// too, or they must have the same coefficients in both, and the
+// differences between replicas they give must each exceed all that the
+// smaller ones and the rest of the subscript can make up.
+bool Usage::separate(const Linear &a, const Linear &b, std::list<Range*> *reps,
+    const Component &body) {
+  std::map<Name*, long> replicated;
+  if (reps != nullptr)
+    for (auto x : *reps)
+      replicated[x->name] = 0;
+  long lo = a.constant - b.constant;
+  long hi = lo;
+  // What the replicated indices add to the difference when they vary
+  // independently, if their ranges are known, and whether their
+  // coefficients are the same in both
+  long rlo = 0;
+  long rhi = 0;
+  bool bounded = true;
+  bool aligned = true;
+  std::map<Name*, std::pair<long, long>> coefficients;
+  for (auto &x : a.terms)
+    coefficients[x.first].first = x.second;
+  for (auto &x : b.terms)
+    coefficients[x.first].second = x.second;
+  for (auto &x : coefficients) {
+    long ka = x.second.first;
+    long kb = x.second.second;
+    auto r = replicated.find(x.first);
+    if (r != replicated.end()) {
+      aligned = aligned && ka == kb;
+      r->second = ka;
+      long l, h;
+      if (!bounded || !interval(x.first, l, h)) {
+        bounded = false;
+        continue;
+      }
+      rlo += std::min(ka * l, ka * h) - std::max(kb * l, kb * h);
+      rhi += std::max(ka * l, ka * h) - std::min(kb * l, kb * h);
+      bounded = rlo > -MAX_TERM && rhi < MAX_TERM;
+      continue;
+    }
+    bool shared = reps != nullptr && !body.declared.count(x.first);
+    if (shared ? ka == kb : ka == 0 && kb == 0)
+      continue;
+    long l, h;
+    if (!interval(x.first, l, h))
+      return false;
+    if (shared) {
+      long k = ka - kb;
+      lo += std::min(k * l, k * h);
+      hi += std::max(k * l, k * h);
+    }
+    else {
+      lo += std::min(ka * l, ka * h) - std::max(kb * l, kb * h);
+      hi += std::max(ka * l, ka * h) - std::min(kb * l, kb * h);
+    }
+    if (lo <= -MAX_TERM || hi >= MAX_TERM)
+      return false;
+  }
+  if (reps == nullptr)
+    return lo > 0 || hi < 0;
+  if (bounded && (lo + rlo > 0 || hi + rhi < 0))
+    return true;
+  if (!aligned)
+    return false;
+
+  // The weight of each replicated index and its number of values, which
+  // need not be known for the greatest
+  std::vector<std::pair<long, long>> weights;
+  for (auto x : *reps) {
+    if (x->step != nullptr && x->step->type != Expr::LITERAL)
+      return false;
+    long count = x->count != nullptr && x->count->type == Expr::LITERAL ?
+        literalValue(static_cast<OperLiteral*>(x->count)->literal) : -1;
+    long step = x->step != nullptr ?
+        literalValue(static_cast<OperLiteral*>(x->step)->literal) : 1;
+    if (count < 0 || count > 1)
+      weights.push_back(std::make_pair(std::labs(replicated[x->name] * step),
+          count));
+  }
+  std::sort(weights.begin(), weights.end());
+  long slack = std::max(std::labs(lo), std::labs(hi));
+  for (size_t i = 0; i < weights.size(); i++) {
+    if (weights[i].first <= slack)
+      return false;
+    if (weights[i].second < 0)
+      return i + 1 == weights.size();
+    slack += weights[i].first * (weights[i].second - 1);
+    if (slack >= MAX_TERM)
+      return false;
+  }
+  return true;
+}
+
+// Whether a subscript that is the same in two uses certainly has the same
+// value in both: in a parallel, when its names are declared outside both
+// components; in a replicated parallel, when it has no replicated index and
+// no name declared in the body other than the indices of replicators,
+// which take the same values in every replica
+bool Usage::same(const Linear &l, std::list<Range*> *reps,
+    const Component &ca, const Component &cb) {
+  for (auto &x : l.terms) {
+    if (x.second == 0)
+      continue;
+    if (reps == nullptr) {
+      if (ca.declared.count(x.first) || cb.declared.count(x.first))
+        return false;
+      continue;
+    }
+    for (auto y : *reps)
+      if (y->name == x.first)
+        return false;
+    if (ca.declared.count(x.first) && !indices.count(x.first))
+      return false;
+  }
+  return true;
+}
+
+// The verdict for two uses of the same class. Only a write to a variable
+// and a use of the same end of a channel need to be told apart.
+Par::Sharing Usage::compare(const Access &a, const Access &b,
+    std::list<Range*> *reps, const Component &ca, const Component &cb) {
+  bool chanA = a.mode >= IN;
+  bool chanB = b.mode >= IN;
+  if (chanA != chanB)
+    return Par::DISJOINT;
+  if (chanA ? a.mode != b.mode : a.mode == READ && b.mode == READ)
+    return Par::DISJOINT;
+  if (a.field != b.field)
+    return Par::DISJOINT;
+  if (a.decl != b.decl)
+    return Par::UNPROVED;
+  size_t n = std::min(a.subscripts.size(), b.subscripts.size());
+  bool certain = a.certain && b.certain;
+  for (size_t i = 0; i < n; i++) {
+    Linear la, lb;
+    if (!linear(a.subscripts[i], la) || !linear(b.subscripts[i], lb)) {
+      certain = false;
+      continue;
+    }
+    if (separate(la, lb, reps, ca))
+      return Par::DISJOINT;
+    certain = certain && la.constant == lb.constant && la.terms == lb.terms
+        && same(la, reps, ca, cb);
+  }
+  return certain ? Par::CONFLICT : Par::UNPROVED;
+}
@@ -0,0 +1,146 @@
+#ifndef USAGE_H
+#define USAGE_H
+
+#include "Tree.h"
+#include "Visitor.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#define USE Usage::get()
+
+// Usage checking: the rules for parallel composition require that the
+// components of a parallel only change variables and components of arrays
+// that no other component uses, and that no two components use the same
+// end of a channel. Each parallel and replicated parallel is marked as
+// DISJOINT where these are proved, so its components can run with no
+// checks, and as CONFLICT where they are certainly broken. The components
+// of arrays that are used are told apart by subscripts that are linear in
+// replicator indices with known ranges, including those of the replicated
+// parallel itself. Instances are checked with a summary of how the
+// definition uses each formal. A formal that is not a value may name the
+// same variable as another such formal or one declared outside its
+// definition, so its uses are compared with those of all of these. Names
+// must have been resolved. The parallels and the uses of each
+// component are found by walks of the tree.
+class Usage : public Visitor<false> {
+public:
+  static Usage instance;
+  static Usage &get() { return instance; }
+  Usage() : depth(0) {};
+  ~Usage() {};
+  void check(Tree *);
+
+protected:
+  bool pre(Spec *) override;
+  bool pre(Cmd *) override;
+  bool pre(Range *) override;
+  void post(Spec *) override;
+
+private:
+  // How a variable or channel is used
+  typedef enum {
+    READ    = 1,
+    WRITE   = 2,
+    IN      = 4,
+    OUT     = 8,
+    CONNECT = 16
+  } Mode;
+  // A use of a variable or channel declared outside a component, or of a
+  // field of one, with the subscripts of the element that is used. A use
+  // is not certain when it is inferred from an unknown definition.
+  struct Access {
+    Name *decl;
+    std::string field;
+    std::vector<Expr*> subscripts;
+    Mode mode;
+    bool certain;
+  };
+  // The uses by a component of what is declared outside it. The uses are
+  // inexact when some can't be known.
+  struct Component {
+    std::vector<Access> accesses;
+    std::set<Name*> declared;
+    bool exact;
+    Component() : exact(true) {}
+  };
+  // The modes each formal of a definition is used in, and its uses of what
+  // is declared outside it
+  struct Summary {
+    std::vector<int> modes;
+    std::vector<Access> free;
+    bool exact;
+    Summary() : exact(false) {}
+  };
+  // A linear combination of names plus a constant
+  struct Linear {
+    std::map<Name*, long> terms;
+    long constant;
+    Linear() : constant(0) {}
+  };
+  // Collects the uses of a component from a walk of it. The body of a
+  // definition is only used by its instances, so it is only walked for the
+  // summary of the definition.
+  class Collect : public Visitor<false> {
+  public:
+    Collect(Usage &u, Component &c, Def *d = nullptr) :
+      usage(u), component(c), def(d) {}
+
+  protected:
+    bool pre(Spec *) override;
+    bool pre(Fml *) override;
+    bool pre(Process *) override;
+    bool pre(Server *) override;
+    bool pre(Cmd *) override;
+    bool pre(Altn *) override;
+    bool pre(Range *) override;
+    bool pre(Expr *) override;
+    void post(Range *) override;
+
+  private:
+    Usage &usage;
+    Component &component;
+    Def *def;
+
+    void actuals(Name *, std::list<Expr*> *);
+  };
+  std::map<Name*, Def*> defs;
+  std::map<Name*, Elem*> aliases;
+  std::set<Name*> references;
+  std::map<Name*, Range*> indices;
+  // The number of definitions the walk is in, and that each name is
+  // declared in
+  int depth;
+  std::map<Name*, int> depths;
+  std::map<Def*, Summary> summaries;
+  std::set<Def*> summarising;
+  Summary unknown;
+
+  // Declarations
+  void declare(Spec *);
+  void declare(std::list<Range*> *);
+  bool aliasable(Name *, Name *);
+
+  // The parallels
+  void par(Par *);
+  void repPar(RepPar *);
+
+  // The uses of a component
+  const Summary &summary(Def *);
+  void access(Elem *, Mode, bool, Component &);
+
+  // Disjointness
+  bool linear(Expr *, Linear &);
+  bool interval(Name *, long &, long &);
+  bool separate(const Linear &, const Linear &, std::list<Range*> *,
+      const Component &);
+  bool same(const Linear &, std::list<Range*> *, const Component &,
+      const Component &);
+  Par::Sharing compare(const Access &, const Access &, std::list<Range*> *,
+      const Component &, const Component &);
+};
+
+#endif
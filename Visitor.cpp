@@ -0,0 +1,458 @@
+#include "Visitor.h"
+#include "Pool.h"
+
+#include <utility>
+#include <vector>
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Tree> t) {
+  for (auto x : t->spec) walk(x);
+  for (auto x : t->prog) walk(x);
+}
+
+template<bool Const>
+void Visitor<Const>::parallel(Ptr<Tree> t,
+    const std::function<std::unique_ptr<Visitor>(size_t)> &visitor) {
+  std::vector<std::pair<Spec*, Cmd*>> items;
+  for (auto x : t->spec) items.push_back(std::make_pair(x, nullptr));
+  for (auto x : t->prog) items.push_back(std::make_pair(nullptr, x));
+  POOL.run(items.size(), [&](size_t i) {
+    std::unique_ptr<Visitor> v = visitor(i);
+    if (items[i].first != nullptr)
+      v->walk(items[i].first);
+    else
+      v->walk(items[i].second);
+  });
+}
+
+template<bool Const>
+template<typename T>
+void Visitor<Const>::walk(std::list<T*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto x : *l)
+    walk(x);
+}
+
+template<bool Const>
+template<typename T>
+void Visitor<Const>::expr(T *const &field) {
+  Ptr<Expr> e = replace(field);
+  if (!Const && e != field)
+    const_cast<T *&>(field) = static_cast<T*>(const_cast<Expr*>(e));
+  walk(e);
+}
+
+template<bool Const>
+template<typename T>
+void Visitor<Const>::exprs(std::list<T*> *l) {
+  if (l == nullptr)
+    return;
+  for (auto &x : *l)
+    expr(x);
+}
+
+// ============================================================================
+// Specifications
+// ============================================================================
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Spec> s) {
+  if (s == nullptr || !pre(s))
+    return;
+  if (s->nameList)
+    walk(s->names);
+  else
+    walk(s->name);
+  switch (s->type) {
+
+  case Spec::DEF: {
+      Ptr<Def> d = static_cast<Ptr<Def>>(s);
+      walk(d->args);
+      switch (d->defType) {
+      case Def::PROCESS:
+        walk(static_cast<Ptr<ProcessDef>>(d)->process);
+        break;
+      case Def::SERVER:
+        walk(static_cast<Ptr<ServerDef>>(d)->server);
+        break;
+      case Def::ISERVER:
+        walk(static_cast<Ptr<InhrtServerDef>>(d)->intf);
+        walk(static_cast<Ptr<InhrtServerDef>>(d)->hidingDecl);
+        break;
+      case Def::FUNCTION:
+        expr(static_cast<Ptr<FunctionDef>>(d)->expr);
+        break;
+      }
+      break;
+    }
+
+  case Spec::DECL: {
+      Ptr<Decl> d = static_cast<Ptr<Decl>>(s);
+      switch (d->tDecl) {
+      case Decl::VAR:
+        walk(static_cast<Ptr<VarDecl>>(d)->spef);
+        break;
+      case Decl::CALL: {
+          Ptr<CallDecl> x = static_cast<Ptr<CallDecl>>(d);
+          walk(x->spef);
+          if (!x->nameList)
+            walk(x->args);
+          else if (x->argss != nullptr)
+            for (auto y : *x->argss)
+              walk(y);
+          break;
+        }
+      case Decl::HIDING:
+        walk(static_cast<Ptr<HidingDecl>>(d)->decls);
+        break;
+      case Decl::SERVER:
+        walk(static_cast<Ptr<ServerDecl>>(d)->server);
+        break;
+      case Decl::RSERVER:
+        walk(static_cast<Ptr<RepServerDecl>>(d)->exprs);
+        walk(static_cast<Ptr<RepServerDecl>>(d)->server);
+        break;
+      case Decl::INITIAL:
+        walk(static_cast<Ptr<InitialDecl>>(d)->cmd);
+        break;
+      }
+      break;
+    }
+
+  case Spec::ABBR: {
+      Ptr<Abbr> a = static_cast<Ptr<Abbr>>(s);
+      walk(a->spef);
+      if (a->type == Abbr::VAL)
+        expr(a->expr);
+      else
+        walk(a->elem);
+      if (a->type == Abbr::CALL)
+        walk(static_cast<Ptr<CallAbbr>>(a)->args);
+      break;
+    }
+
+  case Spec::SSPEC:
+    walk(static_cast<Ptr<SimSpec>>(s)->specs);
+    break;
+  }
+  post(s);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Spef> s) {
+  if (s == nullptr || !pre(s))
+    return;
+  exprs(s->lengths);
+  if (s->kind == Spef::NAMED)
+    walk(static_cast<Ptr<NamedSpef>>(s)->name);
+  else if (s->kind == Spef::INTERFACE)
+    walk(static_cast<Ptr<IntfSpef>>(s)->intf);
+  post(s);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Fml> f) {
+  if (f == nullptr || !pre(f))
+    return;
+  walk(f->spef);
+  walk(f->name);
+  post(f);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Process> p) {
+  if (p == nullptr || !pre(p))
+    return;
+  switch (p->type) {
+  case Process::CMD:
+    walk(static_cast<Ptr<ProcessCmd>>(p)->cmd);
+    break;
+  case Process::SPEC:
+    walk(static_cast<Ptr<ProcessSpec>>(p)->intf);
+    walk(static_cast<Ptr<ProcessSpec>>(p)->cmd);
+    break;
+  case Process::INSTANCE:
+    walk(static_cast<Ptr<ProcessInstance>>(p)->name);
+    exprs(static_cast<Ptr<ProcessInstance>>(p)->actuals);
+    break;
+  }
+  post(p);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Server> s) {
+  if (s == nullptr || !pre(s))
+    return;
+  switch (s->type) {
+  case Server::SPEC:
+    walk(static_cast<Ptr<ServerSpec>>(s)->intfs);
+    walk(static_cast<Ptr<ServerSpec>>(s)->decls);
+    break;
+  case Server::INSTANCE:
+    walk(static_cast<Ptr<ServerInstance>>(s)->name);
+    exprs(static_cast<Ptr<ServerInstance>>(s)->actuals);
+    break;
+  }
+  post(s);
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Cmd> c) {
+  if (c == nullptr || !pre(c))
+    return;
+  switch (c->type) {
+
+  case Cmd::SPEC:
+    walk(static_cast<Ptr<CmdSpec>>(c)->spec);
+    walk(static_cast<Ptr<CmdSpec>>(c)->cmd);
+    break;
+
+  case Cmd::INSTANCE:
+    walk(static_cast<Ptr<Instance>>(c)->name);
+    exprs(static_cast<Ptr<Instance>>(c)->actuals);
+    break;
+
+  case Cmd::CALL:
+    walk(static_cast<Ptr<Call>>(c)->name);
+    walk(static_cast<Ptr<Call>>(c)->field);
+    exprs(static_cast<Ptr<Call>>(c)->actuals);
+    break;
+
+  case Cmd::SKIP:
+  case Cmd::STOP:
+    break;
+
+  case Cmd::ASS:
+    walk(static_cast<Ptr<Ass>>(c)->lhs);
+    expr(static_cast<Ptr<Ass>>(c)->rhs);
+    break;
+
+  case Cmd::IN:
+    walk(static_cast<Ptr<In>>(c)->lhs);
+    walk(static_cast<Ptr<In>>(c)->rhs);
+    break;
+
+  case Cmd::OUT:
+    walk(static_cast<Ptr<Out>>(c)->lhs);
+    expr(static_cast<Ptr<Out>>(c)->rhs);
+    break;
+
+  case Cmd::CONNECT:
+    walk(static_cast<Ptr<Connect>>(c)->local);
+    walk(static_cast<Ptr<Connect>>(c)->remote);
+    break;
+
+  case Cmd::ALT:
+    walk(static_cast<Ptr<Alt>>(c)->altns);
+    break;
+
+  case Cmd::RALT:
+    walk(static_cast<Ptr<RepAlt>>(c)->ranges);
+    walk(static_cast<Ptr<RepAlt>>(c)->altn);
+    break;
+
+  case Cmd::TEST:
+    walk(static_cast<Ptr<Test>>(c)->choices);
+    break;
+
+  case Cmd::RTEST:
+    walk(static_cast<Ptr<RepTest>>(c)->ranges);
+    walk(static_cast<Ptr<RepTest>>(c)->choice);
+    break;
+
+  case Cmd::IFD:
+    expr(static_cast<Ptr<IfD>>(c)->expr);
+    walk(static_cast<Ptr<IfD>>(c)->cmd);
+    break;
+
+  case Cmd::IFTE:
+    expr(static_cast<Ptr<IfTE>>(c)->expr);
+    walk(static_cast<Ptr<IfTE>>(c)->cmd);
+    walk(static_cast<Ptr<IfTE>>(c)->elseCmd);
+    break;
+
+  case Cmd::CASE:
+    expr(static_cast<Ptr<Case>>(c)->expr);
+    walk(static_cast<Ptr<Case>>(c)->selects);
+    break;
+
+  case Cmd::RCASE:
+    expr(static_cast<Ptr<RepCase>>(c)->expr);
+    walk(static_cast<Ptr<RepCase>>(c)->ranges);
+    walk(static_cast<Ptr<RepCase>>(c)->select);
+    break;
+
+  case Cmd::WHILE:
+    expr(static_cast<Ptr<While>>(c)->expr);
+    walk(static_cast<Ptr<While>>(c)->cmd);
+    break;
+
+  case Cmd::UNTIL:
+    expr(static_cast<Ptr<Until>>(c)->expr);
+    walk(static_cast<Ptr<Until>>(c)->cmd);
+    break;
+
+  case Cmd::DO:
+    walk(static_cast<Ptr<Do>>(c)->cmd);
+    expr(static_cast<Ptr<Do>>(c)->expr);
+    break;
+
+  case Cmd::SEQ:
+    walk(static_cast<Ptr<Seq>>(c)->cmds);
+    break;
+
+  case Cmd::PAR:
+    walk(static_cast<Ptr<Par>>(c)->cmds);
+    break;
+
+  case Cmd::RSEQ:
+    walk(static_cast<Ptr<RepSeq>>(c)->ranges);
+    walk(static_cast<Ptr<RepSeq>>(c)->cmd);
+    break;
+
+  case Cmd::RPAR:
+    walk(static_cast<Ptr<RepPar>>(c)->ranges);
+    walk(static_cast<Ptr<RepPar>>(c)->cmd);
+    break;
+  }
+  post(c);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Altn> a) {
+  if (a == nullptr || !pre(a))
+    return;
+  switch (a->type) {
+  case Altn::UNGUARDED:
+    walk(static_cast<Ptr<UnguardedAltn>>(a)->dst);
+    walk(static_cast<Ptr<UnguardedAltn>>(a)->src);
+    walk(static_cast<Ptr<UnguardedAltn>>(a)->cmd);
+    break;
+  case Altn::GUARDED:
+    expr(static_cast<Ptr<GuardedAltn>>(a)->expr);
+    walk(static_cast<Ptr<GuardedAltn>>(a)->dst);
+    walk(static_cast<Ptr<GuardedAltn>>(a)->src);
+    walk(static_cast<Ptr<GuardedAltn>>(a)->cmd);
+    break;
+  case Altn::SKIP:
+    expr(static_cast<Ptr<SkipAltn>>(a)->expr);
+    walk(static_cast<Ptr<SkipAltn>>(a)->cmd);
+    break;
+  case Altn::NESTED:
+    walk(static_cast<Ptr<NestedAltn>>(a)->alt);
+    break;
+  case Altn::SPEC:
+    walk(static_cast<Ptr<SpecAltn>>(a)->spec);
+    walk(static_cast<Ptr<SpecAltn>>(a)->altn);
+    break;
+  }
+  post(a);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Choice> c) {
+  if (c == nullptr || !pre(c))
+    return;
+  switch (c->type) {
+  case Choice::GUARDED:
+    expr(static_cast<Ptr<GuardedChoice>>(c)->expr);
+    walk(static_cast<Ptr<GuardedChoice>>(c)->cmd);
+    break;
+  case Choice::NESTED:
+    walk(static_cast<Ptr<NestedChoice>>(c)->test);
+    break;
+  case Choice::SPEC:
+    walk(static_cast<Ptr<SpecChoice>>(c)->spec);
+    walk(static_cast<Ptr<SpecChoice>>(c)->choice);
+    break;
+  }
+  post(c);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Select> s) {
+  if (s == nullptr || !pre(s))
+    return;
+  if (s->type == Select::GUARDED)
+    expr(static_cast<Ptr<GuardedSelect>>(s)->expr);
+  walk(s->cmd);
+  post(s);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Range> r) {
+  if (r == nullptr || !pre(r))
+    return;
+  walk(r->name);
+  expr(r->base);
+  expr(r->count);
+  expr(r->step);
+  post(r);
+}
+
+// ============================================================================
+// Expressions
+// ============================================================================
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Expr> e) {
+  if (e == nullptr || !pre(e))
+    return;
+  switch (e->type) {
+  case Expr::UNARY:
+    expr(static_cast<Ptr<UnaryOp>>(e)->operand);
+    break;
+  case Expr::BINARY:
+    expr(static_cast<Ptr<BinaryOp>>(e)->left);
+    expr(static_cast<Ptr<BinaryOp>>(e)->right);
+    break;
+  case Expr::NARY:
+    exprs(static_cast<Ptr<NaryOp>>(e)->operands);
+    break;
+  case Expr::ELEM:
+    walk(static_cast<Ptr<OperElem>>(e)->elem);
+    break;
+  case Expr::LITERAL:
+    walk(static_cast<Ptr<OperLiteral>>(e)->literal);
+    break;
+  case Expr::VALOF:
+    walk(static_cast<Ptr<OperValof>>(e)->valof->cmd);
+    expr(static_cast<Ptr<OperValof>>(e)->valof->expr);
+    break;
+  case Expr::EXPR:
+    expr(static_cast<Ptr<OperExpr>>(e)->expr);
+    break;
+  }
+  post(e);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Literal> l) {
+  if (l == nullptr || !pre(l))
+    return;
+  post(l);
+}
+
+template<bool Const>
+void Visitor<Const>::walk(Ptr<Elem> e) {
+  if (e == nullptr || !pre(e))
+    return;
+  exprs(e->subscripts);
+  if (e->type == Elem::FIELD) {
+    walk(static_cast<Ptr<Field>>(e)->base);
+    walk(static_cast<Ptr<Field>>(e)->field);
+  }
+  else if (e->type == Elem::CALL) {
+    walk(static_cast<Ptr<FuncCall>>(e)->name);
+    exprs(static_cast<Ptr<FuncCall>>(e)->actuals);
+  }
+  post(e);
+}
+
+template class Visitor<false>;
+template class Visitor<true>;
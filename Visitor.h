@@ -0,0 +1,90 @@
+#ifndef VISITOR_H
+#define VISITOR_H
+
+#include "Tree.h"
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <type_traits>
+
+// A traversal of every node of a tree, so that a pass need only override
+// the hooks for the kinds of node it is interested in. The pre hook of a
+// node is called before its children are walked, which are skipped when it
+// returns false, and the post hook after them. Children are walked in the
+// order of their fields in Tree.h. A Visitor<true> sees a tree it can't
+// change; a Visitor<false> can change the fields of a node in its pre hook
+// and the walk follows the new ones, replace the expression a field holds
+// before it is walked, or free the node in its post hook.
+template<bool Const>
+class Visitor {
+public:
+  template<typename T>
+  using Ptr = typename std::conditional<Const, const T, T>::type *;
+
+  virtual ~Visitor() {}
+  void walk(Ptr<Tree>);
+  void walk(Ptr<Spec>);
+  void walk(Ptr<Cmd>);
+  void walk(Ptr<Expr>);
+  void walk(Ptr<Elem>);
+
+  // Walk each top-level item of a tree on the threads of the pool, with a
+  // visitor made for it by a factory given its index, which is freed once
+  // the item is walked. The items of a tree are its specifications followed
+  // by its commands. A pass run this way must keep the state of each item
+  // in its own visitor.
+  static void parallel(Ptr<Tree>,
+      const std::function<std::unique_ptr<Visitor>(size_t)> &);
+
+protected:
+  virtual bool pre(Ptr<Spec>)    { return true; }
+  virtual bool pre(Ptr<Spef>)    { return true; }
+  virtual bool pre(Ptr<Fml>)     { return true; }
+  virtual bool pre(Ptr<Process>) { return true; }
+  virtual bool pre(Ptr<Server>)  { return true; }
+  virtual bool pre(Ptr<Cmd>)     { return true; }
+  virtual bool pre(Ptr<Altn>)    { return true; }
+  virtual bool pre(Ptr<Choice>)  { return true; }
+  virtual bool pre(Ptr<Select>)  { return true; }
+  virtual bool pre(Ptr<Range>)   { return true; }
+  virtual bool pre(Ptr<Expr>)    { return true; }
+  virtual bool pre(Ptr<Literal>) { return true; }
+  virtual bool pre(Ptr<Elem>)    { return true; }
+  virtual void post(Ptr<Spec>)    {}
+  virtual void post(Ptr<Spef>)    {}
+  virtual void post(Ptr<Fml>)     {}
+  virtual void post(Ptr<Process>) {}
+  virtual void post(Ptr<Server>)  {}
+  virtual void post(Ptr<Cmd>)     {}
+  virtual void post(Ptr<Altn>)    {}
+  virtual void post(Ptr<Choice>)  {}
+  virtual void post(Ptr<Select>)  {}
+  virtual void post(Ptr<Range>)   {}
+  virtual void post(Ptr<Expr>)    {}
+  virtual void post(Ptr<Literal>) {}
+  virtual void post(Ptr<Elem>)    {}
+
+  // The expression to walk in place of the one a field holds, which the
+  // field of a Visitor<false> is set to
+  virtual Ptr<Expr> replace(Ptr<Expr> e) { return e; }
+
+private:
+  template<typename T>
+  void walk(std::list<T*> *);
+  template<typename T>
+  void expr(T *const &);
+  template<typename T>
+  void exprs(std::list<T*> *);
+  void walk(Ptr<Spef>);
+  void walk(Ptr<Fml>);
+  void walk(Ptr<Process>);
+  void walk(Ptr<Server>);
+  void walk(Ptr<Altn>);
+  void walk(Ptr<Choice>);
+  void walk(Ptr<Select>);
+  void walk(Ptr<Range>);
+  void walk(Ptr<Literal>);
+};
+
+#endif
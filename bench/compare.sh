@@ -0,0 +1,49 @@
+#!/bin/bash
+#
+# Compare two sets of benchmark results and report the regressions.
+#
+# Usage: bench/compare.sh <baseline> <results> [threshold]
+#
+# A result regresses when it takes longer than the baseline by more than
+# the threshold, as a percentage (default 20). Results that take less
+# than MIN_SECONDS (default 0.001) in both are too short to compare and
+# are skipped. The status is 1 when there is a regression.
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <baseline> <results> [threshold]" >&2
+  exit 2
+fi
+
+awk -v threshold="${3:-20}" -v min="${MIN_SECONDS:-0.001}" '
+  function field(line, key,   s) {
+    if (!match(line, "\"" key "\": *\"?[^,\"}]*"))
+      return ""
+    s = substr(line, RSTART, RLENGTH)
+    sub("\"" key "\": *\"?", "", s)
+    return s
+  }
+  $0 !~ /"name"/ { next }
+  FNR == NR { base[field($0, "name")] = field($0, "seconds"); next }
+  {
+    name = field($0, "name")
+    if (!(name in base))
+      next
+    old = base[name]; new = field($0, "seconds")
+    if (old < min && new < min)
+      next
+    change = old > 0 ? (new - old) / old * 100 : 0
+    status = "ok"
+    if (change > threshold) {
+      status = "REGRESSION"
+      regressions++
+    }
+    else if (change < -threshold)
+      status = "improved"
+    printf "%-12s %+7.1f%%  %.6f -> %.6f  %s\n", status, change, old, new, name
+  }
+  END {
+    printf "%d regression%s beyond %s%%\n", regressions,
+        regressions == 1 ? "" : "s", threshold
+    exit regressions > 0
+  }
+' "$1" "$2"
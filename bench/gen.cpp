@@ -0,0 +1,236 @@
+// Generate a synthetic Sire program of a given size and shape, for testing
+// how the compiler scales. Every program is valid in the syntax that the
+// parser accepts, and the same seed always gives the same program.
+//
+// Shapes:
+//   deep   commands nested inside one another, in nests of bounded depth
+//   wide   a parallel of many process instances
+//   specs  a long chain of specifications, each depending on the last
+//   expr   assignments of large expressions
+//   mixed  many definitions with a mix of all of these
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+// The maximum depth of nesting in the mixed shape
+#define MIXED_DEPTH 6
+
+// The number of lines in each definition of the mixed shape
+#define MIXED_LINES 40
+
+// The greatest indentation, so deep nesting stays linear in size
+#define MAX_INDENT 32
+
+// The greatest depth of each nest of the deep shape, within the compiler's
+// default limit on nesting
+#define DEEP_DEPTH 500
+
+class Gen {
+public:
+  Gen(unsigned long seed) : state(seed ? seed : 1), lines(0) {}
+  void deep(int);
+  void wide(int);
+  void specs(int);
+  void expr(int);
+  void mixed(int);
+
+private:
+  unsigned long state;
+  int lines;
+
+  int random(int);
+  void line(int, const std::string &);
+  std::string expression(int, int);
+  std::string condition();
+  void command(int, int &, int);
+};
+
+// A pseudo-random number below n, with xorshift
+int Gen::random(int n) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return (int) (state % (unsigned long) n);
+}
+
+void Gen::line(int indent, const std::string &s) {
+  if (indent > MAX_INDENT)
+    indent = MAX_INDENT;
+  printf("%*s%s\n", indent * 2, "", s.c_str());
+  lines++;
+}
+
+// An expression over x, y and the array a, of the given depth. Operators
+// are always parenthesised, since they have no precedence.
+std::string Gen::expression(int depth, int vars) {
+  static const char *ops[] = { "+", "-", "*", "^", "<<", ">>" };
+  if (depth == 0) {
+    switch (random(4)) {
+    case 0:  return std::to_string(random(100));
+    case 1:  return "x";
+    case 2:  return "y";
+    default: return "a[" + std::to_string(random(vars)) + "]";
+    }
+  }
+  std::string l = expression(depth - 1, vars);
+  std::string r = expression(depth - 1, vars);
+  return "(" + l + " " + ops[random(6)] + " " + r + ")";
+}
+
+std::string Gen::condition() {
+  static const char *ops[] = { "<", ">", "=", "~=", "<=", ">=" };
+  return "x " + std::string(ops[random(6)]) + " " +
+      std::to_string(random(100));
+}
+
+// Commands nested up to the given depth, until there are n more lines
+void Gen::command(int indent, int &n, int depth) {
+  int choice = depth == 0 ? 0 : random(6);
+  n--;
+  switch (choice) {
+  default:
+    line(indent, "x := " + expression(random(3), 16));
+    break;
+  case 1:
+    line(indent, "c ? y");
+    break;
+  case 2:
+    line(indent, "if " + condition() + " then");
+    command(indent + 1, n, depth - 1);
+    line(indent, "else");
+    command(indent + 1, n, depth - 1);
+    break;
+  case 3:
+    line(indent, "seq [i=0 for 16]");
+    command(indent + 1, n, depth - 1);
+    break;
+  case 4:
+    line(indent, "while " + condition() + " do");
+    command(indent + 1, n, depth - 1);
+    break;
+  case 5: {
+      line(indent, "{ x := x + 1;");
+      int k = 1 + random(4);
+      for (int i = 0; i < k && n > 0; i++) {
+        command(indent + 1, n, depth - 1);
+        line(indent + 1, ";");
+      }
+      line(indent + 1, "c ! x");
+      line(indent, "}");
+      break;
+    }
+  }
+}
+
+// A sequence of nests of conditionals, n in all, each at most DEEP_DEPTH
+// deep
+void Gen::deep(int n) {
+  line(0, "process deep(chan c) is");
+  line(1, "var x:");
+  for (int lo = 0; lo < n; lo += DEEP_DEPTH) {
+    int hi = lo + DEEP_DEPTH < n ? lo + DEEP_DEPTH : n;
+    for (int i = lo; i < hi; i++)
+      line(i - lo + 1, std::string(i > lo ? "" : lo == 0 ? "{ " : "; ") +
+          "if x > " + std::to_string(i) + " then");
+    line(hi - lo + 1, "x := 0");
+    for (int i = hi - 1; i >= lo; i--)
+      line(i - lo + 1, "else c ! " + std::to_string(i));
+  }
+  line(1, "}:");
+  line(0, "skip");
+}
+
+// A parallel of n instances
+void Gen::wide(int n) {
+  line(0, "process node(val var i, chan c) is { c ! i }:");
+  line(0, "process wide(chan c) is");
+  for (int i = 0; i < n; i++)
+    line(1, std::string(i == 0 ? "{ " : "& ") + "node(" +
+        std::to_string(i) + ", c)");
+  line(1, "}:");
+  line(0, "skip");
+}
+
+// A chain of n value abbreviations, used by a process
+void Gen::specs(int n) {
+  line(0, "val k0 is 1:");
+  for (int i = 1; i < n; i++)
+    line(0, "val k" + std::to_string(i) + " is (k" + std::to_string(i-1) +
+        " + " + std::to_string(random(8)) + ") ^ 255:");
+  line(0, "process specs(chan c) is { c ! k" + std::to_string(n-1) + " }:");
+  line(0, "skip");
+}
+
+// Assignments of expressions, each a balanced tree, with about n operators
+// in total, and of a chain of n additions
+void Gen::expr(int n) {
+  int depth = 1;
+  while ((1 << depth) < n && depth < 16)
+    depth++;
+  int count = n >> depth > 0 ? n >> depth : 1;
+  line(0, "process expr(chan c, var[16] a) is");
+  line(1, "var x, y:");
+  line(1, "{ x := 0; y := 1;");
+  for (int i = 0; i < count; i++) {
+    std::string e = expression(depth, 16);
+    line(2, "x := " + e + ";");
+  }
+  std::string chain = "y := x";
+  for (int i = 0; i < n; i++) {
+    chain += " + " + expression(0, 16);
+    if (i % 16 == 15) {
+      line(2, chain);
+      chain.clear();
+    }
+  }
+  line(2, chain + ";");
+  line(2, "c ! x + y");
+  line(1, "}:");
+  line(0, "skip");
+}
+
+// Definitions of about MIXED_LINES lines each, until there are n lines
+void Gen::mixed(int n) {
+  int i = 0;
+  while (lines < n) {
+    std::string name = "p" + std::to_string(i++);
+    line(0, "process " + name + "(chan c, var[16] a) is");
+    line(1, "var x, y:");
+    line(1, "{ x := 0; y := 0;");
+    int k = MIXED_LINES;
+    while (k > 0) {
+      command(2, k, MIXED_DEPTH);
+      line(2, ";");
+    }
+    line(2, "c ! x");
+    line(1, "}:");
+  }
+  line(0, "skip");
+}
+
+static void usage() {
+  fprintf(stderr, "Usage: gen <deep|wide|specs|expr|mixed> <size> [seed]\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3)
+    usage();
+  char *end;
+  int size = (int) strtol(argv[2], &end, 0);
+  if (*end != '\0' || size < 1)
+    usage();
+  unsigned long seed = argc > 3 ? strtoul(argv[3], &end, 0) : 1;
+  Gen gen(seed);
+  if      (!strcmp(argv[1], "deep"))  gen.deep(size);
+  else if (!strcmp(argv[1], "wide"))  gen.wide(size);
+  else if (!strcmp(argv[1], "specs")) gen.specs(size);
+  else if (!strcmp(argv[1], "expr"))  gen.expr(size);
+  else if (!strcmp(argv[1], "mixed")) gen.mixed(size);
+  else
+    usage();
+  return 0;
+}
@@ -0,0 +1,128 @@
+#!/bin/bash
+#
+# Benchmark the compiler and write the results as JSON, one result per line.
+#
+# Usage: bench/run.sh [output]
+#
+# Each measurement is the least of REPS runs (default 5) of the time that
+# sire -time reports for a phase, so start-up and output are not counted.
+#
+#  - frontend: lexing throughput of every program, and lexing and parsing
+#    throughput of the benchmark programs, alone and as COPIES copies
+#    concatenated (default 64)
+#  - shapes: parsing, transforming, lowering and optimising generated
+#    programs of each shape in SHAPES (default all of them) with each number
+#    of lines in SIZES (default "1000 10000 100000")
+#  - scaling: compiling the replicated benchmark for each number of cores
+#    in CORES (default "1 4 16 64 256")
+#  - micro: lowering and optimising the channel and server benchmarks
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SIRE=$ROOT/sire
+GEN=$ROOT/bench/gen
+OUT=${1:-$ROOT/bench/results.json}
+REPS=${REPS:-5}
+COPIES=${COPIES:-64}
+SHAPES=${SHAPES:-deep wide specs expr mixed}
+SIZES=${SIZES:-1000 10000 100000}
+CORES=${CORES:-1 4 16 64 256}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+first=1
+
+# The least time of a phase over REPS runs of sire with the given arguments,
+# or nothing when the phase is not reached
+measure() {
+  local phase=$1
+  shift
+  for i in $(seq "$REPS"); do
+    "$SIRE" -time "$@" 2>&1 >/dev/null | awk -v p="$phase" \
+        '$1 == "time" && $2 == p { printf "%.6f\n", $3 }'
+  done | sort -g | head -n 1
+}
+
+# Record a result, with its throughput when the input size is given
+result() {
+  local name=$1 seconds=$2 bytes=$3
+  if [ -z "$seconds" ]; then
+    echo "Skipped $name" >&2
+    return
+  fi
+  [ $first -eq 1 ] || printf ',\n' >> "$OUT"
+  first=0
+  if [ -n "$bytes" ]; then
+    printf '  {"name": "%s", "seconds": %s, "bytes": %s, "mbps": %s}' \
+        "$name" "$seconds" "$bytes" \
+        "$(awk -v b="$bytes" -v s="$seconds" \
+            'BEGIN { printf "%.3f", (s > 0 ? b / s / 1e6 : 0) }')" >> "$OUT"
+  else
+    printf '  {"name": "%s", "seconds": %s}' "$name" "$seconds" >> "$OUT"
+  fi
+}
+
+# Concatenate copies of a program's definitions, followed by its command
+replicate() {
+  local file=$1
+  for i in $(seq "$COPIES"); do
+    sed '$d' "$file"
+  done
+  tail -n 1 "$file"
+}
+
+[ -x "$SIRE" ] || { echo "$SIRE not built" >&2; exit 1; }
+[ -x "$GEN" ] || { echo "$GEN not built" >&2; exit 1; }
+printf '{"reps": %d, "copies": %d, "results": [\n' "$REPS" "$COPIES" > "$OUT"
+
+# Front-end throughput
+for f in "$ROOT"/programs/*.sire "$ROOT"/bench/*.sire; do
+  name=${f#$ROOT/}
+  result "lex/$name" "$(measure lex -l "$f")" "$(wc -c < "$f")"
+done
+for f in "$ROOT"/bench/*.sire; do
+  name=${f#$ROOT/}
+  copy=$TMP/$(basename "$f")
+  replicate "$f" > "$copy"
+  result "lex/$name*$COPIES" "$(measure lex -l "$copy")" "$(wc -c < "$copy")"
+  result "parse/$name" "$(measure parse -t cores=16 -p "$f")" \
+      "$(wc -c < "$f")"
+  result "parse/$name*$COPIES" "$(measure parse -t cores=16 -p "$copy")" \
+      "$(wc -c < "$copy")"
+done
+
+# Front-end throughput on large generated programs
+for s in $SHAPES; do
+  for n in $SIZES; do
+    f=$TMP/$s-$n.sire
+    "$GEN" "$s" "$n" > "$f"
+    for p in parse transform; do
+      result "shapes/$s/$n/$p" "$(measure $p -p "$f")" \
+          "$(wc -c < "$f")"
+    done
+    for p in lower optimise; do
+      result "shapes/$s/$n/$p" "$(measure $p -ir "$f")" \
+          "$(wc -c < "$f")"
+    done
+    rm -f "$f"
+  done
+done
+
+# Compile time as the number of cores grows
+for n in $CORES; do
+  for p in transform lower optimise; do
+    result "scaling/grid.sire/cores=$n/$p" \
+        "$(measure $p -t cores="$n" -ir "$ROOT/bench/grid.sire")"
+  done
+done
+
+# Channel and server micro-benchmarks
+for b in channel server; do
+  for p in lower optimise; do
+    result "micro/$b/$p" "$(measure $p -ir "$ROOT/bench/$b.sire")"
+  done
+done
+
+printf '\n]}\n' >> "$OUT"
+echo "Wrote $OUT"
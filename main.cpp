@@ -1,16 +1,48 @@
 #include "Error.h"
+#include "Dump.h"
 #include "Table.h"
 #include "Lex.h"
 #include "Syn.h"
+#include "Agg.h"
+#include "Own.h"
+#include "Fold.h"
+#include "Target.h"
+#include "Unroll.h"
+#include "Layout.h"
+#include "Bounds.h"
+#include "Flatten.h"
+#include "Devirt.h"
+#include "Specialise.h"
+#include "Inline.h"
+#include "Tail.h"
+#include "Resolve.h"
+#include "Usage.h"
+#include "Lower.h"
+#include "Opt.h"
+#include "Pool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 
+#include <chrono>
 #include <string>
 #include <string.h>
 #include <unistd.h>
 
+// Report the time taken by each phase on stderr, for benchmarking
+static bool optTime = false;
+static std::chrono::steady_clock::time_point phaseStart;
+
+static void phase(const char *name) {
+  if (!optTime)
+    return;
+  auto now = std::chrono::steady_clock::now();
+  fprintf(stderr, "time %s %.6f\n", name,
+      std::chrono::duration<double>(now - phaseStart).count());
+  phaseStart = now;
+}
+
 void interpreter() {
 // Read-eval-pint loop
 //  fprintf(stderr, "> ");
@@ -35,12 +67,28 @@ void printHelp() {
   printf("  -h display usage and options\n");
   printf("  -l print tokenisation only\n");
   printf("  -p print the parse tree\n");
+  printf("  -stream print each item of the parse tree as it is read, untransformed\n");
+  printf("  -format <format> print tokens and trees as text, json or binary\n");
+  printf("  -D<name>=<value> define a constant value\n");
+  printf("  -unchecked omit array bounds checks\n");
+  printf("  -memo memoise recursive functions\n");
+  printf("  -intern share the nodes of identical expressions\n");
+  printf("  -t <target> set the target, e.g. cores=64,topology=mesh\n");
+  printf("  -ir print the intermediate representation\n");
+  printf("  -passes <list> set the optimisation passes, e.g. const,cse,dce\n");
+  printf("  -lanes <n> set the number of vector lanes, or 1 not to vectorise\n");
+  printf("  -time report the time taken by each phase\n");
+  printf("  -nesting <n> set the greatest depth of nesting, at most %d\n",
+      MAX_SAFE_NESTING);
+  printf("  -threads <n> set the number of threads that passes run on\n");
 }
 
 int main(int argc, char *argv[]) {
   bool optPrintHelp = false;
   bool optPrintTree = false;
+  bool optStreamTree = false;
   bool optPrintTokens = false;
+  bool optPrintIR = false;
   std::string filename;
   FILE *fp;
 
@@ -50,6 +98,67 @@ int main(int argc, char *argv[]) {
       if     (!strcmp(argv[i], "-h")) optPrintHelp = true;
       else if(!strcmp(argv[i], "-l")) optPrintTokens = true;
       else if(!strcmp(argv[i], "-p")) optPrintTree = true;
+      else if(!strcmp(argv[i], "-stream")) optStreamTree = true;
+      else if(!strcmp(argv[i], "-unchecked")) BND.disable();
+      else if(!strcmp(argv[i], "-memo")) INL.enableMemo();
+      else if(!strcmp(argv[i], "-intern")) SYN.enableInterning();
+      else if(!strcmp(argv[i], "-ir")) optPrintIR = true;
+      else if(!strcmp(argv[i], "-time")) optTime = true;
+      else if(!strncmp(argv[i], "-D", 2) && strchr(argv[i], '=')) {
+        const char *eq = strchr(argv[i], '=');
+        char *end;
+        int value = (int) strtol(eq+1, &end, 0);
+        if (eq == argv[i]+2 || *(eq+1) == '\0' || *end != '\0') {
+          fprintf(stderr, "Invalid argument.\n");
+          return 0;
+        }
+        FOLD.define(std::string(argv[i]+2, eq-(argv[i]+2)), value);
+      }
+      else if(!strcmp(argv[i], "-t") && i+1 < argc) {
+        if (!TGT.configure(argv[++i])) {
+          fprintf(stderr, "Invalid target: %s.\n", TGT.error().c_str());
+          return 1;
+        }
+      }
+      else if(!strcmp(argv[i], "-format") && i+1 < argc) {
+        if (!DUMP.configure(argv[++i])) {
+          fprintf(stderr, "Invalid format: %s.\n", argv[i]);
+          return 1;
+        }
+      }
+      else if(!strcmp(argv[i], "-passes") && i+1 < argc) {
+        if (!OPT.configure(argv[++i])) {
+          fprintf(stderr, "Invalid passes: %s.\n", OPT.error().c_str());
+          return 1;
+        }
+      }
+      else if(!strcmp(argv[i], "-lanes") && i+1 < argc) {
+        char *end;
+        int n = (int) strtol(argv[++i], &end, 0);
+        if (*argv[i] == '\0' || *end != '\0' || n < 1) {
+          fprintf(stderr, "Invalid number of lanes: %s.\n", argv[i]);
+          return 1;
+        }
+        OPT.setLanes(n);
+      }
+      else if(!strcmp(argv[i], "-nesting") && i+1 < argc) {
+        char *end;
+        int n = (int) strtol(argv[++i], &end, 0);
+        if (*argv[i] == '\0' || *end != '\0' || n < 1) {
+          fprintf(stderr, "Invalid nesting: %s.\n", argv[i]);
+          return 1;
+        }
+        SYN.setMaxNesting(n);
+      }
+      else if(!strcmp(argv[i], "-threads") && i+1 < argc) {
+        char *end;
+        int n = (int) strtol(argv[++i], &end, 0);
+        if (*argv[i] == '\0' || *end != '\0' || n < 1) {
+          fprintf(stderr, "Invalid number of threads: %s.\n", argv[i]);
+          return 1;
+        }
+        POOL.setThreads(n);
+      }
       else {
         fprintf(stderr, "Invalid argument.\n");
         return 0;
@@ -60,6 +169,9 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  // Only the last target description given defines its constants
+  TGT.define();
+
   // Print help
   if(optPrintHelp) {
     printHelp();
@@ -72,6 +184,7 @@ int main(int argc, char *argv[]) {
     if(fp == NULL)
       throw FatalError("Could not open the input file");
 
+    phaseStart = std::chrono::steady_clock::now();
     TAB.init();
     LEX.init(fp);
     SYN.init();
@@ -87,13 +200,52 @@ int main(int argc, char *argv[]) {
       Lex::Token t;
       while ((t = LEX.readToken()) != Lex::tEOF)
         LEX.printToken(t);
+      DUMP.finish();
+      phase("lex");
+    }
+    // Print each item of the parse tree and free it
+    else if (optStreamTree) {
+      Tree printer;
+      SYN.streamTree([&printer](Spec *s) { printer.print(s); },
+                     [&printer](Cmd *c) { printer.print(c); });
+      DUMP.finish();
+      fclose(fp);
+      phase("parse");
     }
     else {
       Tree *tree = SYN.formTree();
       fclose(fp);
       if (ERR.any())
         throw FatalError();
-      tree->print();
+      phase("parse");
+      FOLD.fold(tree);
+      FLAT.flatten(tree);
+      DEV.devirtualise(tree);
+      INL.memoise(tree);
+      SPC.specialise(tree);
+      FOLD.fold(tree);
+      LAY.layout(tree);
+      UNR.unroll(tree);
+      FOLD.fold(tree);
+      TAIL.mark(tree);
+      AGG.aggregate(tree);
+      OWN.transfer(tree);
+      BND.analyse(tree);
+      RES.resolve(tree);
+      USE.check(tree);
+      phase("transform");
+      if (optPrintIR) {
+        Module *module = LOWER.lower(tree);
+        phase("lower");
+        OPT.optimise(module);
+        phase("optimise");
+        module->print();
+      }
+      else {
+        tree->print();
+        DUMP.finish();
+      }
+      phase("print");
       //TRN.translateTree();
     }
   }